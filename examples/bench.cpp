@@ -0,0 +1,907 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/Array.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/Conversions.h>
+#include <js/experimental/JSStencil.h>
+#include <js/experimental/TypedData.h>
+#include <js/JSON.h>
+#include <js/Modules.h>
+#include <js/Object.h>
+#include <js/Promise.h>
+#include <js/SourceText.h>
+#include <js/String.h>
+
+#include <mozilla/RefPtr.h>
+
+#include "boilerplate.h"
+
+namespace zlib {
+#include <zlib.h>
+}
+
+// This program is a benchmark suite for the paths an embedding takes most
+// often, to tell whether a SpiderMonkey update or a change to the embedding
+// made them slower. The "micro" suite times single operations:
+//
+// - creating a context on a new thread, and a global;
+// - JS::Evaluate of a small and a large source;
+// - JS::Call from C++ into JS, and calls from JS into native functions (a
+//   'print' like the one in 'repl.cpp', and 'update' on a CRC object like the
+//   one in 'resolve.cpp');
+// - getting and setting a property through the JSAPI;
+// - throwing and catching an exception, in JS and across JS::Call;
+// - instantiating, linking and evaluating a module that imports another.
+//
+// The "macro" suite times whole requests: rendering a page in a fresh global,
+// a JSON round trip, and a CPU-bound script.
+//
+// Every benchmark is first calibrated: the number of iterations per sample is
+// doubled until a sample takes at least 10 ms. Then it takes a few unmeasured
+// samples to warm up, and SAMPLES measured ones, each after a full GC so that
+// all of them start from the same heap. It prints the median time per
+// operation, and with --json writes every sample to FILE:
+//
+//   {"spidermonkey": "JavaScript-C115.0",
+//    "benchmarks": [{"name": "evaluate.small", "suite": "micro",
+//                    "iterations": 65536, "median_ns": ..., "mean_ns": ...,
+//                    "stddev_ns": ..., "min_ns": ..., "samples_ns": [...]},
+//                   ...]}
+//
+// With --compare, the benchmarks are run with the iteration counts from a file
+// written earlier, and their samples are compared with that file's using a
+// Mann-Whitney U test. A benchmark has regressed if its median is more than 5%
+// slower and the test says, at the 1% level, that this is not noise. The
+// program then fails, which makes 'meson test --benchmark' fail too. See "To
+// benchmark" in README.md.
+//
+// NAME arguments run only the benchmarks whose names start with them.
+//
+// NOTE: Compare results from the same machine and the same build type only.
+// For numbers that repeat well, use a release build of SpiderMonkey and of the
+// examples, and keep the machine otherwise idle.
+//
+// Usage: bench [--suite SUITE] [--samples N] [--json FILE]
+//              [--compare BASELINE] [NAME...]
+
+using Clock = std::chrono::steady_clock;
+
+static const char* suite = nullptr;
+static unsigned sampleCount = 20;
+static const char* jsonPath = nullptr;
+static const char* baselinePath = nullptr;
+static std::vector<std::string> filters;
+
+static const double TargetSampleNs = 10e6;
+static const unsigned WarmupSamples = 3;
+
+// Thresholds for the comparison: a one-sided z of 2.33 is a p-value of 0.01.
+static const double SignificantZ = 2.33;
+static const double MinChange = 0.05;
+
+/**** Natives used by the benchmarks ****/
+
+// Like the 'print' function in 'repl.cpp', but writes to a buffer, so that the
+// benchmark measures the call and the string conversion rather than stdout.
+static std::string printed;
+
+static bool Print(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  JS::RootedString str(cx, JS::ToString(cx, args.get(0)));
+  if (!str) return false;
+
+  JS::UniqueChars chars = JS_EncodeStringToUTF8(cx, str);
+  if (!chars) return false;
+
+  printed.assign(chars.get());
+  printed.push_back('\n');
+
+  args.rval().setUndefined();
+  return true;
+}
+
+// A CRC-32 object with an 'update' method, as in 'resolve.cpp', defined eagerly
+// instead of through a resolve hook.
+enum CrcSlots { CrcSlot, CrcSlotCount };
+
+static void FinalizeCrc(JS::GCContext* gcx, JSObject* obj) {
+  delete JS::GetMaybePtrFromReservedSlot<unsigned long>(obj, CrcSlot);
+}
+
+static const JSClassOps crcClassOps = {
+    nullptr,  // addProperty
+    nullptr,  // deleteProperty
+    nullptr,  // enumerate
+    nullptr,  // newEnumerate
+    nullptr,  // resolve
+    nullptr,  // mayResolve
+    FinalizeCrc,
+};
+
+static const JSClass crcClass = {
+    "Crc",
+    JSCLASS_HAS_RESERVED_SLOTS(CrcSlotCount) | JSCLASS_FOREGROUND_FINALIZE,
+    &crcClassOps};
+
+static bool CrcUpdate(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  JS::RootedObject thisObj(cx);
+  if (!args.computeThis(cx, &thisObj)) return false;
+  if (!JS_InstanceOf(cx, thisObj, &crcClass, &args)) return false;
+
+  if (!args.get(0).isObject() || !JS_IsUint8Array(&args[0].toObject())) {
+    JS_ReportErrorASCII(cx, "argument to update() should be a Uint8Array");
+    return false;
+  }
+
+  JSObject* buffer = &args[0].toObject();
+  unsigned long* crc =
+      JS::GetMaybePtrFromReservedSlot<unsigned long>(thisObj, CrcSlot);
+  {
+    bool isSharedMemory;
+    JS::AutoAssertNoGC nogc;
+    uint8_t* data = JS_GetUint8ArrayData(buffer, &isSharedMemory, nogc);
+    *crc = zlib::crc32(*crc, data, unsigned(JS_GetTypedArrayLength(buffer)));
+  }
+
+  args.rval().setUndefined();
+  return true;
+}
+
+static JSObject* NewCrc(JSContext* cx) {
+  JS::RootedObject crc(cx, JS_NewObject(cx, &crcClass));
+  if (!crc) return nullptr;
+
+  JS::SetReservedSlot(
+      crc, CrcSlot,
+      JS::PrivateValue(new unsigned long(zlib::crc32(0L, nullptr, 0))));
+  if (!JS_DefineFunction(cx, crc, "update", CrcUpdate, 1, 0)) return nullptr;
+  return crc;
+}
+
+/**** Fixtures ****/
+
+// Evaluated once in the global that the micro benchmarks share.
+static const char* fixtureScript = R"js(
+  function add(a, b) { return a + b; }
+
+  function callPrint(n) {
+    for (let i = 0; i < n; i++) print(i);
+  }
+
+  const bytes = new Uint8Array(64).fill(7);
+  function callCrc(n) {
+    for (let i = 0; i < n; i++) crc.update(bytes);
+  }
+
+  function fail() { throw new Error('fail'); }
+
+  function throwAndCatch(n) {
+    let caught = 0;
+    for (let i = 0; i < n; i++) {
+      try { throw new Error('fail'); } catch (e) { caught++; }
+    }
+    return caught;
+  }
+
+  var target = {x: 1, y: 2};
+)js";
+
+static const char* pageScript = R"js(
+  const rows = Array.from({length: 500}, (_, i) => ({
+    id: i, name: 'user' + i, score: (i * 37) % 101,
+  }));
+  const body = rows.filter(r => r.score > 10).map(r =>
+      `<tr><td>${r.id}</td><td>${r.name}</td><td>${r.score}</td></tr>`);
+  '<table>' + body.join('') + '</table>';
+)js";
+
+static const char* jsonScript = R"js(
+  function roundTrip() {
+    const items = Array.from({length: 2000}, (_, i) => ({
+      id: i, name: 'item' + i, tags: ['a', 'b', String(i % 10)],
+      price: i * 0.25, nested: {ok: i % 2 === 0},
+    }));
+    return JSON.parse(JSON.stringify(items)).length;
+  }
+)js";
+
+static const char* computeScript = R"js(
+  function compute() {
+    const sieve = new Uint8Array(200000);
+    let primes = 0;
+    for (let i = 2; i < sieve.length; i++) {
+      if (sieve[i]) continue;
+      primes++;
+      for (let j = i * 2; j < sieve.length; j += i) sieve[j] = 1;
+    }
+    return primes;
+  }
+)js";
+
+// About 100 KB of function declarations.
+static std::string MakeLargeSource() {
+  std::string source;
+  for (int i = 0; i < 2000; i++) {
+    source += "function f" + std::to_string(i) + "(a, b) {\n  return a * " +
+              std::to_string(i) + " + b.length;\n}\n";
+  }
+  return source;
+}
+
+static const std::string largeSource = MakeLargeSource();
+
+static bool Evaluate(JSContext* cx, const char* filename, const char* code,
+                     size_t length, JS::MutableHandleValue rval) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::SourceText<mozilla::Utf8Unit> source;
+  if (!source.init(cx, code, length, JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  return JS::Evaluate(cx, options, source, rval);
+}
+
+static bool Evaluate(JSContext* cx, const char* filename, const char* code) {
+  JS::RootedValue rval(cx);
+  return Evaluate(cx, filename, code, strlen(code), &rval);
+}
+
+// Call global.name(n), for the benchmarks that loop in JS.
+static bool CallWithCount(JSContext* cx, JS::HandleObject global,
+                          const char* name, uint64_t n) {
+  JS::RootedValueArray<1> args(cx);
+  args[0].setNumber(double(n));
+  JS::RootedValue rval(cx);
+  return JS_CallFunctionName(cx, global, name, args, &rval);
+}
+
+/**** Micro benchmarks ****/
+
+static void CreateContexts(JSRuntime* parentRuntime, uint64_t iterations,
+                           bool* ok) {
+  *ok = true;
+  for (uint64_t i = 0; i < iterations; i++) {
+    JSContext* cx = boilerplate::NewChildContext(parentRuntime);
+    if (!cx) {
+      *ok = false;
+      return;
+    }
+    JS_DestroyContext(cx);
+  }
+}
+
+// A thread can have only one context, so this creates them on a new thread.
+static bool BenchContextCreate(JSContext* cx, JS::HandleObject global,
+                               uint64_t iterations) {
+  bool ok;
+  std::thread thread(CreateContexts, JS_GetRuntime(cx), iterations, &ok);
+  thread.join();
+  if (!ok) JS_ReportErrorASCII(cx, "Cannot create a child context");
+  return ok;
+}
+
+static bool BenchGlobalCreate(JSContext* cx, JS::HandleObject global,
+                              uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!boilerplate::CreateGlobal(cx)) return false;
+  }
+  return true;
+}
+
+static bool BenchEvaluateSmall(JSContext* cx, JS::HandleObject global,
+                               uint64_t iterations) {
+  static const char code[] = "var x = 1 + 2; x;";
+  JS::RootedValue rval(cx);
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!Evaluate(cx, "small.js", code, strlen(code), &rval)) return false;
+  }
+  return true;
+}
+
+static bool BenchEvaluateLarge(JSContext* cx, JS::HandleObject global,
+                               uint64_t iterations) {
+  JS::RootedValue rval(cx);
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!Evaluate(cx, "large.js", largeSource.data(), largeSource.size(),
+                  &rval)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool BenchCallHostToJS(JSContext* cx, JS::HandleObject global,
+                              uint64_t iterations) {
+  JS::RootedValue add(cx);
+  if (!JS_GetProperty(cx, global, "add", &add)) return false;
+
+  JS::RootedValueArray<2> args(cx);
+  JS::RootedValue rval(cx);
+  for (uint64_t i = 0; i < iterations; i++) {
+    args[0].setInt32(int32_t(i & 0xffff));
+    args[1].setInt32(1);
+    if (!JS::Call(cx, JS::UndefinedHandleValue, add, args, &rval)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool BenchCallPrint(JSContext* cx, JS::HandleObject global,
+                           uint64_t iterations) {
+  return CallWithCount(cx, global, "callPrint", iterations);
+}
+
+static bool BenchCallCrc(JSContext* cx, JS::HandleObject global,
+                         uint64_t iterations) {
+  return CallWithCount(cx, global, "callCrc", iterations);
+}
+
+static bool BenchPropertyGet(JSContext* cx, JS::HandleObject global,
+                             uint64_t iterations) {
+  JS::RootedValue value(cx);
+  if (!JS_GetProperty(cx, global, "target", &value)) return false;
+  JS::RootedObject target(cx, &value.toObject());
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!JS_GetProperty(cx, target, "x", &value)) return false;
+  }
+  return true;
+}
+
+static bool BenchPropertySet(JSContext* cx, JS::HandleObject global,
+                             uint64_t iterations) {
+  JS::RootedValue value(cx);
+  if (!JS_GetProperty(cx, global, "target", &value)) return false;
+  JS::RootedObject target(cx, &value.toObject());
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    value.setInt32(int32_t(i & 0xffff));
+    if (!JS_SetProperty(cx, target, "y", value)) return false;
+  }
+  return true;
+}
+
+static bool BenchExceptionJS(JSContext* cx, JS::HandleObject global,
+                             uint64_t iterations) {
+  return CallWithCount(cx, global, "throwAndCatch", iterations);
+}
+
+static bool BenchExceptionHost(JSContext* cx, JS::HandleObject global,
+                               uint64_t iterations) {
+  JS::RootedValue fail(cx);
+  if (!JS_GetProperty(cx, global, "fail", &fail)) return false;
+
+  JS::RootedValue rval(cx);
+  JS::RootedValue exception(cx);
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (JS::Call(cx, JS::UndefinedHandleValue, fail,
+                 JS::HandleValueArray::empty(), &rval)) {
+      JS_ReportErrorASCII(cx, "fail() did not throw");
+      return false;
+    }
+    if (!JS_GetPendingException(cx, &exception)) return false;
+    JS_ClearPendingException(cx);
+  }
+  return true;
+}
+
+// The module that the benchmarked module imports, compiled and evaluated once.
+// The resolve hook hands it out for every import.
+static JS::RootedObject* dependencyModule;
+
+static JSObject* ResolveDependency(JSContext* cx,
+                                   JS::HandleValue modulePrivate,
+                                   JS::HandleObject moduleRequest) {
+  return dependencyModule->get();
+}
+
+static bool CompileModuleStencil(JSContext* cx, const char* filename,
+                                 const char* code,
+                                 RefPtr<JS::Stencil>* stencil) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::SourceText<mozilla::Utf8Unit> source;
+  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  *stencil = JS::CompileModuleScriptToStencil(cx, options, source);
+  return *stencil;
+}
+
+static bool LinkAndEvaluate(JSContext* cx, JS::HandleObject module) {
+  if (!JS::ModuleLink(cx, module)) return false;
+
+  JS::RootedValue rval(cx);
+  if (!JS::ModuleEvaluate(cx, module, &rval)) return false;
+
+  // The modules have no top-level await, so evaluation has already finished.
+  if (!rval.isObject()) return true;
+  JS::RootedObject promise(cx, &rval.toObject());
+  if (JS::GetPromiseState(promise) == JS::PromiseState::Rejected) {
+    JS::RootedValue reason(cx, JS::GetPromiseResult(promise));
+    JS_SetPendingException(cx, reason);
+    return false;
+  }
+  return true;
+}
+
+static bool InstantiateModule(JSContext* cx, JS::Stencil* stencil,
+                              JS::MutableHandleObject module) {
+  JS::CompileOptions options(cx);
+  JS::InstantiateOptions instantiateOptions(options);
+  module.set(JS::InstantiateModuleStencil(cx, instantiateOptions, stencil));
+  return module;
+}
+
+// Instantiating from a stencil leaves out parsing, which 'evaluate.*' covers.
+static bool BenchModuleLinkEvaluate(JSContext* cx, JS::HandleObject global,
+                                    uint64_t iterations) {
+  RefPtr<JS::Stencil> dependencyStencil, mainStencil;
+  if (!CompileModuleStencil(cx, "dep.mjs",
+                            "export function add(a, b) { return a + b; }",
+                            &dependencyStencil) ||
+      !CompileModuleStencil(cx, "main.mjs",
+                            "import {add} from 'dep.mjs';\n"
+                            "export const sum = add(1, 2);",
+                            &mainStencil)) {
+    return false;
+  }
+
+  JS::RootedObject dependency(cx);
+  if (!InstantiateModule(cx, dependencyStencil, &dependency) ||
+      !LinkAndEvaluate(cx, dependency)) {
+    return false;
+  }
+
+  JSRuntime* rt = JS_GetRuntime(cx);
+  dependencyModule = &dependency;
+  JS::SetModuleResolveHook(rt, ResolveDependency);
+
+  bool ok = true;
+  JS::RootedObject module(cx);
+  for (uint64_t i = 0; ok && i < iterations; i++) {
+    ok = InstantiateModule(cx, mainStencil, &module) &&
+         LinkAndEvaluate(cx, module);
+  }
+
+  JS::SetModuleResolveHook(rt, nullptr);
+  dependencyModule = nullptr;
+  return ok;
+}
+
+/**** Macro benchmarks ****/
+
+static bool BenchRequest(JSContext* cx, JS::HandleObject global,
+                         uint64_t iterations) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    JS::RootedObject requestGlobal(cx, boilerplate::CreateGlobal(cx));
+    if (!requestGlobal) return false;
+
+    JSAutoRealm ar(cx, requestGlobal);
+    if (!Evaluate(cx, "page.js", pageScript)) return false;
+  }
+  return true;
+}
+
+static bool BenchJSON(JSContext* cx, JS::HandleObject global,
+                      uint64_t iterations) {
+  JS::RootedValue rval(cx);
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!JS_CallFunctionName(cx, global, "roundTrip",
+                             JS::HandleValueArray::empty(), &rval)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool BenchCompute(JSContext* cx, JS::HandleObject global,
+                         uint64_t iterations) {
+  JS::RootedValue rval(cx);
+  for (uint64_t i = 0; i < iterations; i++) {
+    if (!JS_CallFunctionName(cx, global, "compute",
+                             JS::HandleValueArray::empty(), &rval)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Benchmark {
+  const char* name;
+  const char* suite;
+  bool (*run)(JSContext* cx, JS::HandleObject global, uint64_t iterations);
+};
+
+static const Benchmark benchmarks[] = {
+    {"context.create", "micro", BenchContextCreate},
+    {"global.create", "micro", BenchGlobalCreate},
+    {"evaluate.small", "micro", BenchEvaluateSmall},
+    {"evaluate.large", "micro", BenchEvaluateLarge},
+    {"call.host-to-js", "micro", BenchCallHostToJS},
+    {"call.js-to-native.print", "micro", BenchCallPrint},
+    {"call.js-to-native.crc", "micro", BenchCallCrc},
+    {"property.get", "micro", BenchPropertyGet},
+    {"property.set", "micro", BenchPropertySet},
+    {"exception.js", "micro", BenchExceptionJS},
+    {"exception.host", "micro", BenchExceptionHost},
+    {"module.link-evaluate", "micro", BenchModuleLinkEvaluate},
+    {"request.page", "macro", BenchRequest},
+    {"request.json", "macro", BenchJSON},
+    {"request.compute", "macro", BenchCompute},
+};
+
+/**** Measuring ****/
+
+struct Result {
+  std::string name;
+  std::string suite;
+  uint64_t iterations = 0;
+  std::vector<double> samplesNs;  // time per operation in each sample
+
+  double median() const {
+    std::vector<double> sorted = samplesNs;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+  }
+  double mean() const {
+    double sum = 0;
+    for (double ns : samplesNs) sum += ns;
+    return sum / samplesNs.size();
+  }
+  double stddev() const {
+    double m = mean(), sum = 0;
+    for (double ns : samplesNs) sum += (ns - m) * (ns - m);
+    return samplesNs.size() > 1 ? sqrt(sum / (samplesNs.size() - 1)) : 0;
+  }
+  double min() const {
+    return *std::min_element(samplesNs.begin(), samplesNs.end());
+  }
+};
+
+// Time one sample of 'iterations' operations, in nanoseconds.
+static bool TimeSample(JSContext* cx, JS::HandleObject global,
+                       const Benchmark& bench, uint64_t iterations,
+                       double* elapsedNs) {
+  JS_GC(cx);
+  Clock::time_point start = Clock::now();
+  if (!bench.run(cx, global, iterations)) return false;
+  *elapsedNs =
+      std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  return true;
+}
+
+// Measure 'bench'. If 'iterations' is 0, calibrate it first.
+static bool Measure(JSContext* cx, JS::HandleObject global,
+                    const Benchmark& bench, uint64_t iterations,
+                    Result* result) {
+  double elapsedNs;
+  if (iterations == 0) {
+    for (iterations = 1;; iterations *= 2) {
+      if (!TimeSample(cx, global, bench, iterations, &elapsedNs)) {
+        return false;
+      }
+      if (elapsedNs >= TargetSampleNs || iterations >= (1u << 30)) break;
+    }
+  }
+
+  for (unsigned i = 0; i < WarmupSamples; i++) {
+    if (!TimeSample(cx, global, bench, iterations, &elapsedNs)) return false;
+  }
+
+  result->name = bench.name;
+  result->suite = bench.suite;
+  result->iterations = iterations;
+  for (unsigned i = 0; i < sampleCount; i++) {
+    if (!TimeSample(cx, global, bench, iterations, &elapsedNs)) return false;
+    result->samplesNs.push_back(elapsedNs / iterations);
+  }
+  return true;
+}
+
+static bool Selected(const Benchmark& bench) {
+  if (suite && strcmp(suite, bench.suite) != 0) return false;
+  if (filters.empty()) return true;
+  for (const std::string& filter : filters) {
+    if (strncmp(bench.name, filter.c_str(), filter.size()) == 0) return true;
+  }
+  return false;
+}
+
+/**** Results files ****/
+
+static bool WriteResults(const char* path, const std::vector<Result>& results) {
+  FILE* out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+
+  fprintf(out, "{\"spidermonkey\": \"%s\",\n \"benchmarks\": [",
+          JS_GetImplementationVersion());
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& result = results[i];
+    fprintf(out,
+            "%s\n  {\"name\": \"%s\", \"suite\": \"%s\", "
+            "\"iterations\": %llu, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+            "\"stddev_ns\": %.3f, \"min_ns\": %.3f, \"samples_ns\": [",
+            i ? "," : "", result.name.c_str(), result.suite.c_str(),
+            static_cast<unsigned long long>(result.iterations),
+            result.median(), result.mean(), result.stddev(), result.min());
+    for (size_t j = 0; j < result.samplesNs.size(); j++) {
+      fprintf(out, "%s%.3f", j ? ", " : "", result.samplesNs[j]);
+    }
+    fputs("]}", out);
+  }
+  fputs("\n]}\n", out);
+
+  if (fclose(out) != 0) {
+    fprintf(stderr, "Cannot write %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+static bool GetNumber(JSContext* cx, JS::HandleObject obj, const char* name,
+                      double* number) {
+  JS::RootedValue value(cx);
+  return JS_GetProperty(cx, obj, name, &value) &&
+         JS::ToNumber(cx, value, number);
+}
+
+static bool GetArray(JSContext* cx, JS::HandleObject obj, const char* name,
+                     JS::MutableHandleObject array, uint32_t* length) {
+  JS::RootedValue value(cx);
+  if (!JS_GetProperty(cx, obj, name, &value)) return false;
+
+  bool isArray;
+  if (!JS::IsArrayObject(cx, value, &isArray)) return false;
+  if (!isArray) {
+    JS_ReportErrorASCII(cx, "'%s' is not an array", name);
+    return false;
+  }
+  array.set(&value.toObject());
+  return JS::GetArrayLength(cx, array, length);
+}
+
+// Read a file written by WriteResults, using SpiderMonkey's JSON parser. Must
+// be called in a realm.
+static bool ReadResults(JSContext* cx, const char* path,
+                        std::map<std::string, Result>* results) {
+  std::ifstream in(path);
+  if (!in) {
+    JS_ReportErrorUTF8(cx, "Cannot read %s", path);
+    return false;
+  }
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  std::string json = contents.str();
+
+  JS::RootedString str(cx, JS_NewStringCopyN(cx, json.data(), json.size()));
+  if (!str) return false;
+  JS::RootedValue root(cx);
+  if (!JS_ParseJSON(cx, str, &root)) return false;
+  if (!root.isObject()) {
+    JS_ReportErrorUTF8(cx, "%s is not a benchmark results file", path);
+    return false;
+  }
+
+  JS::RootedObject rootObj(cx, &root.toObject());
+  JS::RootedObject list(cx);
+  uint32_t count;
+  if (!GetArray(cx, rootObj, "benchmarks", &list, &count)) return false;
+
+  JS::RootedValue value(cx);
+  JS::RootedObject entry(cx);
+  JS::RootedObject samples(cx);
+  for (uint32_t i = 0; i < count; i++) {
+    if (!JS_GetElement(cx, list, i, &value)) return false;
+    if (!value.isObject()) continue;
+    entry = &value.toObject();
+
+    if (!JS_GetProperty(cx, entry, "name", &value)) return false;
+    JS::RootedString name(cx, JS::ToString(cx, value));
+    if (!name) return false;
+    JS::UniqueChars nameChars = JS_EncodeStringToUTF8(cx, name);
+    if (!nameChars) return false;
+
+    Result result;
+    result.name = nameChars.get();
+    double iterations;
+    uint32_t sampleLength;
+    if (!GetNumber(cx, entry, "iterations", &iterations) ||
+        !GetArray(cx, entry, "samples_ns", &samples, &sampleLength)) {
+      return false;
+    }
+    result.iterations = uint64_t(iterations);
+    for (uint32_t j = 0; j < sampleLength; j++) {
+      double ns;
+      if (!JS_GetElement(cx, samples, j, &value) ||
+          !JS::ToNumber(cx, value, &ns)) {
+        return false;
+      }
+      result.samplesNs.push_back(ns);
+    }
+
+    if (!result.samplesNs.empty()) (*results)[result.name] = result;
+  }
+  return true;
+}
+
+/**** Comparing ****/
+
+// The Mann-Whitney U test's z-score for 'current' being slower than
+// 'baseline', using the normal approximation. It only looks at the order of
+// the samples, so a few outliers, which timings always have, do not sway it.
+static double MannWhitneyZ(const std::vector<double>& baseline,
+                           const std::vector<double>& current) {
+  std::vector<std::pair<double, bool>> all;  // (time, is current)
+  for (double ns : baseline) all.push_back({ns, false});
+  for (double ns : current) all.push_back({ns, true});
+  std::sort(all.begin(), all.end());
+
+  // Sum the ranks of the current samples, giving tied samples the average of
+  // their ranks.
+  double rankSum = 0;
+  for (size_t i = 0; i < all.size();) {
+    size_t j = i;
+    while (j < all.size() && all[j].first == all[i].first) j++;
+    double rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++) {
+      if (all[k].second) rankSum += rank;
+    }
+    i = j;
+  }
+
+  double n1 = current.size(), n2 = baseline.size();
+  double u = rankSum - n1 * (n1 + 1) / 2;
+  double sd = sqrt(n1 * n2 * (n1 + n2 + 1) / 12);
+  return sd > 0 ? (u - n1 * n2 / 2) / sd : 0;
+}
+
+// Print how each result compares with the baseline. Returns the number of
+// significant regressions.
+static unsigned Compare(const std::map<std::string, Result>& baseline,
+                        const std::vector<Result>& results) {
+  printf("\n%-26s %12s %12s %8s %7s\n", "compared with baseline", "before ns",
+         "after ns", "change", "z");
+
+  unsigned regressions = 0;
+  for (const Result& result : results) {
+    auto found = baseline.find(result.name);
+    if (found == baseline.end()) {
+      printf("%-26s %12s %12.1f   (new)\n", result.name.c_str(), "",
+             result.median());
+      continue;
+    }
+
+    const Result& before = found->second;
+    double change = result.median() / before.median() - 1;
+    double z = MannWhitneyZ(before.samplesNs, result.samplesNs);
+
+    const char* verdict = "";
+    if (z > SignificantZ && change > MinChange) {
+      verdict = "REGRESSION";
+      regressions++;
+    } else if (z < -SignificantZ && change < -MinChange) {
+      verdict = "faster";
+    }
+    printf("%-26s %12.1f %12.1f %+7.1f%% %7.2f %s\n", result.name.c_str(),
+           before.median(), result.median(), change * 100, z, verdict);
+  }
+  return regressions;
+}
+
+static bool BenchExample(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  std::map<std::string, Result> baseline;
+  if (baselinePath && !ReadResults(cx, baselinePath, &baseline)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+
+  JS::RootedObject crc(cx, NewCrc(cx));
+  if (!crc || !JS_DefineProperty(cx, global, "crc", crc, 0) ||
+      !JS_DefineFunction(cx, global, "print", &Print, 1, 0) ||
+      !Evaluate(cx, "fixtures.js", fixtureScript) ||
+      !Evaluate(cx, "json.js", jsonScript) ||
+      !Evaluate(cx, "compute.js", computeScript)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+
+  printf("%-26s %12s %10s %12s\n", "benchmark", "median ns", "stddev",
+         "iterations");
+  std::vector<Result> results;
+  for (const Benchmark& bench : benchmarks) {
+    if (!Selected(bench)) continue;
+
+    // Use the same number of iterations as the baseline, so that the samples
+    // are comparable.
+    auto found = baseline.find(bench.name);
+    uint64_t iterations =
+        found == baseline.end() ? 0 : found->second.iterations;
+
+    Result result;
+    if (!Measure(cx, global, bench, iterations, &result)) {
+      fprintf(stderr, "Benchmark %s failed\n", bench.name);
+      if (JS_IsExceptionPending(cx)) boilerplate::ReportAndClearException(cx);
+      return false;
+    }
+    printf("%-26s %12.1f %9.1f%% %12llu\n", result.name.c_str(),
+           result.median(), result.stddev() / result.mean() * 100,
+           static_cast<unsigned long long>(result.iterations));
+    fflush(stdout);
+    results.push_back(std::move(result));
+  }
+
+  if (jsonPath && !WriteResults(jsonPath, results)) return false;
+
+  if (baselinePath) {
+    unsigned regressions = Compare(baseline, results);
+    if (regressions) {
+      fprintf(stderr, "%u significant regression(s) compared with %s\n",
+              regressions, baselinePath);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  bool usageError = false;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--suite") == 0 && hasValue) {
+      suite = argv[++i];
+    } else if (strcmp(argv[i], "--samples") == 0 && hasValue) {
+      sampleCount = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--json") == 0 && hasValue) {
+      jsonPath = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && hasValue) {
+      baselinePath = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usageError = true;
+    } else {
+      filters.push_back(argv[i]);
+    }
+  }
+  if (usageError || sampleCount < 2 ||
+      (suite && strcmp(suite, "micro") != 0 && strcmp(suite, "macro") != 0)) {
+    fprintf(stderr,
+            "Usage: %s [--suite micro|macro] [--samples N] [--json FILE] "
+            "[--compare BASELINE] [NAME...]\n",
+            argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(BenchExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -1,22 +1,40 @@
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <jsapi.h>
+#include <jsfriendapi.h>
 
+#include <js/CompilationAndEvaluation.h>
 #include <js/Initialization.h>
 #include <js/Exception.h>
+#include <js/SourceText.h>
 
 #include "boilerplate.h"
+#include "gcprofile.h"
+#include "jitprofile.h"
+#include "perfjit.h"
+#include "traceevents.h"
 
 // This file contains boilerplate code used by a number of examples. Ideally
 // this should eventually become part of SpiderMonkey itself.
 
+// The class of the global objects created by CreateGlobal.
+const JSClass boilerplate::GlobalClass = {
+    "BoilerplateGlobal", JSCLASS_GLOBAL_FLAGS, &JS::DefaultGlobalClassOps};
+
 // Create a simple Global object. A global object is the top-level 'this' value
 // in a script and is required in order to compile or execute JavaScript.
+//
+// SharedArrayBuffer and Atomics are enabled, so that globals in different
+// threads' contexts can share memory (see 'sharedring.cpp').
 JSObject* boilerplate::CreateGlobal(JSContext* cx) {
   JS::RealmOptions options;
+  options.creationOptions().setSharedMemoryAndAtomicsEnabled(true);
 
-  static JSClass BoilerplateGlobalClass = {
-      "BoilerplateGlobal", JSCLASS_GLOBAL_FLAGS, &JS::DefaultGlobalClassOps};
-
-  return JS_NewGlobalObject(cx, &BoilerplateGlobalClass, nullptr,
+  return JS_NewGlobalObject(cx, &boilerplate::GlobalClass, nullptr,
                             JS::FireOnNewGlobalHook, options);
 }
 
@@ -39,12 +57,189 @@ void boilerplate::ReportAndClearException(JSContext* cx) {
   JS::PrintError(stderr, report, false);
 }
 
-// Initialize the JS environment, create a JSContext and run the example
-// function in that context. By default the self-hosting environment is
-// initialized as it is needed to run any JavaScript). If the 'initSelfHosting'
-// argument is false, we will not initialize self-hosting and instead leave
-// that to the caller.
-bool boilerplate::RunExample(bool (*task)(JSContext*), bool initSelfHosting) {
+// ReadOnlyCompileOptions::filename() is a plain string in some SpiderMonkey
+// versions and a wrapper in others (see 'scriptcache.cpp').
+static const char* Filename(const char* str) { return str ? str : ""; }
+template <typename T>
+static const char* Filename(const T& str) {
+  return str.c_str() ? str.c_str() : "";
+}
+
+// Compile and run a script from UTF-8 source, like JS::Evaluate, but with the
+// compile and the run recorded as separate spans when tracing is on (see
+// 'traceevents.cpp'), so that a timeline shows which one a slow script spent
+// its time in. Returns false with an exception pending on failure.
+bool boilerplate::Evaluate(JSContext* cx,
+                           const JS::ReadOnlyCompileOptions& options,
+                           const char* code, size_t length,
+                           JS::MutableHandleValue rval) {
+  const char* filename = Filename(options.filename());
+
+  JS::SourceText<mozilla::Utf8Unit> source;
+  if (!source.init(cx, code, length, JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  JS::RootedScript script(cx);
+  {
+    boilerplate::TraceScope scope("compile", "compile", filename);
+    script = JS::Compile(cx, options, source);
+  }
+  if (!script) {
+    return false;
+  }
+
+  boilerplate::TraceScope scope("ExecuteScript", "execute", filename);
+  return JS_ExecuteScript(cx, script, rval);
+}
+
+// The self-hosted code (the parts of the standard library that SpiderMonkey
+// implements in JavaScript) is compiled to a stencil when the first context
+// initializes it. SpiderMonkey hands us that stencil in serialized form, and
+// we keep it for the rest of the process. Child contexts (see
+// NewChildContext) share their parent runtime's stencil and never look at the
+// buffer; it is decoded instead of parsing the self-hosted sources again only
+// by contexts that start a new top-level runtime, such as the startup trials
+// in 'startup.cpp' or the processes forked from a Zygote ('zygote.cpp').
+//
+// If the BOILERPLATE_SELFHOSTED_CACHE environment variable names a file, the
+// serialized stencil is also stored there, and loaded from there at startup.
+// That way even the first context in a new process skips the parse. A stale
+// or corrupt file is detected by SpiderMonkey, which then falls back to
+// parsing and we overwrite the file.
+//
+// A buffer that has been handed to SpiderMonkey is never freed or reallocated,
+// because it may keep pointers into it for as long as any runtime that decoded
+// it is alive. When a stale buffer is replaced, it is retired instead.
+static std::mutex selfHostedLock;
+static std::vector<uint8_t> selfHostedCache;
+static std::vector<std::vector<uint8_t>> retiredSelfHostedCaches;
+static bool selfHostedCacheLoaded = false;
+
+static const char* SelfHostedCachePath() {
+  const char* path = getenv("BOILERPLATE_SELFHOSTED_CACHE");
+  return path && path[0] != '\0' ? path : nullptr;
+}
+
+static void LoadSelfHostedCache() {
+  const char* path = SelfHostedCachePath();
+  if (!path) return;
+
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return;
+
+  std::vector<uint8_t> contents;
+  uint8_t chunk[64 * 1024];
+  size_t nread;
+  while ((nread = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    contents.insert(contents.end(), chunk, chunk + nread);
+  }
+  bool ok = !ferror(fp);
+  fclose(fp);
+
+  if (ok) {
+    selfHostedCache = std::move(contents);
+  }
+}
+
+static void StoreSelfHostedCache() {
+  const char* path = SelfHostedCachePath();
+  if (!path) return;
+
+  // Write to a temporary file and rename it into place, so that a concurrent
+  // process never sees a half-written cache.
+  std::string tmpPath = std::string(path) + ".tmp";
+  FILE* fp = fopen(tmpPath.c_str(), "wb");
+  if (!fp) return;
+
+  bool ok = fwrite(selfHostedCache.data(), 1, selfHostedCache.size(), fp) ==
+            selfHostedCache.size();
+  ok = fclose(fp) == 0 && ok;
+
+  if (!ok || rename(tmpPath.c_str(), path) != 0) {
+    remove(tmpPath.c_str());
+  }
+}
+
+static bool WriteSelfHostedCache(JSContext* cx, JS::SelfHostedCache buffer) {
+  std::lock_guard<std::mutex> lock(selfHostedLock);
+  // Moving the vector keeps its memory where it is.
+  if (!selfHostedCache.empty()) {
+    retiredSelfHostedCaches.push_back(std::move(selfHostedCache));
+  }
+  selfHostedCache.assign(buffer.begin(), buffer.end());
+  StoreSelfHostedCache();
+  return true;
+}
+
+// Initialize self-hosted code in a new context, reusing the serialized stencil
+// from an earlier context in this process, or from the cache file, when there
+// is one. Use this instead of JS::InitSelfHostedCode.
+bool boilerplate::InitSelfHosting(JSContext* cx) {
+  JS::SelfHostedCache cache;
+  {
+    std::lock_guard<std::mutex> lock(selfHostedLock);
+    if (!selfHostedCacheLoaded) {
+      LoadSelfHostedCache();
+      selfHostedCacheLoaded = true;
+    }
+    cache = JS::SelfHostedCache(selfHostedCache.data(), selfHostedCache.size());
+  }
+
+  return JS::InitSelfHostedCode(cx, cache, WriteSelfHostedCache);
+}
+
+// Apply the GC profile from the environment, if any, to a new context. Call it
+// before the context allocates anything. See 'gcprofile.cpp'.
+void boilerplate::ApplyEnvironmentGCProfile(JSContext* cx) {
+  boilerplate::GCProfile profile = boilerplate::GCProfileFromEnvironment();
+  if (profile != boilerplate::GCProfile::Default) {
+    boilerplate::ApplyGCProfile(cx, profile);
+  }
+}
+
+// Record a new context's GC pauses, on a timeline row named 'threadName', if
+// tracing is on. See 'traceevents.cpp'.
+void boilerplate::TraceContext(JSContext* cx, const char* threadName) {
+  if (boilerplate::TracingEnabled()) {
+    boilerplate::TraceThreadName(threadName);
+    boilerplate::TraceGC(cx);
+  }
+}
+
+// Create a context for use on a thread other than the main one. The parent
+// runtime must be that of the main thread's context, which must already have
+// initialized self-hosted code. The GC profile, by default the one from the
+// environment, is applied before the context allocates anything. Returns
+// nullptr on failure.
+JSContext* boilerplate::NewChildContext(JSRuntime* parentRuntime,
+                                        uint32_t maxBytes,
+                                        GCProfile profile) {
+  JSContext* cx = JS_NewContext(maxBytes, parentRuntime);
+  if (!cx) {
+    return nullptr;
+  }
+
+  if (profile != boilerplate::GCProfile::Default) {
+    boilerplate::ApplyGCProfile(cx, profile);
+  }
+
+  boilerplate::TraceContext(cx, "worker");
+
+  // Worker threads may block in Atomics.wait; the main thread may not.
+  JS_SetFutexCanWait(cx);
+
+  if (!boilerplate::InitSelfHosting(cx)) {
+    JS_DestroyContext(cx);
+    return nullptr;
+  }
+
+  return cx;
+}
+
+static bool RunExampleInContext(bool (*task)(JSContext*),
+                                bool (*setup)(JSContext*),
+                                bool initSelfHosting) {
   if (!JS_Init()) {
     return false;
   }
@@ -54,7 +249,21 @@ bool boilerplate::RunExample(bool (*task)(JSContext*), bool initSelfHosting) {
     return false;
   }
 
-  if (initSelfHosting && !JS::InitSelfHostedCode(cx)) {
+  boilerplate::ApplyEnvironmentGCProfile(cx);
+
+  // JIT options are global to the process, so unlike the GC profile they are
+  // only applied here, before any child context exists. See 'jitprofile.cpp'.
+  if (!boilerplate::ApplyJitProfileFromEnvironment(cx)) {
+    return false;
+  }
+
+  boilerplate::TraceContext(cx, "main");
+
+  if (setup && !setup(cx)) {
+    return false;
+  }
+
+  if (initSelfHosting && !boilerplate::InitSelfHosting(cx)) {
     return false;
   }
 
@@ -67,3 +276,33 @@ bool boilerplate::RunExample(bool (*task)(JSContext*), bool initSelfHosting) {
 
   return true;
 }
+
+// Any example records a timeline when BOILERPLATE_TRACE names a file, and
+// describes its JIT code to Linux perf when BOILERPLATE_PERF names a mode. See
+// 'traceevents.cpp' and 'perfjit.cpp'.
+static bool RunExampleImpl(bool (*task)(JSContext*),
+                           bool (*setup)(JSContext*), bool initSelfHosting) {
+  boilerplate::EnablePerf(boilerplate::PerfModeFromEnvironment());
+  boilerplate::StartTracingFromEnvironment();
+  bool ok = RunExampleInContext(task, setup, initSelfHosting);
+  boilerplate::StopTracing();
+  boilerplate::CheckPerfOutput();
+  return ok;
+}
+
+// Initialize the JS environment, create a JSContext and run the example
+// function in that context. By default the self-hosting environment is
+// initialized as it is needed to run any JavaScript). If the 'initSelfHosting'
+// argument is false, we will not initialize self-hosting and instead leave
+// that to the caller.
+bool boilerplate::RunExample(bool (*task)(JSContext*), bool initSelfHosting) {
+  return RunExampleImpl(task, nullptr, initSelfHosting);
+}
+
+// Same as above, but call 'setup' on the new context before initializing
+// self-hosting. Some things, such as the job queue, must be set up before the
+// self-hosted code is initialized.
+bool boilerplate::RunExample(bool (*task)(JSContext*),
+                             bool (*setup)(JSContext*)) {
+  return RunExampleImpl(task, setup, true);
+}
@@ -1,4 +1,10 @@
+#ifndef BOILERPLATE_H_
+#define BOILERPLATE_H_
+
 #include <jsapi.h>
+#include <js/CompileOptions.h>
+
+#include "gcprofile.h"
 
 // See 'boilerplate.cpp' for documentation.
 
@@ -6,10 +12,29 @@ namespace boilerplate {
 
 extern const JSClassOps DefaultGlobalClassOps;
 
+extern const JSClass GlobalClass;
+
 JSObject* CreateGlobal(JSContext* cx);
 
 void ReportAndClearException(JSContext* cx);
 
+bool Evaluate(JSContext* cx, const JS::ReadOnlyCompileOptions& options,
+              const char* code, size_t length, JS::MutableHandleValue rval);
+
+bool InitSelfHosting(JSContext* cx);
+
+void ApplyEnvironmentGCProfile(JSContext* cx);
+
+void TraceContext(JSContext* cx, const char* threadName);
+
+JSContext* NewChildContext(JSRuntime* parentRuntime,
+                           uint32_t maxBytes = 8L * 1024L * 1024L,
+                           GCProfile profile = GCProfileFromEnvironment());
+
 bool RunExample(bool (*task)(JSContext*), bool initSelfHosting = true);
 
+bool RunExample(bool (*task)(JSContext*), bool (*setup)(JSContext*));
+
 }  // namespace boilerplate
+
+#endif  // BOILERPLATE_H_
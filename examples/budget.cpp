@@ -0,0 +1,198 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <jsapi.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/SourceText.h>
+
+#include "boilerplate.h"
+#include "watchdog.h"
+
+// This program shows how boilerplate::Watchdog stops runaway scripts, and
+// measures what it costs scripts that behave.
+//
+// First it runs a short script ITERATIONS times: without a watchdog, with the
+// context attached to one, and with each run inside its own Budget. Then it
+// runs a loop of LOOP milliseconds both ways, to show that the interrupt
+// checks don't slow down long-running code. It prints the time per run and
+// the overhead compared to the first case.
+//
+// Finally it runs a few scripts that never finish on their own, each with a
+// 100 ms budget, and shows that the context still works afterwards.
+//
+// Usage: budget [ITERATIONS [LOOP]]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned iterations = 100000;
+static unsigned loopMs = 500;
+
+static const char* shortScript = R"js(
+  let sum = 0;
+  for (let i = 0; i < 100; i++) sum += i;
+  sum;
+)js";
+
+static const char* loopScript = R"js(
+  const end = Date.now() + LOOP;
+  let n = 0;
+  while (Date.now() < end) n++;
+  n;
+)js";
+
+static const char* runaways[] = {
+    "while (true) {}",
+    "for (;;) { try { while (true) {} } catch (e) {} finally { continue; } }",
+    "function f() { try { f(); } finally { f(); } } f();",
+};
+
+static JSScript* Compile(JSContext* cx, const char* filename,
+                         const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::SourceText<mozilla::Utf8Unit> source;
+  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
+    return nullptr;
+  }
+
+  return JS::Compile(cx, options, source);
+}
+
+// Runs 'script' 'count' times, in a Budget of 100 ms CPU time each if
+// 'watchdog' is given, and returns the average time per run in microseconds.
+static double Measure(JSContext* cx, JS::HandleScript script, unsigned count,
+                      boilerplate::Watchdog* watchdog) {
+  JS::RootedValue rval(cx);
+  Clock::time_point start = Clock::now();
+  for (unsigned i = 0; i < count; i++) {
+    bool ok;
+    if (watchdog) {
+      boilerplate::Watchdog::Budget budget(*watchdog, cx, 100);
+      ok = JS_ExecuteScript(cx, script, &rval);
+    } else {
+      ok = JS_ExecuteScript(cx, script, &rval);
+    }
+    if (!ok) {
+      return -1;
+    }
+  }
+  std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+  return elapsed.count() / count;
+}
+
+static void PrintResult(const char* name, double us, double baseline) {
+  printf("  %-20s %10.3f us/run  %+6.2f%%\n", name, us,
+         (us - baseline) / baseline * 100);
+}
+
+static bool Overhead(JSContext* cx, boilerplate::Watchdog& watchdog) {
+  JS::RootedScript script(cx, Compile(cx, "short.js", shortScript));
+  if (!script) return false;
+
+  // Warm up the JIT first, so every case runs the same code.
+  if (Measure(cx, script, iterations, nullptr) < 0) return false;
+
+  printf("short script, %u runs\n", iterations);
+  double bare = Measure(cx, script, iterations, nullptr);
+  if (bare < 0) return false;
+  PrintResult("no watchdog", bare, bare);
+
+  if (!watchdog.attach(cx)) return false;
+  double attached = Measure(cx, script, iterations, nullptr);
+  double budgeted = Measure(cx, script, iterations, &watchdog);
+  watchdog.detach(cx);
+  if (attached < 0 || budgeted < 0) return false;
+  PrintResult("attached", attached, bare);
+  PrintResult("budget per run", budgeted, bare);
+
+  std::string code = "const LOOP = " + std::to_string(loopMs) + ";\n";
+  code += loopScript;
+  JS::RootedScript loop(cx, Compile(cx, "loop.js", code.c_str()));
+  if (!loop) return false;
+
+  // The loop runs for a fixed time, so compare how many iterations it did.
+  JS::RootedValue bareCount(cx), budgetedCount(cx);
+  if (!JS_ExecuteScript(cx, loop, &bareCount)) return false;
+  if (!watchdog.attach(cx)) return false;
+  {
+    boilerplate::Watchdog::Budget budget(watchdog, cx, loopMs * 2);
+    if (!JS_ExecuteScript(cx, loop, &budgetedCount)) return false;
+  }
+  watchdog.detach(cx);
+
+  double before = bareCount.toNumber(), after = budgetedCount.toNumber();
+  printf("%u ms loop\n", loopMs);
+  printf("  %-20s %10.0f iterations\n", "no watchdog", before);
+  printf("  %-20s %10.0f iterations  %+6.2f%%\n", "budget", after,
+         (after - before) / before * 100);
+  return true;
+}
+
+static bool Runaways(JSContext* cx, boilerplate::Watchdog& watchdog) {
+  if (!watchdog.attach(cx)) return false;
+
+  printf("runaway scripts, 100 ms CPU budget each\n");
+  for (const char* code : runaways) {
+    JS::RootedScript script(cx, Compile(cx, "runaway.js", code));
+    if (!script) return false;
+
+    printf("  %s\n", code);
+    boilerplate::Watchdog::Budget budget(watchdog, cx, 100);
+    JS::RootedValue rval(cx);
+    if (JS_ExecuteScript(cx, script, &rval)) {
+      fprintf(stderr, "Error: Script finished on its own\n");
+      return false;
+    }
+    budget.finish();
+    if (budget.exceeded() == boilerplate::Watchdog::Limit::None) {
+      return false;
+    }
+    budget.report();
+  }
+
+  watchdog.detach(cx);
+  printf("%llu interrupts\n", (unsigned long long)watchdog.interrupts());
+
+  // The context is still usable.
+  JS::RootedScript script(cx, Compile(cx, "after.js", shortScript));
+  JS::RootedValue rval(cx);
+  if (!script || !JS_ExecuteScript(cx, script, &rval)) return false;
+  printf("afterwards, 'sum' is %d\n", rval.toInt32());
+  return true;
+}
+
+static bool BudgetExample(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  boilerplate::Watchdog watchdog;
+  bool ok = Overhead(cx, watchdog) && Runaways(cx, watchdog);
+  watchdog.detach(cx);
+  if (!ok) {
+    if (JS_IsExceptionPending(cx)) {
+      boilerplate::ReportAndClearException(cx);
+    }
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) iterations = atoi(argv[1]);
+  if (argc > 2) loopMs = atoi(argv[2]);
+  if (iterations == 0 || loopMs == 0) {
+    fprintf(stderr, "Usage: %s [ITERATIONS [LOOP]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(BudgetExample)) {
+    return 1;
+  }
+  return 0;
+}
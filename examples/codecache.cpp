@@ -0,0 +1,172 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+
+#include "boilerplate.h"
+#include "scriptcache.h"
+
+// This program compiles a corpus of scripts through boilerplate::ScriptCache
+// twice: first with an empty cache directory ("cold"), which parses every
+// script and stores it, and then again ("warm"), which decodes every script
+// from the cache. It prints the time taken and the hit rate of each pass.
+//
+// Without arguments the corpus is generated: SCRIPTS scripts of FUNCTIONS
+// functions each. Alternatively, pass the names of JavaScript files to use
+// those as the corpus; any argument that is not a plain number is taken as a
+// file name.
+//
+// Usage: codecache [SCRIPTS [FUNCTIONS]]
+//        codecache FILE.js...
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned scriptCount = 50;
+static unsigned functionCount = 500;
+static std::vector<std::string> files;
+
+struct Script {
+  std::string filename;
+  std::string source;
+};
+
+static std::vector<Script> corpus;
+
+static std::string GenerateScript(unsigned index) {
+  std::ostringstream out;
+  for (unsigned i = 0; i < functionCount; i++) {
+    out << "function f" << index << "_" << i << "(items, key) {\n"
+        << "  let total = 0;\n"
+        << "  for (const item of items) {\n"
+        << "    if (item && typeof item[key] === 'number')\n"
+        << "      total += item[key];\n"
+        << "    else if (Array.isArray(item)) total += item.length * " << i
+        << ";\n"
+        << "  }\n"
+        << "  return { total, label: `f" << i << ":${key}`, "
+        << "scaled: total / " << (i + 1) << " };\n"
+        << "}\n";
+  }
+  return out.str();
+}
+
+static bool LoadCorpus() {
+  if (files.empty()) {
+    for (unsigned i = 0; i < scriptCount; i++) {
+      corpus.push_back({"generated" + std::to_string(i) + ".js",
+                        GenerateScript(i)});
+    }
+    return true;
+  }
+
+  for (const std::string& filename : files) {
+    std::ifstream in(filename);
+    if (!in) {
+      fprintf(stderr, "Cannot read %s\n", filename.c_str());
+      return false;
+    }
+    std::ostringstream source;
+    source << in.rdbuf();
+    corpus.push_back({filename, source.str()});
+  }
+  return true;
+}
+
+static void RemoveDirectory(const std::string& directory) {
+  if (DIR* dir = opendir(directory.c_str())) {
+    while (struct dirent* entry = readdir(dir)) {
+      if (entry->d_name[0] == '.') continue;
+      unlink((directory + '/' + entry->d_name).c_str());
+    }
+    closedir(dir);
+  }
+  rmdir(directory.c_str());
+}
+
+static bool CompilePass(JSContext* cx, const char* name,
+                        const std::string& directory) {
+  boilerplate::ScriptCache cache(directory);
+  if (!cache.init()) return false;
+
+  Clock::time_point start = Clock::now();
+  for (const Script& script : corpus) {
+    JS::CompileOptions options(cx);
+    options.setFileAndLine(script.filename.c_str(), 1);
+
+    JS::RootedScript compiled(cx, cache.compile(cx, options,
+                                                script.source.data(),
+                                                script.source.size()));
+    if (!compiled) {
+      boilerplate::ReportAndClearException(cx);
+      return false;
+    }
+  }
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+  const boilerplate::ScriptCache::Stats& stats = cache.stats();
+  printf("%-5s %9.2f ms  %7.3f ms/script  hit rate %5.1f%%  (%llu stored)\n",
+         name, elapsed.count(), elapsed.count() / corpus.size(),
+         cache.hitRate() * 100, (unsigned long long)stats.stored);
+  return true;
+}
+
+static bool CodeCacheExample(JSContext* cx) {
+  if (!LoadCorpus()) return false;
+
+  size_t bytes = 0;
+  for (const Script& script : corpus) bytes += script.source.size();
+  printf("Corpus: %zu scripts, %.1f KiB\n", corpus.size(), bytes / 1024.0);
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  std::string directory =
+      "/tmp/codecache-example-" + std::to_string(getpid());
+  RemoveDirectory(directory);
+
+  bool ok = CompilePass(cx, "cold", directory) &&
+            CompilePass(cx, "warm", directory);
+
+  RemoveDirectory(directory);
+  return ok;
+}
+
+static bool IsCount(const char* arg) {
+  return arg[0] != '\0' && strspn(arg, "0123456789") == strlen(arg);
+}
+
+int main(int argc, const char* argv[]) {
+  bool countMode = argc <= 3;
+  for (int i = 1; i < argc; i++) {
+    countMode = countMode && IsCount(argv[i]);
+  }
+
+  if (!countMode) {
+    files.assign(argv + 1, argv + argc);
+  } else {
+    if (argc > 1) scriptCount = atoi(argv[1]);
+    if (argc > 2) functionCount = atoi(argv[2]);
+    if (scriptCount == 0 || functionCount == 0) {
+      fprintf(stderr, "Usage: %s [SCRIPTS [FUNCTIONS]]\n", argv[0]);
+      fprintf(stderr, "       %s FILE.js...\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (!boilerplate::RunExample(CodeCacheExample)) {
+    return 1;
+  }
+  return 0;
+}
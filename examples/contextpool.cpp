@@ -0,0 +1,159 @@
+#include <cstdio>
+
+#include <jsapi.h>
+
+#include "boilerplate.h"
+#include "contextpool.h"
+
+// A pool of pre-warmed JSContexts. Creating a context, initializing
+// self-hosted code and creating a global is much more expensive than running
+// a short script, so an embedding that runs many short scripts should do that
+// setup once per thread and reuse the result.
+//
+// Each pool thread owns one JSContext whose parent is the main thread's
+// runtime, exactly like 'WorkerMain' in worker.cpp. The context and its global
+// live as long as the pool. Tasks are handed to whichever thread is idle, and
+// run inside that thread's global.
+//
+// Pooled contexts use the GC profile given to 'setGCProfile' before the pool
+// is started, or else the one from the environment. See 'gcprofile.cpp'.
+//
+// NOTE: The parent context must have initialized self-hosted code before the
+// pool is started, and must not be destroyed until after the pool has been
+// shut down.
+
+// The optional 'setup' function is called once per pooled global, inside its
+// realm, to define whatever functions and classes the tasks expect.
+boilerplate::ContextPool::ContextPool(JSRuntime* parentRuntime,
+                                      size_t threadCount, GlobalSetup setup,
+                                      uint32_t maxBytes)
+    : m_parentRuntime(parentRuntime),
+      m_threadCount(threadCount),
+      m_setup(setup),
+      m_maxBytes(maxBytes) {}
+
+boilerplate::ContextPool::~ContextPool() { shutdown(); }
+
+// Start the pool threads and wait until every context is ready to accept
+// tasks. Returns false if any context failed to initialize, in which case the
+// pool is shut down again.
+bool boilerplate::ContextPool::start() {
+  for (size_t i = 0; i < m_threadCount; i++) {
+    m_threads.emplace_back(&ContextPool::workerMain, this);
+  }
+
+  bool ok;
+  {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_startup.wait(lock,
+                   [this] { return m_ready + m_failed == m_threadCount; });
+    ok = m_failed == 0;
+  }
+
+  if (!ok) {
+    shutdown();
+  }
+  return ok;
+}
+
+// Queue a task for the next idle context. The returned future becomes ready
+// with the task's return value once it has run. If the task fails with a
+// pending exception, it is reported and cleared on the pool thread.
+std::future<bool> boilerplate::ContextPool::submit(Task task) {
+  PendingTask pending{std::move(task), std::promise<bool>()};
+  std::future<bool> result = pending.result.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_stopping) {
+      pending.result.set_value(false);
+      return result;
+    }
+    m_tasks.push_back(std::move(pending));
+  }
+
+  m_wakeup.notify_one();
+  return result;
+}
+
+// Finish all queued tasks, then destroy the pooled contexts and join their
+// threads. Safe to call more than once.
+void boilerplate::ContextPool::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stopping = true;
+  }
+  m_wakeup.notify_all();
+
+  for (std::thread& thread : m_threads) {
+    thread.join();
+  }
+  m_threads.clear();
+}
+
+void boilerplate::ContextPool::markStarted(bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (ok) {
+      m_ready++;
+    } else {
+      m_failed++;
+    }
+  }
+  m_startup.notify_all();
+}
+
+void boilerplate::ContextPool::workerMain() {
+  JSContext* cx =
+      boilerplate::NewChildContext(m_parentRuntime, m_maxBytes, m_gcProfile);
+  if (!cx) {
+    fprintf(stderr, "Error: Failed to create pooled context\n");
+    markStarted(false);
+    return;
+  }
+
+  serve(cx);
+
+  JS_DestroyContext(cx);
+}
+
+// Create this thread's global and run tasks in it until the pool shuts down.
+// The global must be rooted in a scope that ends before the context is
+// destroyed, which is why this is separate from 'workerMain'.
+void boilerplate::ContextPool::serve(JSContext* cx) {
+  JS::Rooted<JSObject*> global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) {
+    fprintf(stderr, "Error: Failed during boilerplate::CreateGlobal\n");
+    markStarted(false);
+    return;
+  }
+
+  JSAutoRealm ar(cx, global);
+
+  if (m_setup && !m_setup(cx, global)) {
+    boilerplate::ReportAndClearException(cx);
+    markStarted(false);
+    return;
+  }
+
+  markStarted(true);
+
+  for (;;) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_wakeup.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+    if (m_tasks.empty()) {
+      return;
+    }
+    PendingTask pending = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    lock.unlock();
+
+    bool ok = pending.task(cx, global);
+    if (!ok && JS_IsExceptionPending(cx)) {
+      boilerplate::ReportAndClearException(cx);
+    }
+    pending.result.set_value(ok);
+
+    JS_MaybeGC(cx);
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef CONTEXTPOOL_H_
+#define CONTEXTPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <jsapi.h>
+
+#include "gcprofile.h"
+
+// See 'contextpool.cpp' for documentation.
+
+namespace boilerplate {
+
+class ContextPool {
+ public:
+  using Task = std::function<bool(JSContext*, JS::HandleObject)>;
+  using GlobalSetup = bool (*)(JSContext*, JS::HandleObject);
+
+  ContextPool(JSRuntime* parentRuntime, size_t threadCount,
+              GlobalSetup setup = nullptr,
+              uint32_t maxBytes = 8L * 1024L * 1024L);
+  ~ContextPool();
+
+  ContextPool(const ContextPool&) = delete;
+  ContextPool& operator=(const ContextPool&) = delete;
+
+  void setGCProfile(GCProfile profile) { m_gcProfile = profile; }
+
+  bool start();
+  std::future<bool> submit(Task task);
+  void shutdown();
+
+  size_t size() const { return m_threadCount; }
+
+ private:
+  struct PendingTask {
+    Task task;
+    std::promise<bool> result;
+  };
+
+  void workerMain();
+  void serve(JSContext* cx);
+  void markStarted(bool ok);
+
+  JSRuntime* m_parentRuntime;
+  size_t m_threadCount;
+  GlobalSetup m_setup;
+  uint32_t m_maxBytes;
+  GCProfile m_gcProfile = GCProfileFromEnvironment();
+
+  std::mutex m_lock;
+  std::condition_variable m_wakeup;
+  std::condition_variable m_startup;
+  std::deque<PendingTask> m_tasks;
+  std::vector<std::thread> m_threads;
+  size_t m_ready = 0;
+  size_t m_failed = 0;
+  bool m_stopping = false;
+};
+
+}  // namespace boilerplate
+
+#endif  // CONTEXTPOOL_H_
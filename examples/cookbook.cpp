@@ -6,11 +6,10 @@
 #include <mozilla/Unused.h>
 
 #include <js/Array.h>
-#include <js/CompilationAndEvaluation.h>
+#include <js/CompileOptions.h>
 #include <js/Conversions.h>
 #include <js/Initialization.h>
 #include <js/Object.h>
-#include <js/SourceText.h>
 #include <js/ValueArray.h>
 
 #include "boilerplate.h"
@@ -875,13 +874,8 @@ static bool ExecuteCode(JSContext* cx, const char* code) {
   JS::CompileOptions options(cx);
   options.setFileAndLine("noname", 1);
 
-  JS::SourceText<mozilla::Utf8Unit> source;
-  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
-    return false;
-  }
-
   JS::RootedValue unused(cx);
-  return JS::Evaluate(cx, options, source, &unused);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &unused);
 }
 
 class AutoReportException {
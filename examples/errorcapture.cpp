@@ -0,0 +1,278 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
+
+#include <jsapi.h>
+#include <js/ErrorReport.h>
+#include <js/Exception.h>
+#include <js/Object.h>
+#include <js/SavedFrameAPI.h>
+
+#include <mozilla/Span.h>
+
+#include "errorcapture.h"
+
+// A cheaper way to deal with exceptions than ReportAndClearException, for
+// embeddings where scripts may throw at a high rate.
+//
+// ReportAndClearException builds a JS::ErrorReportBuilder with side effects
+// allowed, which may call back into JavaScript (for example, a toString()
+// method on the thrown value), allocates the report, and then prints all of it.
+// That is the right thing for a development tool, but in a server running
+// buggy third-party scripts it becomes a hotspot and floods the logs.
+//
+// CaptureAndClearException instead copies the message, location and the top
+// few frames of the stack into a caller-provided CapturedError, which can be
+// reused for every exception. It never runs JavaScript. The message is taken
+// from the error report that SpiderMonkey already attached to Error objects;
+// for any other thrown value it is a short description that does not involve
+// calling toString().
+//
+// ErrorLog then decides whether to print a captured error. Errors are grouped
+// by the location they were thrown from, and each location may only print a
+// few errors per time interval. The number of errors that were suppressed is
+// printed along with the next one that is allowed through.
+//
+// Usage:
+//
+//   boilerplate::CapturedError error;  // reusable
+//   boilerplate::ErrorLog log;         // one per thread
+//
+//   if (!JS::Evaluate(...)) {
+//     if (!boilerplate::CaptureAndClearException(cx, &error)) ...uncatchable
+//     log.emit(error);
+//   }
+
+// Copy a C string into a fixed size buffer, truncating if necessary, but never
+// in the middle of a UTF-8 sequence.
+static void CopyTruncated(const char* src, char* dest, size_t capacity) {
+  size_t length = strlen(src);
+  if (length >= capacity) {
+    length = capacity - 1;
+    while (length > 0 && (uint8_t(src[length]) & 0xC0) == 0x80) {
+      length--;
+    }
+  }
+  memcpy(dest, src, length);
+  dest[length] = '\0';
+}
+
+// Copy a JS string into a fixed size buffer as UTF-8, truncating if necessary.
+static void CopyString(JSContext* cx, JSString* str, char* dest,
+                       size_t capacity) {
+  auto result = JS_EncodeStringToUTF8BufferPartial(
+      cx, str, mozilla::Span<char>(dest, capacity - 1));
+  size_t written = result ? std::get<1>(*result) : 0;
+  dest[written] = '\0';
+}
+
+// Describe a thrown value without running any JavaScript.
+static void DescribeValue(JSContext* cx, JS::HandleValue value,
+                          boilerplate::CapturedError* error) {
+  char* message = error->message;
+  size_t capacity = boilerplate::CapturedError::MessageCapacity;
+
+  if (value.isObject()) {
+    JS::RootedObject obj(cx, &value.toObject());
+    if (JSErrorReport* report = JS_ErrorFromException(cx, obj)) {
+      if (report->message().c_str()) {
+        CopyTruncated(report->message().c_str(), message, capacity);
+      }
+      if (report->filename) {
+        CopyTruncated(report->filename, error->filename,
+                      boilerplate::CapturedError::FilenameCapacity);
+      }
+      error->line = report->lineno;
+      error->column = report->column;
+      return;
+    }
+    snprintf(message, capacity, "uncaught [object %s]",
+             JS::GetClass(obj)->name);
+  } else if (value.isString()) {
+    CopyString(cx, value.toString(), message, capacity);
+  } else if (value.isNumber()) {
+    snprintf(message, capacity, "uncaught %.17g", value.toNumber());
+  } else if (value.isBoolean()) {
+    snprintf(message, capacity, "uncaught %s",
+             value.toBoolean() ? "true" : "false");
+  } else if (value.isNull()) {
+    CopyTruncated("uncaught null", message, capacity);
+  } else if (value.isUndefined()) {
+    CopyTruncated("uncaught undefined", message, capacity);
+  } else if (value.isSymbol()) {
+    CopyTruncated("uncaught symbol", message, capacity);
+  } else {
+    CopyTruncated("uncaught bigint", message, capacity);
+  }
+}
+
+// Append up to MaxFrames frames of the saved stack, one per line, in the same
+// "function@file:line:column" format that Error.prototype.stack uses.
+static void DescribeStack(JSContext* cx, JS::HandleObject stack,
+                          boilerplate::CapturedError* error) {
+  JS::RootedObject frame(cx, stack);
+  JS::RootedString source(cx);
+  JS::RootedString name(cx);
+  char sourceBuf[boilerplate::CapturedError::FilenameCapacity];
+  char nameBuf[64];
+  size_t used = 0;
+
+  while (frame && error->frames < boilerplate::CapturedError::MaxFrames) {
+    uint32_t line = 0;
+    uint32_t column = 0;
+    if (JS::GetSavedFrameSource(cx, nullptr, frame, &source) !=
+            JS::SavedFrameResult::Ok ||
+        JS::GetSavedFrameLine(cx, nullptr, frame, &line) !=
+            JS::SavedFrameResult::Ok ||
+        JS::GetSavedFrameColumn(cx, nullptr, frame, &column) !=
+            JS::SavedFrameResult::Ok ||
+        JS::GetSavedFrameFunctionDisplayName(cx, nullptr, frame, &name) !=
+            JS::SavedFrameResult::Ok) {
+      break;
+    }
+
+    sourceBuf[0] = '\0';
+    if (source) CopyString(cx, source, sourceBuf, sizeof(sourceBuf));
+    nameBuf[0] = '\0';
+    if (name) CopyString(cx, name, nameBuf, sizeof(nameBuf));
+
+    // Values thrown without a location, such as 'throw 42', take it from the
+    // innermost frame.
+    if (error->frames == 0 && error->filename[0] == '\0') {
+      CopyTruncated(sourceBuf, error->filename, sizeof(error->filename));
+      error->line = line;
+      error->column = column;
+    }
+
+    size_t available = sizeof(error->stack) - used;
+    int length = snprintf(error->stack + used, available, "%s@%s:%u:%u\n",
+                          nameBuf, sourceBuf, line, column);
+    if (length < 0 || size_t(length) >= available) {
+      break;
+    }
+    used += length;
+    error->frames++;
+
+    if (JS::GetSavedFrameParent(cx, nullptr, frame, &frame) !=
+        JS::SavedFrameResult::Ok) {
+      break;
+    }
+  }
+}
+
+// 64-bit FNV-1a over the location an error was thrown from. Errors from the
+// same location are considered the same for rate limiting.
+static uint64_t HashSite(const boilerplate::CapturedError& error) {
+  uint64_t hash = 0xcbf29ce484222325;
+  auto mix = [&hash](uint8_t byte) {
+    hash ^= byte;
+    hash *= 0x100000001b3;
+  };
+  for (const char* p = error.filename; *p; p++) mix(uint8_t(*p));
+  for (int shift = 0; shift < 32; shift += 8) mix(uint8_t(error.line >> shift));
+  for (int shift = 0; shift < 32; shift += 8) {
+    mix(uint8_t(error.column >> shift));
+  }
+  return hash ? hash : 1;
+}
+
+// Take the pending exception off the context and describe it in 'error',
+// which may be reused from a previous call. Returns false if there was no
+// exception to capture, meaning that the failure was uncatchable (for example,
+// out of memory, or a script being terminated). In that case the context has
+// no pending exception and 'error->uncatchable' is set.
+//
+// NOTE: This must be called with a JSAutoRealm (or equivalent) on the stack.
+bool boilerplate::CaptureAndClearException(JSContext* cx,
+                                           CapturedError* error) {
+  error->message[0] = '\0';
+  error->filename[0] = '\0';
+  error->stack[0] = '\0';
+  error->line = 0;
+  error->column = 0;
+  error->frames = 0;
+  error->uncatchable = false;
+
+  JS::ExceptionStack exnStack(cx);
+  if (!JS::StealPendingExceptionStack(cx, &exnStack)) {
+    error->uncatchable = true;
+    CopyTruncated("uncatchable exception", error->message,
+                  sizeof(error->message));
+    error->site = HashSite(*error);
+    return false;
+  }
+
+  DescribeValue(cx, exnStack.exception(), error);
+
+  if (exnStack.stack()) {
+    DescribeStack(cx, exnStack.stack(), error);
+  }
+
+  error->site = HashSite(*error);
+  return true;
+}
+
+// 'sites' is the number of distinct throw locations that are tracked at once;
+// it is rounded up to a power of two. Each location may emit 'burst' errors
+// per 'interval'.
+boilerplate::ErrorLog::ErrorLog(FILE* out, size_t sites, unsigned burst,
+                                Clock::duration interval)
+    : m_out(out), m_burst(burst), m_interval(interval) {
+  size_t capacity = 1;
+  while (capacity < sites) capacity *= 2;
+  m_sites.resize(capacity, Site{0, Clock::time_point(), 0, 0});
+}
+
+// Find the slot for a site, or claim one for it. The table never grows: when
+// the few slots a site may use are taken by other sites, the first of them is
+// recycled, which at worst lets an extra burst of errors through.
+boilerplate::ErrorLog::Site* boilerplate::ErrorLog::lookup(uint64_t site) {
+  static const size_t MaxProbes = 8;
+  size_t mask = m_sites.size() - 1;
+
+  for (size_t i = 0; i < MaxProbes; i++) {
+    Site& slot = m_sites[(site + i) & mask];
+    if (slot.site == site) return &slot;
+    if (slot.site == 0) {
+      slot = Site{site, Clock::time_point(), 0, 0};
+      return &slot;
+    }
+  }
+
+  Site& slot = m_sites[site & mask];
+  slot = Site{site, Clock::time_point(), 0, 0};
+  return &slot;
+}
+
+// Print a captured error, unless its site has used up its allowance for the
+// current interval. Returns whether the error was printed.
+bool boilerplate::ErrorLog::emit(const CapturedError& error) {
+  m_captured++;
+
+  Site* site = lookup(error.site);
+  Clock::time_point now = Clock::now();
+  if (site->inWindow == 0 || now - site->windowStart >= m_interval) {
+    site->windowStart = now;
+    site->inWindow = 0;
+  }
+
+  if (site->inWindow >= m_burst) {
+    site->suppressed++;
+    return false;
+  }
+  site->inWindow++;
+  m_emitted++;
+
+  fprintf(m_out, "%s:%u:%u %s\n", error.filename, error.line, error.column,
+          error.message);
+  if (error.stack[0] != '\0') {
+    fprintf(m_out, "Stack:\n%s", error.stack);
+  }
+  if (site->suppressed > 0) {
+    fprintf(m_out, "(%" PRIu64 " more errors from this location suppressed)\n",
+            site->suppressed);
+    site->suppressed = 0;
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef ERRORCAPTURE_H_
+#define ERRORCAPTURE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <jsapi.h>
+
+// See 'errorcapture.cpp' for documentation.
+
+namespace boilerplate {
+
+struct CapturedError {
+  static constexpr size_t MessageCapacity = 256;
+  static constexpr size_t FilenameCapacity = 128;
+  static constexpr size_t StackCapacity = 512;
+  static constexpr unsigned MaxFrames = 8;
+
+  char message[MessageCapacity];
+  char filename[FilenameCapacity];
+  char stack[StackCapacity];
+  uint32_t line;
+  uint32_t column;
+  unsigned frames;
+  uint64_t site;
+  bool uncatchable;
+};
+
+bool CaptureAndClearException(JSContext* cx, CapturedError* error);
+
+class ErrorLog {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit ErrorLog(FILE* out = stderr, size_t sites = 1024,
+                    unsigned burst = 5,
+                    Clock::duration interval = std::chrono::seconds(10));
+
+  bool emit(const CapturedError& error);
+
+  uint64_t captured() const { return m_captured; }
+  uint64_t emitted() const { return m_emitted; }
+
+ private:
+  struct Site {
+    uint64_t site;
+    Clock::time_point windowStart;
+    unsigned inWindow;
+    uint64_t suppressed;
+  };
+
+  Site* lookup(uint64_t site);
+
+  FILE* m_out;
+  unsigned m_burst;
+  Clock::duration m_interval;
+  std::vector<Site> m_sites;
+  uint64_t m_captured = 0;
+  uint64_t m_emitted = 0;
+};
+
+}  // namespace boilerplate
+
+#endif  // ERRORCAPTURE_H_
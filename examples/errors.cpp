@@ -0,0 +1,170 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Conversions.h>
+#include <js/ValueArray.h>
+
+#include "boilerplate.h"
+#include "errorcapture.h"
+
+// This program throws exceptions from JavaScript as fast as it can, and
+// measures how many per second each way of dealing with them can handle:
+//
+// - "report":  boilerplate::ReportAndClearException, which prints everything.
+// - "tostring": the AutoReportException approach from cookbook.cpp, which
+//              converts the exception to a string with JS::ToString.
+// - "capture": boilerplate::CaptureAndClearException into a reused struct.
+// - "log":     capture, then boilerplate::ErrorLog, which prints only a few
+//              errors per throw location per interval.
+//
+// Output that would go to stderr is sent to /dev/null while measuring, so
+// that the terminal is not part of what is measured.
+//
+// Usage: errors [ITERATIONS]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned iterations = 100000;
+
+static const char* tenantScript = R"js(
+  function validate(input) {
+    if (typeof input !== 'string')
+      throw new TypeError(`expected a string, got ${typeof input}`);
+    return input.trim();
+  }
+  function handle(i) {
+    return validate(i);
+  }
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("tenant.js", 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+static bool ThrowOnce(JSContext* cx, JS::HandleObject global, unsigned i) {
+  JS::RootedValueArray<1> args(cx);
+  args[0].setInt32(i);
+  JS::RootedValue rval(cx);
+  return JS_CallFunctionName(cx, global, "handle", args, &rval);
+}
+
+static void HandleByReport(JSContext* cx) {
+  boilerplate::ReportAndClearException(cx);
+}
+
+static void HandleByToString(JSContext* cx) {
+  JS::RootedValue exn(cx);
+  if (!JS_GetPendingException(cx, &exn)) return;
+  JS_ClearPendingException(cx);
+
+  JS::RootedString message(cx, JS::ToString(cx, exn));
+  if (!message) {
+    std::cerr << "(could not convert thrown exception to string)\n";
+    JS_ClearPendingException(cx);
+    return;
+  }
+  JS::UniqueChars utf8(JS_EncodeStringToUTF8(cx, message));
+  std::cerr << utf8.get() << '\n';
+}
+
+static boilerplate::CapturedError capturedError;
+static boilerplate::ErrorLog* errorLog;
+
+static void HandleByCapture(JSContext* cx) {
+  boilerplate::CaptureAndClearException(cx, &capturedError);
+}
+
+static void HandleByLog(JSContext* cx) {
+  boilerplate::CaptureAndClearException(cx, &capturedError);
+  errorLog->emit(capturedError);
+}
+
+static bool Measure(JSContext* cx, JS::HandleObject global, const char* name,
+                    void (*handle)(JSContext*)) {
+  fflush(stderr);
+  int savedStderr = dup(STDERR_FILENO);
+  FILE* devnull = freopen("/dev/null", "w", stderr);
+
+  // Only the exceptions that were thrown and handled count; the loop stops
+  // early if the script returns without throwing.
+  unsigned handled = 0;
+  Clock::time_point start = Clock::now();
+  for (unsigned i = 0; i < iterations; i++) {
+    if (ThrowOnce(cx, global, i)) {
+      break;
+    }
+    handle(cx);
+    handled++;
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  fflush(stderr);
+  dup2(savedStderr, STDERR_FILENO);
+  close(savedStderr);
+  if (!devnull) return false;
+  if (handled == 0) {
+    fprintf(stderr, "Error: %s: the script did not throw\n", name);
+    return false;
+  }
+
+  printf("%-9s %10.0f exceptions/s  %7.2f us/exception\n", name,
+         handled / elapsed.count(), elapsed.count() * 1e6 / handled);
+  return true;
+}
+
+static bool ErrorsExample(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  if (!ExecuteCode(cx, tenantScript)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+
+  boilerplate::ErrorLog log(stderr);
+  errorLog = &log;
+
+  bool ok = Measure(cx, global, "report", HandleByReport) &&
+            Measure(cx, global, "tostring", HandleByToString) &&
+            Measure(cx, global, "capture", HandleByCapture) &&
+            Measure(cx, global, "log", HandleByLog);
+
+  printf("log printed %llu of %llu errors\n",
+         (unsigned long long)log.emitted(), (unsigned long long)log.captured());
+
+  // Show what a captured error looks like.
+  if (!ThrowOnce(cx, global, 0)) {
+    boilerplate::CaptureAndClearException(cx, &capturedError);
+    printf("\n%s:%u:%u %s\nStack:\n%s", capturedError.filename,
+           capturedError.line, capturedError.column, capturedError.message,
+           capturedError.stack);
+  }
+
+  errorLog = nullptr;
+  return ok;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) iterations = atoi(argv[1]);
+  if (iterations == 0) {
+    fprintf(stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(ErrorsExample)) {
+    return 1;
+  }
+  return 0;
+}
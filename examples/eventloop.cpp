@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+
+#include <jsapi.h>
+#include <jsfriendapi.h>
+#include <js/Array.h>
+#include <js/CallAndConstruct.h>
+#include <js/Conversions.h>
+#include <js/GCAPI.h>
+#include <js/TracingAPI.h>
+
+#include "boilerplate.h"
+#include "eventloop.h"
+#include "messagechannel.h"
+#include "traceevents.h"
+
+// An event loop for one context, with the setTimeout, setInterval,
+// clearTimeout and clearInterval functions known from browsers.
+//
+// A script that wants to wait for something should not block the thread, as
+// that also blocks every other script in the context; instead it asks for a
+// function to be called later, and the loop runs whatever is ready in the
+// meantime. The loop owns the context's promise job queue (see
+// 'microtaskqueue.cpp') and keeps the pending timers in a timer wheel (see
+// 'timerwheel.cpp'), so that a context may have any number of timers pending,
+// and arming or clearing one takes constant time.
+//
+// Each turn of the loop runs a batch of promise jobs, then the messages that
+// arrived on the loop's message ports (see 'messagechannel.cpp'), then the
+// timers that have expired, in the order of their expiry time. Each message
+// and each timer is followed by a batch of the promise jobs that it queued. If
+// nothing is ready, the thread sleeps until the next timer is due or a message
+// arrives. Timers have a resolution of one millisecond.
+// Delays longer than 2^31 - 1 milliseconds are shortened to that.
+//
+// The loop also keeps a histogram of how late each timer ran, in microseconds,
+// and the number of timers that have run.
+//
+// Usage:
+//
+//   boilerplate::EventLoop loop(cx);
+//   if (!loop.init()) ...
+//
+//   JSAutoRealm ar(cx, global);
+//   if (!loop.defineTimerFunctions(global)) ...
+//   ...run scripts that arm timers
+//
+//   if (!loop.run()) ...uncatchable error, e.g. script terminated
+//
+// NOTE: The loop must be destroyed before the context, and after the last
+// script has run.
+
+static constexpr double MaxDelay = 2147483647.0;
+
+static uint64_t Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+// 'batchSize' is the largest number of promise jobs run at a time, see
+// 'MicrotaskQueue', and of messages delivered from each port in one turn.
+boilerplate::EventLoop::EventLoop(JSContext* cx, size_t batchSize)
+    : m_cx(cx),
+      m_jobs(cx, 1024, batchSize),
+      m_batchSize(batchSize ? batchSize : 1),
+      m_start(Clock::now()) {}
+
+// Make the loop's job queue the context's job queue.
+bool boilerplate::EventLoop::init() {
+  if (!m_jobs.init()) return false;
+  if (!JS_AddExtraGCRootsTracer(m_cx, Trace, this)) return false;
+  m_installed = true;
+  return true;
+}
+
+// Timers that are still pending are dropped, and ports are detached.
+boilerplate::EventLoop::~EventLoop() {
+  while (!m_ports.empty()) {
+    m_ports.back()->detach();
+  }
+
+  if (!m_installed) return;
+  JS_RemoveExtraGCRootsTracer(m_cx, Trace, this);
+}
+
+void boilerplate::EventLoop::Trace(JSTracer* trc, void* data) {
+  auto* loop = static_cast<EventLoop*>(data);
+  for (Timer& timer : loop->m_callbacks) {
+    JS::TraceEdge(trc, &timer.global, "EventLoop timer global");
+    JS::TraceEdge(trc, &timer.callback, "EventLoop timer callback");
+    JS::TraceEdge(trc, &timer.arguments, "EventLoop timer arguments");
+  }
+}
+
+// Milliseconds since the loop was created, which is the time unit of the wheel.
+uint64_t boilerplate::EventLoop::tick() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                               m_start)
+      .count();
+}
+
+boilerplate::EventLoop* boilerplate::EventLoop::FromCallee(
+    const JS::CallArgs& args) {
+  JS::Value loop = js::GetFunctionNativeReserved(&args.callee(), 0);
+  return static_cast<EventLoop*>(loop.toPrivate());
+}
+
+// Define the timer functions on 'global', which must be the current global.
+// The functions keep a pointer to the loop, so the global must not outlive it.
+bool boilerplate::EventLoop::defineTimerFunctions(JS::HandleObject global) {
+  static const struct {
+    const char* name;
+    JSNative native;
+    unsigned nargs;
+  } functions[] = {
+      {"setTimeout", SetTimeout, 2},
+      {"setInterval", SetInterval, 2},
+      {"clearTimeout", ClearTimer, 1},
+      {"clearInterval", ClearTimer, 1},
+  };
+
+  for (const auto& function : functions) {
+    JSFunction* fun = js::DefineFunctionWithReserved(
+        m_cx, global, function.name, function.native, function.nargs, 0);
+    if (!fun) return false;
+    js::SetFunctionNativeReserved(JS_GetFunctionObject(fun), 0,
+                                  JS::PrivateValue(this));
+  }
+  return true;
+}
+
+// setTimeout(callback, delay, ...arguments) and the same for setInterval.
+// Returns the timer's ID, a positive integer.
+bool boilerplate::EventLoop::AddTimer(JSContext* cx, const JS::CallArgs& args,
+                                      bool repeat) {
+  boilerplate::TraceScope scope(repeat ? "setInterval" : "setTimeout",
+                                "native");
+  EventLoop* loop = FromCallee(args);
+
+  if (!args.get(0).isObject() || !JS::IsCallable(&args[0].toObject())) {
+    JS_ReportErrorASCII(cx, "%s: callback is not a function",
+                        repeat ? "setInterval" : "setTimeout");
+    return false;
+  }
+
+  double delay = 0;
+  if (args.length() > 1 && !JS::ToNumber(cx, args[1], &delay)) return false;
+  if (!(delay > 0)) delay = 0;  // also NaN
+  delay = std::min(delay, MaxDelay);
+  uint64_t ms = uint64_t(delay);
+
+  JS::RootedObject arguments(cx);
+  if (args.length() > 2) {
+    arguments = JS::NewArrayObject(
+        cx, JS::HandleValueArray::subarray(args, 2, args.length() - 2));
+    if (!arguments) return false;
+  }
+
+  // The wheel's time only moves between turns of the loop, so count the delay
+  // from the actual time, otherwise the timer could run early.
+  uint64_t lag = loop->tick() - loop->m_timers.now();
+  TimerWheel::Id id =
+      loop->m_timers.arm(ms + lag, repeat ? std::max<uint64_t>(ms, 1) : 0);
+  if (!id) {
+    JS_ReportErrorASCII(cx, "too many timers");
+    return false;
+  }
+
+  size_t index = TimerWheel::Index(id);
+  if (index >= loop->m_callbacks.size()) loop->m_callbacks.resize(index + 1);
+  Timer& timer = loop->m_callbacks[index];
+  timer.global = JS::CurrentGlobalOrNull(cx);
+  timer.callback = &args[0].toObject();
+  timer.arguments = arguments;
+
+  args.rval().setNumber(double(id));
+  return true;
+}
+
+bool boilerplate::EventLoop::SetTimeout(JSContext* cx, unsigned argc,
+                                        JS::Value* vp) {
+  return AddTimer(cx, JS::CallArgsFromVp(argc, vp), false);
+}
+
+bool boilerplate::EventLoop::SetInterval(JSContext* cx, unsigned argc,
+                                         JS::Value* vp) {
+  return AddTimer(cx, JS::CallArgsFromVp(argc, vp), true);
+}
+
+// clearTimeout(id) and clearInterval(id). Either one clears any kind of timer,
+// and IDs of timers that are gone are ignored, as in browsers.
+bool boilerplate::EventLoop::ClearTimer(JSContext* cx, unsigned argc,
+                                        JS::Value* vp) {
+  boilerplate::TraceScope scope("clearTimeout", "native");
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  EventLoop* loop = FromCallee(args);
+
+  if (args.get(0).isNumber()) {
+    double value = args[0].toNumber();
+    if (value >= 1 && value < 9007199254740992.0 &&
+        value == std::floor(value)) {
+      auto id = TimerWheel::Id(value);
+      if (loop->m_timers.live(id)) loop->clear(id);
+    }
+  }
+
+  args.rval().setUndefined();
+  return true;
+}
+
+void boilerplate::EventLoop::clear(TimerWheel::Id id) {
+  m_timers.release(id);
+
+  Timer& timer = m_callbacks[TimerWheel::Index(id)];
+  timer.global = nullptr;
+  timer.callback = nullptr;
+  timer.arguments = nullptr;
+}
+
+static bool CallTimer(JSContext* cx, JS::HandleValue callback,
+                      JS::HandleObject arguments) {
+  JS::RootedValueVector argv(cx);
+  if (arguments) {
+    uint32_t length;
+    if (!JS::GetArrayLength(cx, arguments, &length)) return false;
+    if (!argv.resize(length)) {
+      JS_ReportOutOfMemory(cx);
+      return false;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+      if (!JS_GetElement(cx, arguments, i, argv[i])) return false;
+    }
+  }
+
+  boilerplate::TraceScope scope("timer", "execute");
+  JS::RootedValue rval(cx);
+  return JS::Call(cx, JS::UndefinedHandleValue, callback, argv, &rval);
+}
+
+// Run an expired timer. An interval timer is armed again before its callback
+// runs, so that the callback can clear it. Exceptions are reported, and do not
+// stop the loop; returns false on an uncatchable error.
+bool boilerplate::EventLoop::fire(TimerWheel::Id id) {
+  Clock::time_point due =
+      m_start + std::chrono::milliseconds(m_timers.expires(id));
+  Clock::time_point now = Clock::now();
+  m_lateness.record(now > due ? Microseconds(now - due) : 0);
+  m_timersRun++;
+
+  Timer& timer = m_callbacks[TimerWheel::Index(id)];
+  JS::RootedObject global(m_cx, timer.global);
+  JS::RootedValue callback(m_cx, JS::ObjectValue(*timer.callback.get()));
+  JS::RootedObject arguments(m_cx, timer.arguments);
+  if (!m_timers.rearm(id)) clear(id);
+
+  JSAutoRealm ar(m_cx, global);
+  if (!CallTimer(m_cx, callback, arguments)) {
+    if (!JS_IsExceptionPending(m_cx)) return false;
+    boilerplate::ReportAndClearException(m_cx);
+  }
+  return true;
+}
+
+// Whether any attached port has a message waiting.
+bool boilerplate::EventLoop::messagesPending() const {
+  for (MessagePort* port : m_ports) {
+    if (port->pending()) return true;
+  }
+  return false;
+}
+
+// Whether any attached port may still receive messages.
+bool boilerplate::EventLoop::portsOpen() const {
+  for (MessagePort* port : m_ports) {
+    if (!port->closed() || port->pending()) return true;
+  }
+  return false;
+}
+
+void boilerplate::EventLoop::addPort(MessagePort* port) {
+  m_ports.push_back(port);
+}
+
+void boilerplate::EventLoop::removePort(MessagePort* port) {
+  m_ports.erase(std::remove(m_ports.begin(), m_ports.end(), port),
+                m_ports.end());
+}
+
+// Wake the loop up if it is sleeping. May be called on any thread, and is
+// cheap if the loop is not sleeping.
+void boilerplate::EventLoop::wake() {
+  if (!m_sleeping.load()) return;
+
+  std::lock_guard<std::mutex> lock(m_wakeLock);
+  m_woken = true;
+  m_wakeup.notify_one();
+}
+
+// Sleep until the tick 'next', or until a port receives a message or is
+// closed. A sender that finds 'm_sleeping' false does not wake the loop, so the
+// ports are checked again after setting it.
+void boilerplate::EventLoop::wait(uint64_t next) {
+  if (next != TimerWheel::Never && next <= tick()) return;
+
+  std::unique_lock<std::mutex> lock(m_wakeLock);
+  m_sleeping.store(true);
+  if (!m_woken && !messagesPending()) {
+    auto woken = [this] { return m_woken; };
+    if (next != TimerWheel::Never) {
+      m_wakeup.wait_until(lock, m_start + std::chrono::milliseconds(next),
+                          woken);
+    } else if (portsOpen()) {
+      m_wakeup.wait(lock, woken);
+    }
+  }
+  m_woken = false;
+  m_sleeping.store(false);
+}
+
+// Deliver up to a batch of messages from each port, each followed by a batch of
+// the promise jobs that it queued.
+bool boilerplate::EventLoop::dispatchMessages() {
+  for (size_t i = 0; i < m_ports.size(); i++) {
+    MessagePort* port = m_ports[i];
+    for (size_t n = 0; n < m_batchSize && port->pending(); n++) {
+      if (!port->dispatchOne()) return false;
+      if (!m_jobs.empty() && !m_jobs.runBatch()) return false;
+    }
+  }
+  return true;
+}
+
+// Run one turn of the loop, sleeping first if nothing is ready. Returns false
+// on an uncatchable error, such as the script being terminated.
+bool boilerplate::EventLoop::runOnce() {
+  if (!m_jobs.empty() && !m_jobs.runBatch()) return false;
+
+  if (m_jobs.empty() && m_expired.empty() && !messagesPending()) {
+    wait(m_timers.nextExpiry());
+  }
+
+  if (!dispatchMessages()) return false;
+
+  // Timers armed by the callbacks go into the wheel, not into this list, so
+  // they wait for a later turn even if their delay is zero.
+  m_timers.advance(tick(), &m_expired);
+  for (size_t i = 0; i < m_expired.size(); i++) {
+    TimerWheel::Id id = m_expired[i];
+    if (!m_timers.live(id)) continue;  // cleared by an earlier callback
+
+    if (!fire(id) || (!m_jobs.empty() && !m_jobs.runBatch())) {
+      m_expired.erase(m_expired.begin(), m_expired.begin() + i + 1);
+      return false;
+    }
+  }
+  m_expired.clear();
+  return true;
+}
+
+// Run turns of the loop until there are no timers and no promise jobs left, and
+// every attached port is closed.
+bool boilerplate::EventLoop::run() {
+  while (!m_jobs.empty() || !m_timers.empty() || !m_expired.empty() ||
+         portsOpen()) {
+    if (!runOnce()) return false;
+  }
+  return true;
+}
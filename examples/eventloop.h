@@ -0,0 +1,96 @@
+#ifndef EVENTLOOP_H_
+#define EVENTLOOP_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/TracingAPI.h>
+
+#include "histogram.h"
+#include "microtaskqueue.h"
+#include "timerwheel.h"
+
+// See 'eventloop.cpp' for documentation.
+
+namespace boilerplate {
+
+class MessagePort;
+
+class EventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit EventLoop(JSContext* cx, size_t batchSize = 1000);
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  bool init();
+  bool defineTimerFunctions(JS::HandleObject global);
+
+  bool run();
+  bool runOnce();
+  void wake();
+
+  MicrotaskQueue& jobQueue() { return m_jobs; }
+  size_t pendingTimers() const { return m_timers.size() + m_expired.size(); }
+  uint64_t timersRun() const { return m_timersRun; }
+  const Histogram& latenessHistogram() const { return m_lateness; }
+
+ private:
+  struct Timer {
+    JS::Heap<JSObject*> global;
+    JS::Heap<JSObject*> callback;
+    JS::Heap<JSObject*> arguments;
+  };
+
+  static bool SetTimeout(JSContext* cx, unsigned argc, JS::Value* vp);
+  static bool SetInterval(JSContext* cx, unsigned argc, JS::Value* vp);
+  static bool ClearTimer(JSContext* cx, unsigned argc, JS::Value* vp);
+  static bool AddTimer(JSContext* cx, const JS::CallArgs& args,
+                       bool repeat);
+  static EventLoop* FromCallee(const JS::CallArgs& args);
+
+  static void Trace(JSTracer* trc, void* data);
+
+  friend class MessagePort;
+  void addPort(MessagePort* port);
+  void removePort(MessagePort* port);
+  bool messagesPending() const;
+  bool portsOpen() const;
+  bool dispatchMessages();
+  void wait(uint64_t next);
+
+  uint64_t tick() const;
+  void clear(TimerWheel::Id id);
+  bool fire(TimerWheel::Id id);
+
+  JSContext* m_cx;
+  MicrotaskQueue m_jobs;
+  size_t m_batchSize;
+  TimerWheel m_timers;
+  std::vector<Timer> m_callbacks;
+  std::vector<TimerWheel::Id> m_expired;
+  Clock::time_point m_start;
+  std::vector<MessagePort*> m_ports;
+  bool m_installed = false;
+
+  std::mutex m_wakeLock;
+  std::condition_variable m_wakeup;
+  std::atomic<bool> m_sleeping{false};
+  bool m_woken = false;
+
+  uint64_t m_timersRun = 0;
+  Histogram m_lateness;
+};
+
+}  // namespace boilerplate
+
+#endif  // EVENTLOOP_H_
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/ValueArray.h>
+
+#include "boilerplate.h"
+#include "gctelemetry.h"
+
+// This program shows how boilerplate::GCTelemetry tells GC pauses apart from
+// slow scripts. It calls a request handler REQUESTS times, which allocates
+// objects and keeps some of them in a cache, so that both minor and major GCs
+// happen. Each request's latency is measured, along with the GC pause time
+// that fell inside it.
+//
+// It prints the request latency percentiles, how much of the slowest 1% of
+// requests was spent in GC, the telemetry's own pause percentiles and GC
+// reasons, and any GC with a slice longer than 10 ms as it happens. Last, it
+// measures the telemetry's overhead: after a warm-up that is not counted, it
+// runs the same requests in OverheadRounds pairs of runs, with and without
+// the telemetry, alternating which goes first. Every run gets a fresh global
+// and starts after a full GC, so that neither side inherits a warmer heap or
+// JIT state than the other.
+//
+// Usage: gcpauses [REQUESTS]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned requestCount = 100000;
+
+static const unsigned OverheadRounds = 4;
+
+static const char* handlerScript = R"js(
+  const cache = new Array(20000);
+  function handle(i) {
+    const items = [];
+    for (let j = 0; j < 50; j++)
+      items.push({ id: i * 50 + j, name: 'item' + j, tags: [i, j] });
+    cache[i % cache.length] = items[i % items.length];
+    return items.length;
+  }
+)js";
+
+struct Request {
+  uint64_t latencyUs;
+  uint64_t gcUs;
+};
+
+static bool ExecuteCode(JSContext* cx, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("handler.js", 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+static bool RunRequests(JSContext* cx, JS::HandleObject global,
+                        const boilerplate::GCTelemetry* telemetry,
+                        unsigned count, std::vector<Request>* requests) {
+  JS::RootedValueArray<1> args(cx);
+  JS::RootedValue rval(cx);
+  for (unsigned i = 0; i < count; i++) {
+    uint64_t gcBefore = telemetry ? telemetry->pauseTimeUs() : 0;
+    Clock::time_point start = Clock::now();
+
+    args[0].setInt32(i);
+    if (!JS_CallFunctionName(cx, global, "handle", args, &rval)) return false;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+    uint64_t gcAfter = telemetry ? telemetry->pauseTimeUs() : 0;
+    requests->push_back({uint64_t(elapsed.count()), gcAfter - gcBefore});
+  }
+  return true;
+}
+
+static void OnGC(const boilerplate::GCTelemetry::Event& event, void* data) {
+  if (event.maxSliceUs < 10000) return;
+  printf("  slow %s GC (%s): %u slices, longest %.1f ms, "
+         "heap %.1f -> %.1f MB\n",
+         event.major ? "major" : "minor", JS::ExplainGCReason(event.reason),
+         event.slices, event.maxSliceUs / 1000.0,
+         event.bytesBefore / (1024.0 * 1024.0),
+         event.bytesAfter / (1024.0 * 1024.0));
+}
+
+static void PrintPauses(const char* kind,
+                        const boilerplate::Histogram& pauses) {
+  printf("  %-12s %8" PRIu64 "  p50 <= %6" PRIu64 " us  p99 <= %6" PRIu64
+         " us  max %7" PRIu64 " us\n",
+         kind, pauses.count(), pauses.percentile(0.5),
+         pauses.percentile(0.99), pauses.max());
+}
+
+static void Summarize(std::vector<Request>& requests,
+                      const boilerplate::GCTelemetry& telemetry) {
+  std::sort(requests.begin(), requests.end(),
+            [](const Request& a, const Request& b) {
+              return a.latencyUs < b.latencyUs;
+            });
+  size_t n = requests.size();
+  printf("%zu requests: p50 %" PRIu64 " us, p99 %" PRIu64 " us, max %" PRIu64
+         " us\n",
+         n, requests[n / 2].latencyUs, requests[n * 99 / 100].latencyUs,
+         requests.back().latencyUs);
+
+  uint64_t slowTotal = 0, slowGC = 0, slowWithGC = 0;
+  for (size_t i = n * 99 / 100; i < n; i++) {
+    slowTotal += requests[i].latencyUs;
+    slowGC += requests[i].gcUs;
+    if (requests[i].gcUs) slowWithGC++;
+  }
+  printf("slowest 1%%: %" PRIu64 " of %zu paused for GC, %.0f%% of their "
+         "time in GC\n",
+         slowWithGC, n - n * 99 / 100,
+         slowTotal ? 100.0 * slowGC / slowTotal : 0.0);
+
+  printf("GC pauses:\n");
+  PrintPauses("minor", telemetry.minorPauses());
+  PrintPauses("major slice", telemetry.majorSlices());
+  PrintPauses("major total", telemetry.majorPauses());
+  printf("  %" PRIu64 " of %" PRIu64 " major GCs incremental, %.1f ms "
+         "paused in total\n",
+         telemetry.incrementalCount(), telemetry.majorCount(),
+         telemetry.pauseTimeUs() / 1000.0);
+
+  printf("GC reasons:\n");
+  for (size_t i = 0; i < boilerplate::GCTelemetry::ReasonCount; i++) {
+    uint64_t count = telemetry.reasonCount(JS::GCReason(i));
+    if (count) {
+      printf("  %-24s %8" PRIu64 "\n", JS::ExplainGCReason(JS::GCReason(i)),
+             count);
+    }
+  }
+}
+
+static double TotalMs(const std::vector<Request>& requests) {
+  uint64_t total = 0;
+  for (const Request& request : requests) total += request.latencyUs;
+  return total / 1000.0;
+}
+
+// Run 'count' requests in a fresh global, after a full GC, with telemetry
+// installed if 'withTelemetry' is set, and add their total time to '*ms'.
+// Returns false with the error reported.
+static bool TimedRun(JSContext* cx, bool withTelemetry, unsigned count,
+                     double* ms) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+  if (!ExecuteCode(cx, handlerScript)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  JS_GC(cx);
+
+  std::vector<Request> requests;
+  requests.reserve(count);
+  bool ok;
+  if (withTelemetry) {
+    boilerplate::GCTelemetry telemetry(cx);
+    telemetry.install();
+    ok = RunRequests(cx, global, &telemetry, count, &requests);
+  } else {
+    ok = RunRequests(cx, global, nullptr, count, &requests);
+  }
+  if (!ok) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+
+  *ms += TotalMs(requests);
+  return true;
+}
+
+static bool MeasureOverhead(JSContext* cx) {
+  unsigned count = std::max(1u, requestCount / OverheadRounds);
+  double warmup = 0, on = 0, off = 0;
+  if (!TimedRun(cx, true, count, &warmup)) return false;
+
+  for (unsigned round = 0; round < OverheadRounds; round++) {
+    bool onFirst = round % 2 == 0;
+    if (!TimedRun(cx, onFirst, count, onFirst ? &on : &off) ||
+        !TimedRun(cx, !onFirst, count, onFirst ? &off : &on)) {
+      return false;
+    }
+  }
+
+  printf("telemetry overhead: %.1f ms with, %.1f ms without, %+.2f%%\n", on,
+         off, (on - off) / off * 100);
+  return true;
+}
+
+static bool GCPausesExample(JSContext* cx) {
+  {
+    JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+    if (!global) return false;
+
+    JSAutoRealm ar(cx, global);
+    if (!ExecuteCode(cx, handlerScript)) {
+      boilerplate::ReportAndClearException(cx);
+      return false;
+    }
+
+    std::vector<Request> requests;
+    requests.reserve(requestCount);
+
+    boilerplate::GCTelemetry telemetry(cx);
+    telemetry.setListener(OnGC);
+    telemetry.install();
+
+    if (!RunRequests(cx, global, &telemetry, requestCount, &requests)) {
+      boilerplate::ReportAndClearException(cx);
+      return false;
+    }
+    Summarize(requests, telemetry);
+  }
+
+  return MeasureOverhead(cx);
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) requestCount = atoi(argv[1]);
+  if (requestCount == 0) {
+    fprintf(stderr, "Usage: %s [REQUESTS]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(GCPausesExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <jsapi.h>
+#include <js/GCAPI.h>
+
+#include "gcprofile.h"
+
+// Named sets of garbage collector parameters. SpiderMonkey's defaults are tuned
+// for a web browser; an embedding usually knows better whether it cares most
+// about total throughput, about short pauses, or about a small heap.
+//
+// - "throughput": large nursery, non-incremental and non-compacting major GCs,
+//   and a heap allowed to grow quickly. Fewest and cheapest collections, at
+//   the cost of long pauses and a larger heap.
+// - "low-latency": small nursery, so that minor GCs are short, and incremental
+//   major GCs in 5 ms slices. Does more GC work overall.
+// - "low-memory": tiny nursery, frequent compacting collections, slow heap
+//   growth and no cached empty chunks.
+//
+// A profile can be applied to any context with ApplyGCProfile. Contexts created
+// by RunExample and NewChildContext get the profile named by the
+// BOILERPLATE_GC_PROFILE environment variable, if it is set.
+//
+// The parameters only affect the context's own runtime. Child contexts have
+// runtimes of their own, so each one can use a different profile.
+
+struct GCSetting {
+  JSGCParamKey key;
+  uint32_t value;
+};
+
+static const GCSetting throughputSettings[] = {
+    {JSGC_MAX_NURSERY_BYTES, 64 * 1024 * 1024},
+    {JSGC_MIN_NURSERY_BYTES, 16 * 1024 * 1024},
+    {JSGC_INCREMENTAL_GC_ENABLED, 0},
+    {JSGC_COMPACTING_ENABLED, 0},
+    {JSGC_ALLOCATION_THRESHOLD, 64},
+    {JSGC_LOW_FREQUENCY_HEAP_GROWTH, 300},
+};
+
+static const GCSetting lowLatencySettings[] = {
+    {JSGC_MAX_NURSERY_BYTES, 4 * 1024 * 1024},
+    {JSGC_MIN_NURSERY_BYTES, 1024 * 1024},
+    {JSGC_INCREMENTAL_GC_ENABLED, 1},
+    {JSGC_PER_ZONE_GC_ENABLED, 1},
+    {JSGC_SLICE_TIME_BUDGET_MS, 5},
+    {JSGC_COMPACTING_ENABLED, 0},
+    {JSGC_ALLOCATION_THRESHOLD, 30},
+};
+
+static const GCSetting lowMemorySettings[] = {
+    {JSGC_MAX_NURSERY_BYTES, 1024 * 1024},
+    {JSGC_MIN_NURSERY_BYTES, 256 * 1024},
+    {JSGC_INCREMENTAL_GC_ENABLED, 1},
+    {JSGC_PER_ZONE_GC_ENABLED, 1},
+    {JSGC_SLICE_TIME_BUDGET_MS, 10},
+    {JSGC_COMPACTING_ENABLED, 1},
+    {JSGC_ALLOCATION_THRESHOLD, 8},
+    {JSGC_LOW_FREQUENCY_HEAP_GROWTH, 120},
+    {JSGC_HIGH_FREQUENCY_LARGE_HEAP_GROWTH, 120},
+    {JSGC_HIGH_FREQUENCY_SMALL_HEAP_GROWTH, 150},
+    {JSGC_MAX_EMPTY_CHUNK_COUNT, 0},
+    {JSGC_MIN_EMPTY_CHUNK_COUNT, 0},
+};
+
+static const struct {
+  GCProfile profile;
+  const char* name;
+} profileNames[] = {
+    {GCProfile::Default, "default"},
+    {GCProfile::Throughput, "throughput"},
+    {GCProfile::LowLatency, "low-latency"},
+    {GCProfile::LowMemory, "low-memory"},
+};
+
+const char* boilerplate::GCProfileName(GCProfile profile) {
+  for (const auto& entry : profileNames) {
+    if (entry.profile == profile) return entry.name;
+  }
+  return "unknown";
+}
+
+// Look up a profile by the name used in BOILERPLATE_GC_PROFILE. Returns false
+// if there is no such profile.
+bool boilerplate::ParseGCProfile(const char* name, GCProfile* profile) {
+  for (const auto& entry : profileNames) {
+    if (strcmp(entry.name, name) == 0) {
+      *profile = entry.profile;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The profile named by BOILERPLATE_GC_PROFILE, or the default profile if the
+// variable is unset or names no profile.
+boilerplate::GCProfile boilerplate::GCProfileFromEnvironment() {
+  const char* name = getenv("BOILERPLATE_GC_PROFILE");
+  GCProfile profile = GCProfile::Default;
+  if (name && name[0] != '\0' && !ParseGCProfile(name, &profile)) {
+    fprintf(stderr, "Warning: unknown GC profile '%s', using default\n", name);
+  }
+  return profile;
+}
+
+// Every parameter that some profile changes. Here and in each profile's
+// settings, maximums are listed before minimums: resetting or setting them in
+// that order, starting from the defaults, never makes a minimum exceed its
+// maximum.
+static const JSGCParamKey profileKeys[] = {
+    JSGC_MAX_NURSERY_BYTES,
+    JSGC_MIN_NURSERY_BYTES,
+    JSGC_INCREMENTAL_GC_ENABLED,
+    JSGC_PER_ZONE_GC_ENABLED,
+    JSGC_SLICE_TIME_BUDGET_MS,
+    JSGC_COMPACTING_ENABLED,
+    JSGC_ALLOCATION_THRESHOLD,
+    JSGC_LOW_FREQUENCY_HEAP_GROWTH,
+    JSGC_HIGH_FREQUENCY_LARGE_HEAP_GROWTH,
+    JSGC_HIGH_FREQUENCY_SMALL_HEAP_GROWTH,
+    JSGC_MAX_EMPTY_CHUNK_COUNT,
+    JSGC_MIN_EMPTY_CHUNK_COUNT,
+};
+
+template <size_t N>
+static void ApplySettings(JSContext* cx, const GCSetting (&settings)[N]) {
+  for (const GCSetting& setting : settings) {
+    JS_SetGCParameter(cx, setting.key, setting.value);
+  }
+}
+
+// Set the GC parameters of the context's runtime. Best called right after the
+// context is created, before it has allocated much. Applying a different
+// profile later replaces the previous one entirely.
+void boilerplate::ApplyGCProfile(JSContext* cx, GCProfile profile) {
+  for (JSGCParamKey key : profileKeys) {
+    JS_ResetGCParameter(cx, key);
+  }
+
+  switch (profile) {
+    case GCProfile::Default:
+      break;
+    case GCProfile::Throughput:
+      ApplySettings(cx, throughputSettings);
+      break;
+    case GCProfile::LowLatency:
+      ApplySettings(cx, lowLatencySettings);
+      break;
+    case GCProfile::LowMemory:
+      ApplySettings(cx, lowMemorySettings);
+      break;
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef GCPROFILE_H_
+#define GCPROFILE_H_
+
+#include <jsapi.h>
+
+// See 'gcprofile.cpp' for documentation.
+
+namespace boilerplate {
+
+enum class GCProfile { Default, Throughput, LowLatency, LowMemory };
+
+const char* GCProfileName(GCProfile profile);
+
+bool ParseGCProfile(const char* name, GCProfile* profile);
+
+GCProfile GCProfileFromEnvironment();
+
+void ApplyGCProfile(JSContext* cx, GCProfile profile);
+
+}  // namespace boilerplate
+
+#endif  // GCPROFILE_H_
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/GCAPI.h>
+
+#include "boilerplate.h"
+#include "gcprofile.h"
+
+// This program runs an allocation-heavy script under each of the GC profiles
+// from 'gcprofile.cpp', and prints how long the script took next to the GC
+// pauses it suffered, to show the tradeoff between throughput and latency.
+//
+// Every profile runs in a fresh child context on a thread of its own, since GC
+// parameters belong to the runtime.
+//
+// Usage: gcprofiles [PROFILE...]
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps a sliding window of live objects, so that some survive long enough to
+// be tenured and have to be dealt with by major GCs.
+static const char* allocationScript = R"js(
+  const window = new Array(50000);
+  let checksum = 0;
+  for (let i = 0; i < 2000000; i++) {
+    const item = { id: i, name: 'item' + i, tags: [i, i + 1, i + 2] };
+    window[i % window.length] = item;
+    checksum = (checksum + item.tags.length + item.name.length) | 0;
+  }
+  checksum;
+)js";
+
+struct PauseStats {
+  std::vector<double> minor;
+  std::vector<double> major;
+  Clock::time_point minorStart;
+  Clock::time_point sliceStart;
+};
+
+static thread_local PauseStats* pauseStats;
+
+static double MillisSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+static void OnNurseryCollection(JSContext* cx, JS::GCNurseryProgress progress,
+                                JS::GCReason reason) {
+  if (progress == JS::GCNurseryProgress::GC_NURSERY_COLLECTION_START) {
+    pauseStats->minorStart = Clock::now();
+  } else {
+    pauseStats->minor.push_back(MillisSince(pauseStats->minorStart));
+  }
+}
+
+static void OnGCSlice(JSContext* cx, JS::GCProgress progress,
+                      const JS::GCDescription& desc) {
+  if (progress == JS::GC_SLICE_BEGIN) {
+    pauseStats->sliceStart = Clock::now();
+  } else if (progress == JS::GC_SLICE_END) {
+    pauseStats->major.push_back(MillisSince(pauseStats->sliceStart));
+  }
+}
+
+static bool RunScript(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("allocate.js", 1);
+
+  JS::RootedValue rval(cx);
+  if (!boilerplate::Evaluate(cx, options, allocationScript,
+                             strlen(allocationScript), &rval)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  return true;
+}
+
+static void Summarize(const char* kind, std::vector<double>& pauses) {
+  if (pauses.empty()) {
+    printf("  %-5s pauses: none\n", kind);
+    return;
+  }
+
+  std::sort(pauses.begin(), pauses.end());
+  double total = 0;
+  for (double ms : pauses) total += ms;
+  printf("  %-5s pauses: %6zu  total %8.2f ms  p50 %6.2f ms  p99 %6.2f ms  "
+         "max %7.2f ms\n",
+         kind, pauses.size(), total, pauses[pauses.size() / 2],
+         pauses[pauses.size() * 99 / 100], pauses.back());
+}
+
+static void RunProfile(JSRuntime* parentRuntime,
+                       boilerplate::GCProfile profile, bool* ok) {
+  JSContext* cx = boilerplate::NewChildContext(
+      parentRuntime, JS::DefaultHeapMaxBytes, profile);
+  if (!cx) {
+    *ok = false;
+    return;
+  }
+
+  PauseStats stats;
+  pauseStats = &stats;
+  JS::SetGCNurseryCollectionCallback(cx, OnNurseryCollection);
+  JS::SetGCSliceCallback(cx, OnGCSlice);
+
+  Clock::time_point start = Clock::now();
+  *ok = RunScript(cx);
+  double elapsed = MillisSince(start);
+  uint32_t heapBytes = JS_GetGCParameter(cx, JSGC_BYTES);
+
+  JS::SetGCSliceCallback(cx, nullptr);
+  JS::SetGCNurseryCollectionCallback(cx, nullptr);
+  JS_DestroyContext(cx);
+  pauseStats = nullptr;
+
+  printf("%-12s script %8.2f ms  final heap %6.1f MB\n",
+         boilerplate::GCProfileName(profile), elapsed,
+         heapBytes / (1024.0 * 1024.0));
+  Summarize("minor", stats.minor);
+  Summarize("major", stats.major);
+}
+
+static std::vector<boilerplate::GCProfile> profiles;
+
+static bool GCProfilesExample(JSContext* cx) {
+  for (boilerplate::GCProfile profile : profiles) {
+    bool ok;
+    std::thread thread(RunProfile, JS_GetRuntime(cx), profile, &ok);
+    thread.join();
+    if (!ok) return false;
+  }
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    boilerplate::GCProfile profile;
+    if (!boilerplate::ParseGCProfile(argv[i], &profile)) {
+      fprintf(stderr, "Unknown GC profile '%s'\n", argv[i]);
+      return 1;
+    }
+    profiles.push_back(profile);
+  }
+  if (profiles.empty()) {
+    profiles = {boilerplate::GCProfile::Default,
+                boilerplate::GCProfile::Throughput,
+                boilerplate::GCProfile::LowLatency,
+                boilerplate::GCProfile::LowMemory};
+  }
+
+  if (!boilerplate::RunExample(GCProfilesExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include <cinttypes>
+#include <string>
+
+#include <jsapi.h>
+#include <js/GCAPI.h>
+
+#include "gctelemetry.h"
+
+// GC telemetry for one JSContext, to tell whether a latency spike in a script
+// came from the garbage collector. It hooks the nursery collection and GC
+// slice callbacks and records every minor and major GC: its reason, how many
+// slices it took, the longest slice, the total pause and the time from start
+// to end, the GC heap size before and after, and whether it was incremental
+// (ran in more than one slice).
+//
+// Pause times go into three histograms, in microseconds: one for minor GCs,
+// one for each major GC slice, and one for the total pause of each major GC.
+// Like all Histograms they can be read from any thread, for p50/p99/max or to
+// be exported (see 'histogram.cpp'); so can the counters, including the total
+// time the context has spent paused. To find out how much of a call into
+// JS went to GC, compare 'pauseTimeUs' before and after it.
+//
+// The callbacks read a clock and update a few counters, and never allocate,
+// so the telemetry can stay on in production. A listener may be set to see
+// every GC as it ends, for example to log the slow ones; it is called from
+// inside the GC, so it must not run JS or allocate GC things.
+//
+// Usage:
+//
+//   boilerplate::GCTelemetry telemetry(cx);
+//   telemetry.install();
+//   ...
+//   uint64_t p99 = telemetry.majorSlices().percentile(0.99);
+//   telemetry.writeMetrics(stdout);
+//
+// NOTE: The slice and nursery callbacks hold one function per context, so the
+// ones installed before are called after the telemetry's own. The
+// JS_SetGCCallback slot is left for the embedding; the heap sizes are read in
+// the slice callback instead.
+
+namespace {
+// The telemetry installed on this thread's context.
+thread_local boilerplate::GCTelemetry* t_telemetry = nullptr;
+}  // namespace
+
+static uint64_t Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+static void Increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+}
+
+boilerplate::GCTelemetry::GCTelemetry(JSContext* cx) : m_cx(cx) {}
+
+boilerplate::GCTelemetry::~GCTelemetry() { uninstall(); }
+
+// Start recording. Must be called on the context's thread, which can have
+// only one GCTelemetry installed at a time.
+void boilerplate::GCTelemetry::install() {
+  if (m_installed) return;
+
+  t_telemetry = this;
+  m_previousNursery = JS::SetGCNurseryCollectionCallback(
+      m_cx, &GCTelemetry::OnNurseryCollection);
+  m_previousSlice = JS::SetGCSliceCallback(m_cx, &GCTelemetry::OnGCSlice);
+  m_installed = true;
+}
+
+void boilerplate::GCTelemetry::uninstall() {
+  if (!m_installed) return;
+
+  JS::SetGCSliceCallback(m_cx, m_previousSlice);
+  JS::SetGCNurseryCollectionCallback(m_cx, m_previousNursery);
+  if (t_telemetry == this) {
+    t_telemetry = nullptr;
+  }
+  m_installed = false;
+}
+
+void boilerplate::GCTelemetry::setListener(Listener listener, void* data) {
+  m_listener = listener;
+  m_listenerData = data;
+}
+
+uint64_t boilerplate::GCTelemetry::heapBytes() const {
+  return JS_GetGCParameter(m_cx, JSGC_BYTES);
+}
+
+void boilerplate::GCTelemetry::OnNurseryCollection(
+    JSContext* cx, JS::GCNurseryProgress progress, JS::GCReason reason) {
+  GCTelemetry* self = t_telemetry;
+  if (self && self->m_cx == cx) {
+    if (progress == JS::GCNurseryProgress::GC_NURSERY_COLLECTION_START) {
+      self->m_minor = Event();
+      self->m_minor.reason = reason;
+      self->m_minor.bytesBefore = self->heapBytes();
+      self->m_minorStart = Clock::now();
+    } else {
+      uint64_t us = Microseconds(Clock::now() - self->m_minorStart);
+      self->m_minor.slices = 1;
+      self->m_minor.pauseUs = us;
+      self->m_minor.maxSliceUs = us;
+      self->m_minor.durationUs = us;
+      self->m_minor.bytesAfter = self->heapBytes();
+
+      self->m_minorPauses.record(us);
+      // Inside a major slice, the time is counted as part of the slice.
+      if (!self->m_inSlice) {
+        Increment(self->m_pauseTime, us);
+      }
+      self->finish(self->m_minor);
+    }
+  }
+
+  if (self && self->m_previousNursery) {
+    self->m_previousNursery(cx, progress, reason);
+  }
+}
+
+void boilerplate::GCTelemetry::OnGCSlice(JSContext* cx,
+                                         JS::GCProgress progress,
+                                         const JS::GCDescription& desc) {
+  GCTelemetry* self = t_telemetry;
+  if (self && self->m_cx == cx) {
+    Clock::time_point now = Clock::now();
+    Event& major = self->m_major;
+
+    switch (progress) {
+      case JS::GC_CYCLE_BEGIN:
+        major = Event();
+        major.major = true;
+        major.reason = desc.reason_;
+        major.bytesBefore = self->heapBytes();
+        self->m_majorStart = now;
+        break;
+
+      case JS::GC_SLICE_BEGIN:
+        self->m_sliceStart = now;
+        self->m_inSlice = true;
+        break;
+
+      case JS::GC_SLICE_END: {
+        uint64_t us = Microseconds(now - self->m_sliceStart);
+        major.slices++;
+        major.pauseUs += us;
+        if (us > major.maxSliceUs) major.maxSliceUs = us;
+        self->m_inSlice = false;
+
+        self->m_majorSlices.record(us);
+        Increment(self->m_pauseTime, us);
+        break;
+      }
+
+      case JS::GC_CYCLE_END:
+        major.durationUs = Microseconds(now - self->m_majorStart);
+        major.incremental = major.slices > 1;
+        major.bytesAfter = self->heapBytes();
+
+        self->m_majorPauses.record(major.pauseUs);
+        if (major.incremental) {
+          Increment(self->m_incremental, 1);
+        }
+        self->finish(major);
+        break;
+    }
+  }
+
+  if (self && self->m_previousSlice) {
+    self->m_previousSlice(cx, progress, desc);
+  }
+}
+
+void boilerplate::GCTelemetry::finish(const Event& event) {
+  Increment(m_reasons[size_t(event.reason)], 1);
+  if (m_listener) {
+    m_listener(event, m_listenerData);
+  }
+}
+
+// Write the counters and histograms in the Prometheus text exposition format,
+// with GC reasons as labels.
+void boilerplate::GCTelemetry::writeMetrics(FILE* out,
+                                            const char* prefix) const {
+  std::string name(prefix);
+
+  fprintf(out, "# HELP %s_total Garbage collections, by reason\n", prefix);
+  fprintf(out, "# TYPE %s_total counter\n", prefix);
+  for (size_t i = 0; i < ReasonCount; i++) {
+    uint64_t count = m_reasons[i].load(std::memory_order_relaxed);
+    if (count) {
+      fprintf(out, "%s_total{reason=\"%s\"} %" PRIu64 "\n", prefix,
+              JS::ExplainGCReason(JS::GCReason(i)), count);
+    }
+  }
+
+  fprintf(out, "# HELP %s_incremental_total Major GCs run in slices\n",
+          prefix);
+  fprintf(out, "# TYPE %s_incremental_total counter\n", prefix);
+  fprintf(out, "%s_incremental_total %" PRIu64 "\n", prefix,
+          incrementalCount());
+
+  fprintf(out, "# HELP %s_pause_microseconds_total Time spent in GC pauses\n",
+          prefix);
+  fprintf(out, "# TYPE %s_pause_microseconds_total counter\n", prefix);
+  fprintf(out, "%s_pause_microseconds_total %" PRIu64 "\n", prefix,
+          pauseTimeUs());
+
+  m_minorPauses.writePrometheus(out, (name + "_minor_microseconds").c_str(),
+                                "Pause of each minor GC");
+  m_majorSlices.writePrometheus(out,
+                                (name + "_slice_microseconds").c_str(),
+                                "Pause of each major GC slice");
+  m_majorPauses.writePrometheus(out, (name + "_major_microseconds").c_str(),
+                                "Total pause of each major GC");
+}
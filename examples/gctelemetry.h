@@ -0,0 +1,103 @@
+#ifndef GCTELEMETRY_H_
+#define GCTELEMETRY_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <jsapi.h>
+#include <js/GCAPI.h>
+
+#include "histogram.h"
+
+// See 'gctelemetry.cpp' for documentation.
+
+namespace boilerplate {
+
+class GCTelemetry {
+ public:
+  struct Event {
+    bool major = false;
+    bool incremental = false;
+    JS::GCReason reason = JS::GCReason::NO_REASON;
+    unsigned slices = 0;
+    uint64_t pauseUs = 0;
+    uint64_t maxSliceUs = 0;
+    uint64_t durationUs = 0;
+    uint64_t bytesBefore = 0;
+    uint64_t bytesAfter = 0;
+  };
+
+  using Listener = void (*)(const Event& event, void* data);
+
+  static constexpr size_t ReasonCount = size_t(JS::GCReason::NUM_REASONS);
+
+  explicit GCTelemetry(JSContext* cx);
+  ~GCTelemetry();
+
+  GCTelemetry(const GCTelemetry&) = delete;
+  GCTelemetry& operator=(const GCTelemetry&) = delete;
+
+  void install();
+  void uninstall();
+
+  void setListener(Listener listener, void* data = nullptr);
+
+  const Histogram& minorPauses() const { return m_minorPauses; }
+  const Histogram& majorSlices() const { return m_majorSlices; }
+  const Histogram& majorPauses() const { return m_majorPauses; }
+
+  uint64_t minorCount() const { return m_minorPauses.count(); }
+  uint64_t majorCount() const { return m_majorPauses.count(); }
+  uint64_t incrementalCount() const {
+    return m_incremental.load(std::memory_order_relaxed);
+  }
+  uint64_t pauseTimeUs() const {
+    return m_pauseTime.load(std::memory_order_relaxed);
+  }
+  uint64_t reasonCount(JS::GCReason reason) const {
+    return m_reasons[size_t(reason)].load(std::memory_order_relaxed);
+  }
+
+  void writeMetrics(FILE* out, const char* prefix = "js_gc") const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  static void OnNurseryCollection(JSContext* cx,
+                                  JS::GCNurseryProgress progress,
+                                  JS::GCReason reason);
+  static void OnGCSlice(JSContext* cx, JS::GCProgress progress,
+                        const JS::GCDescription& desc);
+
+  void finish(const Event& event);
+  uint64_t heapBytes() const;
+
+  JSContext* m_cx;
+  bool m_installed = false;
+  JS::GCNurseryCollectionCallback m_previousNursery = nullptr;
+  JS::GCSliceCallback m_previousSlice = nullptr;
+  Listener m_listener = nullptr;
+  void* m_listenerData = nullptr;
+
+  // The collections in progress. A minor GC may run inside a major slice.
+  Event m_minor;
+  Event m_major;
+  Clock::time_point m_minorStart;
+  Clock::time_point m_majorStart;
+  Clock::time_point m_sliceStart;
+  bool m_inSlice = false;
+
+  Histogram m_minorPauses;
+  Histogram m_majorSlices;
+  Histogram m_majorPauses;
+  std::atomic<uint64_t> m_incremental{0};
+  std::atomic<uint64_t> m_pauseTime{0};
+  std::atomic<uint64_t> m_reasons[ReasonCount] = {};
+};
+
+}  // namespace boilerplate
+
+#endif  // GCTELEMETRY_H_
@@ -0,0 +1,157 @@
+#include <cstring>
+
+#include <jsapi.h>
+#include <jsfriendapi.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/GCAPI.h>
+#include <js/SourceText.h>
+#include <js/experimental/JSStencil.h>
+
+#include "globaltemplate.h"
+
+// A factory for globals that all look the same. Embeddings that want a fresh
+// global per request, so that one request cannot see what the previous one
+// left behind, would otherwise repeat the whole setup done in examples such as
+// 'RunCookbook' for every request: create the global, define the native
+// functions, initialize the embedder classes, and parse and run a bootstrap
+// script.
+//
+// The template captures that recipe once. The bootstrap script is compiled to
+// a JS::Stencil a single time, and each new global instantiates the stencil
+// instead of parsing the source again. All globals stamped out by one template
+// are also created in a single shared zone, which makes creating a realm
+// cheaper and lets the GC reclaim released realms with a zone GC that does not
+// touch the rest of the heap.
+//
+// Usage:
+//
+//   boilerplate::GlobalTemplate tmpl;
+//   tmpl.setFunctions(globalFunctions);
+//   tmpl.addClass(DefineMyClass);
+//   tmpl.setBootstrap("bootstrap.js", bootstrapSource);
+//   if (!tmpl.init(cx)) ...
+//
+//   // per request:
+//   {
+//     JS::RootedObject global(cx, tmpl.newGlobal(cx));
+//     JSAutoRealm ar(cx, global);
+//     ...
+//   }
+//   tmpl.release(cx);
+//
+// NOTE: The template holds GC things, so 'reset()' must be called before the
+// context is destroyed if the template outlives it.
+
+// 'clasp' is the class of the globals that will be created. It must have
+// JSCLASS_GLOBAL_FLAGS.
+boilerplate::GlobalTemplate::GlobalTemplate(const JSClass* clasp)
+    : m_clasp(clasp) {}
+
+// The bootstrap script runs in every new global after the functions and
+// classes have been defined. Both strings must outlive the template.
+void boilerplate::GlobalTemplate::setBootstrap(const char* filename,
+                                               const char* source) {
+  m_bootstrapFilename = filename;
+  m_bootstrapSource = source;
+}
+
+// Do the one-time work: create the global that anchors the shared zone, and
+// compile the bootstrap script. Must be called before 'newGlobal'.
+bool boilerplate::GlobalTemplate::init(JSContext* cx) {
+  // The anchor is never handed out, so it uses the plain boilerplate class
+  // rather than one that might expect private data to be set up.
+  JS::RealmOptions options;
+  m_zoneAnchor.init(cx, JS_NewGlobalObject(cx, &boilerplate::GlobalClass,
+                                           nullptr, JS::FireOnNewGlobalHook,
+                                           options));
+  if (!m_zoneAnchor) {
+    return false;
+  }
+
+  if (!m_bootstrapSource) {
+    return true;
+  }
+
+  JSAutoRealm ar(cx, m_zoneAnchor);
+
+  JS::CompileOptions compileOptions(cx);
+  compileOptions.setFileAndLine(m_bootstrapFilename, 1);
+
+  JS::SourceText<mozilla::Utf8Unit> source;
+  if (!source.init(cx, m_bootstrapSource, strlen(m_bootstrapSource),
+                   JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  m_bootstrap = JS::CompileGlobalScriptToStencil(cx, compileOptions, source);
+  return !!m_bootstrap;
+}
+
+// Create a new, fully set up global. Returns nullptr with an exception pending
+// on failure.
+JSObject* boilerplate::GlobalTemplate::newGlobal(JSContext* cx) {
+  JS::RealmOptions options;
+  options.creationOptions().setNewCompartmentInExistingZone(m_zoneAnchor);
+
+  JS::Rooted<JSObject*> global(
+      cx, JS_NewGlobalObject(cx, m_clasp, nullptr, JS::FireOnNewGlobalHook,
+                             options));
+  if (!global) {
+    return nullptr;
+  }
+
+  JSAutoRealm ar(cx, global);
+
+  if (m_functions && !JS_DefineFunctions(cx, global, m_functions)) {
+    return nullptr;
+  }
+
+  for (ClassInit init : m_classes) {
+    if (!init(cx, global)) {
+      return nullptr;
+    }
+  }
+
+  if (m_bootstrap && !runBootstrap(cx)) {
+    return nullptr;
+  }
+
+  return global;
+}
+
+bool boilerplate::GlobalTemplate::runBootstrap(JSContext* cx) {
+  // The instantiate options must agree with the options the stencil was
+  // compiled with.
+  JS::CompileOptions compileOptions(cx);
+  compileOptions.setFileAndLine(m_bootstrapFilename, 1);
+  JS::InstantiateOptions instantiateOptions(compileOptions);
+
+  JS::Rooted<JSScript*> script(
+      cx, JS::InstantiateGlobalStencil(cx, instantiateOptions, m_bootstrap));
+  if (!script) {
+    return false;
+  }
+
+  JS::Rooted<JS::Value> rval(cx);
+  return JS_ExecuteScript(cx, script, &rval);
+}
+
+// Tell the template that the caller has dropped its last reference to a
+// global it created. Every 'collectInterval' releases, the shared zone is
+// collected so that the memory held by dead realms is given back promptly,
+// instead of whenever the GC next decides to look at that zone.
+void boilerplate::GlobalTemplate::release(JSContext* cx) {
+  if (++m_released < m_collectInterval) {
+    return;
+  }
+  m_released = 0;
+
+  JS::PrepareZoneForGC(cx, js::GetObjectZoneFromAnyThread(m_zoneAnchor));
+  JS::NonIncrementalGC(cx, JS::GCOptions::Normal, JS::GCReason::API);
+}
+
+// Drop the compiled bootstrap and the zone anchor.
+void boilerplate::GlobalTemplate::reset() {
+  m_bootstrap = nullptr;
+  m_zoneAnchor.reset();
+}
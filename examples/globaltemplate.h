@@ -0,0 +1,56 @@
+#ifndef GLOBALTEMPLATE_H_
+#define GLOBALTEMPLATE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/experimental/JSStencil.h>
+
+#include <mozilla/RefPtr.h>
+
+#include "boilerplate.h"
+
+// See 'globaltemplate.cpp' for documentation.
+
+namespace boilerplate {
+
+class GlobalTemplate {
+ public:
+  using ClassInit = bool (*)(JSContext*, JS::HandleObject);
+
+  explicit GlobalTemplate(const JSClass* clasp = &GlobalClass);
+
+  GlobalTemplate(const GlobalTemplate&) = delete;
+  GlobalTemplate& operator=(const GlobalTemplate&) = delete;
+
+  void setFunctions(const JSFunctionSpec* functions) {
+    m_functions = functions;
+  }
+  void addClass(ClassInit init) { m_classes.push_back(init); }
+  void setBootstrap(const char* filename, const char* source);
+  void setCollectInterval(size_t interval) { m_collectInterval = interval; }
+
+  bool init(JSContext* cx);
+  JSObject* newGlobal(JSContext* cx);
+  void release(JSContext* cx);
+  void reset();
+
+ private:
+  bool runBootstrap(JSContext* cx);
+
+  const JSClass* m_clasp;
+  const JSFunctionSpec* m_functions = nullptr;
+  std::vector<ClassInit> m_classes;
+  const char* m_bootstrapFilename = nullptr;
+  const char* m_bootstrapSource = nullptr;
+  size_t m_collectInterval = 64;
+  size_t m_released = 0;
+
+  RefPtr<JS::Stencil> m_bootstrap;
+  JS::PersistentRooted<JSObject*> m_zoneAnchor;
+};
+
+}  // namespace boilerplate
+
+#endif  // GLOBALTEMPLATE_H_
@@ -1,8 +1,7 @@
 #include <cstdio>
 
 #include <jsapi.h>
-#include <js/CompilationAndEvaluation.h>
-#include <js/SourceText.h>
+#include <js/CompileOptions.h>
 
 #include "boilerplate.h"
 
@@ -21,14 +20,11 @@ static bool ExecuteCodePrintResult(JSContext* cx, const char* code) {
   JS::CompileOptions options(cx);
   options.setFileAndLine("noname", 1);
 
-  JS::SourceText<mozilla::Utf8Unit> source;
-  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
+  JS::RootedValue rval(cx);
+  if (!boilerplate::Evaluate(cx, options, code, strlen(code), &rval)) {
     return false;
   }
 
-  JS::RootedValue rval(cx);
-  if (!JS::Evaluate(cx, options, source, &rval)) return false;
-
   // There are many ways to display an arbitrary value as a result. In this
   // case, we know that the value is an ASCII string because of the expression
   // that we executed, so we can just print the string directly.
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cinttypes>
+
+#include <mozilla/MathAlgorithms.h>
+
+#include "histogram.h"
+
+// A histogram of integer values, such as durations in microseconds, with
+// power-of-two buckets. Bucket 0 counts zeroes, and bucket i counts values from
+// 2^(i-1) up to 2^i - 1, with the last bucket taking everything larger.
+// Recording is a handful of instructions and never allocates.
+//
+// A histogram is written to by a single thread, but may be read from any
+// thread, for example to serve the metrics to a monitoring system. The
+// counters are read one at a time, so a reader may see a count that is a few
+// values behind the buckets.
+//
+// Usage:
+//
+//   boilerplate::Histogram latency;
+//   latency.record(microseconds);
+//
+//   latency.writePrometheus(stdout, "myapp_latency_microseconds",
+//                           "Time from request to response");
+
+static void Increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+}
+
+void boilerplate::Histogram::record(uint64_t value) {
+  size_t index = value == 0 ? 0 : 64 - mozilla::CountLeadingZeroes64(value);
+  if (index >= BucketCount) index = BucketCount - 1;
+
+  Increment(m_buckets[index], 1);
+  Increment(m_count, 1);
+  Increment(m_sum, value);
+  if (value > m_max.load(std::memory_order_relaxed)) {
+    m_max.store(value, std::memory_order_relaxed);
+  }
+}
+
+void boilerplate::Histogram::reset() {
+  for (std::atomic<uint64_t>& bucket : m_buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  m_count.store(0, std::memory_order_relaxed);
+  m_sum.store(0, std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+// The largest value counted in bucket 'i'. The last bucket has no limit.
+uint64_t boilerplate::Histogram::BucketLimit(size_t i) {
+  if (i >= BucketCount - 1) return UINT64_MAX;
+  return (uint64_t(1) << i) - 1;
+}
+
+// An upper bound for the given fraction (0.5 for the median, 0.99 for the 99th
+// percentile) of the recorded values, accurate to within a factor of two.
+uint64_t boilerplate::Histogram::percentile(double fraction) const {
+  uint64_t total = count();
+  if (total == 0) return 0;
+
+  uint64_t wanted = uint64_t(fraction * total);
+  if (wanted >= total) wanted = total - 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BucketCount; i++) {
+    seen += bucket(i);
+    if (seen > wanted) return std::min(BucketLimit(i), max());
+  }
+  return max();
+}
+
+// Write the histogram in the Prometheus text exposition format. Empty buckets
+// past the largest value are left out.
+void boilerplate::Histogram::writePrometheus(FILE* out, const char* name,
+                                             const char* help) const {
+  fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+  uint64_t cumulative = 0;
+  uint64_t largest = max();
+  for (size_t i = 0; i < BucketCount - 1; i++) {
+    cumulative += bucket(i);
+    fprintf(out, "%s_bucket{le=\"%" PRIu64 "\"} %" PRIu64 "\n", name,
+            BucketLimit(i), cumulative);
+    if (BucketLimit(i) >= largest) break;
+  }
+  fprintf(out, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, count());
+  fprintf(out, "%s_sum %" PRIu64 "\n%s_count %" PRIu64 "\n", name, sum(), name,
+          count());
+}
@@ -0,0 +1,48 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// See 'histogram.cpp' for documentation.
+
+namespace boilerplate {
+
+class Histogram {
+ public:
+  static constexpr size_t BucketCount = 40;
+
+  Histogram() { reset(); }
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void record(uint64_t value);
+  void reset();
+
+  uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+  uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+  uint64_t bucket(size_t i) const {
+    return m_buckets[i].load(std::memory_order_relaxed);
+  }
+  static uint64_t BucketLimit(size_t i);
+
+  uint64_t percentile(double fraction) const;
+
+  void writePrometheus(FILE* out, const char* name, const char* help) const;
+
+ private:
+  // Only one thread records, so these are updated with plain loads and
+  // stores; they are atomic so that other threads can read them.
+  std::atomic<uint64_t> m_buckets[BucketCount];
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_sum;
+  std::atomic<uint64_t> m_max;
+};
+
+}  // namespace boilerplate
+
+#endif  // HISTOGRAM_H_
@@ -0,0 +1,205 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <jsapi.h>
+
+#include "jitprofile.h"
+
+// JIT profiles: sets of SpiderMonkey's JIT compiler options, stored in a file
+// so that they can be tuned for a workload once and then used by every run.
+//
+// By default a function is interpreted, compiled by the Baseline JIT after 100
+// calls or loop iterations, and compiled by Ion, the optimizing JIT, after
+// 1500. These thresholds suit long-lived web pages. Scripts that run for a
+// few milliseconds may never reach Ion and pay for Baseline compilation that
+// never pays off, or may be better off tiering up much earlier. 'jittuning.cpp'
+// runs a corpus of scripts under a matrix of options and writes the fastest
+// set to a profile.
+//
+// A profile is a text file with one option per line, using the names that
+// SpiderMonkey's shell and setJitCompilerOption() use:
+//
+//   # Short-lived scripts: tier up early.
+//   baseline.warmup.trigger = 10
+//   ion.warmup.trigger = 500
+//
+// Some useful options:
+//
+// - "blinterp.warmup.trigger", "baseline.warmup.trigger",
+//   "ion.warmup.trigger": the warm-up counts at which a function moves to the
+//   Baseline interpreter, the Baseline JIT and Ion.
+// - "blinterp.enable", "baseline.enable", "ion.enable": turn a tier on or off.
+//   With all three set to 0, scripts only run in the C++ interpreter, which
+//   starts fastest and uses least memory, but runs hot code slowest.
+// - "offthread-compilation.enable": whether Ion compiles on helper threads.
+// - "jit_trustedprincipals.enable": whether the JITs are used for realms with
+//   trusted (system) principals. The globals made by CreateGlobal have none,
+//   so this only matters to embeddings that create such realms.
+//
+// RunExample applies the profile named by the BOILERPLATE_JIT_PROFILE
+// environment variable, if it is set, to the context it creates.
+//
+// NOTE: Despite being set through a context, these options are global to the
+// process: they apply to every context, including those of other threads.
+// That is why the profile is applied once, to the main context, before any
+// other thread can be running JS. Options that turn a JIT tier on or off also
+// throw away the context's existing JIT code.
+
+static const struct {
+  JSJitCompilerOption option;
+  const char* name;
+} optionNames[] = {
+#define JIT_OPTION_NAME(key, string) {JSJITCOMPILER_##key, string},
+    JIT_COMPILER_OPTIONS(JIT_OPTION_NAME)
+#undef JIT_OPTION_NAME
+};
+
+const char* boilerplate::JitOptionName(JSJitCompilerOption option) {
+  for (const auto& entry : optionNames) {
+    if (entry.option == option) return entry.name;
+  }
+  return "unknown";
+}
+
+// Look up an option by the name used in profiles. Returns false if there is no
+// such option.
+bool boilerplate::ParseJitOption(const char* name,
+                                 JSJitCompilerOption* option) {
+  for (const auto& entry : optionNames) {
+    if (strcmp(entry.name, name) == 0) {
+      *option = entry.option;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Set an option in 'profile', replacing any value it already had.
+void boilerplate::SetJitOption(JitProfile* profile, JSJitCompilerOption option,
+                               uint32_t value) {
+  for (JitSetting& setting : *profile) {
+    if (setting.option == option) {
+      setting.value = value;
+      return;
+    }
+  }
+  profile->push_back({option, value});
+}
+
+// Read the current values of some options into 'profile', for instance to
+// restore them later. Returns false if an option cannot be read; SpiderMonkey
+// only reports the values of some of them.
+bool boilerplate::GetJitOptions(JSContext* cx,
+                                const JSJitCompilerOption* options,
+                                size_t count, JitProfile* profile) {
+  for (size_t i = 0; i < count; i++) {
+    uint32_t value;
+    if (!JS_GetGlobalJitCompilerOption(cx, options[i], &value)) {
+      fprintf(stderr, "Cannot read JIT option %s\n",
+              JitOptionName(options[i]));
+      return false;
+    }
+    SetJitOption(profile, options[i], value);
+  }
+  return true;
+}
+
+static std::string Trim(const std::string& str) {
+  size_t start = str.find_first_not_of(" \t\r");
+  if (start == std::string::npos) return "";
+  size_t end = str.find_last_not_of(" \t\r");
+  return str.substr(start, end - start + 1);
+}
+
+// Read a profile from 'path'. Prints an error and returns false if the file
+// cannot be read or has a line that is not "name = value" for a known option.
+// A later line for the same option replaces the earlier one.
+bool boilerplate::ReadJitProfile(const char* path, JitProfile* profile) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "Cannot read JIT profile %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+
+  JitProfile result;
+  std::string line;
+  for (unsigned lineno = 1; std::getline(in, line); lineno++) {
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+
+    size_t equals = line.find('=');
+    std::string name = Trim(line.substr(0, equals));
+    std::string value =
+        equals == std::string::npos ? "" : Trim(line.substr(equals + 1));
+
+    JSJitCompilerOption option;
+    if (!ParseJitOption(name.c_str(), &option)) {
+      fprintf(stderr, "%s:%u: unknown JIT option '%s'\n", path, lineno,
+              name.c_str());
+      return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long number = strtoul(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0' || errno != 0 || number > UINT32_MAX) {
+      fprintf(stderr, "%s:%u: bad value '%s' for %s\n", path, lineno,
+              value.c_str(), name.c_str());
+      return false;
+    }
+
+    SetJitOption(&result, option, number);
+  }
+
+  *profile = std::move(result);
+  return true;
+}
+
+// Write 'profile' to 'path' in the format ReadJitProfile reads, after
+// 'comment', if given, as a comment line.
+bool boilerplate::WriteJitProfile(const char* path, const JitProfile& profile,
+                                  const char* comment) {
+  FILE* out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "Cannot write JIT profile %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+
+  if (comment) fprintf(out, "# %s\n", comment);
+  for (const JitSetting& setting : profile) {
+    fprintf(out, "%s = %u\n", JitOptionName(setting.option), setting.value);
+  }
+
+  if (fclose(out) != 0) {
+    fprintf(stderr, "Cannot write JIT profile %s\n", path);
+    return false;
+  }
+  return true;
+}
+
+// Set the options in 'profile', in order. Options it does not mention keep
+// their current values.
+void boilerplate::ApplyJitProfile(JSContext* cx, const JitProfile& profile) {
+  for (const JitSetting& setting : profile) {
+    JS_SetGlobalJitCompilerOption(cx, setting.option, setting.value);
+  }
+}
+
+// Apply the profile in the file named by BOILERPLATE_JIT_PROFILE, if the
+// variable is set. Returns false if the file cannot be read.
+bool boilerplate::ApplyJitProfileFromEnvironment(JSContext* cx) {
+  const char* path = getenv("BOILERPLATE_JIT_PROFILE");
+  if (!path || path[0] == '\0') return true;
+
+  JitProfile profile;
+  if (!ReadJitProfile(path, &profile)) return false;
+
+  ApplyJitProfile(cx, profile);
+  return true;
+}
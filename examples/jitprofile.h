@@ -0,0 +1,41 @@
+#ifndef JITPROFILE_H_
+#define JITPROFILE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <jsapi.h>
+
+// See 'jitprofile.cpp' for documentation.
+
+namespace boilerplate {
+
+struct JitSetting {
+  JSJitCompilerOption option;
+  uint32_t value;
+};
+
+using JitProfile = std::vector<JitSetting>;
+
+const char* JitOptionName(JSJitCompilerOption option);
+
+bool ParseJitOption(const char* name, JSJitCompilerOption* option);
+
+void SetJitOption(JitProfile* profile, JSJitCompilerOption option,
+                  uint32_t value);
+
+bool GetJitOptions(JSContext* cx, const JSJitCompilerOption* options,
+                   size_t count, JitProfile* profile);
+
+bool ReadJitProfile(const char* path, JitProfile* profile);
+
+bool WriteJitProfile(const char* path, const JitProfile& profile,
+                     const char* comment = nullptr);
+
+void ApplyJitProfile(JSContext* cx, const JitProfile& profile);
+
+bool ApplyJitProfileFromEnvironment(JSContext* cx);
+
+}  // namespace boilerplate
+
+#endif  // JITPROFILE_H_
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/GCAPI.h>
+
+#include "boilerplate.h"
+#include "jitprofile.h"
+
+// This program tunes SpiderMonkey's JIT options for a corpus of short-lived
+// scripts: the given JavaScript files, or a built-in corpus. It runs the
+// corpus under each configuration in a matrix of Baseline and Ion warm-up
+// thresholds, plus interpreter-only and Baseline-interpreter-only modes, and
+// prints the throughput and latency of each one.
+//
+// Every request evaluates one script of the corpus in a fresh global, as a
+// server running untrusted snippets would, so no JIT code survives from one
+// request to the next.
+//
+// The winning configuration is the one with the highest throughput among
+// those whose 99th percentile latency is within 10% of the best. It is written
+// to OUTPUT as a JIT profile (see 'jitprofile.cpp'), which any example loads
+// when the BOILERPLATE_JIT_PROFILE environment variable names it:
+//
+//   jittuning jit.profile app/*.js
+//   BOILERPLATE_JIT_PROFILE=jit.profile _build/pool
+//
+// Usage: jittuning [OUTPUT [FILE.js...]]
+
+using Clock = std::chrono::steady_clock;
+
+static const char* outputPath = "jit.profile";
+static std::vector<std::string> files;
+
+// How many times each configuration runs the whole corpus.
+static const unsigned Rounds = 40;
+
+struct Script {
+  std::string filename;
+  std::string source;
+};
+
+// The built-in corpus: a few milliseconds of templating, JSON processing and
+// arithmetic each, with loops that are hot enough for Baseline but only some
+// of them for Ion with the default thresholds.
+static const std::vector<Script> corpus = {
+    {"template.js", R"js(
+      const rows = Array.from({length: 300}, (_, i) => ({
+        id: i, name: 'user' + i, score: (i * 37) % 101,
+      }));
+      function row(r) {
+        return `<tr><td>${r.id}</td><td>${r.name}</td>` +
+               `<td class="${r.score > 50 ? 'hi' : 'lo'}">${r.score}</td></tr>`;
+      }
+      '<table>' + rows.map(row).join('') + '</table>';
+    )js"},
+    {"json.js", R"js(
+      const items = [];
+      for (let i = 0; i < 500; i++)
+        items.push({id: i, tags: ['a' + i % 7, 'b' + i % 3], price: i * 1.5});
+      const parsed = JSON.parse(JSON.stringify(items));
+      const byTag = {};
+      for (const item of parsed) {
+        for (const tag of item.tags)
+          byTag[tag] = (byTag[tag] || 0) + item.price;
+      }
+      JSON.stringify(byTag);
+    )js"},
+    {"checksum.js", R"js(
+      function crc(data) {
+        let c = -1;
+        for (let i = 0; i < data.length; i++) {
+          c ^= data[i];
+          for (let k = 0; k < 8; k++) c = (c >>> 1) ^ (0xedb88320 & -(c & 1));
+        }
+        return ~c >>> 0;
+      }
+      const data = new Uint8Array(4096);
+      for (let i = 0; i < data.length; i++) data[i] = (i * 131) & 0xff;
+      crc(data);
+    )js"},
+};
+
+static bool LoadScripts(std::vector<Script>* scripts) {
+  if (files.empty()) {
+    *scripts = corpus;
+    return true;
+  }
+
+  for (const std::string& filename : files) {
+    std::ifstream in(filename);
+    if (!in) {
+      fprintf(stderr, "Cannot read %s\n", filename.c_str());
+      return false;
+    }
+    std::ostringstream source;
+    source << in.rdbuf();
+    scripts->push_back({filename, source.str()});
+  }
+  return true;
+}
+
+// The options the matrix varies. Every configuration sets all of them, so
+// the profile it writes does not depend on SpiderMonkey's defaults.
+static const JSJitCompilerOption tunedOptions[] = {
+    JSJITCOMPILER_BASELINE_INTERPRETER_ENABLE,
+    JSJITCOMPILER_BASELINE_ENABLE,
+    JSJITCOMPILER_ION_ENABLE,
+    JSJITCOMPILER_BASELINE_WARMUP_TRIGGER,
+    JSJITCOMPILER_ION_NORMAL_WARMUP_TRIGGER,
+};
+
+struct Configuration {
+  std::string name;
+  boilerplate::JitProfile profile;
+
+  double requestsPerSecond = 0;
+  double p50Us = 0;
+  double p99Us = 0;
+};
+
+static uint32_t DefaultValue(const boilerplate::JitProfile& defaults,
+                             JSJitCompilerOption option) {
+  for (const boilerplate::JitSetting& setting : defaults) {
+    if (setting.option == option) return setting.value;
+  }
+  return 0;
+}
+
+static std::vector<Configuration> MakeMatrix(
+    const boilerplate::JitProfile& defaults) {
+  std::vector<Configuration> matrix;
+
+  Configuration interpreter{"interpreter only", defaults};
+  boilerplate::SetJitOption(&interpreter.profile,
+                            JSJITCOMPILER_BASELINE_INTERPRETER_ENABLE, 0);
+  boilerplate::SetJitOption(&interpreter.profile,
+                            JSJITCOMPILER_BASELINE_ENABLE, 0);
+  boilerplate::SetJitOption(&interpreter.profile, JSJITCOMPILER_ION_ENABLE,
+                            0);
+  matrix.push_back(interpreter);
+
+  Configuration blinterp{"baseline interpreter only", defaults};
+  boilerplate::SetJitOption(&blinterp.profile, JSJITCOMPILER_BASELINE_ENABLE,
+                            0);
+  boilerplate::SetJitOption(&blinterp.profile, JSJITCOMPILER_ION_ENABLE, 0);
+  matrix.push_back(blinterp);
+
+  uint32_t baselineDefault =
+      DefaultValue(defaults, JSJITCOMPILER_BASELINE_WARMUP_TRIGGER);
+  uint32_t ionDefault =
+      DefaultValue(defaults, JSJITCOMPILER_ION_NORMAL_WARMUP_TRIGGER);
+
+  for (uint32_t baseline : {uint32_t(10), baselineDefault}) {
+    // 0 stands for Ion turned off.
+    for (uint32_t ion : {uint32_t(0), uint32_t(100), uint32_t(500),
+                         ionDefault}) {
+      Configuration config{"", defaults};
+      boilerplate::SetJitOption(&config.profile,
+                                JSJITCOMPILER_BASELINE_WARMUP_TRIGGER,
+                                baseline);
+      char name[64];
+      if (ion == 0) {
+        boilerplate::SetJitOption(&config.profile, JSJITCOMPILER_ION_ENABLE,
+                                  0);
+        snprintf(name, sizeof(name), "baseline %u, no ion", baseline);
+      } else {
+        boilerplate::SetJitOption(&config.profile,
+                                  JSJITCOMPILER_ION_NORMAL_WARMUP_TRIGGER, ion);
+        snprintf(name, sizeof(name), "baseline %u, ion %u", baseline, ion);
+      }
+      config.name = name;
+      if (baseline == baselineDefault && ion == ionDefault) {
+        config.name += " (default)";
+      }
+      matrix.push_back(config);
+    }
+  }
+
+  return matrix;
+}
+
+// Evaluate 'script' in a new global, as one request.
+static bool RunRequest(JSContext* cx, const Script& script) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(script.filename.c_str(), 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, script.source.data(),
+                               script.source.size(), &rval);
+}
+
+static bool Measure(JSContext* cx, const std::vector<Script>& scripts,
+                    Configuration* config) {
+  boilerplate::ApplyJitProfile(cx, config->profile);
+
+  // Start every configuration from an empty heap, and warm up the allocator
+  // with one unmeasured pass over the corpus.
+  JS_GC(cx);
+  for (const Script& script : scripts) {
+    if (!RunRequest(cx, script)) return false;
+  }
+
+  std::vector<double> latencies;
+  Clock::time_point start = Clock::now();
+  for (unsigned round = 0; round < Rounds; round++) {
+    for (const Script& script : scripts) {
+      Clock::time_point requestStart = Clock::now();
+      if (!RunRequest(cx, script)) return false;
+      latencies.push_back(std::chrono::duration<double, std::micro>(
+                              Clock::now() - requestStart)
+                              .count());
+    }
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  std::sort(latencies.begin(), latencies.end());
+  config->requestsPerSecond = latencies.size() / elapsed.count();
+  config->p50Us = latencies[latencies.size() / 2];
+  config->p99Us = latencies[latencies.size() * 99 / 100];
+  return true;
+}
+
+static const Configuration* PickWinner(
+    const std::vector<Configuration>& matrix) {
+  double bestP99 = matrix[0].p99Us;
+  for (const Configuration& config : matrix) {
+    bestP99 = std::min(bestP99, config.p99Us);
+  }
+
+  const Configuration* winner = nullptr;
+  for (const Configuration& config : matrix) {
+    if (config.p99Us > bestP99 * 1.1) continue;
+    if (!winner || config.requestsPerSecond > winner->requestsPerSecond) {
+      winner = &config;
+    }
+  }
+  return winner;
+}
+
+static bool JitTuningExample(JSContext* cx) {
+  std::vector<Script> scripts;
+  if (!LoadScripts(&scripts)) return false;
+
+  boilerplate::JitProfile defaults;
+  if (!boilerplate::GetJitOptions(cx, tunedOptions, std::size(tunedOptions),
+                                  &defaults)) {
+    return false;
+  }
+
+  std::vector<Configuration> matrix = MakeMatrix(defaults);
+  printf("%-34s %12s %10s %10s\n", "configuration", "requests/s", "p50 us",
+         "p99 us");
+  for (Configuration& config : matrix) {
+    if (!Measure(cx, scripts, &config)) {
+      if (JS_IsExceptionPending(cx)) boilerplate::ReportAndClearException(cx);
+      boilerplate::ApplyJitProfile(cx, defaults);
+      return false;
+    }
+    printf("%-34s %12.0f %10.1f %10.1f\n", config.name.c_str(),
+           config.requestsPerSecond, config.p50Us, config.p99Us);
+  }
+  boilerplate::ApplyJitProfile(cx, defaults);
+
+  const Configuration* winner = PickWinner(matrix);
+  char comment[160];
+  snprintf(comment, sizeof(comment),
+           "Written by jittuning: %s, %.0f requests/s, p99 %.1f us",
+           winner->name.c_str(), winner->requestsPerSecond, winner->p99Us);
+  if (!boilerplate::WriteJitProfile(outputPath, winner->profile, comment)) {
+    return false;
+  }
+
+  printf("\nwinner: %s; wrote %s\n", winner->name.c_str(), outputPath);
+  printf("to use it: BOILERPLATE_JIT_PROFILE=%s\n", outputPath);
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) outputPath = argv[1];
+  for (int i = 2; i < argc; i++) files.push_back(argv[i]);
+
+  if (!boilerplate::RunExample(JitTuningExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Conversions.h>
+#include <js/MemoryFunctions.h>
+
+#include "boilerplate.h"
+#include "memoryreporter.h"
+
+// This program shows boilerplate::MemoryReporter on a context with a few
+// tenants, each in its own realm: one that keeps many strings, one that keeps
+// native Blob objects whose memory is malloc'd, and one that runs enough code
+// to be JIT-compiled. It prints the tenants' realm ids and then a memory
+// report, as JSON.
+//
+// Then it sets per-realm caps of SOFT and HARD megabytes, and runs a fourth
+// tenant that allocates Blobs forever. The reporter kills that tenant once it
+// is over the hard cap, while the others are unaffected, and the program
+// prints a final report without it.
+//
+// Usage: memory [SOFT [HARD]]
+
+static unsigned softMB = 16;
+static unsigned hardMB = 32;
+
+struct Tenant {
+  const char* name;
+  const char* code;
+};
+
+static const Tenant tenants[] = {
+    {"strings", R"js(
+      globalThis.keep = Array.from(
+          {length: 20000}, (_, i) => `item ${i} ` + "x".repeat(i % 100));
+    )js"},
+    {"blobs", R"js(
+      globalThis.keep = Array.from({length: 64}, () => makeBlob(64 * 1024));
+    )js"},
+    {"code", R"js(
+      function mix(a, b) { return (a * 31 + b) | 0; }
+      function hash(s) {
+        let h = 0;
+        for (const c of s) h = mix(h, c.charCodeAt(0));
+        return h;
+      }
+      let h = 0;
+      for (let i = 0; i < 100000; i++) h ^= hash(String(i));
+      globalThis.keep = h;
+    )js"},
+};
+
+static const char* hogCode = R"js(
+  const keep = [];
+  for (;;) keep.push(makeBlob(1024 * 1024));
+)js";
+
+// A Blob holds a malloc'd buffer, which SpiderMonkey knows about only through
+// JS::AddAssociatedMemory, and which the reporter measures as private data.
+enum BlobSlots { BlobDataSlot, BlobSizeSlot, BlobSlotCount };
+
+static void BlobFinalize(JS::GCContext* gcx, JSObject* obj) {
+  void* data = JS::GetMaybePtrFromReservedSlot<void>(obj, BlobDataSlot);
+  if (data) {
+    size_t size = JS::GetReservedSlot(obj, BlobSizeSlot).toNumber();
+    JS::RemoveAssociatedMemory(obj, size, JS::MemoryUse::Embedding1);
+    free(data);
+  }
+}
+
+static const JSClassOps blobClassOps = {
+    nullptr,  // addProperty
+    nullptr,  // deleteProperty
+    nullptr,  // enumerate
+    nullptr,  // newEnumerate
+    nullptr,  // resolve
+    nullptr,  // mayResolve
+    &BlobFinalize,
+    nullptr,  // call
+    nullptr,  // construct
+    nullptr,  // trace
+};
+
+static const JSClass blobClass = {
+    "Blob",
+    JSCLASS_HAS_RESERVED_SLOTS(BlobSlotCount) | JSCLASS_FOREGROUND_FINALIZE,
+    &blobClassOps,
+};
+
+static size_t BlobSizeOf(JSObject* obj, mozilla::MallocSizeOf mallocSizeOf) {
+  return mallocSizeOf(
+      JS::GetMaybePtrFromReservedSlot<void>(obj, BlobDataSlot));
+}
+
+static bool MakeBlob(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  uint32_t size;
+  if (!JS::ToUint32(cx, args.get(0), &size)) return false;
+
+  JS::RootedObject blob(cx, JS_NewObject(cx, &blobClass));
+  if (!blob) return false;
+
+  void* data = calloc(1, size);
+  if (!data) {
+    JS_ReportOutOfMemory(cx);
+    return false;
+  }
+  JS::SetReservedSlot(blob, BlobDataSlot, JS::PrivateValue(data));
+  JS::SetReservedSlot(blob, BlobSizeSlot, JS::NumberValue(size));
+  JS::AddAssociatedMemory(blob, size, JS::MemoryUse::Embedding1);
+
+  args.rval().setObject(*blob);
+  return true;
+}
+
+static bool ExecuteCode(JSContext* cx, const char* filename, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+static JSObject* NewTenant(JSContext* cx, const char* name, const char* code) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return nullptr;
+
+  JSAutoRealm ar(cx, global);
+  if (!JS_DefineFunction(cx, global, "makeBlob", &MakeBlob, 1, 0)) {
+    return nullptr;
+  }
+
+  printf("{\"tenant\": \"%s\", \"realm\": \"0x%" PRIxPTR "\"}\n", name,
+         uintptr_t(JS::GetObjectRealmOrNull(global)));
+
+  if (!ExecuteCode(cx, name, code)) {
+    // A killed tenant stops with no exception pending.
+    if (JS_IsExceptionPending(cx)) {
+      boilerplate::ReportAndClearException(cx);
+    }
+    return nullptr;
+  }
+  return global;
+}
+
+static void OnKill(JSContext* cx,
+                   const boilerplate::MemoryReporter::RealmUsage& usage,
+                   void* data) {
+  printf("{\"killed\": \"0x%" PRIxPTR "\", \"bytes\": %zu}\n",
+         uintptr_t(usage.realm), usage.total());
+}
+
+static bool MemoryExample(JSContext* cx) {
+  boilerplate::MemoryReporter reporter(cx);
+  reporter.registerPrivate(&blobClass, &BlobSizeOf);
+
+  JS::RootedObjectVector globals(cx);
+  for (const Tenant& tenant : tenants) {
+    JS::RootedObject global(cx, NewTenant(cx, tenant.name, tenant.code));
+    if (!global || !globals.append(global)) return false;
+  }
+
+  if (!reporter.report(stdout)) return false;
+
+  if (!reporter.setRealmCaps(size_t(softMB) << 20, size_t(hardMB) << 20,
+                             &OnKill)) {
+    return false;
+  }
+
+  JS::RootedObject hog(cx, NewTenant(cx, "hog", hogCode));
+  if (hog) {
+    fprintf(stderr, "Error: The hog was not stopped\n");
+    return false;
+  }
+
+  JS_GC(cx);
+  if (!reporter.report(stdout)) return false;
+
+  printf("{\"gcsForced\": %llu, \"realmsKilled\": %llu}\n",
+         (unsigned long long)reporter.gcsForced(),
+         (unsigned long long)reporter.realmsKilled());
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) softMB = atoi(argv[1]);
+  if (argc > 2) hardMB = atoi(argv[2]);
+  if (softMB == 0 || hardMB < softMB) {
+    fprintf(stderr, "Usage: %s [SOFT [HARD]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(MemoryExample)) {
+    return 1;
+  }
+  return 0;
+}
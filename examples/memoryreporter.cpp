@@ -0,0 +1,448 @@
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include <jsapi.h>
+#include <jsfriendapi.h>
+#include <js/GCAPI.h>
+#include <js/MemoryMetrics.h>
+#include <js/Realm.h>
+
+#include "memoryreporter.h"
+
+// A memory reporter for one JSContext, built on JS::CollectRuntimeStats from
+// 'js/MemoryMetrics.h'. It walks the context's whole heap and breaks the
+// memory down per realm (objects, scripts, JIT data) and per zone (strings,
+// shapes, scopes, JIT code, regexps), and writes the result as JSON.
+//
+// SpiderMonkey does not know how big the C++ data behind an object's private
+// pointer is, such as the 'Crc' in resolve.cpp or the 'ReplGlobal' in
+// repl.cpp. 'registerPrivate' tells the reporter how to measure the data for
+// objects of one JSClass; it is counted as the realm's "objectsPrivate".
+//
+// Reports are on demand, and walk every GC thing in the heap, so their cost
+// grows with the heap, like that of a full GC. Realm caps are checked after a
+// major GC, at the next interrupt, and at most once every CheckInterval so
+// that checks cost at most a fraction of the GC's own time; a check that
+// comes too soon is put off, and a timer thread requests another interrupt
+// once the interval has passed, so that no GC goes unchecked. If any realm is
+// over the soft cap, the whole heap gets one shrinking, non-incremental GC.
+// Any realm that is still over the hard cap after that is killed: wrappers
+// from other compartments into it are cut, the 'onKill' callback is called so
+// the embedding can drop its own references to the realm's global, and if a
+// script in that realm is running, it is terminated with an uncatchable
+// exception. A realm's zone-level memory (strings, shapes and so on) only
+// counts against it when it has its zone to itself; see 'setRealmCaps'.
+//
+// Usage:
+//
+//   boilerplate::MemoryReporter reporter(cx);
+//   reporter.registerPrivate(&Crc::klass, [](JSObject* obj,
+//                                            mozilla::MallocSizeOf sizeOf) {
+//     return sizeOf(JS::GetMaybePtrFromReservedSlot<Crc>(obj, CrcSlot));
+//   });
+//   reporter.report(stdout);
+//
+//   reporter.setRealmCaps(32 * 1024 * 1024, 64 * 1024 * 1024, OnKill);
+//
+// NOTE: Private data is measured with the system allocator's
+// malloc_usable_size(), which is only right if the data was allocated with
+// malloc or the default operator new. The reporter must be used on its
+// context's thread.
+
+static constexpr std::chrono::milliseconds CheckInterval(50);
+
+namespace {
+// The reporter collecting on this thread, and the one enforcing caps.
+thread_local boilerplate::MemoryReporter* t_collecting = nullptr;
+thread_local boilerplate::MemoryReporter* t_enforcing = nullptr;
+}  // namespace
+
+class boilerplate::MemoryReporter::Stats : public JS::RuntimeStats {
+ public:
+  Stats() : JS::RuntimeStats(&MemoryReporter::MallocSizeOf) {}
+
+  void initExtraZoneStats(JS::Zone* zone, JS::ZoneStats* zoneStats,
+                          const JS::AutoRequireNoGC& nogc) override {
+    zoneStats->extra = zone;
+  }
+
+  void initExtraRealmStats(JS::Realm* realm, JS::RealmStats* realmStats,
+                           const JS::AutoRequireNoGC& nogc) override {
+    realmStats->extra = realm;
+  }
+};
+
+// SpiderMonkey asks the visitor for an nsISupports pointer, as Gecko has, for
+// each object, and then for that pointer's size. Here the "nsISupports" is
+// just the object itself, for objects of a registered class.
+class boilerplate::MemoryReporter::PrivateVisitor
+    : public JS::ObjectPrivateVisitor {
+ public:
+  explicit PrivateVisitor(MemoryReporter* reporter)
+      : JS::ObjectPrivateVisitor(&GetISupports), m_reporter(reporter) {}
+
+  size_t sizeOfIncludingThis(nsISupports* iface) override {
+    auto* obj = reinterpret_cast<JSObject*>(iface);
+    PrivateSizeOf sizeOf = m_reporter->privateSizeOf(JS::GetClass(obj));
+    return sizeOf ? sizeOf(obj, &MemoryReporter::MallocSizeOf) : 0;
+  }
+
+ private:
+  static bool GetISupports(JSObject* obj, nsISupports** iface) {
+    if (!t_collecting || !t_collecting->privateSizeOf(JS::GetClass(obj))) {
+      return false;
+    }
+    *iface = reinterpret_cast<nsISupports*>(obj);
+    return true;
+  }
+
+  MemoryReporter* m_reporter;
+};
+
+boilerplate::MemoryReporter::MemoryReporter(JSContext* cx) : m_cx(cx) {}
+
+boilerplate::MemoryReporter::~MemoryReporter() {
+  if (m_timer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_timerLock);
+      m_timerStopping = true;
+    }
+    m_timerWakeup.notify_all();
+    m_timer.join();
+  }
+
+  if (m_callbacksInstalled) {
+    JS_RemoveFinalizeCallback(m_cx, &MemoryReporter::FinalizeCallback);
+  }
+  if (t_enforcing == this) {
+    t_enforcing = nullptr;
+  }
+}
+
+size_t boilerplate::MemoryReporter::MallocSizeOf(const void* ptr) {
+  if (!ptr) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return malloc_size(ptr);
+#else
+  return malloc_usable_size(const_cast<void*>(ptr));
+#endif
+}
+
+// Measure the private data of objects of class 'clasp' with 'sizeOf', which
+// runs while the heap is being walked, so it must not allocate GC things or
+// run JS.
+void boilerplate::MemoryReporter::registerPrivate(const JSClass* clasp,
+                                                  PrivateSizeOf sizeOf) {
+  m_privates.emplace_back(clasp, sizeOf);
+}
+
+boilerplate::MemoryReporter::PrivateSizeOf
+boilerplate::MemoryReporter::privateSizeOf(const JSClass* clasp) const {
+  for (const auto& entry : m_privates) {
+    if (entry.first == clasp) {
+      return entry.second;
+    }
+  }
+  return nullptr;
+}
+
+// Walk the heap and fill in 'snapshot'. Returns false, with an exception
+// pending, if it runs out of memory.
+bool boilerplate::MemoryReporter::collect(Snapshot* snapshot) {
+  Stats stats;
+  PrivateVisitor visitor(this);
+
+  t_collecting = this;
+  bool ok = JS::CollectRuntimeStats(m_cx, &stats, &visitor, false);
+  t_collecting = nullptr;
+  if (!ok) {
+    JS_ReportOutOfMemory(m_cx);
+    return false;
+  }
+
+  snapshot->gcHeapChunks = stats.gcHeapChunkTotal;
+  snapshot->gcHeapUsed = stats.gcHeapGCThings;
+  snapshot->gcHeapUnused = stats.gcHeapUnusedChunks + stats.gcHeapUnusedArenas;
+  snapshot->gcHeapAdmin = stats.gcHeapChunkAdmin;
+  snapshot->gcHeapDecommitted = stats.gcHeapDecommittedPages;
+
+  // The live GC things not counted in any of the named categories, such as
+  // shapes, symbols and BigInts, are counted as 'other'.
+  std::vector<JS::Zone*> zones;
+  snapshot->zones.clear();
+  for (const JS::ZoneStats& zs : stats.zoneStatsVector) {
+    ZoneUsage usage;
+    usage.strings = zs.stringInfo.gcHeapLatin1 + zs.stringInfo.gcHeapTwoByte +
+                    zs.stringInfo.mallocHeapLatin1 +
+                    zs.stringInfo.mallocHeapTwoByte;
+    usage.shapes = zs.compactPropMapsGCHeap + zs.normalPropMapsGCHeap +
+                   zs.dictPropMapsGCHeap + zs.propMapChildren +
+                   zs.propMapTables + zs.shapeTables;
+    usage.scopes = zs.scopesGCHeap + zs.scopesMallocHeap;
+    usage.jitCode =
+        zs.jitCodesGCHeap + zs.jitZone + zs.baselineStubsOptimized;
+    usage.regExps =
+        zs.regExpSharedsGCHeap + zs.regExpSharedsMallocHeap + zs.regexpZone;
+
+    size_t namedGCThings =
+        zs.stringInfo.gcHeapLatin1 + zs.stringInfo.gcHeapTwoByte +
+        zs.compactPropMapsGCHeap + zs.normalPropMapsGCHeap +
+        zs.dictPropMapsGCHeap + zs.scopesGCHeap + zs.jitCodesGCHeap +
+        zs.regExpSharedsGCHeap;
+    usage.other = zs.sizeOfLiveGCThings() - namedGCThings +
+                  zs.gcHeapArenaAdmin + zs.uniqueIdMap +
+                  zs.compartmentObjects + zs.crossCompartmentWrappersTables;
+    usage.unused = zs.unusedGCThings.totalSize();
+
+    zones.push_back(static_cast<JS::Zone*>(zs.extra));
+    snapshot->zones.push_back(usage);
+  }
+
+  snapshot->realms.clear();
+  for (const JS::RealmStats& rs : stats.realmStatsVector) {
+    RealmUsage usage;
+    usage.realm = static_cast<JS::Realm*>(rs.extra);
+
+    JSObject* global = JS::GetRealmGlobalOrNull(usage.realm);
+    usage.global = global ? JS::GetClass(global)->name : "(none)";
+
+    JS::Zone* zone =
+        js::GetCompartmentZone(JS::GetCompartmentForRealm(usage.realm));
+    for (size_t i = 0; i < zones.size(); i++) {
+      if (zones[i] == zone) {
+        usage.zone = i;
+        break;
+      }
+    }
+
+    usage.objects = rs.classInfo.sizeOfAllThings();
+    usage.objectsPrivate = rs.objectsPrivate;
+    usage.scripts = rs.scriptsGCHeap + rs.scriptsMallocHeapData;
+    usage.jit = rs.baselineData + rs.baselineStubsFallback + rs.ionData +
+                rs.jitScripts;
+    usage.other = rs.realmObject + rs.realmTables + rs.innerViewsTable +
+                  rs.objectMetadataTable + rs.savedStacksSet +
+                  rs.nonSyntacticLexicalScopesTable;
+    snapshot->realms.push_back(usage);
+  }
+  return true;
+}
+
+// Write 'snapshot' to 'out' as a JSON object, with sizes in bytes. Realms are
+// identified by address, so that reports taken at different times can be
+// compared, and refer to their zone by its index in "zones".
+void boilerplate::MemoryReporter::WriteJSON(FILE* out,
+                                            const Snapshot& snapshot) {
+  fprintf(out,
+          "{\"gcHeap\": {\"chunks\": %zu, \"used\": %zu, \"unused\": %zu, "
+          "\"admin\": %zu, \"decommitted\": %zu},\n",
+          snapshot.gcHeapChunks, snapshot.gcHeapUsed, snapshot.gcHeapUnused,
+          snapshot.gcHeapAdmin, snapshot.gcHeapDecommitted);
+
+  fprintf(out, " \"zones\": [");
+  for (size_t i = 0; i < snapshot.zones.size(); i++) {
+    const ZoneUsage& zone = snapshot.zones[i];
+    fprintf(out,
+            "%s\n  {\"id\": %zu, \"strings\": %zu, \"shapes\": %zu, "
+            "\"scopes\": %zu, \"jitCode\": %zu, \"regExps\": %zu, "
+            "\"other\": %zu, \"unused\": %zu, \"total\": %zu}",
+            i ? "," : "", i, zone.strings, zone.shapes, zone.scopes,
+            zone.jitCode, zone.regExps, zone.other, zone.unused,
+            zone.total());
+  }
+  fprintf(out, "],\n");
+
+  fprintf(out, " \"realms\": [");
+  for (size_t i = 0; i < snapshot.realms.size(); i++) {
+    const RealmUsage& realm = snapshot.realms[i];
+    fprintf(out,
+            "%s\n  {\"id\": \"0x%" PRIxPTR "\", \"global\": \"%s\", "
+            "\"zone\": %zu, \"objects\": %zu, \"objectsPrivate\": %zu, "
+            "\"scripts\": %zu, \"jit\": %zu, \"other\": %zu, \"total\": %zu}",
+            i ? "," : "", uintptr_t(realm.realm), realm.global, realm.zone,
+            realm.objects, realm.objectsPrivate, realm.scripts, realm.jit,
+            realm.other, realm.total());
+  }
+  fprintf(out, "]}\n");
+}
+
+// Collect a snapshot and write it to 'out' as JSON.
+bool boilerplate::MemoryReporter::report(FILE* out) {
+  Snapshot snapshot;
+  if (!collect(&snapshot)) {
+    return false;
+  }
+  WriteJSON(out, snapshot);
+  return true;
+}
+
+// Enforce caps on the memory of each realm in this context, checked after
+// every major GC. A cap of zero is no cap. Strings, shapes, scopes and the
+// rest of the zone-level memory count against a realm only when it is the
+// only realm in its zone; realms that share a zone are capped on their own
+// objects, scripts and JIT data alone, so a realm that fills a shared zone
+// with strings escapes its caps. Must be called on the context's
+// thread; only one reporter per thread can enforce caps.
+bool boilerplate::MemoryReporter::setRealmCaps(size_t softBytes,
+                                               size_t hardBytes,
+                                               KillCallback onKill,
+                                               void* data) {
+  m_softBytes = softBytes;
+  m_hardBytes = hardBytes;
+  m_onKill = onKill;
+  m_killData = data;
+
+  if (!m_callbacksInstalled) {
+    if (!JS_AddFinalizeCallback(m_cx, &MemoryReporter::FinalizeCallback,
+                                this) ||
+        !JS_AddInterruptCallback(m_cx, &MemoryReporter::InterruptCallback)) {
+      JS_ReportOutOfMemory(m_cx);
+      return false;
+    }
+    m_callbacksInstalled = true;
+  }
+  t_enforcing = this;
+  return true;
+}
+
+void boilerplate::MemoryReporter::FinalizeCallback(JS::GCContext* gcx,
+                                                   JSFinalizeStatus status,
+                                                   void* data) {
+  auto* reporter = static_cast<MemoryReporter*>(data);
+  if (status != JSFINALIZE_COLLECTION_END || reporter->m_enforcing) {
+    return;
+  }
+
+  // Reports can't be collected during a GC, so do it at the next interrupt.
+  reporter->m_checkPending = true;
+  JS_RequestInterruptCallback(reporter->m_cx);
+}
+
+bool boilerplate::MemoryReporter::InterruptCallback(JSContext* cx) {
+  MemoryReporter* reporter = t_enforcing;
+  if (!reporter || reporter->m_cx != cx || !reporter->m_checkPending) {
+    return true;
+  }
+
+  Clock::time_point now = Clock::now();
+  if (now - reporter->m_lastCheck < CheckInterval) {
+    reporter->scheduleRecheck(reporter->m_lastCheck + CheckInterval);
+    return true;
+  }
+  reporter->m_checkPending = false;
+  reporter->m_lastCheck = now;
+  return reporter->enforce();
+}
+
+// Have the timer thread request an interrupt at 'when', for a check that was
+// put off. The thread is started the first time it is needed.
+void boilerplate::MemoryReporter::scheduleRecheck(Clock::time_point when) {
+  {
+    std::lock_guard<std::mutex> lock(m_timerLock);
+    m_recheckAt = when;
+    m_recheckScheduled = true;
+  }
+  if (!m_timer.joinable()) {
+    m_timer = std::thread(&MemoryReporter::timerMain, this);
+  }
+  m_timerWakeup.notify_all();
+}
+
+// JS_RequestInterruptCallback is the one JSAPI call that is safe from another
+// thread. The context outlives the reporter, which stops this thread.
+void boilerplate::MemoryReporter::timerMain() {
+  std::unique_lock<std::mutex> lock(m_timerLock);
+  while (!m_timerStopping) {
+    if (!m_recheckScheduled) {
+      m_timerWakeup.wait(lock);
+      continue;
+    }
+    if (Clock::now() < m_recheckAt) {
+      m_timerWakeup.wait_until(lock, m_recheckAt);
+      continue;
+    }
+    m_recheckScheduled = false;
+    JS_RequestInterruptCallback(m_cx);
+  }
+}
+
+// The memory that counts against a realm's caps: its own, plus its zone's if
+// no other realm shares the zone.
+static size_t CappedBytes(
+    const boilerplate::MemoryReporter::Snapshot& snapshot,
+    const boilerplate::MemoryReporter::RealmUsage& usage) {
+  size_t sharing = 0;
+  for (const auto& other : snapshot.realms) {
+    if (other.zone == usage.zone) sharing++;
+  }
+  size_t bytes = usage.total();
+  if (sharing == 1 && usage.zone < snapshot.zones.size()) {
+    bytes += snapshot.zones[usage.zone].total();
+  }
+  return bytes;
+}
+
+// Check every realm against the caps now: collect a GC if any is over the
+// soft cap, and kill those still over the hard cap after that. Returns false
+// if the realm of the running script was killed, in which case there is no
+// exception pending and the script should not continue, or if collecting a
+// report ran out of memory.
+bool boilerplate::MemoryReporter::enforce() {
+  if (m_softBytes == 0 && m_hardBytes == 0) {
+    return true;
+  }
+  m_enforcing = true;
+
+  Snapshot snapshot;
+  bool ok = collect(&snapshot);
+
+  if (ok && m_softBytes) {
+    bool overSoftCap = false;
+    for (const RealmUsage& usage : snapshot.realms) {
+      overSoftCap = overSoftCap || CappedBytes(snapshot, usage) > m_softBytes;
+    }
+    if (overSoftCap) {
+      JS::PrepareForFullGC(m_cx);
+      JS::NonIncrementalGC(m_cx, JS::GCOptions::Shrink, JS::GCReason::API);
+      m_gcsForced++;
+      ok = collect(&snapshot);
+    }
+  }
+
+  bool killedCurrent = false;
+  if (ok && m_hardBytes) {
+    JS::Realm* current = JS::GetCurrentRealmOrNull(m_cx);
+    for (const RealmUsage& usage : snapshot.realms) {
+      if (CappedBytes(snapshot, usage) > m_hardBytes) {
+        kill(usage);
+        killedCurrent = killedCurrent || usage.realm == current;
+      }
+    }
+  }
+
+  m_enforcing = false;
+  return ok && !killedCurrent;
+}
+
+// Cut the realm off from the rest of the heap, so it can be collected once the
+// embedding drops its global. The callback may be called again for the same
+// realm if it is still over the cap at a later check.
+void boilerplate::MemoryReporter::kill(const RealmUsage& usage) {
+  m_realmsKilled++;
+  js::NukeCrossCompartmentWrappers(m_cx, js::AllCompartments(), usage.realm,
+                                   js::DontNukeWindowReferences,
+                                   js::NukeAllReferences);
+  if (m_onKill) {
+    m_onKill(m_cx, usage, m_killData);
+  }
+}
@@ -0,0 +1,130 @@
+#ifndef MEMORYREPORTER_H_
+#define MEMORYREPORTER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <jsapi.h>
+#include <mozilla/MemoryReporting.h>
+
+// See 'memoryreporter.cpp' for documentation.
+
+namespace boilerplate {
+
+class MemoryReporter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct ZoneUsage {
+    size_t strings = 0;
+    size_t shapes = 0;
+    size_t scopes = 0;
+    size_t jitCode = 0;
+    size_t regExps = 0;
+    size_t other = 0;
+    size_t unused = 0;
+
+    size_t total() const {
+      return strings + shapes + scopes + jitCode + regExps + other + unused;
+    }
+  };
+
+  struct RealmUsage {
+    JS::Realm* realm = nullptr;
+    const char* global = nullptr;  // class name of the realm's global
+    size_t zone = 0;               // index into Snapshot::zones
+    size_t objects = 0;
+    size_t objectsPrivate = 0;
+    size_t scripts = 0;
+    size_t jit = 0;
+    size_t other = 0;
+
+    size_t total() const {
+      return objects + objectsPrivate + scripts + jit + other;
+    }
+  };
+
+  struct Snapshot {
+    size_t gcHeapChunks = 0;
+    size_t gcHeapUsed = 0;
+    size_t gcHeapUnused = 0;
+    size_t gcHeapAdmin = 0;
+    size_t gcHeapDecommitted = 0;
+    std::vector<ZoneUsage> zones;
+    std::vector<RealmUsage> realms;
+  };
+
+  using PrivateSizeOf = size_t (*)(JSObject* obj,
+                                   mozilla::MallocSizeOf mallocSizeOf);
+  using KillCallback = void (*)(JSContext* cx, const RealmUsage& usage,
+                                void* data);
+
+  explicit MemoryReporter(JSContext* cx);
+  ~MemoryReporter();
+
+  MemoryReporter(const MemoryReporter&) = delete;
+  MemoryReporter& operator=(const MemoryReporter&) = delete;
+
+  static size_t MallocSizeOf(const void* ptr);
+
+  void registerPrivate(const JSClass* clasp, PrivateSizeOf sizeOf);
+
+  bool collect(Snapshot* snapshot);
+  static void WriteJSON(FILE* out, const Snapshot& snapshot);
+  bool report(FILE* out);
+
+  bool setRealmCaps(size_t softBytes, size_t hardBytes,
+                    KillCallback onKill = nullptr, void* data = nullptr);
+  bool enforce();
+
+  uint64_t gcsForced() const { return m_gcsForced; }
+  uint64_t realmsKilled() const { return m_realmsKilled; }
+
+ private:
+  class Stats;
+  class PrivateVisitor;
+
+  static void FinalizeCallback(JS::GCContext* gcx, JSFinalizeStatus status,
+                               void* data);
+  static bool InterruptCallback(JSContext* cx);
+
+  void scheduleRecheck(Clock::time_point when);
+  void timerMain();
+
+  PrivateSizeOf privateSizeOf(const JSClass* clasp) const;
+  void kill(const RealmUsage& usage);
+
+  JSContext* m_cx;
+  std::vector<std::pair<const JSClass*, PrivateSizeOf>> m_privates;
+
+  size_t m_softBytes = 0;
+  size_t m_hardBytes = 0;
+  KillCallback m_onKill = nullptr;
+  void* m_killData = nullptr;
+  bool m_callbacksInstalled = false;
+  bool m_checkPending = false;
+  bool m_enforcing = false;
+  Clock::time_point m_lastCheck;
+
+  // Timer thread for checks that were put off.
+  std::mutex m_timerLock;
+  std::condition_variable m_timerWakeup;
+  std::thread m_timer;
+  Clock::time_point m_recheckAt;
+  bool m_recheckScheduled = false;
+  bool m_timerStopping = false;
+
+  uint64_t m_gcsForced = 0;
+  uint64_t m_realmsKilled = 0;
+};
+
+}  // namespace boilerplate
+
+#endif  // MEMORYREPORTER_H_
@@ -0,0 +1,264 @@
+#include <memory>
+
+#include <jsapi.h>
+#include <jsfriendapi.h>
+#include <js/CallAndConstruct.h>
+#include <js/PropertyAndElement.h>
+#include <js/StructuredClone.h>
+
+#include "boilerplate.h"
+#include "eventloop.h"
+#include "messagechannel.h"
+#include "traceevents.h"
+
+// A channel for passing messages between contexts on different threads, with
+// the postMessage function and onmessage handler known from web workers.
+//
+// A boilerplate::MessageChannel has two ports; each thread attaches one of them
+// to its boilerplate::EventLoop, and to an object, which gets 'postMessage'
+// and 'close' methods. A message posted on one port is delivered to the other
+// port's object, by calling its 'onmessage' method with an event whose 'data'
+// property is the message. In a worker the object is usually the global, so
+// that 'postMessage' and 'onmessage' are globals as in a web worker.
+//
+// Messages are copied with the structured clone algorithm: the sending thread
+// writes the message into a buffer with JS_WriteStructuredClone, and the
+// receiving thread reads it back with JS_ReadStructuredClone, into its own
+// context. ArrayBuffers listed in postMessage's second argument are
+// transferred rather than copied: their contents move to the receiving side
+// without being copied, however large they are, and the sender's ArrayBuffer
+// is detached. SharedArrayBuffers are not copied either; both threads see the
+// same memory.
+//
+// Each port's incoming messages are kept in a lock-free queue that any thread
+// may post to, so senders never wait for each other or for the receiver. If
+// the receiving loop is asleep, the sender wakes it.
+//
+// Each port counts the messages it received, and keeps a histogram of the time
+// from posting each message to its delivery, in microseconds.
+//
+// Usage:
+//
+//   auto channel = std::make_shared<boilerplate::MessageChannel>();
+//   std::thread worker(WorkerMain, channel);  // attaches channel->port2()
+//
+//   boilerplate::EventLoop loop(cx);
+//   ...
+//   JS::RootedObject worker(cx, JS_NewPlainObject(cx));
+//   if (!channel->port1().attach(cx, &loop, worker)) ...
+//   ...define 'worker' on the global, run scripts that use
+//      worker.postMessage(message, [transfer...]) and worker.onmessage
+//   if (!loop.run()) ...
+//
+// Calling 'close' on either port closes the channel: no more messages can be
+// posted on it, and the event loops stop waiting for its messages once the
+// ones already sent have been delivered.
+//
+// NOTE: A port must be detached before its context is destroyed; the event
+// loop detaches its ports when it is destroyed. The channel must outlive the
+// threads that use it.
+
+// SharedArrayBuffers are shared rather than copied; both sides see the same
+// memory.
+static JS::CloneDataPolicy SharingPolicy() {
+  JS::CloneDataPolicy policy;
+  policy.allowSharedMemoryObjects();
+  return policy;
+}
+
+static uint64_t Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+boilerplate::MessageChannel::MessageChannel() : m_port1(this), m_port2(this) {
+  m_port1.m_peer = &m_port2;
+  m_port2.m_peer = &m_port1;
+}
+
+boilerplate::MessagePort::MessagePort(MessageChannel* channel)
+    : m_channel(channel), m_tail(&m_stub), m_head(&m_stub) {}
+
+// Messages that were not delivered are dropped. Any ArrayBuffers that they
+// transferred are freed.
+boilerplate::MessagePort::~MessagePort() {
+  while (Message* message = pop()) {
+    delete message;
+  }
+}
+
+// This is Dmitry Vyukov's intrusive multiple-producer single-consumer queue.
+// Pushing is one atomic exchange, and popping needs no atomic read-modify-write
+// operations except when the queue becomes empty.
+void boilerplate::MessagePort::push(Node* node) {
+  node->next.store(nullptr, std::memory_order_relaxed);
+  Node* prev = m_tail.exchange(node);
+  prev->next.store(node, std::memory_order_release);
+}
+
+// Returns null if the queue is empty, or if a message is halfway through being
+// pushed; in the latter case the sender wakes the loop when it is done.
+boilerplate::MessagePort::Message* boilerplate::MessagePort::pop() {
+  Node* head = m_head;
+  Node* next = head->next.load(std::memory_order_acquire);
+  if (head == &m_stub) {
+    if (!next) return nullptr;
+    m_head = head = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+
+  if (!next) {
+    if (head != m_tail.load()) return nullptr;
+    push(&m_stub);
+    next = head->next.load(std::memory_order_acquire);
+    if (!next) return nullptr;
+  }
+
+  m_head = next;
+  return static_cast<Message*>(head);
+}
+
+// Whether a message may be waiting. Only called on the owning thread.
+bool boilerplate::MessagePort::pending() const {
+  return m_head != &m_stub || m_tail.load() != &m_stub;
+}
+
+bool boilerplate::MessagePort::closed() const { return m_channel->closed(); }
+
+void boilerplate::MessagePort::wakeOwner() {
+  std::lock_guard<std::mutex> lock(m_loopLock);
+  if (m_loop) m_loop->wake();
+}
+
+// Deliver messages arriving on this port to 'target', in 'loop', and define
+// 'postMessage' and 'close' on 'target'. Must be called on the thread that
+// runs 'loop', with 'target' in the current realm.
+bool boilerplate::MessagePort::attach(JSContext* cx, EventLoop* loop,
+                                      JS::HandleObject target) {
+  static const struct {
+    const char* name;
+    JSNative native;
+    unsigned nargs;
+  } functions[] = {
+      {"postMessage", PostMessage, 2},
+      {"close", Close, 0},
+  };
+
+  for (const auto& function : functions) {
+    JSFunction* fun = js::DefineFunctionWithReserved(
+        cx, target, function.name, function.native, function.nargs, 0);
+    if (!fun) return false;
+    js::SetFunctionNativeReserved(JS_GetFunctionObject(fun), 0,
+                                  JS::PrivateValue(this));
+  }
+
+  m_cx = cx;
+  m_target.init(cx, target);
+  {
+    std::lock_guard<std::mutex> lock(m_loopLock);
+    m_loop = loop;
+  }
+  loop->addPort(this);
+  return true;
+}
+
+// Stop delivering messages. They stay queued, but are not delivered unless the
+// port is attached again.
+void boilerplate::MessagePort::detach() {
+  EventLoop* loop;
+  {
+    std::lock_guard<std::mutex> lock(m_loopLock);
+    loop = m_loop;
+    m_loop = nullptr;
+  }
+  if (loop) loop->removePort(this);
+  m_target.reset();
+}
+
+// Post a message to the other port. 'transfer' is undefined, or an array of
+// ArrayBuffers to transfer. Messages posted after the channel is closed are
+// dropped.
+bool boilerplate::MessagePort::post(JSContext* cx, JS::HandleValue message,
+                                    JS::HandleValue transfer) {
+  if (closed()) return true;
+
+  auto queued = std::make_unique<Message>();
+  if (!queued->buffer.write(cx, message, transfer, SharingPolicy())) {
+    return false;
+  }
+  queued->sent = Clock::now();
+
+  m_peer->push(queued.release());
+  m_peer->wakeOwner();
+  return true;
+}
+
+// Close the channel. May be called on any thread.
+void boilerplate::MessagePort::close() {
+  m_channel->m_closed.store(true);
+  wakeOwner();
+  m_peer->wakeOwner();
+}
+
+bool boilerplate::MessagePort::PostMessage(JSContext* cx, unsigned argc,
+                                           JS::Value* vp) {
+  boilerplate::TraceScope scope("postMessage", "native");
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  JS::Value port = js::GetFunctionNativeReserved(&args.callee(), 0);
+
+  args.rval().setUndefined();
+  return static_cast<MessagePort*>(port.toPrivate())
+      ->post(cx, args.get(0), args.get(1));
+}
+
+bool boilerplate::MessagePort::Close(JSContext* cx, unsigned argc,
+                                     JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  JS::Value port = js::GetFunctionNativeReserved(&args.callee(), 0);
+
+  static_cast<MessagePort*>(port.toPrivate())->close();
+  args.rval().setUndefined();
+  return true;
+}
+
+static bool Deliver(JSContext* cx, JS::HandleObject target,
+                    JSAutoStructuredCloneBuffer& buffer) {
+  boilerplate::TraceScope scope("onmessage", "execute");
+  JS::RootedValue data(cx);
+  if (!buffer.read(cx, &data, SharingPolicy())) return false;
+
+  JS::RootedValue handler(cx);
+  if (!JS_GetProperty(cx, target, "onmessage", &handler)) return false;
+  if (!handler.isObject() || !JS::IsCallable(&handler.toObject())) {
+    return true;  // nobody is listening
+  }
+
+  JS::RootedObject event(cx, JS_NewPlainObject(cx));
+  if (!event || !JS_DefineProperty(cx, event, "data", data, JSPROP_ENUMERATE)) {
+    return false;
+  }
+
+  JS::RootedValue eventValue(cx, JS::ObjectValue(*event));
+  JS::RootedValue rval(cx);
+  return JS::Call(cx, target, handler, JS::HandleValueArray(eventValue),
+                  &rval);
+}
+
+// Deliver the next message, if there is one. Exceptions thrown by 'onmessage'
+// are reported; returns false on an uncatchable error.
+bool boilerplate::MessagePort::dispatchOne() {
+  if (!m_target.initialized()) return true;
+
+  std::unique_ptr<Message> message(pop());
+  if (!message) return true;
+
+  m_received++;
+  m_latency.record(Microseconds(Clock::now() - message->sent));
+
+  JSAutoRealm ar(m_cx, m_target);
+  if (!Deliver(m_cx, m_target, message->buffer)) {
+    if (!JS_IsExceptionPending(m_cx)) return false;
+    boilerplate::ReportAndClearException(m_cx);
+  }
+  return true;
+}
@@ -0,0 +1,106 @@
+#ifndef MESSAGECHANNEL_H_
+#define MESSAGECHANNEL_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include <jsapi.h>
+#include <js/StructuredClone.h>
+
+#include "histogram.h"
+
+// See 'messagechannel.cpp' for documentation.
+
+namespace boilerplate {
+
+class EventLoop;
+class MessageChannel;
+
+class MessagePort {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  ~MessagePort();
+
+  MessagePort(const MessagePort&) = delete;
+  MessagePort& operator=(const MessagePort&) = delete;
+
+  bool attach(JSContext* cx, EventLoop* loop, JS::HandleObject target);
+  void detach();
+
+  bool post(JSContext* cx, JS::HandleValue message, JS::HandleValue transfer);
+  void close();
+  bool closed() const;
+
+  bool pending() const;
+  bool dispatchOne();
+
+  uint64_t messagesReceived() const { return m_received; }
+  const Histogram& latencyHistogram() const { return m_latency; }
+
+ private:
+  friend class MessageChannel;
+
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+  };
+
+  struct Message : Node {
+    Message()
+        : buffer(JS::StructuredCloneScope::SameProcess, nullptr, nullptr) {}
+    JSAutoStructuredCloneBuffer buffer;
+    Clock::time_point sent;
+  };
+
+  explicit MessagePort(MessageChannel* channel);
+
+  void push(Node* node);
+  Message* pop();
+  void wakeOwner();
+
+  static bool PostMessage(JSContext* cx, unsigned argc, JS::Value* vp);
+  static bool Close(JSContext* cx, unsigned argc, JS::Value* vp);
+
+  MessageChannel* m_channel;
+  MessagePort* m_peer = nullptr;
+
+  // The queue of incoming messages. Any thread pushes at the tail; only the
+  // owning thread pops at the head.
+  Node m_stub;
+  std::atomic<Node*> m_tail;
+  Node* m_head;
+
+  std::mutex m_loopLock;
+  EventLoop* m_loop = nullptr;
+  JSContext* m_cx = nullptr;
+  JS::PersistentRootedObject m_target;
+
+  uint64_t m_received = 0;
+  Histogram m_latency;
+};
+
+class MessageChannel {
+ public:
+  MessageChannel();
+
+  MessageChannel(const MessageChannel&) = delete;
+  MessageChannel& operator=(const MessageChannel&) = delete;
+
+  MessagePort& port1() { return m_port1; }
+  MessagePort& port2() { return m_port2; }
+
+  bool closed() const { return m_closed.load(); }
+
+ private:
+  friend class MessagePort;
+
+  MessagePort m_port1;
+  MessagePort m_port2;
+  std::atomic<bool> m_closed{false};
+};
+
+}  // namespace boilerplate
+
+#endif  // MESSAGECHANNEL_H_
@@ -0,0 +1,229 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Conversions.h>
+
+#include "boilerplate.h"
+#include "eventloop.h"
+#include "messagechannel.h"
+
+// This program measures a boilerplate::MessageChannel between the main thread
+// and a worker thread that posts every message it receives back. It prints:
+// - the throughput of MESSAGES small objects, all posted at once;
+// - the round trip latency of small messages, posting each one after the
+//   reply to the previous one;
+// - the time taken by ROUNDS round trips of a 64 MB ArrayBuffer, once
+//   transferred and once copied.
+//
+// Usage: messaging [MESSAGES [ROUNDS]]
+
+static unsigned messageCount = 100000;
+static unsigned rounds = 10;
+
+static const char* workerCode = R"js(
+onmessage = e => {
+  const message = e.data;
+  postMessage(message, message && message.transfer ? [message.buffer] : []);
+};
+)js";
+
+static const char* mainCode = R"js(
+const inbox = [];
+let first = 0;
+let waiting = null;
+worker.onmessage = e => {
+  if (waiting) {
+    const resolve = waiting;
+    waiting = null;
+    resolve(e.data);
+  } else {
+    inbox.push(e.data);
+  }
+};
+
+function receive() {
+  if (first < inbox.length) {
+    const message = inbox[first];
+    inbox[first++] = undefined;
+    return Promise.resolve(message);
+  }
+  return new Promise(resolve => { waiting = resolve; });
+}
+
+async function burst() {
+  const start = now();
+  for (let i = 0; i < MESSAGES; i++)
+    worker.postMessage({id: i, text: "hello"});
+  for (let i = 0; i < MESSAGES; i++)
+    await receive();
+  const elapsed = now() - start;
+  print(`burst: ${MESSAGES} round trips in ${elapsed.toFixed(1)} ms, ` +
+        `${(MESSAGES / elapsed * 1000).toFixed(0)} per second`);
+}
+
+async function pingPong() {
+  const count = Math.min(MESSAGES, 10000);
+  const times = [];
+  for (let i = 0; i < count; i++) {
+    const start = now();
+    worker.postMessage(i);
+    await receive();
+    times.push(now() - start);
+  }
+  times.sort((a, b) => a - b);
+  const us = p => (times[Math.floor(p * (count - 1))] * 1000).toFixed(1);
+  print(`ping-pong: ${count} round trips, p50 ${us(0.5)} us, ` +
+        `p99 ${us(0.99)} us`);
+}
+
+async function buffers(transfer) {
+  let buffer = new ArrayBuffer(64 * 1024 * 1024);
+  const start = now();
+  for (let i = 0; i < ROUNDS; i++) {
+    worker.postMessage({buffer, transfer}, transfer ? [buffer] : []);
+    ({buffer} = await receive());
+  }
+  const elapsed = now() - start;
+  print(`64 MB ${transfer ? "transferred" : "copied"}: ${ROUNDS} round ` +
+        `trips in ${elapsed.toFixed(1)} ms, ` +
+        `${(elapsed / ROUNDS).toFixed(2)} ms each`);
+}
+
+(async function () {
+  await burst();
+  await pingPong();
+  await buffers(true);
+  await buffers(false);
+})().catch(e => print(`${e}\n${e.stack}`)).finally(() => worker.close());
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* filename,
+                        const std::string& code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code.data(), code.size(), &rval);
+}
+
+static bool Print(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  JS::RootedString str(cx, JS::ToString(cx, args.get(0)));
+  if (!str) return false;
+
+  JS::UniqueChars chars = JS_EncodeStringToUTF8(cx, str);
+  if (!chars) return false;
+  printf("%s\n", chars.get());
+
+  args.rval().setUndefined();
+  return true;
+}
+
+// Milliseconds, with sub-microsecond precision.
+static bool Now(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  args.rval().setDouble(
+      std::chrono::duration<double, std::milli>(now).count());
+  return true;
+}
+
+static void RunWorker(JSRuntime* parentRuntime,
+                      boilerplate::MessagePort& port) {
+  JSContext* cx = boilerplate::NewChildContext(parentRuntime);
+  if (!cx) {
+    fprintf(stderr, "Error: Failed during boilerplate::NewChildContext\n");
+    return;
+  }
+
+  {
+    boilerplate::EventLoop loop(cx);
+    if (!loop.init()) return;
+
+    JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+    if (!global) return;
+
+    JSAutoRealm ar(cx, global);
+
+    if (!port.attach(cx, &loop, global) ||
+        !ExecuteCode(cx, "worker.js", workerCode)) {
+      boilerplate::ReportAndClearException(cx);
+      return;
+    }
+
+    if (!loop.run()) return;
+  }
+
+  JS_DestroyContext(cx);
+}
+
+static void WorkerMain(JSRuntime* parentRuntime,
+                       std::shared_ptr<boilerplate::MessageChannel> channel) {
+  RunWorker(parentRuntime, channel->port2());
+  channel->port2().close();
+}
+
+static bool MessagingExample(JSContext* cx) {
+  boilerplate::EventLoop loop(cx);
+  if (!loop.init()) return false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  auto channel = std::make_shared<boilerplate::MessageChannel>();
+  std::thread thread(WorkerMain, JS_GetRuntime(cx), channel);
+
+  bool ok;
+  {
+    JSAutoRealm ar(cx, global);
+
+    JS::RootedObject worker(cx, JS_NewPlainObject(cx));
+    std::string code = "const MESSAGES = " + std::to_string(messageCount) +
+                       ", ROUNDS = " + std::to_string(rounds) + ";\n" +
+                       mainCode;
+    ok = worker && channel->port1().attach(cx, &loop, worker) &&
+         JS_DefineProperty(cx, global, "worker", worker, 0) &&
+         JS_DefineFunction(cx, global, "print", &Print, 1, 0) &&
+         JS_DefineFunction(cx, global, "now", &Now, 0, 0) &&
+         ExecuteCode(cx, "main.js", code);
+    if (!ok) {
+      boilerplate::ReportAndClearException(cx);
+      channel->port1().close();
+    } else {
+      ok = loop.run();
+    }
+
+    if (ok) {
+      const boilerplate::Histogram& latency =
+          channel->port1().latencyHistogram();
+      printf("# %llu replies, one-way latency p50 %llu us, p99 %llu us\n",
+             (unsigned long long)channel->port1().messagesReceived(),
+             (unsigned long long)latency.percentile(0.5),
+             (unsigned long long)latency.percentile(0.99));
+    }
+  }
+
+  thread.join();
+  return ok;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) messageCount = atoi(argv[1]);
+  if (argc > 2) rounds = atoi(argv[2]);
+  if (messageCount == 0 || rounds == 0) {
+    fprintf(stderr, "Usage: %s [MESSAGES [ROUNDS]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(MessagingExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,245 @@
+#include <cinttypes>
+#include <string>
+#include <utility>
+
+#include <jsapi.h>
+#include <js/CallAndConstruct.h>
+#include <js/GCAPI.h>
+#include <js/Promise.h>
+#include <js/TracingAPI.h>
+#include <js/Utility.h>
+
+#include "boilerplate.h"
+#include "microtaskqueue.h"
+#include "traceevents.h"
+
+// A promise job queue owned by the embedding, in place of the one that
+// js::UseInternalJobQueues provides.
+//
+// SpiderMonkey hands every promise reaction, and other microtasks, to the
+// context's JS::JobQueue, and the embedding decides when to run them. The
+// internal queue can only be drained completely with js::RunJobs, so a promise
+// chain that keeps adding jobs to the queue keeps the thread busy until it
+// ends, and nothing else (timers, I/O, other requests) gets to run. This
+// queue can also be drained in batches of a bounded size with 'runBatch', so
+// that an event loop can alternate between promise jobs and its other work.
+//
+// Jobs are kept in a ring buffer that is allocated up front, so that queuing a
+// job does not allocate unless the ring is full, in which case it doubles in
+// size.
+//
+// The queue keeps three histograms, which may be read at any time from any
+// thread (see 'histogram.cpp'). 'writeMetrics' writes them out, along with the
+// current depth and the number of jobs run, in the Prometheus text format; it
+// must be called on the thread that owns the queue. The histograms are:
+// - the queue depth each time a job is queued;
+// - the time taken by each batch of jobs, in microseconds;
+// - the time each job waited between being queued and starting to run, in
+//   microseconds.
+//
+// Usage:
+//
+//   boilerplate::MicrotaskQueue queue(cx);
+//   if (!queue.init()) ...
+//
+//   while (!queue.empty()) {
+//     if (!queue.runBatch()) ...uncatchable error, e.g. script terminated
+//     ...other work
+//   }
+//
+// NOTE: The queue must be destroyed before the context, and after the last
+// script has run.
+
+static uint64_t Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+// 'capacity' is the number of jobs the ring holds before it has to grow.
+// 'batchSize' is the largest number of jobs that 'runBatch' runs.
+boilerplate::MicrotaskQueue::MicrotaskQueue(JSContext* cx, size_t capacity,
+                                            size_t batchSize)
+    : m_cx(cx), m_capacity(capacity ? capacity : 1), m_batchSize(batchSize) {
+  m_ring.entries.resize(m_capacity);
+}
+
+// Make this the context's job queue.
+bool boilerplate::MicrotaskQueue::init() {
+  if (!JS_AddExtraGCRootsTracer(m_cx, Trace, this)) return false;
+  m_installed = true;
+  JS::SetJobQueue(m_cx, this);
+  return true;
+}
+
+// Any jobs that are still queued are dropped.
+boilerplate::MicrotaskQueue::~MicrotaskQueue() {
+  if (!m_installed) return;
+
+  JS::SetJobQueue(m_cx, nullptr);
+  JS_RemoveExtraGCRootsTracer(m_cx, Trace, this);
+}
+
+void boilerplate::MicrotaskQueue::TraceRing(JSTracer* trc, Ring& ring) {
+  size_t size = ring.entries.size();
+  for (size_t i = 0; i < ring.count; i++) {
+    JS::TraceEdge(trc, &ring.entries[(ring.head + i) % size].job,
+                  "MicrotaskQueue job");
+  }
+}
+
+void boilerplate::MicrotaskQueue::Trace(JSTracer* trc, void* data) {
+  auto* queue = static_cast<MicrotaskQueue*>(data);
+  TraceRing(trc, queue->m_ring);
+  for (Ring& ring : queue->m_saved) {
+    TraceRing(trc, ring);
+  }
+}
+
+JSObject* boilerplate::MicrotaskQueue::getIncumbentGlobal(JSContext* cx) {
+  return JS::CurrentGlobalOrNull(cx);
+}
+
+void boilerplate::MicrotaskQueue::grow() {
+  size_t size = m_ring.entries.size();
+  std::vector<Entry> grown(size * 2);
+  for (size_t i = 0; i < m_ring.count; i++) {
+    Entry& entry = m_ring.entries[(m_ring.head + i) % size];
+    grown[i].job = entry.job;
+    grown[i].enqueued = entry.enqueued;
+  }
+  m_ring.entries.swap(grown);
+  m_ring.head = 0;
+}
+
+bool boilerplate::MicrotaskQueue::enqueuePromiseJob(
+    JSContext* cx, JS::HandleObject promise, JS::HandleObject job,
+    JS::HandleObject allocationSite, JS::HandleObject incumbentGlobal) {
+  if (m_ring.count == m_ring.entries.size()) {
+    grow();
+  }
+
+  size_t size = m_ring.entries.size();
+  Entry& entry = m_ring.entries[(m_ring.head + m_ring.count) % size];
+  entry.job = job;
+  entry.enqueued = Clock::now();
+  m_ring.count++;
+
+  m_depth.record(m_ring.count);
+  return true;
+}
+
+// Run jobs from the front of the queue until 'maxJobs' have run, the queue is
+// empty, or a job fails with an uncatchable error. Returns false in the last
+// case. Jobs that throw an exception are reported, and do not stop the queue.
+bool boilerplate::MicrotaskQueue::run(size_t maxJobs) {
+  JS::RootedObject job(m_cx);
+  JS::RootedValue rval(m_cx);
+
+  for (size_t ran = 0; ran < maxJobs && m_ring.count > 0; ran++) {
+    Entry& entry = m_ring.entries[m_ring.head];
+    job = entry.job;
+    entry.job = nullptr;
+    Clock::time_point enqueued = entry.enqueued;
+    m_ring.head = (m_ring.head + 1) % m_ring.entries.size();
+    m_ring.count--;
+
+    m_latency.record(Microseconds(Clock::now() - enqueued));
+    m_jobsRun++;
+
+    JSAutoRealm ar(m_cx, job);
+    if (!JS::Call(m_cx, JS::UndefinedHandleValue, job,
+                  JS::HandleValueArray::empty(), &rval)) {
+      if (!JS_IsExceptionPending(m_cx)) return false;
+      boilerplate::ReportAndClearException(m_cx);
+    }
+  }
+  return true;
+}
+
+// Run up to 'batchSize' jobs, including jobs that are queued by the jobs in the
+// batch. Returns false if a job failed with an uncatchable error, such as the
+// script being terminated; the remaining jobs stay queued.
+bool boilerplate::MicrotaskQueue::runBatch() {
+  if (m_draining) return true;
+  m_draining = true;
+
+  Clock::time_point start = Clock::now();
+  bool ok;
+  {
+    boilerplate::TraceScope scope("microtasks", "jobs");
+    ok = run(m_batchSize);
+  }
+  m_drainTime.record(Microseconds(Clock::now() - start));
+
+  // Like SpiderMonkey's own queue, release the targets of WeakRefs that were
+  // dereferenced during this microtask checkpoint once it is over.
+  if (ok && m_ring.count == 0) {
+    JS::ClearKeptObjects(m_cx);
+  }
+
+  m_draining = false;
+  return ok;
+}
+
+// Called by SpiderMonkey, for example from js::RunJobs, to run every job until
+// the queue is empty.
+void boilerplate::MicrotaskQueue::runJobs(JSContext* cx) {
+  while (!empty()) {
+    if (m_draining || !runBatch()) return;
+  }
+}
+
+// While the debugger pauses a script, jobs that the debugger's own code queues
+// must run without running the paused script's jobs, so SpiderMonkey asks the
+// queue to set aside its contents until the debugger is done.
+class boilerplate::MicrotaskQueue::SavedQueue
+    : public JS::JobQueue::SavedJobQueue {
+ public:
+  explicit SavedQueue(MicrotaskQueue* queue)
+      : m_queue(queue), m_wasDraining(queue->m_draining) {
+    queue->m_saved.push_back(std::move(queue->m_ring));
+    queue->m_ring = Ring();
+    queue->m_ring.entries.resize(queue->m_capacity);
+    queue->m_draining = false;
+  }
+
+  ~SavedQueue() override {
+    m_queue->m_ring = std::move(m_queue->m_saved.back());
+    m_queue->m_saved.pop_back();
+    m_queue->m_draining = m_wasDraining;
+  }
+
+ private:
+  MicrotaskQueue* m_queue;
+  bool m_wasDraining;
+};
+
+js::UniquePtr<JS::JobQueue::SavedJobQueue>
+boilerplate::MicrotaskQueue::saveJobQueue(JSContext* cx) {
+  auto saved = js::MakeUnique<SavedQueue>(this);
+  if (!saved) {
+    JS_ReportOutOfMemory(cx);
+    return nullptr;
+  }
+  return saved;
+}
+
+void boilerplate::MicrotaskQueue::writeMetrics(FILE* out,
+                                               const char* prefix) const {
+  std::string name(prefix);
+
+  fprintf(out, "# HELP %s_jobs_total Promise jobs run\n", prefix);
+  fprintf(out, "# TYPE %s_jobs_total counter\n", prefix);
+  fprintf(out, "%s_jobs_total %" PRIu64 "\n", prefix, m_jobsRun);
+
+  fprintf(out, "# HELP %s_depth Promise jobs waiting to run\n", prefix);
+  fprintf(out, "# TYPE %s_depth gauge\n", prefix);
+  fprintf(out, "%s_depth %zu\n", prefix, depth());
+
+  m_depth.writePrometheus(out, (name + "_enqueue_depth").c_str(),
+                          "Queue depth after each job was queued");
+  m_drainTime.writePrometheus(out, (name + "_batch_microseconds").c_str(),
+                              "Time taken to run each batch of jobs");
+  m_latency.writePrometheus(out, (name + "_latency_microseconds").c_str(),
+                            "Time from queuing a job to running it");
+}
@@ -0,0 +1,90 @@
+#ifndef MICROTASKQUEUE_H_
+#define MICROTASKQUEUE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/Promise.h>
+#include <js/TracingAPI.h>
+#include <js/Utility.h>
+
+#include "histogram.h"
+
+// See 'microtaskqueue.cpp' for documentation.
+
+namespace boilerplate {
+
+class MicrotaskQueue : public JS::JobQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit MicrotaskQueue(JSContext* cx, size_t capacity = 1024,
+                          size_t batchSize = 1000);
+  ~MicrotaskQueue() override;
+
+  MicrotaskQueue(const MicrotaskQueue&) = delete;
+  MicrotaskQueue& operator=(const MicrotaskQueue&) = delete;
+
+  bool init();
+  bool runBatch();
+
+  size_t depth() const { return m_ring.count; }
+  uint64_t jobsRun() const { return m_jobsRun; }
+
+  const Histogram& depthHistogram() const { return m_depth; }
+  const Histogram& drainTimeHistogram() const { return m_drainTime; }
+  const Histogram& latencyHistogram() const { return m_latency; }
+
+  void writeMetrics(FILE* out, const char* prefix = "js_microtask") const;
+
+  // JS::JobQueue
+  JSObject* getIncumbentGlobal(JSContext* cx) override;
+  bool enqueuePromiseJob(JSContext* cx, JS::HandleObject promise,
+                         JS::HandleObject job, JS::HandleObject allocationSite,
+                         JS::HandleObject incumbentGlobal) override;
+  void runJobs(JSContext* cx) override;
+  bool empty() const override { return m_ring.count == 0; }
+
+ private:
+  struct Entry {
+    JS::Heap<JSObject*> job;
+    Clock::time_point enqueued;
+  };
+
+  struct Ring {
+    std::vector<Entry> entries;
+    size_t head = 0;
+    size_t count = 0;
+  };
+
+  class SavedQueue;
+
+  js::UniquePtr<SavedJobQueue> saveJobQueue(JSContext* cx) override;
+
+  static void Trace(JSTracer* trc, void* data);
+  static void TraceRing(JSTracer* trc, Ring& ring);
+
+  void grow();
+  bool run(size_t maxJobs);
+
+  JSContext* m_cx;
+  Ring m_ring;
+  std::vector<Ring> m_saved;
+  size_t m_capacity;
+  size_t m_batchSize;
+  bool m_installed = false;
+  bool m_draining = false;
+
+  uint64_t m_jobsRun = 0;
+  Histogram m_depth;
+  Histogram m_drainTime;
+  Histogram m_latency;
+};
+
+}  // namespace boilerplate
+
+#endif  // MICROTASKQUEUE_H_
@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+
+#include "boilerplate.h"
+#include "microtaskqueue.h"
+
+// This program starts a promise chain that queues JOBS jobs one after the
+// other, the kind of runaway chain that would keep js::RunJobs busy until it
+// ends. It drains boilerplate::MicrotaskQueue in batches of at most BATCH jobs
+// instead, and between batches runs an "event loop turn" standing in for the
+// embedding's other work. It prints how many turns ran and the longest time
+// between two turns, followed by the queue's metrics in the Prometheus text
+// format.
+//
+// Usage: microtasks [JOBS [BATCH]]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned jobCount = 1000000;
+static unsigned batchSize = 1000;
+
+static bool ExecuteCode(JSContext* cx, const std::string& code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("chain.js", 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code.data(), code.size(), &rval);
+}
+
+static bool MicrotasksExample(JSContext* cx) {
+  boilerplate::MicrotaskQueue queue(cx, 1024, batchSize);
+  if (!queue.init()) return false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  std::string code = "let n = 0;\n"
+                     "function step() {\n"
+                     "  if (++n < " + std::to_string(jobCount) + ")\n"
+                     "    Promise.resolve().then(step);\n"
+                     "}\n"
+                     "step();\n";
+  if (!ExecuteCode(cx, code)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+
+  unsigned long turns = 0;
+  Clock::duration longestGap{};
+  Clock::time_point lastTurn = Clock::now();
+  Clock::time_point start = lastTurn;
+
+  while (!queue.empty()) {
+    if (!queue.runBatch()) return false;
+
+    // The embedding's other work would go here.
+    Clock::time_point now = Clock::now();
+    if (now - lastTurn > longestGap) longestGap = now - lastTurn;
+    lastTurn = now;
+    turns++;
+  }
+
+  std::chrono::duration<double, std::milli> total = Clock::now() - start;
+  std::chrono::duration<double, std::milli> gap = longestGap;
+  printf("# %llu jobs in %.1f ms, %lu event loop turns, longest gap %.3f ms\n",
+         (unsigned long long)queue.jobsRun(), total.count(), turns,
+         gap.count());
+
+  queue.writeMetrics(stdout);
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) jobCount = atoi(argv[1]);
+  if (argc > 2) batchSize = atoi(argv[2]);
+  if (jobCount == 0 || batchSize == 0) {
+    fprintf(stderr, "Usage: %s [JOBS [BATCH]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(MicrotasksExample)) {
+    return 1;
+  }
+  return 0;
+}
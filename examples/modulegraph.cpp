@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/Modules.h>
+
+#include "boilerplate.h"
+#include "moduleloader.h"
+
+// This program writes a large generated module graph to a temporary directory
+// and measures how long it takes to load and link it with
+// boilerplate::ModuleLoader:
+//
+// - "hook": prefetching disabled, so that each module is read and compiled on
+//   the main thread when JS::ModuleLink asks for it, as in the original
+//   modules.cpp.
+// - "prefetch": the graph is read by a number of reader threads and compiled on
+//   SpiderMonkey's helper threads before linking.
+//
+// SpiderMonkey sizes its helper thread pool by the number of cores, so to see
+// how loading scales with cores, run this under 'taskset', for example
+// 'taskset -c 0-3 modulegraph'.
+//
+// Usage: modulegraph [MODULES]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned moduleCount = 2000;
+
+static std::string ModuleName(unsigned i) {
+  return "m" + std::to_string(i);
+}
+
+// Module i imports its children 2i+1 and 2i+2 in a binary tree, so that all
+// modules are reachable from m0, plus one module further along that is shared
+// with other importers. Half of the children are imported as bare specifiers
+// from the 'lib' directory.
+static std::string GenerateModule(unsigned i) {
+  std::ostringstream out;
+  std::vector<unsigned> imports;
+  if (2 * i + 1 < moduleCount) imports.push_back(2 * i + 1);
+  if (2 * i + 2 < moduleCount) imports.push_back(2 * i + 2);
+  unsigned shared = (i * 7 + 3) % moduleCount;
+  if (shared > 2 * i + 2) imports.push_back(shared);
+
+  for (unsigned j : imports) {
+    if (j % 2) {
+      out << "import { f as " << ModuleName(j) << " } from '"
+          << ModuleName(j) << "';\n";
+    } else {
+      out << "import { f as " << ModuleName(j) << " } from '../lib/"
+          << ModuleName(j) << ".js';\n";
+    }
+  }
+
+  out << "export function f(n) {\n  let total = n;\n";
+  for (unsigned j : imports) {
+    out << "  total += " << ModuleName(j) << "(n - 1);\n";
+  }
+  out << "  return total;\n}\n";
+
+  // Some bulk, so that compiling takes a realistic amount of time.
+  for (unsigned k = 0; k < 20; k++) {
+    out << "export function helper" << k << "(items) {\n"
+        << "  return items.filter(x => x % " << (k + 2) << " === 0)\n"
+        << "              .map(x => ({ value: x, label: `" << i << "-" << k
+        << "-${x}` }));\n"
+        << "}\n";
+  }
+  return out.str();
+}
+
+static bool WriteGraph(const std::string& directory) {
+  if (mkdir((directory + "/app").c_str(), 0700) != 0 ||
+      mkdir((directory + "/lib").c_str(), 0700) != 0) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < moduleCount; i++) {
+    std::string path = i == 0 ? directory + "/app/main.mjs"
+                              : directory + "/lib/" + ModuleName(i) + ".js";
+
+    FILE* fp = fopen(path.c_str(), "w");
+    if (!fp) return false;
+    std::string source = GenerateModule(i);
+    bool ok = fwrite(source.data(), 1, source.size(), fp) == source.size();
+    if (fclose(fp) != 0 || !ok) return false;
+  }
+  return true;
+}
+
+static void RemoveTree(const std::string& directory) {
+  for (const char* sub : {"/app", "/lib"}) {
+    std::string path = directory + sub;
+    if (DIR* dir = opendir(path.c_str())) {
+      while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        unlink((path + '/' + entry->d_name).c_str());
+      }
+      closedir(dir);
+    }
+    rmdir(path.c_str());
+  }
+  rmdir(directory.c_str());
+}
+
+static std::string graphDirectory;
+
+// Load and link the graph into a fresh global. Prints the time taken unless
+// 'name' is null.
+static bool LoadGraph(JSContext* cx, const char* name, bool prefetch,
+                      size_t readers) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  Clock::time_point start = Clock::now();
+  size_t loaded;
+  {
+    boilerplate::ModuleLoader loader(cx);
+    loader.addSearchPath(graphDirectory + "/lib");
+    loader.setPrefetch(prefetch);
+    loader.setReaderThreads(readers);
+
+    JS::RootedObject mod(cx, loader.load(graphDirectory + "/app/main.mjs"));
+    if (!mod || !JS::ModuleLink(cx, mod)) {
+      boilerplate::ReportAndClearException(cx);
+      return false;
+    }
+    loaded = loader.moduleCount();
+  }
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+
+  if (name) {
+    printf("%-8s %3zu readers  %5zu modules loaded and linked in %8.1f ms\n",
+           name, prefetch ? readers : 0, loaded, elapsed.count());
+  }
+  return true;
+}
+
+static bool ModuleGraphExample(JSContext* cx) {
+  // Once without measuring, so that every run finds the files in the page
+  // cache.
+  if (!LoadGraph(cx, nullptr, false, 1)) return false;
+
+  if (!LoadGraph(cx, "hook", false, 1)) return false;
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t readers = 1; readers < cores; readers *= 2) {
+    if (!LoadGraph(cx, "prefetch", true, readers)) return false;
+  }
+  return LoadGraph(cx, "prefetch", true, cores);
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) moduleCount = atoi(argv[1]);
+  if (moduleCount == 0) {
+    fprintf(stderr, "Usage: %s [MODULES]\n", argv[0]);
+    return 1;
+  }
+
+  char tmpl[] = "/tmp/modulegraph-XXXXXX";
+  if (!mkdtemp(tmpl)) {
+    perror("Cannot create temporary directory");
+    return 1;
+  }
+  graphDirectory = tmpl;
+
+  bool ok = WriteGraph(graphDirectory) &&
+            boilerplate::RunExample(ModuleGraphExample);
+
+  RemoveTree(graphDirectory);
+  return ok ? 0 : 1;
+}
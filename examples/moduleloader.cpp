@@ -0,0 +1,770 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <jsfriendapi.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/CompileOptions.h>
+#include <js/Modules.h>
+#include <js/OffThreadScriptCompilation.h>
+#include <js/Promise.h>
+#include <js/SourceText.h>
+#include <js/String.h>
+#include <js/experimental/JSStencil.h>
+
+#include "moduleloader.h"
+#include "traceevents.h"
+
+// A module loader that reads ES modules from the filesystem, for embeddings
+// that have more than a handful of modules.
+//
+// modules.cpp shows the minimum: a resolve hook that compiles each module on
+// the main thread when SpiderMonkey asks for it during JS::ModuleLink. For a
+// large import graph that means reading and compiling every file one after the
+// other. ModuleLoader instead finds the whole graph before linking: reader
+// threads read each file and scan it for import and export-from declarations,
+// which tells them the next files to read, and each file that has been read is
+// handed to SpiderMonkey's helper threads to compile. Both happen in parallel
+// and overlap with each other. When the graph is complete, the compiled
+// modules are instantiated on the main thread, and JS::ModuleLink only has to
+// look up modules that are already loaded.
+//
+// The scan is a quick lexical one, which does not understand all of
+// JavaScript; for example, a regular expression literal containing a quote can
+// throw it off. That only costs performance: an import that the scan misses is
+// loaded by the resolve hook when it is needed, and a file that is read for an
+// import that does not really exist is never used.
+//
+// Specifiers starting with '/', './' or '../' are resolved relative to the
+// importing module. Other ("bare") specifiers are looked up in each search path
+// in turn. In both cases the file may leave off a '.js' or '.mjs' extension, or
+// name a directory containing 'index.js' or 'index.mjs'. The results of
+// resolving and of checking whether files exist are cached.
+//
+// A loader keeps the registry of modules for one global, and loads modules into
+// whatever realm the context is in when 'load' is called; create a separate
+// loader for each global. The resolve hook finds the loader through each
+// module's private value, so several loaders can coexist in one runtime.
+//
+// Usage:
+//
+//   boilerplate::ModuleLoader loader(cx);
+//   loader.addSearchPath("/usr/lib/myapp/modules");
+//
+//   JS::RootedObject mod(cx, loader.load("main.mjs"));
+//   if (!mod || !loader.run(mod)) ...exception pending
+//
+// Modules may also use import(). A dynamically imported module is only read
+// when the import() call runs, so code paths that are imported lazily cost
+// nothing at startup. 'run' evaluates the entry module and then drives the job
+// queue, loading dynamic imports as they come, until the entry module has
+// finished evaluating, including any top-level await.
+//
+// NOTE: The loader holds its modules alive, so it must be destroyed before the
+// context is.
+
+static std::string Dirname(const std::string& path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) return ".";
+  if (slash == 0) return "/";
+  return path.substr(0, slash);
+}
+
+// Make a path absolute and remove '.' and '..' components, so that each file
+// has one name in the registry. Does not touch the filesystem.
+static std::string NormalizePath(const std::string& path) {
+  std::string absolute = path;
+  if (path.empty() || path[0] != '/') {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd))) {
+      absolute = std::string(cwd) + '/' + path;
+    }
+  }
+
+  std::vector<std::string_view> parts;
+  std::string_view rest(absolute);
+  while (!rest.empty()) {
+    size_t slash = rest.find('/');
+    std::string_view part = rest.substr(0, slash);
+    rest = slash == std::string_view::npos ? std::string_view()
+                                           : rest.substr(slash + 1);
+    if (part.empty() || part == ".") continue;
+    if (part == "..") {
+      if (!parts.empty()) parts.pop_back();
+      continue;
+    }
+    parts.push_back(part);
+  }
+
+  std::string result;
+  for (std::string_view part : parts) {
+    result += '/';
+    result += part;
+  }
+  return result.empty() ? "/" : result;
+}
+
+static bool IsRelativeSpecifier(const std::string& specifier) {
+  return specifier[0] == '/' || specifier.compare(0, 2, "./") == 0 ||
+         specifier.compare(0, 3, "../") == 0;
+}
+
+static bool IsIdentifierChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '$' || uint8_t(c) >= 0x80;
+}
+
+// Find the specifiers of static import declarations ("import ... from 'x'",
+// "import 'x'") and export-from declarations ("export ... from 'x'"). Dynamic
+// import() and import.meta are skipped.
+static void ScanImports(const std::string& source,
+                        std::vector<std::string>* specifiers) {
+  bool inDeclaration = false;
+  bool expectSpecifier = false;
+  char previous = ';';
+  size_t n = source.size();
+  size_t i = 0;
+
+  while (i < n) {
+    char c = source[i];
+
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      i++;
+    } else if (c == '/' && i + 1 < n && source[i + 1] == '/') {
+      while (i < n && source[i] != '\n') i++;
+    } else if (c == '/' && i + 1 < n && source[i + 1] == '*') {
+      size_t end = source.find("*/", i + 2);
+      i = end == std::string::npos ? n : end + 2;
+    } else if (c == '\'' || c == '"' || c == '`') {
+      size_t end = i + 1;
+      while (end < n && source[end] != c && (c == '`' || source[end] != '\n')) {
+        if (source[end] == '\\') end++;
+        end++;
+      }
+      if (inDeclaration && expectSpecifier && c != '`') {
+        std::string specifier = source.substr(i + 1, end - i - 1);
+        if (!specifier.empty() &&
+            std::find(specifiers->begin(), specifiers->end(), specifier) ==
+                specifiers->end()) {
+          specifiers->push_back(std::move(specifier));
+        }
+        inDeclaration = false;
+      }
+      expectSpecifier = false;
+      previous = c;
+      i = end + 1;
+    } else if (IsIdentifierChar(c)) {
+      size_t start = i;
+      while (i < n && IsIdentifierChar(source[i])) i++;
+      std::string_view word(source.data() + start, i - start);
+
+      if (previous == '.') {
+        // A property name, such as 'foo.import'.
+      } else if (word == "import") {
+        size_t next = i;
+        while (next < n && (source[next] == ' ' || source[next] == '\t')) {
+          next++;
+        }
+        bool dynamic = next < n && (source[next] == '(' || source[next] == '.');
+        inDeclaration = !dynamic;
+        expectSpecifier = !dynamic;
+      } else if (word == "export") {
+        inDeclaration = true;
+        expectSpecifier = false;
+      } else {
+        expectSpecifier = inDeclaration && word == "from";
+      }
+      previous = 'a';
+    } else {
+      // Anything that cannot occur before 'from' ends the declaration, for
+      // example in 'export const x = ...' or 'export function f() ...'.
+      if (c == ';' || c == '(' || c == '=') inDeclaration = false;
+      expectSpecifier = false;
+      previous = c;
+      i++;
+    }
+  }
+}
+
+// Compare a module request's specifier with one found by ScanImports, without
+// copying the specifier out of the JS string. Only ASCII specifiers can match;
+// others take the slow path in 'lookupImport'.
+static bool SpecifierEquals(JSContext* cx, JSString* str,
+                            const std::string& specifier) {
+  size_t length = JS_GetStringLength(str);
+  if (length != specifier.size()) return false;
+
+  JS::AutoCheckCannotGC nogc;
+  if (JS_StringHasLatin1Chars(str)) {
+    const JS::Latin1Char* chars =
+        JS_GetLatin1StringCharsAndLength(cx, nogc, str, &length);
+    if (!chars) return false;
+    for (size_t i = 0; i < length; i++) {
+      if (uint8_t(specifier[i]) >= 0x80 || chars[i] != specifier[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char16_t* chars =
+      JS_GetTwoByteStringCharsAndLength(cx, nogc, str, &length);
+  if (!chars) return false;
+  for (size_t i = 0; i < length; i++) {
+    if (uint8_t(specifier[i]) >= 0x80 || chars[i] != specifier[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Installs the module resolve and dynamic import hooks for the context's
+// runtime.
+boilerplate::ModuleLoader::ModuleLoader(JSContext* cx)
+    : m_cx(cx),
+      m_readerThreads(std::max(1u, std::thread::hardware_concurrency())) {
+  JS::SetModuleResolveHook(JS_GetRuntime(cx), ResolveHook);
+  JS::SetModuleDynamicImportHook(JS_GetRuntime(cx), DynamicImportHook);
+}
+
+boilerplate::ModuleLoader::~ModuleLoader() {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stopping = true;
+    m_wakeup.notify_all();
+  }
+  for (std::thread& reader : m_readers) {
+    reader.join();
+  }
+
+  for (auto& entry : m_registry) {
+    Module* module = entry.second.get();
+    if (module->token) {
+      JS::CancelOffThreadToken(m_cx, module->token);
+    }
+    if (module->object) {
+      JS::SetModulePrivate(module->object, JS::UndefinedValue());
+    }
+  }
+}
+
+// Add a directory in which to look for bare specifiers such as 'lodash'.
+// Search paths are tried in the order they were added.
+void boilerplate::ModuleLoader::addSearchPath(const std::string& directory) {
+  m_searchPaths.push_back(NormalizePath(directory));
+}
+
+bool boilerplate::ModuleLoader::fileExists(const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(m_cacheLock);
+    auto search = m_statCache.find(path);
+    if (search != m_statCache.end()) return search->second;
+  }
+
+  struct stat st;
+  bool exists = stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+
+  std::lock_guard<std::mutex> lock(m_cacheLock);
+  m_statCache.emplace(path, exists);
+  return exists;
+}
+
+// Returns the normalized path of the file that 'specifier' refers to when
+// imported from the module at path 'referrer', or an empty string if there is
+// no such file.
+std::string boilerplate::ModuleLoader::resolve(const std::string& referrer,
+                                               const std::string& specifier) {
+  // Bare specifiers resolve the same way from anywhere.
+  std::string key = IsRelativeSpecifier(specifier) && specifier[0] != '/'
+                        ? Dirname(referrer) + '\0' + specifier
+                        : '\0' + specifier;
+  {
+    std::lock_guard<std::mutex> lock(m_cacheLock);
+    auto search = m_resolveCache.find(key);
+    if (search != m_resolveCache.end()) return search->second;
+  }
+
+  std::string path = resolveUncached(referrer, specifier);
+
+  std::lock_guard<std::mutex> lock(m_cacheLock);
+  m_resolveCache.emplace(std::move(key), path);
+  return path;
+}
+
+std::string boilerplate::ModuleLoader::resolveUncached(
+    const std::string& referrer, const std::string& specifier) {
+  static const char* suffixes[] = {"", ".js", ".mjs", "/index.js",
+                                   "/index.mjs"};
+
+  std::vector<std::string> bases;
+  if (specifier[0] == '/') {
+    bases.push_back(specifier);
+  } else if (IsRelativeSpecifier(specifier)) {
+    bases.push_back(Dirname(referrer) + '/' + specifier);
+  } else {
+    for (const std::string& directory : m_searchPaths) {
+      bases.push_back(directory + '/' + specifier);
+    }
+  }
+
+  for (const std::string& base : bases) {
+    std::string normalized = NormalizePath(base);
+    for (const char* suffix : suffixes) {
+      std::string path = normalized + suffix;
+      if (fileExists(path)) return path;
+    }
+  }
+  return std::string();
+}
+
+// Read a module's source, and resolve its imports if 'scan' is set. Runs on
+// the reader threads during 'prefetch'.
+void boilerplate::ModuleLoader::read(Module* module, bool scan) {
+  FILE* fp = fopen(module->path.c_str(), "rb");
+  if (!fp) {
+    module->readError = errno;
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fileno(fp), &st) == 0) {
+    module->source.resize(st.st_size);
+    module->source.resize(
+        fread(&module->source[0], 1, module->source.size(), fp));
+  }
+  module->readError = ferror(fp) ? EIO : 0;
+  fclose(fp);
+  if (module->readError) return;
+  module->readOk = true;
+
+  if (!scan) return;
+
+  // A module that a failed prefetch dropped may be read again.
+  module->imports.clear();
+  std::vector<std::string> specifiers;
+  ScanImports(module->source, &specifiers);
+  for (std::string& specifier : specifiers) {
+    Import import;
+    import.path = resolve(module->path, specifier);
+    import.specifier = std::move(specifier);
+    module->imports.push_back(std::move(import));
+  }
+}
+
+boilerplate::ModuleLoader::Module* boilerplate::ModuleLoader::registerModule(
+    const std::string& path) {
+  std::unique_ptr<Module>& slot = m_registry[path];
+  if (!slot) {
+    slot = std::make_unique<Module>();
+    slot->loader = this;
+    slot->path = path;
+  }
+  return slot.get();
+}
+
+// The reader threads are started by the first 'prefetch', and wait for more
+// files to read between prefetches until the loader is destroyed.
+void boilerplate::ModuleLoader::readerMain() {
+  for (;;) {
+    Module* module;
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_wakeup.wait(lock, [this] { return m_stopping || !m_toRead.empty(); });
+      if (m_stopping) return;
+      module = m_toRead.front();
+      m_toRead.pop_front();
+      m_reading++;
+    }
+
+    read(module, true);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_reading--;
+    m_read.push_back(module);
+    m_done.notify_all();
+  }
+}
+
+// Called on a helper thread when a module has been compiled. This must not use
+// any JSAPI.
+void boilerplate::ModuleLoader::OnCompiled(JS::OffThreadToken* token,
+                                           void* data) {
+  Module* module = static_cast<Module*>(data);
+  ModuleLoader* loader = module->loader;
+
+  std::lock_guard<std::mutex> lock(loader->m_lock);
+  module->token = token;
+  loader->m_compiling--;
+  loader->m_done.notify_all();
+}
+
+// Read, scan and compile every module reachable from 'entry' that is not
+// already loaded, and instantiate them all. Returns false with an exception
+// pending if any of them failed to compile. Modules that could not be read are
+// left for the resolve hook to report if they turn out to be imported.
+bool boilerplate::ModuleLoader::prefetch(Module* entry) {
+  if (m_readers.empty()) {
+    for (size_t i = 0; i < std::max(size_t(1), m_readerThreads); i++) {
+      m_readers.emplace_back(&ModuleLoader::readerMain, this);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_toRead.push_back(entry);
+    m_wakeup.notify_one();
+  }
+  size_t outstanding = 1;
+
+  std::vector<Module*> fetched;
+
+  bool ok = true;
+  while (ok && outstanding > 0) {
+    Module* module;
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_done.wait(lock, [this] { return !m_read.empty(); });
+      module = m_read.front();
+      m_read.pop_front();
+    }
+    outstanding--;
+    fetched.push_back(module);
+
+    for (Import& import : module->imports) {
+      if (import.path.empty() || m_registry.count(import.path)) continue;
+
+      Module* dependency = registerModule(import.path);
+      std::lock_guard<std::mutex> lock(m_lock);
+      m_toRead.push_back(dependency);
+      m_wakeup.notify_one();
+      outstanding++;
+    }
+
+    if (!module->readOk) continue;
+
+    // Small modules are compiled off-thread too, even though
+    // JS::CanCompileOffThread would advise against it for each one on its own,
+    // because there are many of them to spread over the helper threads.
+    JS::CompileOptions options(m_cx);
+    options.setFileAndLine(module->path.c_str(), 1);
+
+    JS::SourceText<mozilla::Utf8Unit> srcBuf;
+    ok = srcBuf.init(m_cx, module->source.data(), module->source.size(),
+                     JS::SourceOwnership::Borrowed);
+    if (!ok) break;
+
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      m_compiling++;
+    }
+    JS::OffThreadToken* token = JS::CompileModuleToStencilOffThread(
+        m_cx, options, srcBuf, OnCompiled, module);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (token) {
+      module->token = token;
+    } else {
+      m_compiling--;
+      ok = false;
+    }
+  }
+
+  // After a failure, drop the files not yet read, and let the readers finish
+  // the ones they have started, so that none is left in the queues for the
+  // next prefetch.
+  {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_toRead.clear();
+    m_done.wait(lock, [this] { return m_reading == 0 && m_compiling == 0; });
+    m_read.clear();
+  }
+
+  // Finish compiling in the order the modules were found. After a failure,
+  // the rest are only cleaned up.
+  for (Module* module : fetched) {
+    if (!module->token) continue;
+
+    JS::OffThreadToken* token = module->token;
+    module->token = nullptr;
+    if (!ok) {
+      JS::CancelOffThreadToken(m_cx, token);
+      continue;
+    }
+
+    RefPtr<JS::Stencil> stencil = JS::FinishOffThreadStencil(m_cx, token);
+    ok = stencil && instantiate(module, stencil);
+  }
+
+  for (Module* module : fetched) {
+    for (Import& import : module->imports) {
+      if (!import.path.empty()) import.target = m_registry[import.path].get();
+    }
+  }
+
+  return ok;
+}
+
+bool boilerplate::ModuleLoader::instantiate(Module* module,
+                                            JS::Stencil* stencil) {
+  JS::CompileOptions options(m_cx);
+  options.setFileAndLine(module->path.c_str(), 1);
+
+  JS::InstantiateOptions instantiateOptions(options);
+  JS::RootedObject object(
+      m_cx, JS::InstantiateModuleStencil(m_cx, instantiateOptions, stencil));
+  if (!object) return false;
+
+  setObject(module, object);
+  return true;
+}
+
+// Record the compiled module object. The source is no longer needed once it has
+// been compiled; SpiderMonkey keeps its own copy.
+void boilerplate::ModuleLoader::setObject(Module* module,
+                                          JS::HandleObject object) {
+  JS::SetModulePrivate(object, JS::PrivateValue(module));
+  module->object.init(m_cx, object);
+  module->source = std::string();
+}
+
+// Compile a module on the main thread, reading it first if necessary.
+bool boilerplate::ModuleLoader::loadNow(Module* module) {
+  if (!module->readOk) {
+    read(module, false);
+  }
+  if (!module->readOk) {
+    JS_ReportErrorUTF8(m_cx, "Cannot read module %s: %s", module->path.c_str(),
+                       strerror(module->readError));
+    return false;
+  }
+
+  JS::CompileOptions options(m_cx);
+  options.setFileAndLine(module->path.c_str(), 1);
+
+  JS::SourceText<mozilla::Utf8Unit> srcBuf;
+  if (!srcBuf.init(m_cx, module->source.data(), module->source.size(),
+                   JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  boilerplate::TraceScope scope("CompileModule", "compile",
+                                module->path.c_str());
+  JS::RootedObject object(m_cx, JS::CompileModule(m_cx, options, srcBuf));
+  if (!object) return false;
+
+  setObject(module, object);
+  return true;
+}
+
+// Compile a module that is not loaded yet, along with everything it imports if
+// prefetching is enabled.
+bool boilerplate::ModuleLoader::ensureLoaded(Module* module) {
+  if (module->object) return true;
+  if (m_prefetch && !prefetch(module)) return false;
+  return module->object || loadNow(module);
+}
+
+// Load the module at 'path', and with prefetching enabled, everything it
+// imports. Returns the module, ready for JS::ModuleLink, or nullptr with an
+// exception pending. Loading a module a second time returns the same object.
+JSObject* boilerplate::ModuleLoader::load(const std::string& path) {
+  Module* entry = registerModule(NormalizePath(path));
+  if (!ensureLoaded(entry)) return nullptr;
+  return entry->object;
+}
+
+// Find the module that 'specifier' refers to in 'referrer', loading it if the
+// scan in 'prefetch' did not find it, or if prefetching is disabled. Dynamic
+// imports always come through the second path, because the scan skips them.
+boilerplate::ModuleLoader::Module* boilerplate::ModuleLoader::lookupImport(
+    JSContext* cx, Module* referrer, JS::HandleString specifier) {
+  for (Import& import : referrer->imports) {
+    if (!SpecifierEquals(cx, specifier, import.specifier)) continue;
+
+    if (import.path.empty()) {
+      JS_ReportErrorUTF8(cx, "Cannot find module '%s' imported from %s",
+                         import.specifier.c_str(), referrer->path.c_str());
+      return nullptr;
+    }
+    // Imports of a module that a failed prefetch dropped were never linked
+    // to their targets.
+    if (!import.target) import.target = registerModule(import.path);
+    if (!ensureLoaded(import.target)) return nullptr;
+    return import.target;
+  }
+
+  JS::UniqueChars chars(JS_EncodeStringToUTF8(cx, specifier));
+  if (!chars) return nullptr;
+
+  Import import;
+  import.specifier = chars.get();
+  import.path = import.specifier.empty()
+                    ? std::string()
+                    : resolve(referrer->path, import.specifier);
+  if (import.path.empty()) {
+    JS_ReportErrorUTF8(cx, "Cannot find module '%s' imported from %s",
+                       chars.get(), referrer->path.c_str());
+    return nullptr;
+  }
+
+  import.target = registerModule(import.path);
+  if (!ensureLoaded(import.target)) return nullptr;
+
+  Module* target = import.target;
+  referrer->imports.push_back(std::move(import));
+  return target;
+}
+
+JSObject* boilerplate::ModuleLoader::ResolveHook(
+    JSContext* cx, JS::HandleValue modulePrivate,
+    JS::HandleObject moduleRequest) {
+  if (modulePrivate.isUndefined()) {
+    JS_ReportErrorASCII(cx, "Module was not loaded by a ModuleLoader");
+    return nullptr;
+  }
+  Module* referrer = static_cast<Module*>(modulePrivate.toPrivate());
+
+  JS::RootedString specifier(cx,
+                             JS::GetModuleRequestSpecifier(cx, moduleRequest));
+  if (!specifier) return nullptr;
+
+  Module* target = referrer->loader->lookupImport(cx, referrer, specifier);
+  return target ? target->object.get() : nullptr;
+}
+
+// Called when a module runs import(). The import is queued, and carried out by
+// 'run' once the current job has finished.
+bool boilerplate::ModuleLoader::DynamicImportHook(
+    JSContext* cx, JS::HandleValue referencingPrivate,
+    JS::HandleObject moduleRequest, JS::HandleObject promise) {
+  if (referencingPrivate.isUndefined()) {
+    JS_ReportErrorASCII(cx,
+                        "import() is only supported in modules loaded by a "
+                        "ModuleLoader");
+    return false;
+  }
+  Module* referrer = static_cast<Module*>(referencingPrivate.toPrivate());
+
+  auto import = std::make_unique<DynamicImport>(cx);
+  import->referencingPrivate = referencingPrivate;
+  import->moduleRequest = moduleRequest;
+  import->promise = promise;
+  referrer->loader->m_dynamicImports.push_back(std::move(import));
+  return true;
+}
+
+// Load, link and evaluate the module requested by a queued import(), and settle
+// the promise that import() returned.
+bool boilerplate::ModuleLoader::finishDynamicImport(DynamicImport* import) {
+  JS::RootedValue referencingPrivate(m_cx, import->referencingPrivate);
+  JS::RootedObject moduleRequest(m_cx, import->moduleRequest);
+  JS::RootedObject promise(m_cx, import->promise);
+  Module* referrer = static_cast<Module*>(referencingPrivate.toPrivate());
+
+  // Loading is the part of an import that is spent waiting for files to be
+  // read and compiled.
+  Clock::time_point start = Clock::now();
+  JS::RootedString specifier(
+      m_cx, JS::GetModuleRequestSpecifier(m_cx, moduleRequest));
+  Module* target =
+      specifier ? lookupImport(m_cx, referrer, specifier) : nullptr;
+  JS::RootedObject module(m_cx, target ? target->object.get() : nullptr);
+  bool ok = module && JS::ModuleLink(m_cx, module);
+  m_runStats.waiting += Clock::now() - start;
+
+  JS::RootedObject evaluationPromise(m_cx);
+  if (ok) {
+    start = Clock::now();
+    boilerplate::TraceScope scope("ModuleEvaluate", "execute",
+                                  target->path.c_str());
+    JS::RootedValue rval(m_cx);
+    ok = JS::ModuleEvaluate(m_cx, module, &rval);
+    m_runStats.executing += Clock::now() - start;
+
+    if (ok && rval.isObject()) {
+      evaluationPromise = &rval.toObject();
+    } else if (ok) {
+      evaluationPromise = JS::CallOriginalPromiseResolve(m_cx, rval);
+    }
+  }
+  m_runStats.dynamicImports++;
+
+  // Without an evaluation promise, this rejects the import() promise with the
+  // pending exception.
+  if (!evaluationPromise && !JS_IsExceptionPending(m_cx)) return false;
+  return JS::FinishDynamicModuleImport(m_cx, evaluationPromise,
+                                       referencingPrivate, moduleRequest,
+                                       promise);
+}
+
+// Link and evaluate a module returned by 'load', and then keep running promise
+// jobs and dynamic imports until its evaluation has finished. Modules that use
+// top-level await only finish evaluating this way. Returns false with an
+// exception pending if the module threw, or if its evaluation can never finish
+// because it is waiting for something that will not happen.
+//
+// The time spent running JavaScript and waiting for dynamically imported
+// modules to load is available from 'runStats' afterwards.
+//
+// NOTE: The context must have a job queue, such as boilerplate::MicrotaskQueue
+// or the one from js::UseInternalJobQueues.
+bool boilerplate::ModuleLoader::run(JS::HandleObject module) {
+  m_runStats = RunStats();
+
+  if (!JS::ModuleLink(m_cx, module)) return false;
+
+  Clock::time_point start = Clock::now();
+  JS::RootedValue rval(m_cx);
+  bool ok;
+  {
+    boilerplate::TraceScope scope("ModuleEvaluate", "execute");
+    ok = JS::ModuleEvaluate(m_cx, module, &rval);
+  }
+  m_runStats.executing += Clock::now() - start;
+  if (!ok) return false;
+
+  // Without top-level await support, evaluation is already complete.
+  if (!rval.isObject()) return true;
+  JS::RootedObject evaluationPromise(m_cx, &rval.toObject());
+
+  for (;;) {
+    start = Clock::now();
+    {
+      boilerplate::TraceScope scope("RunJobs", "jobs");
+      js::RunJobs(m_cx);
+    }
+    m_runStats.executing += Clock::now() - start;
+
+    if (m_dynamicImports.empty()) break;
+
+    std::unique_ptr<DynamicImport> import =
+        std::move(m_dynamicImports.front());
+    m_dynamicImports.pop_front();
+    if (!finishDynamicImport(import.get())) return false;
+  }
+
+  switch (JS::GetPromiseState(evaluationPromise)) {
+    case JS::PromiseState::Fulfilled:
+      return true;
+    case JS::PromiseState::Rejected: {
+      JS::RootedValue reason(m_cx, JS::GetPromiseResult(evaluationPromise));
+      JS_SetPendingException(m_cx, reason);
+      return false;
+    }
+    case JS::PromiseState::Pending:
+      break;
+  }
+  JS_ReportErrorASCII(m_cx,
+                      "Module evaluation did not finish: it is awaiting a "
+                      "promise that can never be settled");
+  return false;
+}
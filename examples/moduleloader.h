@@ -0,0 +1,139 @@
+#ifndef MODULELOADER_H_
+#define MODULELOADER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/OffThreadScriptCompilation.h>
+#include <js/experimental/JSStencil.h>
+
+#include <mozilla/RefPtr.h>
+
+// See 'moduleloader.cpp' for documentation.
+
+namespace boilerplate {
+
+class ModuleLoader {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct RunStats {
+    Clock::duration executing{};
+    Clock::duration waiting{};
+    unsigned dynamicImports = 0;
+  };
+
+  explicit ModuleLoader(JSContext* cx);
+  ~ModuleLoader();
+
+  ModuleLoader(const ModuleLoader&) = delete;
+  ModuleLoader& operator=(const ModuleLoader&) = delete;
+
+  void addSearchPath(const std::string& directory);
+  // Takes effect only before the first 'load'.
+  void setReaderThreads(size_t count) { m_readerThreads = count; }
+  void setPrefetch(bool prefetch) { m_prefetch = prefetch; }
+
+  JSObject* load(const std::string& path);
+  bool run(JS::HandleObject module);
+
+  const RunStats& runStats() const { return m_runStats; }
+
+  size_t moduleCount() const { return m_registry.size(); }
+
+ private:
+  struct Module;
+
+  struct Import {
+    std::string specifier;
+    std::string path;  // empty if it could not be resolved
+    Module* target = nullptr;
+  };
+
+  struct Module {
+    ModuleLoader* loader;
+    std::string path;
+    std::string source;
+    std::vector<Import> imports;
+    bool readOk = false;
+    int readError = 0;
+    JS::OffThreadToken* token = nullptr;
+    JS::PersistentRootedObject object;
+  };
+
+  struct DynamicImport {
+    explicit DynamicImport(JSContext* cx)
+        : referencingPrivate(cx), moduleRequest(cx), promise(cx) {}
+
+    JS::PersistentRootedValue referencingPrivate;
+    JS::PersistentRootedObject moduleRequest;
+    JS::PersistentRootedObject promise;
+  };
+
+  static JSObject* ResolveHook(JSContext* cx, JS::HandleValue modulePrivate,
+                               JS::HandleObject moduleRequest);
+  static bool DynamicImportHook(JSContext* cx,
+                                JS::HandleValue referencingPrivate,
+                                JS::HandleObject moduleRequest,
+                                JS::HandleObject promise);
+  static void OnCompiled(JS::OffThreadToken* token, void* data);
+
+  bool fileExists(const std::string& path);
+  std::string resolve(const std::string& referrer,
+                      const std::string& specifier);
+  std::string resolveUncached(const std::string& referrer,
+                              const std::string& specifier);
+  void read(Module* module, bool scan);
+
+  Module* registerModule(const std::string& path);
+  bool prefetch(Module* entry);
+  void readerMain();
+  bool instantiate(Module* module, JS::Stencil* stencil);
+  void setObject(Module* module, JS::HandleObject object);
+  bool loadNow(Module* module);
+  bool ensureLoaded(Module* module);
+  bool finishDynamicImport(DynamicImport* import);
+  Module* lookupImport(JSContext* cx, Module* referrer,
+                       JS::HandleString specifier);
+
+  JSContext* m_cx;
+  std::vector<std::string> m_searchPaths;
+  size_t m_readerThreads;
+  bool m_prefetch = true;
+
+  // Registry of every module loaded into this loader's global, by path.
+  std::unordered_map<std::string, std::unique_ptr<Module>> m_registry;
+
+  // import() calls waiting to be carried out by 'run'.
+  std::deque<std::unique_ptr<DynamicImport>> m_dynamicImports;
+  RunStats m_runStats;
+
+  // Caches shared by the reader threads.
+  std::mutex m_cacheLock;
+  std::unordered_map<std::string, bool> m_statCache;
+  std::unordered_map<std::string, std::string> m_resolveCache;
+
+  // Reader threads and work queues for 'prefetch'.
+  std::vector<std::thread> m_readers;
+  std::mutex m_lock;
+  std::condition_variable m_wakeup;
+  std::condition_variable m_done;
+  std::deque<Module*> m_toRead;
+  std::deque<Module*> m_read;
+  size_t m_reading = 0;
+  size_t m_compiling = 0;
+  bool m_stopping = false;
+};
+
+}  // namespace boilerplate
+
+#endif  // MODULELOADER_H_
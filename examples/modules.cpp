@@ -1,89 +1,107 @@
-#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <jsapi.h>
+#include <jsfriendapi.h>
 
-#include <js/CompilationAndEvaluation.h>
 #include <js/Modules.h>
-#include <js/SourceText.h>
 
 #include "boilerplate.h"
+#include "moduleloader.h"
 
-// This examples demonstrates how to compile ES modules in an embedding.
+// This examples demonstrates how to load ES modules from the filesystem in an
+// embedding.
+//
+// The modules are found, read and compiled by boilerplate::ModuleLoader, which
+// installs the hooks that SpiderMonkey calls for each import statement and
+// import() call. The loader also drives the job queue until the entry module
+// has finished evaluating, which matters for modules that use top-level await.
+// See 'moduleloader.cpp' for how that works.
+//
+// If no entry module is given, a small module graph is written to a temporary
+// directory and loaded from there.
 //
 // See 'boilerplate.cpp' for the parts of this example that are reused in many
 // simple embedding examples.
+//
+// Usage: modules [ENTRY [SEARCH_PATH...]]
 
-// Translates source code into a JSObject representing the compiled module. This
-// module is not yet linked/instantiated.
-static JSObject* CompileExampleModule(JSContext* cx, const char* filename,
-                                      const char* code) {
-  JS::CompileOptions options(cx);
-  options.setFileAndLine(filename, 1);
-
-  JS::SourceText<mozilla::Utf8Unit> source;
-  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
-    return nullptr;
-  }
+static std::string entryPath;
+static std::vector<std::string> searchPaths;
 
-  // Compile the module source to bytecode.
-  //
-  // NOTE: This generates a JSObject instead of a JSScript. This contains
-  // additional metadata to resolve imports/exports. This object should not be
-  // exposed to other JS code or unexpected behaviour may occur.
-  return JS::CompileModule(cx, options, source);
+static bool WriteFile(const std::string& path, const char* contents) {
+  FILE* fp = fopen(path.c_str(), "w");
+  if (!fp) return false;
+  bool ok = fputs(contents, fp) >= 0;
+  return fclose(fp) == 0 && ok;
 }
 
-// Maintain a registry of imported modules. The ResolveHook may be called
-// multiple times for the same specifier and we need to return the same compiled
-// module.
-//
-// NOTE: This example assumes only one JSContext/GlobalObject is used, but in
-// general the registry needs to be distinct for each GlobalObject.
-static std::map<std::u16string, JS::PersistentRootedObject> moduleRegistry;
-
-// Callback for embedding to provide modules for import statements. This example
-// hardcodes sources, but an embedding would normally load files here.
-static JSObject* ExampleResolveHook(JSContext* cx,
-                                    JS::HandleValue modulePrivate,
-                                    JS::HandleObject moduleRequest) {
-  // Extract module specifier string.
-  JS::Rooted<JSString*> specifierString(
-      cx, JS::GetModuleRequestSpecifier(cx, moduleRequest));
-  if (!specifierString) {
-    return nullptr;
-  }
+// Writes 'top.mjs', which imports one module by relative path and one by bare
+// specifier, found in the 'lib' search path, and then awaits a dynamic import
+// of a module that itself uses top-level await.
+static bool WriteExampleModules(std::string* directory) {
+  char tmpl[] = "/tmp/modules-example-XXXXXX";
+  if (!mkdtemp(tmpl)) return false;
+  *directory = tmpl;
+
+  return mkdir((*directory + "/lib").c_str(), 0700) == 0 &&
+         WriteFile(*directory + "/top.mjs",
+                   "import {C1} from './a.mjs';\n"
+                   "import {C2} from 'b';\n"
+                   "if (C1 + C2 !== 3) throw new Error('wrong exports');\n"
+                   "const {C3} = await import('./lazy.mjs');\n"
+                   "if (C3 !== 3) throw new Error('wrong lazy export');\n") &&
+         WriteFile(*directory + "/a.mjs", "export const C1 = 1;\n") &&
+         WriteFile(*directory + "/lib/b.js", "export const C2 = 2;\n") &&
+         WriteFile(*directory + "/lazy.mjs",
+                   "await Promise.resolve();\n"
+                   "export const C3 = 3;\n");
+}
 
-  // Convert specifier to a std::u16char for simplicity.
-  JS::UniqueTwoByteChars specChars(JS_CopyStringCharsZ(cx, specifierString));
-  if (!specChars) {
-    return nullptr;
-  }
-  std::u16string filename(specChars.get());
+static void RemoveExampleModules(const std::string& directory) {
+  unlink((directory + "/lazy.mjs").c_str());
+  unlink((directory + "/lib/b.js").c_str());
+  unlink((directory + "/a.mjs").c_str());
+  unlink((directory + "/top.mjs").c_str());
+  rmdir((directory + "/lib").c_str());
+  rmdir(directory.c_str());
+}
 
-  // If we already resolved before, return same module.
-  auto search = moduleRegistry.find(filename);
-  if (search != moduleRegistry.end()) {
-    return search->second;
+static bool LoadAndRun(JSContext* cx) {
+  // The loader keeps a registry of modules for this global.
+  boilerplate::ModuleLoader loader(cx);
+  for (const std::string& path : searchPaths) {
+    loader.addSearchPath(path);
   }
 
-  JS::RootedObject mod(cx);
-
-  if (filename == u"a") {
-    mod = CompileExampleModule(cx, "a", "export const C1 = 1;");
-    if (!mod) {
-      return nullptr;
-    }
+  // Read and compile the entry module and everything it imports.
+  JS::RootedObject mod(cx, loader.load(entryPath));
+  if (!mod) {
+    return false;
   }
 
-  // Register result in table.
-  if (mod) {
-    moduleRegistry.emplace(filename, JS::PersistentRootedObject(cx, mod));
-    return mod;
+  // Resolve imports, execute the module bytecode, and run promise jobs and
+  // dynamic imports until the module has finished evaluating. The loader has
+  // already loaded every module that the import statements name, so linking
+  // only looks them up.
+  if (!loader.run(mod)) {
+    return false;
   }
 
-  JS_ReportErrorASCII(cx, "Cannot resolve import specifier");
-  return nullptr;
+  const boilerplate::ModuleLoader::RunStats& stats = loader.runStats();
+  std::chrono::duration<double, std::milli> executing = stats.executing;
+  std::chrono::duration<double, std::milli> waiting = stats.waiting;
+  printf("%zu modules, %u dynamic imports\n", loader.moduleCount(),
+         stats.dynamicImports);
+  printf("executing %.2f ms, waiting for imports %.2f ms\n", executing.count(),
+         waiting.count());
+  return true;
 }
 
 static bool ModuleExample(JSContext* cx) {
@@ -94,38 +112,40 @@ static bool ModuleExample(JSContext* cx) {
 
   JSAutoRealm ar(cx, global);
 
-  // Register a hook in order to provide modules
-  JS::SetModuleResolveHook(JS_GetRuntime(cx), ExampleResolveHook);
-
-  // Compile the top module.
-  JS::RootedObject mod(
-      cx, CompileExampleModule(cx, "top", "import {C1} from 'a';"));
-  if (!mod) {
+  if (!LoadAndRun(cx)) {
     boilerplate::ReportAndClearException(cx);
     return false;
   }
 
-  // Resolve imports by loading and compiling additional scripts.
-  if (!JS::ModuleLink(cx, mod)) {
-    boilerplate::ReportAndClearException(cx);
-    return false;
-  }
+  return true;
+}
 
-  // Result value, used for top-level await.
-  JS::RootedValue rval(cx);
+// ModuleLoader::run settles top-level await and import() by draining the
+// context's job queue, so this example needs one; it uses SpiderMonkey's
+// internal queue. js::UseInternalJobQueues refuses once self-hosted code
+// exists, so it runs here, in RunExample's setup step, before InitSelfHosting.
+static bool SetUpJobQueue(JSContext* cx) {
+  return js::UseInternalJobQueues(cx);
+}
 
-  // Execute the module bytecode.
-  if (!JS::ModuleEvaluate(cx, mod, &rval)) {
-    boilerplate::ReportAndClearException(cx);
-    return false;
+int main(int argc, const char* argv[]) {
+  std::string exampleDirectory;
+  if (argc > 1) {
+    entryPath = argv[1];
+    searchPaths.assign(argv + 2, argv + argc);
+  } else {
+    if (!WriteExampleModules(&exampleDirectory)) {
+      perror("Cannot write example modules");
+      return 1;
+    }
+    entryPath = exampleDirectory + "/top.mjs";
+    searchPaths.push_back(exampleDirectory + "/lib");
   }
 
-  return true;
-}
+  bool ok = boilerplate::RunExample(ModuleExample, SetUpJobQueue);
 
-int main(int argc, const char* argv[]) {
-  if (!boilerplate::RunExample(ModuleExample)) {
-    return 1;
+  if (!exampleDirectory.empty()) {
+    RemoveExampleModules(exampleDirectory);
   }
-  return 0;
+  return ok ? 0 : 1;
 }
@@ -0,0 +1,196 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/SourceText.h>
+
+#include "boilerplate.h"
+#include "scriptpipeline.h"
+
+// This program loads a few large generated "bundles" into a global, in two
+// ways:
+//
+// - "sync": boilerplate::Evaluate on each bundle in turn, so that the context
+//   does nothing else until everything is compiled.
+// - "offthread": all bundles are submitted to a boilerplate::ScriptPipeline
+//   at once, and the context runs a small "tick" job over and over while they
+//   compile, executing each bundle as soon as it is ready.
+//
+// It prints the time until the first bundle starts executing, the time until
+// all of them have executed, and how many ticks the context managed to run in
+// the meantime.
+//
+// Usage: offthread [MEGABYTES [BUNDLES]]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned megabytes = 5;
+static unsigned bundleCount = 4;
+
+static Clock::time_point firstExecution;
+static bool executed = false;
+
+// Each bundle calls this first thing.
+static bool Started(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  if (!executed) {
+    firstExecution = Clock::now();
+    executed = true;
+  }
+  args.rval().setUndefined();
+  return true;
+}
+
+static std::string GenerateBundle(unsigned index) {
+  std::ostringstream out;
+  out << "started();\n";
+  size_t target = size_t(megabytes) * 1024 * 1024;
+  for (unsigned i = 0; size_t(out.tellp()) < target; i++) {
+    out << "function b" << index << "_" << i << "(state, action) {\n"
+        << "  switch (action.type) {\n"
+        << "    case 'add': return { ...state, count: state.count + " << i
+        << " };\n"
+        << "    case 'reset': return { count: 0, label: 'b" << index << "_"
+        << i << "' };\n"
+        << "    default: return state;\n"
+        << "  }\n"
+        << "}\n";
+  }
+  out << "globalThis.loaded = (globalThis.loaded || 0) + 1;\n";
+  return out.str();
+}
+
+static bool CompileTick(JSContext* cx, JS::MutableHandleScript script) {
+  static const char* code = "for (let i = 0; i < 1000; i++) Math.sqrt(i);";
+
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("tick.js", 1);
+
+  JS::SourceText<mozilla::Utf8Unit> source;
+  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  script.set(JS::Compile(cx, options, source));
+  return !!script;
+}
+
+static JSObject* NewBundleGlobal(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return nullptr;
+
+  JSAutoRealm ar(cx, global);
+  if (!JS_DefineFunction(cx, global, "started", &Started, 0, 0)) {
+    return nullptr;
+  }
+  return global;
+}
+
+static void PrintResult(const char* name, Clock::time_point start,
+                        unsigned long ticks) {
+  std::chrono::duration<double, std::milli> first = firstExecution - start;
+  std::chrono::duration<double, std::milli> all = Clock::now() - start;
+  printf("%-9s first execution %8.1f ms  all executed %8.1f ms  ticks %lu\n",
+         name, first.count(), all.count(), ticks);
+}
+
+static bool LoadSync(JSContext* cx, const std::vector<std::string>& bundles) {
+  executed = false;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < bundles.size(); i++) {
+    std::string filename = "bundle" + std::to_string(i) + ".js";
+    JS::CompileOptions options(cx);
+    options.setFileAndLine(filename.c_str(), 1);
+
+    JS::RootedValue rval(cx);
+    if (!boilerplate::Evaluate(cx, options, bundles[i].data(),
+                               bundles[i].size(), &rval)) {
+      return false;
+    }
+  }
+
+  PrintResult("sync", start, 0);
+  return true;
+}
+
+static void PrintLatency(const std::string& filename,
+                         boilerplate::ScriptPipeline::Clock::duration latency) {
+  std::chrono::duration<double, std::milli> ms = latency;
+  printf("  %s executed after %.1f ms\n", filename.c_str(), ms.count());
+}
+
+static bool LoadOffThread(JSContext* cx,
+                          const std::vector<std::string>& bundles) {
+  JS::RootedScript tick(cx);
+  if (!CompileTick(cx, &tick)) return false;
+
+  boilerplate::ScriptPipeline pipeline(cx);
+  pipeline.setObserver(PrintLatency);
+
+  executed = false;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < bundles.size(); i++) {
+    if (!pipeline.submit("bundle" + std::to_string(i) + ".js", bundles[i])) {
+      return false;
+    }
+  }
+
+  unsigned long ticks = 0;
+  while (pipeline.pending() > 0) {
+    JS::RootedValue rval(cx);
+    if (!JS_ExecuteScript(cx, tick, &rval)) return false;
+    ticks++;
+
+    if (!pipeline.runReady()) return false;
+  }
+
+  PrintResult("offthread", start, ticks);
+  return true;
+}
+
+// Load the bundles into a fresh global with the given method.
+static bool Run(JSContext* cx, const std::vector<std::string>& bundles,
+                bool (*load)(JSContext*, const std::vector<std::string>&)) {
+  JS::RootedObject global(cx, NewBundleGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+  if (!load(cx, bundles)) {
+    if (JS_IsExceptionPending(cx)) boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  return true;
+}
+
+static bool OffThreadExample(JSContext* cx) {
+  std::vector<std::string> bundles;
+  size_t bytes = 0;
+  for (unsigned i = 0; i < bundleCount; i++) {
+    bundles.push_back(GenerateBundle(i));
+    bytes += bundles.back().size();
+  }
+  printf("%u bundles, %.1f MiB in total\n", bundleCount,
+         bytes / (1024.0 * 1024.0));
+
+  return Run(cx, bundles, LoadSync) && Run(cx, bundles, LoadOffThread);
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) megabytes = atoi(argv[1]);
+  if (argc > 2) bundleCount = atoi(argv[2]);
+  if (megabytes == 0 || bundleCount == 0) {
+    fprintf(stderr, "Usage: %s [MEGABYTES [BUNDLES]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(OffThreadExample)) {
+    return 1;
+  }
+  return 0;
+}
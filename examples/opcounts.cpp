@@ -0,0 +1,181 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <jsapi.h>
+#include <jsfriendapi.h>
+#include <js/CompileOptions.h>
+
+#include "boilerplate.h"
+
+// This program counts how many times each bytecode instruction runs, using
+// SpiderMonkey's PC count profiling. It runs the given JavaScript files, or a
+// built-in workload, and writes the counts of every script to OUTPUT as JSON:
+//
+//   [{"summary": {"file": ..., "line": ..., "name": ...,
+//                 "totals": {"interp": ..., "ion": ...}},
+//     "contents": {"opcodes": [{"id": ..., "line": ..., "name": ...,
+//                               "counts": {"interp": ...}}, ...]}},
+//    ...]
+//
+// "interp" counts the instructions run before the script was compiled by Ion,
+// and "ion" the work done in Ion code. A script with a large "interp" count and
+// no "ion" count never tiered up, usually because it uses an instruction that
+// Ion does not support.
+//
+// tools/opcode_profile.py joins the counts with the opcode descriptions from
+// SpiderMonkey's Opcodes.h (see docs/Bytecodes.md) and prints the hottest
+// opcodes, the hottest instructions, and the scripts that stayed in the
+// interpreter:
+//
+//   opcounts opcounts.json app.js
+//   tools/opcode_profile.py ~/mozilla-esr115 opcounts.json
+//
+// NOTE: Turning on PC count profiling throws away all JIT code, and only
+// scripts compiled while it is on are counted, so the scripts run more slowly
+// than usual.
+//
+// Usage: opcounts [OUTPUT [FILE.js...]]
+
+static const char* outputPath = "opcounts.json";
+static std::vector<std::string> files;
+
+struct Script {
+  std::string filename;
+  std::string source;
+};
+
+// The built-in workload: a hot function that Ion can compile, and one that it
+// cannot, because of the 'with' statement.
+static const Script workload = {"workload.js", R"js(
+  function distance(points) {
+    let total = 0;
+    for (let i = 1; i < points.length; i++) {
+      const dx = points[i].x - points[i - 1].x;
+      const dy = points[i].y - points[i - 1].y;
+      total += Math.sqrt(dx * dx + dy * dy);
+    }
+    return total;
+  }
+
+  function scale(points, factor) {
+    const result = [];
+    for (const point of points) {
+      with (point) result.push({x: x * factor, y: y * factor});
+    }
+    return result;
+  }
+
+  const points = Array.from({length: 1000}, (_, i) => ({x: i % 17, y: i % 29}));
+  let total = 0;
+  for (let i = 0; i < 200; i++) total += distance(scale(points, i));
+)js"};
+
+static bool LoadScripts(std::vector<Script>* scripts) {
+  if (files.empty()) {
+    scripts->push_back(workload);
+    return true;
+  }
+
+  for (const std::string& filename : files) {
+    std::ifstream in(filename);
+    if (!in) {
+      fprintf(stderr, "Cannot read %s\n", filename.c_str());
+      return false;
+    }
+    std::ostringstream source;
+    source << in.rdbuf();
+    scripts->push_back({filename, source.str()});
+  }
+  return true;
+}
+
+static bool ExecuteCode(JSContext* cx, const Script& script) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(script.filename.c_str(), 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, script.source.data(),
+                               script.source.size(), &rval);
+}
+
+// Write the JSON that SpiderMonkey produced for a script's counts.
+static bool WriteJSON(JSContext* cx, FILE* out, JSString* json) {
+  if (!json) return false;
+
+  JS::RootedString str(cx, json);
+  JS::UniqueChars chars = JS_EncodeStringToUTF8(cx, str);
+  if (!chars) return false;
+
+  fputs(chars.get(), out);
+  return true;
+}
+
+static bool WriteCounts(JSContext* cx, FILE* out, size_t* scriptCount) {
+  *scriptCount = js::GetPCCountScriptCount(cx);
+
+  fputs("[", out);
+  for (size_t i = 0; i < *scriptCount; i++) {
+    fputs(i ? ",\n{\"summary\": " : "\n{\"summary\": ", out);
+    if (!WriteJSON(cx, out, js::GetPCCountScriptSummary(cx, i))) return false;
+    fputs(",\n \"contents\": ", out);
+    if (!WriteJSON(cx, out, js::GetPCCountScriptContents(cx, i))) {
+      return false;
+    }
+    fputs("}", out);
+  }
+  fputs("\n]\n", out);
+  return true;
+}
+
+static bool OpcountsExample(JSContext* cx) {
+  std::vector<Script> scripts;
+  if (!LoadScripts(&scripts)) return false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  js::StartPCCountProfiling(cx);
+  for (const Script& script : scripts) {
+    if (!ExecuteCode(cx, script)) {
+      boilerplate::ReportAndClearException(cx);
+      return false;
+    }
+  }
+  js::StopPCCountProfiling(cx);
+
+  FILE* out = fopen(outputPath, "w");
+  if (!out) {
+    fprintf(stderr, "Cannot write %s\n", outputPath);
+    return false;
+  }
+
+  size_t scriptCount;
+  bool ok = WriteCounts(cx, out, &scriptCount);
+  ok = fclose(out) == 0 && ok;
+  js::PurgePCCounts(cx);
+  if (!ok) {
+    if (JS_IsExceptionPending(cx)) boilerplate::ReportAndClearException(cx);
+    fprintf(stderr, "Cannot write %s\n", outputPath);
+    return false;
+  }
+
+  printf("Wrote the counts of %zu scripts to %s\n", scriptCount, outputPath);
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) outputPath = argv[1];
+  for (int i = 2; i < argc; i++) files.push_back(argv[i]);
+
+  if (!boilerplate::RunExample(OpcountsExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "perfjit.h"
+
+// Support for profiling JIT-compiled JS code with Linux perf. perf finds the
+// functions of a native program through its symbol tables, but JIT code has
+// none, so 'perf report' shows its samples as bare addresses. SpiderMonkey can
+// describe the code it generates in a "jitdump" file, which 'perf inject'
+// merges into the recording, so that JS functions show up by name next to the
+// native ones.
+//
+// SpiderMonkey only does this when it was configured with --enable-perf, and
+// the IONPERF environment variable is set when the JITs start. EnablePerf sets
+// it, along with the directory that the jitdump file is written to:
+//
+// - "func": one entry per compiled function, named after the function and its
+//   script's location. Enough for 'perf report' and flame graphs.
+// - "src": also maps machine code to JS source lines, for 'perf annotate'.
+// - "ir": also maps machine code to the JIT's intermediate representation,
+//   which is mostly useful when working on SpiderMonkey itself.
+//
+// RunExample calls EnablePerf with the mode named by the BOILERPLATE_PERF
+// environment variable. Without the variable, the mode chosen by the 'perf'
+// meson option is used, which also builds the examples with frame pointers, so
+// that 'perf record -g' can walk through their frames. See "Profiling JIT code
+// with perf" in 'docs/Debugging Tips.md' for a walkthrough.
+//
+// NOTE: EnablePerf must be called before JS_Init. An IONPERF variable that is
+// already set is left alone. If SpiderMonkey was built without --enable-perf,
+// nothing is written; CheckPerfOutput warns about that at the end.
+
+#ifndef BOILERPLATE_PERF_DEFAULT
+#define BOILERPLATE_PERF_DEFAULT "off"
+#endif
+
+static const struct {
+  boilerplate::PerfMode mode;
+  const char* name;
+} modeNames[] = {
+    {boilerplate::PerfMode::Off, "off"},
+    {boilerplate::PerfMode::Functions, "func"},
+    {boilerplate::PerfMode::Source, "src"},
+    {boilerplate::PerfMode::IR, "ir"},
+};
+
+// The jitdump file SpiderMonkey writes, if perf support was enabled.
+static std::string jitdumpPath;
+
+const char* boilerplate::PerfModeName(PerfMode mode) {
+  for (const auto& entry : modeNames) {
+    if (entry.mode == mode) return entry.name;
+  }
+  return "unknown";
+}
+
+// Look up a mode by the name used in BOILERPLATE_PERF and IONPERF. Returns
+// false if there is no such mode.
+bool boilerplate::ParsePerfMode(const char* name, PerfMode* mode) {
+  for (const auto& entry : modeNames) {
+    if (strcmp(entry.name, name) == 0) {
+      *mode = entry.mode;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The mode named by BOILERPLATE_PERF, or else the one the examples were built
+// with.
+boilerplate::PerfMode boilerplate::PerfModeFromEnvironment() {
+  const char* name = getenv("BOILERPLATE_PERF");
+  if (!name || name[0] == '\0') name = BOILERPLATE_PERF_DEFAULT;
+
+  PerfMode mode = PerfMode::Off;
+  if (!ParsePerfMode(name, &mode)) {
+    fprintf(stderr, "Warning: unknown perf mode '%s', using off\n", name);
+  }
+  return mode;
+}
+
+// Have SpiderMonkey describe its JIT code for perf, in a jitdump file in 'dir'
+// (by default $PERF_SPEWER_DIR, or else /tmp). Returns false if the mode is
+// Off or the environment could not be changed.
+bool boilerplate::EnablePerf(PerfMode mode, const char* dir) {
+  if (mode == PerfMode::Off) return false;
+
+  if (setenv("IONPERF", PerfModeName(mode), /* overwrite = */ 0) != 0) {
+    return false;
+  }
+  if (dir && setenv("PERF_SPEWER_DIR", dir, 1) != 0) {
+    return false;
+  }
+
+  const char* spewDir = getenv("PERF_SPEWER_DIR");
+  jitdumpPath = std::string(spewDir ? spewDir : "/tmp") + "/jit-" +
+                std::to_string(getpid()) + ".dump";
+  return true;
+}
+
+// Warn if perf support was enabled but SpiderMonkey wrote no jitdump file,
+// usually because it was built without --enable-perf.
+void boilerplate::CheckPerfOutput() {
+  if (jitdumpPath.empty()) return;
+
+  struct stat st;
+  if (stat(jitdumpPath.c_str(), &st) != 0) {
+    fprintf(stderr,
+            "Warning: perf support is enabled, but SpiderMonkey wrote no %s. "
+            "It needs to be configured with --enable-perf, and code must run "
+            "long enough to be JIT-compiled.\n",
+            jitdumpPath.c_str());
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef PERFJIT_H_
+#define PERFJIT_H_
+
+// See 'perfjit.cpp' for documentation.
+
+namespace boilerplate {
+
+enum class PerfMode { Off, Functions, Source, IR };
+
+const char* PerfModeName(PerfMode mode);
+
+bool ParsePerfMode(const char* name, PerfMode* mode);
+
+PerfMode PerfModeFromEnvironment();
+
+bool EnablePerf(PerfMode mode, const char* dir = nullptr);
+
+void CheckPerfOutput();
+
+}  // namespace boilerplate
+
+#endif  // PERFJIT_H_
@@ -0,0 +1,156 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Initialization.h>
+
+#include "boilerplate.h"
+#include "contextpool.h"
+
+// This example shows how to run many short scripts on a pool of pre-warmed
+// contexts, and measures how much that saves compared to creating a fresh
+// context for every script the way 'WorkerMain' in worker.cpp does.
+//
+// See 'contextpool.cpp' for the pool itself.
+//
+// Usage: pool [TASKS [THREADS]]
+
+static unsigned taskCount = 2000;
+static unsigned threadCount = 4;
+
+static const char* taskScript = R"js(
+  let sum = 0;
+  for (let i = 0; i < 100; i++) sum += i;
+  sum;
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("task", 1);
+
+  JS::Rooted<JS::Value> rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+// The cold path: everything 'WorkerMain' does, once per task.
+static bool RunColdTask(JSRuntime* parentRuntime) {
+  JSContext* cx = JS_NewContext(8L * 1024L * 1024L, parentRuntime);
+  if (!cx) {
+    return false;
+  }
+
+  bool ok = JS::InitSelfHostedCode(cx);
+  if (ok) {
+    JS::Rooted<JSObject*> global(cx, boilerplate::CreateGlobal(cx));
+    ok = global != nullptr;
+    if (ok) {
+      JSAutoRealm ar(cx, global);
+      ok = ExecuteCode(cx, taskScript);
+      if (!ok) {
+        boilerplate::ReportAndClearException(cx);
+      }
+    }
+  }
+
+  JS_DestroyContext(cx);
+  return ok;
+}
+
+static double ColdBenchmark(JSRuntime* parentRuntime) {
+  std::atomic<unsigned> next(0);
+  std::atomic<bool> ok(true);
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < threadCount; i++) {
+    threads.emplace_back([&] {
+      while (next++ < taskCount) {
+        if (!RunColdTask(parentRuntime)) {
+          ok = false;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return ok ? elapsed.count() : -1;
+}
+
+static double PoolBenchmark(boilerplate::ContextPool& pool) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::future<bool>> results;
+  results.reserve(taskCount);
+  for (unsigned i = 0; i < taskCount; i++) {
+    results.push_back(pool.submit([](JSContext* cx, JS::HandleObject global) {
+      return ExecuteCode(cx, taskScript);
+    }));
+  }
+
+  bool ok = true;
+  for (std::future<bool>& result : results) {
+    ok = result.get() && ok;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return ok ? elapsed.count() : -1;
+}
+
+static void PrintResult(const char* name, double seconds) {
+  printf("%-6s %8u tasks  %8.3f s  %10.0f tasks/s  %8.1f us/task\n", name,
+         taskCount, seconds, taskCount / seconds, seconds * 1e6 / taskCount);
+}
+
+static bool PoolExample(JSContext* cx) {
+  JSRuntime* rt = JS_GetRuntime(cx);
+
+  double cold = ColdBenchmark(rt);
+  if (cold < 0) {
+    return false;
+  }
+
+  // Startup of the pool is paid once, so it is not part of the measurement.
+  boilerplate::ContextPool pool(rt, threadCount);
+  if (!pool.start()) {
+    return false;
+  }
+
+  double warm = PoolBenchmark(pool);
+  if (warm < 0) {
+    return false;
+  }
+
+  pool.shutdown();
+
+  printf("%u threads\n", threadCount);
+  PrintResult("cold", cold);
+  PrintResult("pool", warm);
+  printf("speedup %.1fx\n", cold / warm);
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) taskCount = atoi(argv[1]);
+  if (argc > 2) threadCount = atoi(argv[2]);
+  if (taskCount == 0 || threadCount == 0) {
+    fprintf(stderr, "Usage: %s [TASKS [THREADS]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(PoolExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Initialization.h>
+
+#include "boilerplate.h"
+#include "zygote.h"
+
+// This program measures what a boilerplate::Zygote saves a pre-forking server.
+// It starts CHILDREN worker processes in two ways:
+//
+// - "scratch": each process calls JS_Init, creates a context, parses the
+//              self-hosted code, and compiles and runs the bootstrap script.
+// - "zygote":  each process is forked from a zygote that did all of that but
+//              running the bootstrap script, so it only creates a context,
+//              decodes the self-hosted stencil, and instantiates and runs the
+//              bootstrap stencil.
+//
+// Every worker then serves one request. Workers are started one at a time,
+// and each measures its startup time, from just before the fork until its
+// first request is done. Once all of them are up, the parent reads their
+// memory use from /proc: the resident set (RSS), the proportional set (PSS),
+// which divides each shared page among the processes that share it, and the
+// private pages, which are what each additional worker really costs.
+//
+// Usage: prefork [CHILDREN]
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned childCount = 8;
+
+// A stand-in for the libraries every global loads: about 200 KB of code.
+static std::string MakeBootstrapSource() {
+  std::string source = R"js(
+    const helpers = [];
+    function escape(s) {
+      return String(s).replace(/[&<>"]/g, c => `&#${c.charCodeAt(0)};`);
+    }
+    function render(rows) {
+      return rows.map(r => `<li>${escape(r.name)}: ${helpers[r.id](r.id)}</li>`)
+          .join('');
+    }
+  )js";
+  for (int i = 0; i < 2000; i++) {
+    std::string n = std::to_string(i);
+    source += "function helper" + n + "(x) {\n  return (x * " + n +
+              " + 7) % 1009;\n}\nhelpers.push(helper" + n + ");\n";
+  }
+  return source;
+}
+
+static const std::string bootstrapSource = MakeBootstrapSource();
+
+static const char* requestSource = R"js(
+  render(Array.from({length: 100}, (_, i) => ({id: i, name: 'row <' + i})));
+)js";
+
+static double MillisSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+static bool Evaluate(JSContext* cx, const char* filename, const char* code,
+                     size_t length) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, length, &rval);
+}
+
+static bool ServeRequest(JSContext* cx) {
+  return Evaluate(cx, "request.js", requestSource, strlen(requestSource));
+}
+
+// Startup of a worker without a zygote. Runs in the child.
+static bool StartFromScratch() {
+  if (!JS_Init()) return false;
+
+  JSContext* cx = JS_NewContext(JS::DefaultHeapMaxBytes);
+  if (!cx || !JS::InitSelfHostedCode(cx)) return false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+  if (!Evaluate(cx, "bootstrap.js", bootstrapSource.data(),
+                bootstrapSource.size()) ||
+      !ServeRequest(cx)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  return true;
+}
+
+// Startup of a worker forked from the zygote. Runs in the child.
+static bool StartFromZygote(boilerplate::Zygote* zygote, JSContext** cxOut) {
+  JSContext* cx = zygote->newContext();
+  *cxOut = cx;
+  if (!cx) return false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+  if (!zygote->runBootstrap(cx) || !ServeRequest(cx)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  return true;
+}
+
+struct Memory {
+  long rssKb = -1;
+  long pssKb = -1;
+  long privateKb = -1;
+};
+
+// Read a process's memory totals from /proc/PID/smaps_rollup (Linux 4.14 and
+// later). Leaves -1 for whatever cannot be read.
+static Memory ReadMemory(pid_t pid) {
+  Memory memory;
+  std::string path = "/proc/" + std::to_string(pid) + "/smaps_rollup";
+  FILE* fp = fopen(path.c_str(), "r");
+  if (!fp) return memory;
+
+  char line[256];
+  long privateClean = -1, privateDirty = -1, kb;
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "Rss: %ld kB", &kb) == 1) memory.rssKb = kb;
+    if (sscanf(line, "Pss: %ld kB", &kb) == 1) memory.pssKb = kb;
+    if (sscanf(line, "Private_Clean: %ld kB", &kb) == 1) privateClean = kb;
+    if (sscanf(line, "Private_Dirty: %ld kB", &kb) == 1) privateDirty = kb;
+  }
+  fclose(fp);
+
+  if (privateClean >= 0 && privateDirty >= 0) {
+    memory.privateKb = privateClean + privateDirty;
+  }
+  return memory;
+}
+
+struct Child {
+  pid_t pid;
+  double startupMs;
+  Memory memory;
+};
+
+// Keeps the children alive until the parent has measured them. Each child
+// waits for end of file on 'releaseFd'.
+static void WaitForRelease(int releaseFd) {
+  char byte;
+  while (read(releaseFd, &byte, 1) > 0) {
+  }
+}
+
+// Fork one worker, with 'start' running its startup in the child, and wait
+// until it reports its startup time.
+template <typename Start>
+static bool StartChild(int release[2], Start start, Child* child) {
+  int report[2];
+  if (pipe(report) != 0) return false;
+
+  fflush(stdout);
+  Clock::time_point forkTime = Clock::now();
+  pid_t pid = start.fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    close(release[1]);
+    close(report[0]);
+    bool ok = start.run();
+    double startupMs = MillisSince(forkTime);
+    if (ok && write(report[1], &startupMs, sizeof(startupMs)) !=
+                  sizeof(startupMs)) {
+      ok = false;
+    }
+    close(report[1]);
+    WaitForRelease(release[0]);
+    start.exit(ok ? 0 : 1);
+  }
+
+  close(report[1]);
+  child->pid = pid;
+  bool ok = read(report[0], &child->startupMs, sizeof(child->startupMs)) ==
+            sizeof(child->startupMs);
+  close(report[0]);
+  return ok;
+}
+
+// Start all the workers, measure them, then let them exit.
+template <typename Start>
+static bool RunTrial(const char* name, Start start) {
+  int release[2];
+  if (pipe(release) != 0) return false;
+
+  std::vector<Child> children;
+  bool ok = true;
+  for (unsigned i = 0; ok && i < childCount; i++) {
+    Child child;
+    ok = StartChild(release, start, &child);
+    if (ok) children.push_back(child);
+  }
+
+  for (Child& child : children) child.memory = ReadMemory(child.pid);
+
+  close(release[0]);
+  close(release[1]);
+  for (const Child& child : children) {
+    int status;
+    waitpid(child.pid, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: A %s worker failed to start\n", name);
+    return false;
+  }
+
+  std::vector<double> startup;
+  Memory total;
+  total.rssKb = total.pssKb = total.privateKb = 0;
+  for (const Child& child : children) {
+    startup.push_back(child.startupMs);
+    total.rssKb += child.memory.rssKb;
+    total.pssKb += child.memory.pssKb;
+    total.privateKb += child.memory.privateKb;
+  }
+  std::sort(startup.begin(), startup.end());
+
+  printf("%-8s startup median %7.2f ms  max %7.2f ms", name,
+         startup[startup.size() / 2], startup.back());
+  if (children[0].memory.rssKb < 0 || children[0].memory.privateKb < 0) {
+    printf("  (no memory figures: /proc/PID/smaps_rollup is missing)\n");
+  } else {
+    size_t n = children.size();
+    printf("  per worker: RSS %6.1f MB  PSS %6.1f MB  private %6.1f MB\n",
+           total.rssKb / 1024.0 / n, total.pssKb / 1024.0 / n,
+           total.privateKb / 1024.0 / n);
+  }
+  return true;
+}
+
+// How the two kinds of worker are forked, started and ended.
+struct ScratchStart {
+  pid_t fork() { return ::fork(); }
+  bool run() { return StartFromScratch(); }
+  [[noreturn]] void exit(int status) {
+    fflush(stdout);
+    _exit(status);
+  }
+};
+
+struct ZygoteStart {
+  boilerplate::Zygote* zygote;
+  JSContext* cx = nullptr;
+
+  pid_t fork() { return zygote->fork(); }
+  bool run() { return StartFromZygote(zygote, &cx); }
+  [[noreturn]] void exit(int status) { zygote->exitChild(cx, status); }
+};
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) childCount = atoi(argv[1]);
+  if (childCount == 0 || childCount > 1000) {
+    fprintf(stderr, "Usage: %s [CHILDREN]\n", argv[0]);
+    return 1;
+  }
+
+  // The scratch workers must be forked before this process calls JS_Init.
+  if (!RunTrial("scratch", ScratchStart())) return 1;
+
+  Clock::time_point start = Clock::now();
+  boilerplate::Zygote zygote;
+  if (!zygote.init() ||
+      !zygote.addBootstrapScript("bootstrap.js", bootstrapSource)) {
+    return 1;
+  }
+  printf("zygote   initialized once in %.2f ms\n", MillisSince(start));
+
+  bool ok = RunTrial("zygote", ZygoteStart{&zygote});
+  zygote.shutdown();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+
+#include "boilerplate.h"
+#include "profiler.h"
+
+// This program profiles a CPU-bound script with boilerplate::Profiler, on the
+// main thread and on two worker threads with contexts of their own, set up as
+// in 'worker.cpp'. It writes the samples to OUTPUT as folded stacks, which
+// flamegraph.pl turns into a flame graph:
+//
+//   flamegraph.pl profile.folded > profile.svg
+//
+// The script is run once without the profiler and then once sampled RATE
+// times per second, and the program prints both running times along with the
+// time the profiler spent taking samples.
+//
+// Usage: profile [OUTPUT [RATE]]
+
+using Clock = std::chrono::steady_clock;
+
+static const char* outputPath = "profile.folded";
+static unsigned rate = 1000;
+
+static const unsigned Rounds = 30;
+
+static const char* workload = R"js(
+  function fib(n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+  }
+
+  function compare(a, b) {
+    return a.key - b.key || a.name.localeCompare(b.name);
+  }
+
+  function sortAll(n) {
+    const items = Array.from(
+        {length: n}, (_, i) => ({key: (i * 7919) % 1000, name: 'n' + i}));
+    return items.sort(compare).length;
+  }
+
+  function render(n) {
+    let out = '';
+    for (let i = 0; i < n; i++) out += JSON.stringify({i, square: i * i});
+    return out.length;
+  }
+
+  function run(rounds) {
+    let total = 0;
+    for (let i = 0; i < rounds; i++)
+      total += fib(22) + sortAll(5000) + render(5000);
+    return total;
+  }
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* filename, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+// Run the workload in a new global on 'cx', sampled by 'profiler' if it is not
+// null.
+static bool RunWorkload(JSContext* cx, boilerplate::Profiler* profiler,
+                        const char* threadName) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+  if (profiler && !profiler->attach(cx, threadName)) return false;
+
+  char call[32];
+  snprintf(call, sizeof(call), "run(%u);", Rounds);
+  bool ok = ExecuteCode(cx, "work.js", workload) &&
+            ExecuteCode(cx, "main.js", call);
+  if (!ok) boilerplate::ReportAndClearException(cx);
+
+  if (profiler) profiler->detach(cx);
+  return ok;
+}
+
+// Sets '*ok' to whether the worker's workload ran successfully.
+static void WorkerMain(JSRuntime* parentRuntime,
+                       boilerplate::Profiler* profiler, const char* threadName,
+                       bool* ok) {
+  JSContext* cx = boilerplate::NewChildContext(parentRuntime);
+  if (!cx) {
+    fprintf(stderr, "Error: Failed during boilerplate::NewChildContext\n");
+    *ok = false;
+    return;
+  }
+
+  *ok = RunWorkload(cx, profiler, threadName);
+  JS_DestroyContext(cx);
+}
+
+// Run the workload on the main thread and two workers at once. Returns the
+// elapsed time in milliseconds, or a negative number if any of them failed.
+static double RunAll(JSContext* cx, boilerplate::Profiler* profiler) {
+  Clock::time_point start = Clock::now();
+
+  bool ok1 = false, ok2 = false;
+  std::thread worker1(WorkerMain, JS_GetRuntime(cx), profiler, "worker 1",
+                      &ok1);
+  std::thread worker2(WorkerMain, JS_GetRuntime(cx), profiler, "worker 2",
+                      &ok2);
+  bool ok = RunWorkload(cx, profiler, "main");
+  worker1.join();
+  worker2.join();
+
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+  return ok && ok1 && ok2 ? elapsed.count() : -1;
+}
+
+static bool ProfileExample(JSContext* cx) {
+  double withoutMs = RunAll(cx, nullptr);
+  if (withoutMs < 0) return false;
+
+  boilerplate::Profiler profiler(1000000 / rate);
+  double withMs = RunAll(cx, &profiler);
+  if (withMs < 0) return false;
+
+  printf("without profiler: %.1f ms\n", withoutMs);
+  printf("with profiler at %u Hz: %.1f ms (%+.1f%%)\n", rate, withMs,
+         (withMs - withoutMs) / withoutMs * 100);
+  profiler.report(stdout);
+
+  FILE* out = fopen(outputPath, "w");
+  if (!out) {
+    fprintf(stderr, "Error: Cannot open %s: %s\n", outputPath,
+            strerror(errno));
+    return false;
+  }
+  bool ok = profiler.writeFolded(out);
+  ok = fclose(out) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "Error: Cannot write %s\n", outputPath);
+    return false;
+  }
+
+  printf("wrote %s; to view it: flamegraph.pl %s > profile.svg\n", outputPath,
+         outputPath);
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) outputPath = argv[1];
+  if (argc > 2) rate = atoi(argv[2]);
+  if (rate == 0 || rate > 1000000) {
+    fprintf(stderr, "Usage: %s [OUTPUT [RATE]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(ProfileExample)) {
+    return 1;
+  }
+  return 0;
+}
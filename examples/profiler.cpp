@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <jsapi.h>
+#include <js/ProfilingFrameIterator.h>
+#include <js/ProfilingStack.h>
+
+#include "profiler.h"
+
+// A sampling profiler for JS code, to find the functions that a context spends
+// its time in. Its output is in the "folded stacks" format, one line per
+// distinct stack with the number of samples that landed in it, which
+// flamegraph.pl (https://github.com/brendangregg/FlameGraph) turns into a
+// flame graph:
+//
+//   worker 1;run (work.js:20:5);sortAll (work.js:9:3);compare (work.js:2:1) 412
+//
+// Attaching a context turns on its profiling stack, the stack of frames that
+// SpiderMonkey maintains for the Gecko profiler: the interpreter pushes a
+// frame for each function it enters, and entering JS from C++ pushes one for
+// the entry point. With the profiling stack on, the JITs also keep track of
+// their frames, so that JS::ProfilingFrameIterator can walk them.
+//
+// A timer thread requests an interrupt from every attached context at the
+// configured interval, and the context takes the sample itself, in its
+// interrupt callback, where its stack is consistent and cannot change under
+// the profiler. This needs no signals and no suspending of threads, so it
+// works the same for any number of contexts on any number of threads. While a
+// context is idle, its one pending request waits for it to run JS again, so
+// idle time is not counted.
+//
+// The time spent taking samples is measured on the sampled threads, and is
+// the profiler's overhead; 'report' prints it.
+//
+// Usage:
+//
+//   boilerplate::Profiler profiler(1000);  // one sample per millisecond
+//   profiler.attach(cx, "main");  // on each context's own thread
+//   ...
+//   profiler.detach(cx);  // before JS_DestroyContext
+//   profiler.report(stderr);
+//   profiler.writeFolded(file);
+//
+// NOTE: Samples are taken where SpiderMonkey checks for interrupts, at function
+// entries and loop iterations, so a long native call or GC gets only the one
+// sample that is taken after it. Frames in JIT code are placed after the
+// frames on the profiling stack, which is right unless JIT code called a
+// native that called back into the interpreter.
+
+namespace {
+// The slot of the context attached on this thread, if any.
+thread_local void* t_slot = nullptr;
+
+// The context on this thread that has the interrupt callback installed. There
+// is no way to remove it, so attaching the same context again reuses it.
+thread_local JSContext* t_callbackInstalled = nullptr;
+}  // namespace
+
+// Frames from the profiling stack and from the JITs are labeled the same way,
+// as "function (file:line:column)".
+static void AppendFrame(std::string& key, const char* label) {
+  if (!label || !label[0]) return;
+
+  key += ';';
+  size_t start = key.size();
+  key += label;
+  // Semicolons separate the frames.
+  std::replace(key.begin() + start, key.end(), ';', ',');
+}
+
+int64_t boilerplate::Profiler::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The timer thread samples every attached context once per 'intervalUs'.
+boilerplate::Profiler::Profiler(unsigned intervalUs)
+    : m_intervalNs(int64_t(std::max(intervalUs, 1u)) * 1000) {
+  m_thread = std::thread(&Profiler::timerMain, this);
+}
+
+boilerplate::Profiler::~Profiler() {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stopping = true;
+  }
+  m_wakeup.notify_all();
+  m_thread.join();
+}
+
+// Start sampling 'cx', which must be called on the context's own thread. A
+// thread may have only one attached context at a time. 'threadName' is the
+// root frame of the context's samples.
+bool boilerplate::Profiler::attach(JSContext* cx, const char* threadName) {
+  auto slot = std::make_unique<Slot>();
+  slot->cx = cx;
+  slot->name = threadName;
+
+  if (t_callbackInstalled != cx) {
+    if (!JS_AddInterruptCallback(cx, &Profiler::InterruptCallback)) {
+      JS_ReportOutOfMemory(cx);
+      return false;
+    }
+    t_callbackInstalled = cx;
+  }
+
+  js::SetContextProfilingStack(cx, &slot->stack);
+  js::EnableContextProfilingStack(cx, true);
+
+  t_slot = slot.get();
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_slots.push_back(std::move(slot));
+  }
+  m_wakeup.notify_all();
+  return true;
+}
+
+// Stop sampling 'cx'. Must be called on the context's thread, before the
+// context is destroyed. Its samples are kept.
+void boilerplate::Profiler::detach(JSContext* cx) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+    Slot* slot = it->get();
+    if (slot->cx != cx) continue;
+
+    js::EnableContextProfilingStack(cx, false);
+    js::SetContextProfilingStack(cx, nullptr);
+    if (t_slot == slot) {
+      t_slot = nullptr;
+    }
+
+    std::lock_guard<std::mutex> slotLock(slot->lock);
+    for (const auto& entry : slot->folded) {
+      m_detached[entry.first] += entry.second;
+    }
+    m_detachedStats.samples += slot->stats.samples;
+    m_detachedStats.sampleTimeNs += slot->stats.sampleTimeNs;
+
+    m_slots.erase(it);
+    return;
+  }
+}
+
+bool boilerplate::Profiler::InterruptCallback(JSContext* cx) {
+  auto* slot = static_cast<Slot*>(t_slot);
+  if (!slot || slot->cx != cx) {
+    return true;
+  }
+
+  // The interrupt may have been requested by someone else.
+  if (!slot->requested.exchange(false)) {
+    return true;
+  }
+
+  int64_t start = Now();
+  Sample(slot);
+
+  std::lock_guard<std::mutex> lock(slot->lock);
+  slot->stats.sampleTimeNs += Now() - start;
+  return true;
+}
+
+// Called on the slot's own thread, from the interrupt callback.
+void boilerplate::Profiler::Sample(Slot* slot) {
+  std::string& key = slot->key;
+  key = slot->name;
+
+  const js::ProfilingStack& stack = slot->stack;
+  uint32_t size = std::min(stack.stackSize(), stack.stackCapacity());
+  const char* lastJSFrame = nullptr;
+  for (uint32_t i = 0; i < size; i++) {
+    const js::ProfilingStackFrame& frame = stack.frames[i];
+    if (frame.isJsFrame() && frame.dynamicString()) {
+      lastJSFrame = frame.dynamicString();
+      AppendFrame(key, lastJSFrame);
+    } else {
+      AppendFrame(key, frame.label());
+    }
+  }
+
+  // The JIT frames come innermost first. The outermost one is often the entry
+  // point that is already on the profiling stack.
+  std::vector<const char*>& jitFrames = slot->jitFrames;
+  jitFrames.clear();
+  JS::ProfilingFrameIterator::RegisterState state;
+  for (JS::ProfilingFrameIterator it(slot->cx, state); !it.done(); ++it) {
+    JS::ProfilingFrameIterator::Frame frames[16];
+    uint32_t count = it.extractStack(frames, 0, 16);
+    for (uint32_t i = 0; i < count; i++) {
+      if (frames[i].label) jitFrames.push_back(frames[i].label);
+    }
+  }
+  auto outermost = jitFrames.rbegin();
+  if (outermost != jitFrames.rend() && lastJSFrame &&
+      strcmp(*outermost, lastJSFrame) == 0) {
+    ++outermost;
+  }
+  for (; outermost != jitFrames.rend(); ++outermost) {
+    AppendFrame(key, *outermost);
+  }
+
+  std::lock_guard<std::mutex> lock(slot->lock);
+  slot->folded[key]++;
+  slot->stats.samples++;
+}
+
+void boilerplate::Profiler::timerMain() {
+  std::unique_lock<std::mutex> lock(m_lock);
+  while (!m_stopping) {
+    if (m_slots.empty()) {
+      m_wakeup.wait(lock);
+      continue;
+    }
+
+    // The lock keeps the contexts from being detached and destroyed while
+    // they are being interrupted.
+    for (std::unique_ptr<Slot>& slot : m_slots) {
+      if (!slot->requested.exchange(true)) {
+        JS_RequestInterruptCallback(slot->cx);
+      }
+    }
+    m_wakeup.wait_for(lock, std::chrono::nanoseconds(m_intervalNs));
+  }
+}
+
+// The samples taken so far, from all contexts, including detached ones.
+boilerplate::Profiler::Stats boilerplate::Profiler::stats() const {
+  std::lock_guard<std::mutex> lock(m_lock);
+  Stats total = m_detachedStats;
+  for (const std::unique_ptr<Slot>& slot : m_slots) {
+    std::lock_guard<std::mutex> slotLock(slot->lock);
+    total.samples += slot->stats.samples;
+    total.sampleTimeNs += slot->stats.sampleTimeNs;
+  }
+  return total;
+}
+
+// Print the number of samples and the time it took to take them.
+void boilerplate::Profiler::report(FILE* out) const {
+  Stats total = stats();
+  fprintf(out,
+          "%" PRIu64 " samples, %.1f us per sample, %.1f ms in total\n",
+          total.samples,
+          total.samples ? total.sampleTimeNs / 1e3 / total.samples : 0.0,
+          total.sampleTimeNs / 1e6);
+}
+
+// Write the samples of all contexts, including detached ones, as folded
+// stacks. Returns false if writing failed.
+bool boilerplate::Profiler::writeFolded(FILE* out) const {
+  Folded all;
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    all = m_detached;
+    for (const std::unique_ptr<Slot>& slot : m_slots) {
+      std::lock_guard<std::mutex> slotLock(slot->lock);
+      for (const auto& entry : slot->folded) {
+        all[entry.first] += entry.second;
+      }
+    }
+  }
+
+  for (const auto& entry : all) {
+    fprintf(out, "%s %" PRIu64 "\n", entry.first.c_str(), entry.second);
+  }
+  return !ferror(out);
+}
@@ -0,0 +1,87 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/ProfilingStack.h>
+
+// See 'profiler.cpp' for documentation.
+
+namespace boilerplate {
+
+class Profiler {
+  struct Slot;
+
+ public:
+  struct Stats {
+    uint64_t samples = 0;
+    uint64_t sampleTimeNs = 0;
+  };
+
+  explicit Profiler(unsigned intervalUs = 1000);
+  ~Profiler();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  bool attach(JSContext* cx, const char* threadName);
+  void detach(JSContext* cx);
+
+  Stats stats() const;
+  void report(FILE* out) const;
+  bool writeFolded(FILE* out) const;
+
+ private:
+  using Folded = std::map<std::string, uint64_t>;
+
+  struct Slot {
+    JSContext* cx;
+    std::string name;
+    js::ProfilingStack stack;
+
+    // Whether the timer thread has asked for a sample that is not taken yet.
+    std::atomic<bool> requested{false};
+
+    // Guards the samples, which the sampled thread writes and any thread may
+    // read.
+    mutable std::mutex lock;
+    Folded folded;
+    Stats stats;
+
+    // Reused for every sample, so that taking one seldom allocates.
+    std::string key;
+    std::vector<const char*> jitFrames;
+  };
+
+  static bool InterruptCallback(JSContext* cx);
+  static int64_t Now();
+
+  void timerMain();
+  static void Sample(Slot* slot);
+
+  int64_t m_intervalNs;
+
+  mutable std::mutex m_lock;
+  std::condition_variable m_wakeup;
+  std::vector<std::unique_ptr<Slot>> m_slots;
+  std::thread m_thread;
+  bool m_stopping = false;
+
+  // The samples of contexts that have been detached.
+  Folded m_detached;
+  Stats m_detachedStats;
+};
+
+}  // namespace boilerplate
+
+#endif  // PROFILER_H_
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Conversions.h>
+#include <js/GCAPI.h>
+#include <js/GCVector.h>
+#include <js/Object.h>
+
+#include "boilerplate.h"
+#include "globaltemplate.h"
+
+// This example shows how to give every request its own global, for isolation
+// between requests, without paying for the full global setup each time.
+//
+// See 'globaltemplate.cpp' for the template itself. This program compares it
+// against setting up each global from scratch, and reports the latency of
+// creating a realm and the memory that each live realm retains.
+//
+// Usage: realms [REQUESTS]
+
+static unsigned requestCount = 2000;
+static const unsigned retainedRealms = 200;
+
+///// The per-request environment //////////////////////////////////////////////
+
+static bool Now(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  std::chrono::duration<double, std::milli> ms = now;
+  args.rval().setDouble(ms.count());
+  return true;
+}
+
+static JSFunctionSpec globalFunctions[] = {JS_FN("now", Now, 0, 0),
+                                           JS_FS_END};
+
+static JSClass counterClass = {"Counter", JSCLASS_HAS_RESERVED_SLOTS(1),
+                               nullptr};
+
+static bool CounterIncrement(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  JS::RootedObject thisObj(cx);
+  if (!args.computeThis(cx, &thisObj)) return false;
+  if (!JS_InstanceOf(cx, thisObj, &counterClass, &args)) return false;
+
+  JS::RootedValue count(cx, JS::GetReservedSlot(thisObj, 0));
+  int32_t next = count.isInt32() ? count.toInt32() + 1 : 1;
+  JS::SetReservedSlot(thisObj, 0, JS::Int32Value(next));
+
+  args.rval().setInt32(next);
+  return true;
+}
+
+static JSFunctionSpec counterMethods[] = {
+    JS_FN("increment", CounterIncrement, 0, JSPROP_ENUMERATE), JS_FS_END};
+
+static bool CounterConstructor(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  if (!args.isConstructing()) {
+    JS_ReportErrorASCII(cx, "You must call this constructor with 'new'");
+    return false;
+  }
+  JS::RootedObject thisObj(cx,
+                           JS_NewObjectForConstructor(cx, &counterClass, args));
+  if (!thisObj) return false;
+  JS::SetReservedSlot(thisObj, 0, JS::Int32Value(0));
+  args.rval().setObject(*thisObj);
+  return true;
+}
+
+static bool DefineCounterClass(JSContext* cx, JS::HandleObject global) {
+  return JS_InitClass(cx, global, nullptr, nullptr, counterClass.name,
+                      CounterConstructor, 0, nullptr, counterMethods, nullptr,
+                      nullptr) != nullptr;
+}
+
+// Stands in for the library code that an embedding loads into every global.
+static const char* bootstrapScript = R"js(
+  const config = Object.freeze({ version: 3, locale: 'en-US', retries: 2 });
+
+  class Request {
+    constructor(id, body) { this.id = id; this.body = body; }
+    get size() { return JSON.stringify(this.body).length; }
+  }
+
+  function formatRecord(record) {
+    return `${record.id}:${String(record.name).toUpperCase()}`;
+  }
+
+  function handle(request) {
+    const started = now();
+    const counter = new Counter();
+    const out = [];
+    for (const record of request.body.records) {
+      counter.increment();
+      out.push(formatRecord(record));
+    }
+    return { count: counter.increment() - 1, out, elapsed: now() - started };
+  }
+)js";
+
+static const char* requestScript = R"js(
+  const records = [{ id: 1, name: 'a' }, { id: 2, name: 'b' }];
+  handle(new Request(1, { records }));
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* filename, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+///// Two ways of creating the global //////////////////////////////////////////
+
+// What every example in this directory does, once per request.
+static JSObject* NewGlobalFromScratch(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return nullptr;
+
+  JSAutoRealm ar(cx, global);
+  if (!JS_DefineFunctions(cx, global, globalFunctions) ||
+      !DefineCounterClass(cx, global) ||
+      !ExecuteCode(cx, "bootstrap.js", bootstrapScript)) {
+    return nullptr;
+  }
+  return global;
+}
+
+static boilerplate::GlobalTemplate* globalTemplate;
+
+static JSObject* NewGlobalFromTemplate(JSContext* cx) {
+  return globalTemplate->newGlobal(cx);
+}
+
+///// Measurements /////////////////////////////////////////////////////////////
+
+static void PrintLatency(const char* name, std::vector<double>& micros) {
+  std::sort(micros.begin(), micros.end());
+  double total = 0;
+  for (double us : micros) total += us;
+  printf("%-9s realm creation: mean %7.1f us  p50 %7.1f us  p99 %7.1f us\n",
+         name, total / micros.size(), micros[micros.size() / 2],
+         micros[micros.size() * 99 / 100]);
+}
+
+// Create a new global for every request, run the request in it, and drop it.
+static bool MeasureLatency(JSContext* cx, const char* name,
+                           JSObject* (*newGlobal)(JSContext*)) {
+  std::vector<double> micros;
+  micros.reserve(requestCount);
+
+  for (unsigned i = 0; i < requestCount; i++) {
+    auto start = std::chrono::steady_clock::now();
+    JS::RootedObject global(cx, newGlobal(cx));
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (!global) return false;
+    micros.push_back(elapsed.count());
+
+    {
+      JSAutoRealm ar(cx, global);
+      if (!ExecuteCode(cx, "request.js", requestScript)) return false;
+    }
+
+    global = nullptr;
+    if (newGlobal == NewGlobalFromTemplate) {
+      globalTemplate->release(cx);
+    } else {
+      JS_MaybeGC(cx);
+    }
+  }
+
+  PrintLatency(name, micros);
+  return true;
+}
+
+// Keep a number of request globals alive at once and see how much the GC heap
+// grows, then drop them and see how much is given back.
+static bool MeasureRetained(JSContext* cx, const char* name,
+                            JSObject* (*newGlobal)(JSContext*)) {
+  JS_GC(cx);
+  uint32_t baseline = JS_GetGCParameter(cx, JSGC_BYTES);
+
+  {
+    JS::RootedVector<JSObject*> globals(cx);
+    for (unsigned i = 0; i < retainedRealms; i++) {
+      JS::RootedObject global(cx, newGlobal(cx));
+      if (!global || !globals.append(global)) return false;
+    }
+
+    JS_GC(cx);
+    uint32_t live = JS_GetGCParameter(cx, JSGC_BYTES);
+    printf("%-9s retained per realm: %7.1f KB (%u live realms)\n", name,
+           (double(live) - baseline) / retainedRealms / 1024.0,
+           retainedRealms);
+  }
+
+  JS_GC(cx);
+  uint32_t after = JS_GetGCParameter(cx, JSGC_BYTES);
+  printf("%-9s after release:      %7.1f KB above baseline\n", name,
+         (double(after) - baseline) / 1024.0);
+  return true;
+}
+
+static bool RealmsExample(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  boilerplate::GlobalTemplate tmpl;
+  tmpl.setFunctions(globalFunctions);
+  tmpl.addClass(DefineCounterClass);
+  tmpl.setBootstrap("bootstrap.js", bootstrapScript);
+  if (!tmpl.init(cx)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  globalTemplate = &tmpl;
+
+  bool ok = MeasureLatency(cx, "scratch", NewGlobalFromScratch) &&
+            MeasureLatency(cx, "template", NewGlobalFromTemplate) &&
+            MeasureRetained(cx, "scratch", NewGlobalFromScratch) &&
+            MeasureRetained(cx, "template", NewGlobalFromTemplate);
+  if (!ok && JS_IsExceptionPending(cx)) {
+    boilerplate::ReportAndClearException(cx);
+  }
+
+  globalTemplate = nullptr;
+  tmpl.reset();
+  return ok;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) requestCount = atoi(argv[1]);
+  if (requestCount == 0) {
+    fprintf(stderr, "Usage: %s [REQUESTS]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(RealmsExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -16,13 +16,14 @@
 #include <js/Exception.h>
 #include <js/Initialization.h>
 #include <js/Object.h>
-#include <js/SourceText.h>
 #include <js/Warnings.h>
 
 #include <readline/history.h>
 #include <readline/readline.h>
 
 #include "boilerplate.h"
+#include "microtaskqueue.h"
+#include "watchdog.h"
 
 /* This is a longer example that illustrates how to build a simple
  * REPL (Read-Eval-Print Loop). */
@@ -52,8 +53,8 @@ class ReplGlobal {
     // Return an "uncatchable" exception, by returning false without setting an
     // exception to be pending. We distinguish it from any other uncatchable
     // that the JS engine might throw, by setting m_shouldQuit
+    // This also stops the job queue, if quit() is called from a promise job.
     priv(global)->m_shouldQuit = true;
-    js::StopDrainingJobQueue(cx);
     return false;
   }
 
@@ -64,7 +65,9 @@ class ReplGlobal {
 
  public:
   static JSObject* create(JSContext* cx);
-  static void loop(JSContext* cx, JS::HandleObject global);
+  static void loop(JSContext* cx, JS::HandleObject global,
+                   boilerplate::MicrotaskQueue* jobQueue,
+                   boilerplate::Watchdog* watchdog);
 };
 constexpr JSFunctionSpec ReplGlobal::functions[];
 
@@ -152,15 +155,12 @@ bool EvalAndPrint(JSContext* cx, const std::string& buffer, unsigned lineno) {
   JS::CompileOptions options(cx);
   options.setFileAndLine("typein", lineno);
 
-  JS::SourceText<mozilla::Utf8Unit> source;
-  if (!source.init(cx, buffer.c_str(), buffer.size(),
-                   JS::SourceOwnership::Borrowed)) {
+  JS::RootedValue result(cx);
+  if (!boilerplate::Evaluate(cx, options, buffer.c_str(), buffer.size(),
+                             &result)) {
     return false;
   }
 
-  JS::RootedValue result(cx);
-  if (!JS::Evaluate(cx, options, source, &result)) return false;
-
   JS_MaybeGC(cx);
 
   if (result.isUndefined()) return true;
@@ -170,7 +170,14 @@ bool EvalAndPrint(JSContext* cx, const std::string& buffer, unsigned lineno) {
   return true;
 }
 
-void ReplGlobal::loop(JSContext* cx, JS::HandleObject global) {
+// Each line of input, with the promise jobs it queues, may use up to this
+// much CPU time before it is stopped, so that 'while(true){}' does not hang
+// the REPL.
+static const unsigned InputBudgetMs = 10000;
+
+void ReplGlobal::loop(JSContext* cx, JS::HandleObject global,
+                      boilerplate::MicrotaskQueue* jobQueue,
+                      boilerplate::Watchdog* watchdog) {
   bool eof = false;
   unsigned lineno = 1;
   do {
@@ -194,27 +201,32 @@ void ReplGlobal::loop(JSContext* cx, JS::HandleObject global) {
     } while (!JS_Utf8BufferIsCompilableUnit(cx, global, buffer.c_str(),
                                             buffer.length()));
 
+    boilerplate::Watchdog::Budget budget(*watchdog, cx, InputBudgetMs);
     if (!EvalAndPrint(cx, buffer, startline)) {
-      if (!priv(global)->m_shouldQuit) {
+      // If the watchdog stopped the input, there is no exception to report.
+      if (!priv(global)->m_shouldQuit && JS_IsExceptionPending(cx)) {
         boilerplate::ReportAndClearException(cx);
       }
     }
 
-    js::RunJobs(cx);
+    // Run promise jobs queued by this line of input, until there are none left
+    // or one of them calls quit().
+    while (!jobQueue->empty() && jobQueue->runBatch()) {
+    }
+
+    budget.finish();
+    budget.report();
   } while (!eof && !priv(global)->m_shouldQuit);
 }
 
 static bool RunREPL(JSContext* cx) {
-  // In order to use Promises in the REPL, we need a job queue to process
-  // events after each line of input is processed.
+  // In order to use Promises in the REPL, we need a job queue to process events
+  // after each line of input is processed. See 'microtaskqueue.cpp'.
   //
-  // A more sophisticated embedding would schedule it's own tasks and use
-  // JS::SetEnqueuePromiseJobCallback(), JS::SetGetIncumbentGlobalCallback(),
-  // and JS::SetPromiseRejectionTrackerCallback().
-  if (!js::UseInternalJobQueues(cx)) return false;
-
-  // We must instantiate self-hosting *after* setting up job queue.
-  if (!JS::InitSelfHostedCode(cx)) return false;
+  // A more sophisticated embedding would also use
+  // JS::SetPromiseRejectionTrackerCallback() to report unhandled rejections.
+  boilerplate::MicrotaskQueue jobQueue(cx);
+  if (!jobQueue.init()) return false;
 
   JS::RootedObject global(cx, ReplGlobal::create(cx));
   if (!global) return false;
@@ -225,14 +237,19 @@ static bool RunREPL(JSContext* cx) {
     JS::PrintError(stderr, report, true);
   });
 
-  ReplGlobal::loop(cx, global);
+  // Stop input that runs for too long. See 'watchdog.cpp'.
+  boilerplate::Watchdog watchdog;
+  if (!watchdog.attach(cx)) return false;
+
+  ReplGlobal::loop(cx, global, &jobQueue, &watchdog);
+
+  watchdog.detach(cx);
 
   std::cout << '\n';
   return true;
 }
 
 int main(int argc, const char* argv[]) {
-  if (!boilerplate::RunExample(RunREPL, /* initSelfHosting = */ false))
-    return 1;
+  if (!boilerplate::RunExample(RunREPL)) return 1;
   return 0;
 }
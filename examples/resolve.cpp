@@ -4,13 +4,12 @@
 #include <jsapi.h>
 #include <jsfriendapi.h>
 
-#include <js/CompilationAndEvaluation.h>
+#include <js/CompileOptions.h>
 #include <js/Conversions.h>
 #include <js/experimental/TypedData.h>
 #include <js/friend/ErrorMessages.h>
 #include <js/Object.h>
 #include <js/Initialization.h>
-#include <js/SourceText.h>
 
 #include "boilerplate.h"
 
@@ -225,14 +224,11 @@ static bool ExecuteCodePrintResult(JSContext* cx, const char* code) {
   JS::CompileOptions options(cx);
   options.setFileAndLine("noname", 1);
 
-  JS::SourceText<mozilla::Utf8Unit> source;
-  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
+  JS::RootedValue rval(cx);
+  if (!boilerplate::Evaluate(cx, options, code, strlen(code), &rval)) {
     return false;
   }
 
-  JS::RootedValue rval(cx);
-  if (!JS::Evaluate(cx, options, source, &rval)) return false;
-
   JS::RootedString rval_str(cx, JS::ToString(cx, rval));
   if (!rval_str) return false;
 
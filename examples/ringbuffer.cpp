@@ -0,0 +1,218 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Conversions.h>
+
+#include "boilerplate.h"
+#include "eventloop.h"
+#include "messagechannel.h"
+#include "sharedring.h"
+
+// This program streams RECORDS records from the main thread, in C++, to a
+// script in a worker context, through a boilerplate::SharedRing of CAPACITY
+// records in a SharedArrayBuffer. The buffer is sent to the worker once, over
+// a boilerplate::MessageChannel; after that, the records pass through shared
+// memory without being copied into messages, allocated, or locked. Each record
+// is a sequence number and a value; the worker checks the sequence and sums the
+// values.
+//
+// It prints the rate at which the producer wrote records and the worker read
+// them, in millions of records per second.
+//
+// Usage: ringbuffer [RECORDS [CAPACITY]]
+
+using Clock = std::chrono::steady_clock;
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+static unsigned long recordCount = 20000000;
+static unsigned capacity = 65536;
+
+// Set when the worker thread is done, normally or not, so that the producer
+// does not wait forever for a consumer that is gone.
+static std::atomic<bool> workerExited{false};
+
+static const int ReserveTimeoutMs = 100;
+
+struct Record {
+  double sequence;
+  double value;
+};
+
+static const char* workerCode = R"js(
+onmessage = e => {
+  const ring = new SharedRing(e.data);
+  const f64 = ring.f64;
+  let count = 0, sum = 0, expected = 0, misordered = 0, n;
+
+  const consume = offset => {
+    const i = offset >> 3;
+    if (f64[i] !== expected++) misordered++;
+    sum += f64[i + 1];
+  };
+
+  const start = now();
+  try {
+    while ((n = ring.read(consume)) >= 0)
+      count += n;
+  } finally {
+    ring.close();
+  }
+  const elapsed = now() - start;
+
+  print(`consumer: ${count} records in ${elapsed.toFixed(1)} ms, ` +
+        `${(count / elapsed / 1000).toFixed(2)} million per second, ` +
+        `${misordered} out of order, sum ${sum}`);
+  close();
+};
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* filename, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+static bool Print(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  JS::RootedString str(cx, JS::ToString(cx, args.get(0)));
+  if (!str) return false;
+
+  JS::UniqueChars chars = JS_EncodeStringToUTF8(cx, str);
+  if (!chars) return false;
+  printf("%s\n", chars.get());
+
+  args.rval().setUndefined();
+  return true;
+}
+
+static bool Now(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+  args.rval().setDouble(Milliseconds(Clock::now().time_since_epoch()).count());
+  return true;
+}
+
+static void RunWorker(JSRuntime* parentRuntime,
+                      boilerplate::MessagePort& port) {
+  JSContext* cx = boilerplate::NewChildContext(parentRuntime);
+  if (!cx) {
+    fprintf(stderr, "Error: Failed during boilerplate::NewChildContext\n");
+    return;
+  }
+
+  {
+    boilerplate::EventLoop loop(cx);
+    if (!loop.init()) return;
+
+    JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+    if (!global) return;
+
+    JSAutoRealm ar(cx, global);
+
+    if (!JS_DefineFunction(cx, global, "print", &Print, 1, 0) ||
+        !JS_DefineFunction(cx, global, "now", &Now, 0, 0) ||
+        !boilerplate::SharedRing::DefineFunctions(cx, global) ||
+        !port.attach(cx, &loop, global) ||
+        !ExecuteCode(cx, "worker.js", workerCode)) {
+      boilerplate::ReportAndClearException(cx);
+      return;
+    }
+
+    if (!loop.run()) return;
+  }
+
+  JS_DestroyContext(cx);
+}
+
+static void WorkerMain(JSRuntime* parentRuntime,
+                       std::shared_ptr<boilerplate::MessageChannel> channel) {
+  RunWorker(parentRuntime, channel->port2());
+  workerExited = true;
+  channel->port2().close();
+}
+
+static bool Produce(JSContext* cx, boilerplate::MessagePort& port) {
+  JS::RootedObject buffer(
+      cx, boilerplate::SharedRing::NewBuffer(cx, capacity, sizeof(Record)));
+  if (!buffer) return false;
+
+  JS::RootedValue message(cx, JS::ObjectValue(*buffer));
+  if (!port.post(cx, message, JS::UndefinedHandleValue)) return false;
+
+  // 'buffer' stays rooted, and so alive, while the ring uses its memory.
+  boilerplate::SharedRing ring(buffer);
+
+  // The worker closes the ring when its script is done with it, but if it
+  // fails before it gets that far, only 'workerExited' says so; hence the
+  // bounded waits while the ring is full.
+  Clock::time_point start = Clock::now();
+  unsigned long written = 0;
+  while (written < recordCount) {
+    auto* record = static_cast<Record*>(ring.reserve(ReserveTimeoutMs));
+    if (!record) {
+      if (ring.closed() || workerExited) break;
+      continue;
+    }
+    record->sequence = double(written++);
+    record->value = 1.0;
+    ring.commit();
+  }
+  ring.close();
+  Milliseconds elapsed = Clock::now() - start;
+
+  printf("producer: %lu records in %.1f ms, %.2f million per second\n",
+         written, elapsed.count(), written / elapsed.count() / 1000);
+  if (written < recordCount) {
+    fprintf(stderr, "Error: The consumer stopped after %lu records\n",
+            written);
+    return false;
+  }
+  return true;
+}
+
+static bool RingBufferExample(JSContext* cx) {
+  workerExited = false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  auto channel = std::make_shared<boilerplate::MessageChannel>();
+  std::thread thread(WorkerMain, JS_GetRuntime(cx), channel);
+
+  bool ok;
+  {
+    JSAutoRealm ar(cx, global);
+    ok = Produce(cx, channel->port1());
+    if (!ok) {
+      if (JS_IsExceptionPending(cx)) boilerplate::ReportAndClearException(cx);
+      channel->port1().close();
+    }
+  }
+
+  thread.join();
+  return ok;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) recordCount = strtoul(argv[1], nullptr, 10);
+  if (argc > 2) capacity = atoi(argv[2]);
+  if (recordCount == 0 || capacity == 0) {
+    fprintf(stderr, "Usage: %s [RECORDS [CAPACITY]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(RingBufferExample)) {
+    return 1;
+  }
+  return 0;
+}
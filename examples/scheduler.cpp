@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cstdio>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include <jsapi.h>
+
+#include "boilerplate.h"
+#include "scheduler.h"
+
+// A work-stealing scheduler over one JSContext per core. Where ContextPool
+// hands tasks out from a single locked queue, which is fine for a handful of
+// threads, every thread here has its own pair of queues, so submitting and
+// running tasks on different threads rarely touch the same lock. A thread
+// with nothing left to do takes work from the others before going to sleep,
+// which keeps every core busy when tasks of very different lengths are mixed.
+//
+// Tasks may carry an affinity key, such as the id of a tenant, a document or
+// a script. All tasks with the same key are sent to the same thread, and run
+// there in a global of their own that lives as long as the scheduler, so the
+// key's scripts, type information and JIT code are already warm when the next
+// task for it arrives. Keyed tasks are only stolen once more than the
+// "affinity slack" of them (default 4) are waiting on their thread; a thief
+// runs them in its own global for the key, which starts cold. Tasks without a
+// key are spread round-robin over the threads and run in the thread's default
+// global. Tasks submitted by a running task go to its own thread's queue.
+//
+// Each thread keeps the globals of at most 'setAffineGlobalLimit' keys
+// (default 64), and drops the one for its least recently used key to make room
+// for a new key; the next task for a dropped key starts cold again, and the
+// dropped global is left for the GC. A server with many more keys than
+// threads times the limit gets little out of affinity, and should either raise
+// the limit, if it can spare the memory, or use coarser keys.
+//
+// Like ContextPool, each thread's context is a child of the main thread's
+// runtime, runs the optional 'setup' function in each global it creates, and
+// uses the GC profile given to 'setGCProfile' or else the one from the
+// environment. 'setAffinitySlack' and 'setAffineGlobalLimit' must also be
+// called before 'start'.
+//
+// Usage:
+//
+//   boilerplate::Scheduler scheduler(JS_GetRuntime(cx));  // one per core
+//   if (!scheduler.start()) return false;
+//   std::future<bool> result = scheduler.submit(
+//       [](JSContext* cx, JS::HandleObject global) { ... }, tenantId);
+//
+// NOTE: The parent context must have initialized self-hosted code before the
+// scheduler is started, and must not be destroyed until after it has been
+// shut down.
+
+namespace {
+// The scheduler and thread index of the calling thread, if it is one of the
+// scheduler's own.
+thread_local boilerplate::Scheduler* t_scheduler = nullptr;
+thread_local size_t t_index = 0;
+}  // namespace
+
+// A 'threadCount' of zero means one thread per hardware thread.
+boilerplate::Scheduler::Scheduler(JSRuntime* parentRuntime,
+                                  size_t threadCount, GlobalSetup setup,
+                                  uint32_t maxBytes)
+    : m_parentRuntime(parentRuntime),
+      m_threadCount(threadCount),
+      m_setup(setup),
+      m_maxBytes(maxBytes) {
+  if (m_threadCount == 0) {
+    m_threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < m_threadCount; i++) {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+}
+
+boilerplate::Scheduler::~Scheduler() { shutdown(); }
+
+// Start the threads and wait until every context is ready to accept tasks.
+// Returns false if any context failed to initialize, in which case the
+// scheduler is shut down again.
+bool boilerplate::Scheduler::start() {
+  for (size_t i = 0; i < m_threadCount; i++) {
+    m_threads.emplace_back(&Scheduler::workerMain, this, i);
+  }
+
+  bool ok;
+  {
+    std::unique_lock<std::mutex> lock(m_startLock);
+    m_startup.wait(lock,
+                   [this] { return m_ready + m_failed == m_threadCount; });
+    ok = m_failed == 0;
+  }
+
+  if (!ok) {
+    shutdown();
+  }
+  return ok;
+}
+
+// Queue a task, on the thread that owns 'affinity' if one is given. The
+// returned future becomes ready with the task's return value once it has run.
+// If the task fails with a pending exception, it is reported and cleared on
+// the thread that ran it.
+std::future<bool> boilerplate::Scheduler::submit(Task task,
+                                                 uint64_t affinity) {
+  PendingTask pending{std::move(task), std::promise<bool>(), affinity, 0};
+  std::future<bool> result = pending.result.get_future();
+
+  if (m_stopping) {
+    pending.result.set_value(false);
+    return result;
+  }
+
+  size_t index;
+  if (affinity != NoAffinity) {
+    index = home(affinity);
+  } else if (t_scheduler == this) {
+    index = t_index;
+  } else {
+    index = m_roundRobin++ % m_threadCount;
+  }
+
+  Worker& worker = *m_workers[index];
+  bool stealable;
+  {
+    std::lock_guard<std::mutex> lock(worker.lock);
+    pending.sequence = m_sequence++;
+    if (affinity == NoAffinity) {
+      worker.shared.push_back(std::move(pending));
+      stealable = true;
+    } else {
+      worker.affine.push_back(std::move(pending));
+      stealable = worker.affine.size() > m_affinitySlack;
+    }
+    if (stealable) {
+      m_stealable++;
+    }
+  }
+
+  // Pairs with the check of 'm_stealable' in 'next': either a thread going to
+  // sleep sees the new task, or it is already marked as sleeping here.
+  if (worker.sleeping) {
+    worker.wakeup.notify_one();
+  } else if (stealable) {
+    wakeIdle(index);
+  }
+  return result;
+}
+
+// Finish all queued tasks, then destroy the contexts and join their threads.
+// Safe to call more than once. Tasks that race with shutdown and are queued
+// after the threads have exited complete with false.
+void boilerplate::Scheduler::shutdown() {
+  m_stopping = true;
+  for (std::unique_ptr<Worker>& worker : m_workers) {
+    std::lock_guard<std::mutex> lock(worker->lock);
+    worker->wakeup.notify_all();
+  }
+
+  for (std::thread& thread : m_threads) {
+    thread.join();
+  }
+  m_threads.clear();
+
+  for (std::unique_ptr<Worker>& worker : m_workers) {
+    std::lock_guard<std::mutex> lock(worker->lock);
+    for (PendingTask& pending : worker->shared) {
+      pending.result.set_value(false);
+    }
+    for (PendingTask& pending : worker->affine) {
+      pending.result.set_value(false);
+    }
+    worker->shared.clear();
+    worker->affine.clear();
+  }
+}
+
+boilerplate::Scheduler::Stats boilerplate::Scheduler::stats() const {
+  Stats stats;
+  for (const std::unique_ptr<Worker>& worker : m_workers) {
+    stats.tasksRun += worker->tasksRun;
+    stats.steals += worker->steals;
+    stats.affineSteals += worker->affineSteals;
+  }
+  return stats;
+}
+
+void boilerplate::Scheduler::markStarted(bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(m_startLock);
+    if (ok) {
+      m_ready++;
+    } else {
+      m_failed++;
+    }
+  }
+  m_startup.notify_all();
+}
+
+// Keys are often pointers or small consecutive integers, so mix the bits
+// before picking a thread.
+size_t boilerplate::Scheduler::home(uint64_t affinity) const {
+  return ((affinity * 0x9E3779B97F4A7C15ull) >> 32) % m_threadCount;
+}
+
+void boilerplate::Scheduler::workerMain(size_t index) {
+  JSContext* cx =
+      boilerplate::NewChildContext(m_parentRuntime, m_maxBytes, m_gcProfile);
+  if (!cx) {
+    fprintf(stderr, "Error: Failed to create scheduler context\n");
+    markStarted(false);
+    return;
+  }
+
+  t_scheduler = this;
+  t_index = index;
+  serve(cx, index);
+  t_scheduler = nullptr;
+
+  JS_DestroyContext(cx);
+}
+
+// Create a global and run 'setup' in it. On failure the exception is reported
+// and null is returned.
+JSObject* boilerplate::Scheduler::newGlobal(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) {
+    fprintf(stderr, "Error: Failed during boilerplate::CreateGlobal\n");
+    return nullptr;
+  }
+
+  JSAutoRealm ar(cx, global);
+  if (m_setup && !m_setup(cx, global)) {
+    boilerplate::ReportAndClearException(cx);
+    return nullptr;
+  }
+  return global;
+}
+
+// Run tasks until the scheduler shuts down. The globals must be rooted in a
+// scope that ends before the context is destroyed, which is why this is
+// separate from 'workerMain'.
+void boilerplate::Scheduler::serve(JSContext* cx, size_t index) {
+  JS::RootedObject global(cx, newGlobal(cx));
+  if (!global) {
+    markStarted(false);
+    return;
+  }
+
+  // One global per affinity key recently seen on this thread, the most
+  // recently used first.
+  using AffineGlobal =
+      std::pair<uint64_t, std::unique_ptr<JS::PersistentRootedObject>>;
+  std::list<AffineGlobal> affineGlobals;
+  std::unordered_map<uint64_t, std::list<AffineGlobal>::iterator>
+      affineIndex;
+
+  markStarted(true);
+
+  Worker& worker = *m_workers[index];
+  PendingTask pending;
+  while (next(index, &pending)) {
+    JS::RootedObject target(cx, global);
+    if (pending.affinity != NoAffinity) {
+      auto search = affineIndex.find(pending.affinity);
+      if (search != affineIndex.end()) {
+        affineGlobals.splice(affineGlobals.begin(), affineGlobals,
+                             search->second);
+      } else {
+        JSObject* obj = newGlobal(cx);
+        if (!obj) {
+          pending.result.set_value(false);
+          continue;
+        }
+        if (affineGlobals.size() >= std::max(size_t(1), m_affineGlobalLimit)) {
+          affineIndex.erase(affineGlobals.back().first);
+          affineGlobals.pop_back();
+        }
+        affineGlobals.emplace_front(
+            pending.affinity,
+            std::make_unique<JS::PersistentRootedObject>(cx, obj));
+        affineIndex[pending.affinity] = affineGlobals.begin();
+      }
+      target = affineGlobals.front().second->get();
+    }
+
+    bool ok;
+    {
+      JSAutoRealm ar(cx, target);
+      ok = pending.task(cx, target);
+      if (!ok && JS_IsExceptionPending(cx)) {
+        boilerplate::ReportAndClearException(cx);
+      }
+    }
+    pending.result.set_value(ok);
+    worker.tasksRun++;
+
+    JS_MaybeGC(cx);
+  }
+}
+
+// Take the next task for thread 'index': its own oldest task, else one stolen
+// from another thread, else sleep until there is one. Returns false once the
+// scheduler is shutting down and no work is left for this thread.
+bool boilerplate::Scheduler::next(size_t index, PendingTask* task) {
+  Worker& worker = *m_workers[index];
+  for (;;) {
+    if (popLocal(index, task) || steal(index, task)) {
+      return true;
+    }
+
+    std::unique_lock<std::mutex> lock(worker.lock);
+    worker.sleeping = true;
+    auto ready = [&] {
+      return !worker.shared.empty() || !worker.affine.empty() ||
+             m_stealable > 0;
+    };
+    worker.wakeup.wait(lock, [&] { return m_stopping || ready(); });
+    worker.sleeping = false;
+    if (!ready()) {
+      return false;
+    }
+  }
+}
+
+bool boilerplate::Scheduler::popLocal(size_t index, PendingTask* task) {
+  Worker& worker = *m_workers[index];
+  std::lock_guard<std::mutex> lock(worker.lock);
+
+  bool haveShared = !worker.shared.empty();
+  bool haveAffine = !worker.affine.empty();
+  if (!haveShared && !haveAffine) {
+    return false;
+  }
+
+  if (haveAffine && (!haveShared || worker.affine.front().sequence <
+                                        worker.shared.front().sequence)) {
+    if (worker.affine.size() > m_affinitySlack) {
+      m_stealable--;
+    }
+    *task = std::move(worker.affine.front());
+    worker.affine.pop_front();
+  } else {
+    m_stealable--;
+    *task = std::move(worker.shared.front());
+    worker.shared.pop_front();
+  }
+  return true;
+}
+
+// Visit the other threads in order, starting after this one, and take the
+// oldest unkeyed task found, or else the newest keyed task from a thread that
+// has more of them waiting than the affinity slack.
+bool boilerplate::Scheduler::steal(size_t index, PendingTask* task) {
+  if (m_stealable == 0) {
+    return false;
+  }
+
+  for (size_t i = 1; i < m_threadCount; i++) {
+    Worker& victim = *m_workers[(index + i) % m_threadCount];
+    std::lock_guard<std::mutex> lock(victim.lock);
+
+    if (!victim.shared.empty()) {
+      m_stealable--;
+      *task = std::move(victim.shared.front());
+      victim.shared.pop_front();
+      m_workers[index]->steals++;
+      return true;
+    }
+
+    if (victim.affine.size() > m_affinitySlack) {
+      m_stealable--;
+      *task = std::move(victim.affine.back());
+      victim.affine.pop_back();
+      m_workers[index]->steals++;
+      m_workers[index]->affineSteals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Wake one sleeping thread other than 'from', if there is one, to steal a
+// task that was just queued on a busy thread.
+void boilerplate::Scheduler::wakeIdle(size_t from) {
+  for (size_t i = 1; i < m_threadCount; i++) {
+    Worker& worker = *m_workers[(from + i) % m_threadCount];
+    if (worker.sleeping) {
+      std::lock_guard<std::mutex> lock(worker.lock);
+      worker.wakeup.notify_one();
+      return;
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <jsapi.h>
+
+#include "gcprofile.h"
+
+// See 'scheduler.cpp' for documentation.
+
+namespace boilerplate {
+
+class Scheduler {
+ public:
+  using Task = std::function<bool(JSContext*, JS::HandleObject)>;
+  using GlobalSetup = bool (*)(JSContext*, JS::HandleObject);
+
+  static constexpr uint64_t NoAffinity = 0;
+
+  struct Stats {
+    uint64_t tasksRun = 0;
+    uint64_t steals = 0;
+    uint64_t affineSteals = 0;
+  };
+
+  Scheduler(JSRuntime* parentRuntime, size_t threadCount = 0,
+            GlobalSetup setup = nullptr,
+            uint32_t maxBytes = 8L * 1024L * 1024L);
+  ~Scheduler();
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  void setGCProfile(GCProfile profile) { m_gcProfile = profile; }
+  void setAffinitySlack(size_t tasks) { m_affinitySlack = tasks; }
+  void setAffineGlobalLimit(size_t globals) { m_affineGlobalLimit = globals; }
+
+  bool start();
+  std::future<bool> submit(Task task, uint64_t affinity = NoAffinity);
+  void shutdown();
+
+  size_t size() const { return m_threadCount; }
+  Stats stats() const;
+
+ private:
+  struct PendingTask {
+    Task task;
+    std::promise<bool> result;
+    uint64_t affinity;
+    uint64_t sequence;
+  };
+
+  struct Worker {
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::deque<PendingTask> shared;
+    std::deque<PendingTask> affine;
+    std::atomic<bool> sleeping{false};
+
+    std::atomic<uint64_t> tasksRun{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> affineSteals{0};
+  };
+
+  void workerMain(size_t index);
+  void serve(JSContext* cx, size_t index);
+  void markStarted(bool ok);
+  JSObject* newGlobal(JSContext* cx);
+
+  size_t home(uint64_t affinity) const;
+  bool next(size_t index, PendingTask* task);
+  bool popLocal(size_t index, PendingTask* task);
+  bool steal(size_t index, PendingTask* task);
+  void wakeIdle(size_t from);
+
+  JSRuntime* m_parentRuntime;
+  size_t m_threadCount;
+  GlobalSetup m_setup;
+  uint32_t m_maxBytes;
+  GCProfile m_gcProfile = GCProfileFromEnvironment();
+  size_t m_affinitySlack = 4;
+  size_t m_affineGlobalLimit = 64;
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::thread> m_threads;
+  std::atomic<size_t> m_stealable{0};
+  std::atomic<size_t> m_roundRobin{0};
+  std::atomic<uint64_t> m_sequence{0};
+  std::atomic<bool> m_stopping{false};
+
+  std::mutex m_startLock;
+  std::condition_variable m_startup;
+  size_t m_ready = 0;
+  size_t m_failed = 0;
+};
+
+}  // namespace boilerplate
+
+#endif  // SCHEDULER_H_
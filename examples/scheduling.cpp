@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/ValueArray.h>
+
+#include "boilerplate.h"
+#include "scheduler.h"
+
+// This program measures how boilerplate::Scheduler scales with the number of
+// threads, on TASKS tasks of mixed lengths: one in 16 runs a loop 100 times
+// longer than the others. Each thread count is measured twice: once with
+// unkeyed tasks, which are spread round-robin and balanced by stealing, and
+// once with every task keyed to one of 64 tenants, which keeps each tenant's
+// code warm on one thread.
+//
+// It prints the throughput for 1, 2, 4, ... up to THREADS threads, the
+// speedup over one thread, and the fraction of tasks that were stolen.
+//
+// See 'scheduler.cpp' for the scheduler itself.
+//
+// Usage: scheduling [TASKS [THREADS]]
+
+static unsigned taskCount = 20000;
+static unsigned maxThreads = 0;
+
+static const unsigned Tenants = 64;
+static const unsigned ShortIterations = 2000;
+static const unsigned LongIterations = 200000;
+
+static const char* setupScript = R"js(
+  function work(n) {
+    let sum = 0;
+    for (let i = 0; i < n; i++) sum = (sum + i * i) % 1000003;
+    return sum;
+  }
+)js";
+
+static bool ExecuteCode(JSContext* cx, const char* code) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("setup", 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+static bool Setup(JSContext* cx, JS::HandleObject global) {
+  return ExecuteCode(cx, setupScript);
+}
+
+static bool RunTask(JSContext* cx, JS::HandleObject global, unsigned n) {
+  JS::RootedValueArray<1> args(cx);
+  args[0].setInt32(n);
+  JS::RootedValue rval(cx);
+  return JS_CallFunctionName(cx, global, "work", args, &rval);
+}
+
+struct Result {
+  double seconds;
+  double stolen;
+};
+
+static bool Measure(JSRuntime* rt, unsigned threads, bool keyed,
+                    Result* result) {
+  boilerplate::Scheduler scheduler(rt, threads, Setup);
+  if (!scheduler.start()) {
+    return false;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::future<bool>> results;
+  results.reserve(taskCount);
+  for (unsigned i = 0; i < taskCount; i++) {
+    unsigned n = i % 16 == 0 ? LongIterations : ShortIterations;
+    uint64_t affinity =
+        keyed ? i % Tenants + 1 : boilerplate::Scheduler::NoAffinity;
+    results.push_back(scheduler.submit(
+        [n](JSContext* cx, JS::HandleObject global) {
+          return RunTask(cx, global, n);
+        },
+        affinity));
+  }
+
+  bool ok = true;
+  for (std::future<bool>& future : results) {
+    ok = future.get() && ok;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  boilerplate::Scheduler::Stats stats = scheduler.stats();
+  scheduler.shutdown();
+
+  result->seconds = elapsed.count();
+  result->stolen = double(stats.steals) / taskCount;
+  return ok;
+}
+
+static bool SchedulingExample(JSContext* cx) {
+  JSRuntime* rt = JS_GetRuntime(cx);
+
+  printf("%u tasks, 1 in 16 long\n", taskCount);
+  printf("%7s  %12s %7s %7s  %12s %7s %7s\n", "threads", "unkeyed/s",
+         "speedup", "stolen", "keyed/s", "speedup", "stolen");
+
+  Result baseline[2];
+  for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+    Result results[2];
+    for (int keyed = 0; keyed < 2; keyed++) {
+      if (!Measure(rt, threads, keyed, &results[keyed])) {
+        return false;
+      }
+      if (threads == 1) {
+        baseline[keyed] = results[keyed];
+      }
+    }
+
+    printf("%7u", threads);
+    for (int keyed = 0; keyed < 2; keyed++) {
+      printf("  %12.0f %6.2fx %6.1f%%", taskCount / results[keyed].seconds,
+             baseline[keyed].seconds / results[keyed].seconds,
+             results[keyed].stolen * 100);
+    }
+    printf("\n");
+
+    if (threads == maxThreads) {
+      break;
+    }
+  }
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  if (argc > 1) taskCount = atoi(argv[1]);
+  if (argc > 2) maxThreads = atoi(argv[2]);
+  if (taskCount == 0 || maxThreads == 0) {
+    fprintf(stderr, "Usage: %s [TASKS [THREADS]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(SchedulingExample)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,316 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/BuildId.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/SourceText.h>
+#include <js/Transcoding.h>
+#include <js/experimental/JSStencil.h>
+
+#include "scriptcache.h"
+#include "traceevents.h"
+
+// A persistent cache of compiled scripts. The examples all compile their
+// scripts from source every time they run. For a large script that is run
+// over and over, in many processes, most of that work can be skipped by
+// storing the compiled stencil on disk and decoding it next time.
+//
+// The cache lives in a directory with one file per script. Files are named
+// after a hash of the script's source text, its filename and starting
+// position, the compile options that affect the result, and the engine build
+// ID, so a cache directory can be shared by different versions of the
+// embedding. On a hit, the file is mapped into memory and decoded. If the file cannot be used for any reason (it belongs to a
+// different build of SpiderMonkey, it is truncated, or the hash collided), it
+// is removed and the script is compiled from source as if the cache were not
+// there.
+//
+// SpiderMonkey refuses to encode or decode stencils unless the embedding
+// tells it its build ID, because the encoded form changes from build to build.
+// 'init' installs a build ID derived from the SpiderMonkey library itself.
+//
+// Usage:
+//
+//   boilerplate::ScriptCache cache("/var/cache/myapp");
+//   if (!cache.init()) ...
+//
+//   JS::RootedValue rval(cx);
+//   if (!cache.evaluate(cx, options, source, length, &rval)) ...
+
+static const char cacheMagic[4] = {'S', 'M', 'B', 'C'};
+static const uint32_t cacheVersion = 1;
+
+// The file header. Its size is a multiple of 8, so that the encoded stencil
+// that follows it is suitably aligned for decoding in place.
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint64_t check;
+  uint64_t sourceLength;
+};
+
+static std::string engineBuildId;
+static std::once_flag engineBuildIdOnce;
+
+// The implementation version alone does not distinguish between two builds of
+// the same release, so also use the size and modification time of the file
+// that SpiderMonkey was loaded from. When SpiderMonkey is linked statically,
+// that file is the embedding's own executable, so every relink of the
+// embedding starts a new cache; stale entries are never used, only rebuilt
+// more often than necessary.
+static void ComputeEngineBuildId() {
+  engineBuildId = JS_GetImplementationVersion();
+
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(&JS_NewContext), &info) &&
+      info.dli_fname) {
+    struct stat st;
+    if (stat(info.dli_fname, &st) == 0) {
+      engineBuildId += '-' + std::to_string(st.st_size) + '-' +
+                       std::to_string(st.st_mtime);
+    }
+  }
+}
+
+static const std::string& EngineBuildId() {
+  std::call_once(engineBuildIdOnce, ComputeEngineBuildId);
+  return engineBuildId;
+}
+
+static bool EngineBuildIdOp(JS::BuildIdCharVector* buildId) {
+  const std::string& id = EngineBuildId();
+  return buildId->append(id.data(), id.size());
+}
+
+// 64-bit FNV-1a. Not a cryptographic hash; the cache directory is assumed to
+// be writable only by the embedding.
+static uint64_t Hash(uint64_t hash, const void* data, size_t length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+static const uint64_t hashBasis = 0xcbf29ce484222325;
+static const uint64_t checkBasis = 0x84222325cbf29ce4;
+
+// The type of ReadOnlyCompileOptions::filename() differs between SpiderMonkey
+// versions; accept both.
+static const char* CString(const char* str) { return str ? str : ""; }
+template <typename T>
+static const char* CString(const T& str) {
+  return str.c_str() ? str.c_str() : "";
+}
+
+template <typename T>
+static uint64_t HashValue(uint64_t hash, const T& value) {
+  return Hash(hash, &value, sizeof(value));
+}
+
+// The key covers every compile option that changes the stencil, so that a
+// script compiled with different options, such as strict mode or without a
+// return value, is cached separately. The cache only holds global scripts;
+// modules would need a kind of their own in the key.
+static uint64_t CacheKey(const JS::ReadOnlyCompileOptions& options,
+                         const char* source, size_t length) {
+  const std::string& buildId = EngineBuildId();
+  const char* filename = CString(options.filename());
+
+  uint8_t flags[] = {
+      options.forceStrictMode(), options.noScriptRval,
+      options.isRunOnce,         options.nonSyntacticScope,
+      options.selfHostingMode,   options.allowHTMLComments,
+      options.topLevelAwait,     options.discardSource,
+      options.sourceIsLazy,      options.mutedErrors(),
+  };
+
+  uint64_t hash = Hash(hashBasis, buildId.data(), buildId.size());
+  hash = Hash(hash, filename, strlen(filename) + 1);
+  hash = HashValue(hash, options.lineno);
+  hash = HashValue(hash, options.column);
+  hash = HashValue(hash, options.scriptSourceOffset);
+  hash = Hash(hash, flags, sizeof(flags));
+  return Hash(hash, source, length);
+}
+
+// A second, independent hash of the source, stored in the file header to catch
+// collisions of the key.
+static uint64_t SourceCheck(const char* source, size_t length) {
+  return Hash(checkBasis, source, length);
+}
+
+// 'directory' is created by 'init' if it does not exist.
+boilerplate::ScriptCache::ScriptCache(const std::string& directory)
+    : m_directory(directory) {}
+
+bool boilerplate::ScriptCache::init() {
+  JS::SetProcessBuildIdOp(EngineBuildIdOp);
+
+  if (mkdir(m_directory.c_str(), 0700) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Cannot create script cache directory %s: %s\n",
+            m_directory.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+std::string boilerplate::ScriptCache::pathFor(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016" PRIx64 ".jsbc", key);
+  return m_directory + name;
+}
+
+// Map and decode a cache file. Returns nullptr on a miss, and also when the
+// file is unusable, in which case it is removed.
+already_AddRefed<JS::Stencil> boilerplate::ScriptCache::load(
+    JSContext* cx, const JS::ReadOnlyCompileOptions& options,
+    const std::string& path, uint64_t key, uint64_t check, size_t length) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) > sizeof(CacheHeader)) {
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  JS::Stencil* stencil = nullptr;
+  if (map != MAP_FAILED) {
+    const CacheHeader* header = static_cast<const CacheHeader*>(map);
+    const uint8_t* data = static_cast<const uint8_t*>(map);
+
+    if (memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+        header->version == cacheVersion && header->key == key &&
+        header->check == check && header->sourceLength == length) {
+      // The decoded stencil copies what it needs out of the buffer, so the
+      // mapping can go away as soon as decoding is done.
+      JS::DecodeOptions decodeOptions(options);
+      JS::TranscodeRange range(data + sizeof(CacheHeader),
+                               st.st_size - sizeof(CacheHeader));
+      JS::TranscodeResult result =
+          JS::DecodeStencil(cx, decodeOptions, range, &stencil);
+      if (result != JS::TranscodeResult::Ok) {
+        if (result == JS::TranscodeResult::Throw) {
+          JS_ClearPendingException(cx);
+        }
+        stencil = nullptr;
+      }
+    }
+
+    munmap(map, st.st_size);
+  }
+
+  if (!stencil) {
+    m_stats.rejected++;
+    unlink(path.c_str());
+  }
+  return already_AddRefed<JS::Stencil>(stencil);
+}
+
+// Encode a freshly compiled stencil and write it to the cache. Failing to
+// store is not an error; the script will simply be compiled again next time.
+void boilerplate::ScriptCache::store(JSContext* cx, JS::Stencil* stencil,
+                                     const std::string& path, uint64_t key,
+                                     uint64_t check, size_t length) {
+  JS::TranscodeBuffer buffer;
+  JS::TranscodeResult result = JS::EncodeStencil(cx, stencil, buffer);
+  if (result != JS::TranscodeResult::Ok) {
+    if (result == JS::TranscodeResult::Throw) {
+      JS_ClearPendingException(cx);
+    }
+    return;
+  }
+
+  CacheHeader header;
+  memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  header.key = key;
+  header.check = check;
+  header.sourceLength = length;
+
+  // Write to a temporary file and rename it into place, so that concurrent
+  // readers never see a partially written file.
+  std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+  FILE* fp = fopen(tmpPath.c_str(), "wb");
+  if (!fp) {
+    return;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(buffer.begin(), 1, buffer.length(), fp) == buffer.length();
+  ok = fclose(fp) == 0 && ok;
+
+  if (ok && rename(tmpPath.c_str(), path.c_str()) == 0) {
+    m_stats.stored++;
+  } else {
+    unlink(tmpPath.c_str());
+  }
+}
+
+// Compile a global script, from the cache if possible. Returns nullptr with an
+// exception pending on failure, like JS::Compile.
+JSScript* boilerplate::ScriptCache::compile(
+    JSContext* cx, const JS::ReadOnlyCompileOptions& options,
+    const char* source, size_t length) {
+  boilerplate::TraceScope scope("compile", "compile",
+                                CString(options.filename()));
+  uint64_t key = CacheKey(options, source, length);
+  uint64_t check = SourceCheck(source, length);
+  std::string path = pathFor(key);
+
+  RefPtr<JS::Stencil> stencil = load(cx, options, path, key, check, length);
+  if (stencil) {
+    m_stats.hits++;
+  } else {
+    m_stats.misses++;
+
+    JS::SourceText<mozilla::Utf8Unit> srcBuf;
+    if (!srcBuf.init(cx, source, length, JS::SourceOwnership::Borrowed)) {
+      return nullptr;
+    }
+
+    stencil = JS::CompileGlobalScriptToStencil(cx, options, srcBuf);
+    if (!stencil) {
+      return nullptr;
+    }
+
+    store(cx, stencil, path, key, check, length);
+  }
+
+  JS::InstantiateOptions instantiateOptions(options);
+  return JS::InstantiateGlobalStencil(cx, instantiateOptions, stencil);
+}
+
+// Drop-in replacement for JS::Evaluate on UTF-8 source.
+bool boilerplate::ScriptCache::evaluate(
+    JSContext* cx, const JS::ReadOnlyCompileOptions& options,
+    const char* source, size_t length, JS::MutableHandleValue rval) {
+  JS::RootedScript script(cx, compile(cx, options, source, length));
+  if (!script) {
+    return false;
+  }
+
+  boilerplate::TraceScope scope("ExecuteScript", "execute",
+                                CString(options.filename()));
+  return JS_ExecuteScript(cx, script, rval);
+}
+
+double boilerplate::ScriptCache::hitRate() const {
+  uint64_t lookups = m_stats.hits + m_stats.misses;
+  return lookups ? double(m_stats.hits) / lookups : 0;
+}
@@ -0,0 +1,55 @@
+#ifndef SCRIPTCACHE_H_
+#define SCRIPTCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/experimental/JSStencil.h>
+
+#include <mozilla/RefPtr.h>
+
+// See 'scriptcache.cpp' for documentation.
+
+namespace boilerplate {
+
+class ScriptCache {
+ public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t rejected = 0;
+    uint64_t stored = 0;
+  };
+
+  explicit ScriptCache(const std::string& directory);
+
+  bool init();
+
+  JSScript* compile(JSContext* cx, const JS::ReadOnlyCompileOptions& options,
+                    const char* source, size_t length);
+  bool evaluate(JSContext* cx, const JS::ReadOnlyCompileOptions& options,
+                const char* source, size_t length,
+                JS::MutableHandleValue rval);
+
+  const Stats& stats() const { return m_stats; }
+  double hitRate() const;
+
+ private:
+  std::string pathFor(uint64_t key) const;
+  already_AddRefed<JS::Stencil> load(JSContext* cx,
+                                     const JS::ReadOnlyCompileOptions& options,
+                                     const std::string& path, uint64_t key,
+                                     uint64_t check, size_t length);
+  void store(JSContext* cx, JS::Stencil* stencil, const std::string& path,
+             uint64_t key, uint64_t check, size_t length);
+
+  std::string m_directory;
+  Stats m_stats;
+};
+
+}  // namespace boilerplate
+
+#endif  // SCRIPTCACHE_H_
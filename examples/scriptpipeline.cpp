@@ -0,0 +1,207 @@
+#include <utility>
+
+#include <jsapi.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/CompileOptions.h>
+#include <js/OffThreadScriptCompilation.h>
+#include <js/SourceText.h>
+#include <js/experimental/JSStencil.h>
+
+#include "scriptpipeline.h"
+#include "traceevents.h"
+
+// Compiling a large script takes a long time, and JS::Evaluate does it on the
+// thread that owns the context, which can do nothing else in the meantime.
+// ScriptPipeline instead hands the source to one of SpiderMonkey's helper
+// threads, which compiles it to a stencil. The owning thread keeps running
+// other work, and calls 'runReady' now and then to instantiate and execute
+// whichever scripts have finished compiling.
+//
+// Any number of scripts may be submitted at once. They compile in parallel,
+// as many at a time as there are helper threads, but are executed in the order
+// they were submitted, so that a script can rely on the ones before it, as with
+// <script> tags in a web page. Scripts that are too small to be worth sending
+// to another thread are compiled right away in 'submit'.
+//
+// Scripts execute in whatever realm the context is in when 'runReady' is
+// called.
+//
+// Usage:
+//
+//   boilerplate::ScriptPipeline pipeline(cx);
+//   pipeline.submit("bundle.js", std::move(source));
+//
+//   while (pipeline.pending()) {
+//     ...do other work...
+//     if (!pipeline.runReady()) ...exception pending
+//   }
+
+boilerplate::ScriptPipeline::ScriptPipeline(JSContext* cx) : m_cx(cx) {}
+
+// Pending compilations are cancelled. This waits for any that are running on
+// a helper thread.
+boilerplate::ScriptPipeline::~ScriptPipeline() {
+  std::deque<std::unique_ptr<Job>> jobs;
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    jobs.swap(m_jobs);
+  }
+  for (std::unique_ptr<Job>& job : jobs) {
+    if (job->token) {
+      JS::CancelOffThreadToken(m_cx, job->token);
+    }
+  }
+}
+
+// Called on the helper thread when compilation is done, successfully or not.
+// This must not use any JSAPI; it just marks the job as ready to finish.
+void boilerplate::ScriptPipeline::OnCompiled(JS::OffThreadToken* token,
+                                             void* data) {
+  Job* job = static_cast<Job*>(data);
+  ScriptPipeline* pipeline = job->pipeline;
+
+  std::lock_guard<std::mutex> lock(pipeline->m_lock);
+  job->token = token;
+  job->ready = true;
+  pipeline->m_compiled.notify_all();
+}
+
+// Start compiling a script. The pipeline keeps the source alive until the
+// script has executed. Returns false with an exception pending if the script
+// could not be submitted, or, if it was compiled right away, if it had a
+// syntax error.
+bool boilerplate::ScriptPipeline::submit(const std::string& filename,
+                                         std::string source) {
+  auto job = std::make_unique<Job>();
+  job->pipeline = this;
+  job->filename = filename;
+  job->source = std::move(source);
+  job->submitted = Clock::now();
+
+  JS::CompileOptions options(m_cx);
+  options.setFileAndLine(job->filename.c_str(), 1);
+
+  JS::SourceText<mozilla::Utf8Unit> srcBuf;
+  if (!srcBuf.init(m_cx, job->source.data(), job->source.size(),
+                   JS::SourceOwnership::Borrowed)) {
+    return false;
+  }
+
+  if (!JS::CanCompileOffThread(m_cx, options, job->source.size())) {
+    job->stencil = JS::CompileGlobalScriptToStencil(m_cx, options, srcBuf);
+    if (!job->stencil) {
+      return false;
+    }
+    job->ready = true;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_jobs.push_back(std::move(job));
+    return true;
+  }
+
+  // The callback may run before this returns, so the job has to be queued
+  // first, and the token is recorded under the lock.
+  Job* raw = job.get();
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_jobs.push_back(std::move(job));
+  }
+
+  JS::OffThreadToken* token =
+      JS::CompileToStencilOffThread(m_cx, options, srcBuf, OnCompiled, raw);
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  if (!token) {
+    m_jobs.pop_back();
+    return false;
+  }
+  raw->token = token;
+  return true;
+}
+
+// Instantiate a compiled script in the current realm and run it.
+bool boilerplate::ScriptPipeline::execute(Job* job) {
+  JS::CompileOptions options(m_cx);
+  options.setFileAndLine(job->filename.c_str(), 1);
+
+  if (job->token) {
+    job->stencil = JS::FinishOffThreadStencil(m_cx, job->token);
+    job->token = nullptr;
+    if (!job->stencil) {
+      return false;
+    }
+  }
+
+  JS::InstantiateOptions instantiateOptions(options);
+  JS::RootedScript script(m_cx);
+  {
+    boilerplate::TraceScope scope("InstantiateGlobalStencil", "compile",
+                                  job->filename.c_str());
+    script = JS::InstantiateGlobalStencil(m_cx, instantiateOptions,
+                                          job->stencil);
+  }
+  if (!script) {
+    return false;
+  }
+
+  JS::RootedValue rval(m_cx);
+  bool ok;
+  {
+    boilerplate::TraceScope scope("ExecuteScript", "execute",
+                                  job->filename.c_str());
+    ok = JS_ExecuteScript(m_cx, script, &rval);
+  }
+
+  if (m_observer) {
+    m_observer(job->filename, Clock::now() - job->submitted);
+  }
+  return ok;
+}
+
+// Execute, in order, every script at the front of the queue that has finished
+// compiling. Does not block. Returns false with an exception pending if a
+// script failed to compile or threw; that script is dropped and the rest stay
+// queued.
+bool boilerplate::ScriptPipeline::runReady() {
+  for (;;) {
+    std::unique_ptr<Job> job;
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      if (m_jobs.empty() || !m_jobs.front()->ready) {
+        return true;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    if (!execute(job.get())) {
+      return false;
+    }
+  }
+}
+
+// Block until the next script in order has finished compiling, then execute
+// it and any others that are ready.
+bool boilerplate::ScriptPipeline::waitAndRun() {
+  {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_compiled.wait(lock,
+                    [this] { return m_jobs.empty() || m_jobs.front()->ready; });
+  }
+  return runReady();
+}
+
+// Execute every submitted script, blocking as needed.
+bool boilerplate::ScriptPipeline::drain() {
+  while (pending() > 0) {
+    if (!waitAndRun()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t boilerplate::ScriptPipeline::pending() const {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_jobs.size();
+}
@@ -0,0 +1,68 @@
+#ifndef SCRIPTPIPELINE_H_
+#define SCRIPTPIPELINE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <jsapi.h>
+#include <js/OffThreadScriptCompilation.h>
+#include <js/experimental/JSStencil.h>
+
+#include <mozilla/RefPtr.h>
+
+// See 'scriptpipeline.cpp' for documentation.
+
+namespace boilerplate {
+
+class ScriptPipeline {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Observer =
+      std::function<void(const std::string& filename, Clock::duration latency)>;
+
+  explicit ScriptPipeline(JSContext* cx);
+  ~ScriptPipeline();
+
+  ScriptPipeline(const ScriptPipeline&) = delete;
+  ScriptPipeline& operator=(const ScriptPipeline&) = delete;
+
+  void setObserver(Observer observer) { m_observer = std::move(observer); }
+
+  bool submit(const std::string& filename, std::string source);
+  bool runReady();
+  bool waitAndRun();
+  bool drain();
+
+  size_t pending() const;
+
+ private:
+  struct Job {
+    ScriptPipeline* pipeline;
+    std::string filename;
+    std::string source;
+    Clock::time_point submitted;
+    JS::OffThreadToken* token = nullptr;
+    RefPtr<JS::Stencil> stencil;
+    bool ready = false;
+  };
+
+  static void OnCompiled(JS::OffThreadToken* token, void* data);
+  bool execute(Job* job);
+
+  JSContext* m_cx;
+  Observer m_observer;
+
+  mutable std::mutex m_lock;
+  std::condition_variable m_compiled;
+  std::deque<std::unique_ptr<Job>> m_jobs;
+};
+
+}  // namespace boilerplate
+
+#endif  // SCRIPTPIPELINE_H_
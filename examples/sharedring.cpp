@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <jsapi.h>
+#include <js/CallAndConstruct.h>
+#include <js/CompileOptions.h>
+#include <js/Conversions.h>
+#include <js/GCAPI.h>
+#include <js/PropertyAndElement.h>
+#include <js/SharedArrayBuffer.h>
+
+#include "boilerplate.h"
+#include "sharedring.h"
+
+// A single-producer single-consumer ring buffer of fixed-size records in a
+// SharedArrayBuffer, for streaming records between threads without copying
+// them through messages, allocating, or taking locks. Either end may be
+// JavaScript, with the SharedRing class that 'DefineFunctions' adds to a
+// global, or C++, with boilerplate::SharedRing; for example, a host thread can
+// produce records that a script in a worker context consumes.
+//
+// The buffer starts with a header that holds the producer's and consumer's
+// positions, on separate cache lines, followed by the records. The positions
+// count records from the start and wrap around at 2^32; the capacity is a
+// power of two, so a position's slot is its low bits. Each side writes only its
+// own position, with a release store after it is done with the records, and
+// only reads the other side's position when the ring looks full or empty.
+//
+// A side that finds the ring full or empty spins briefly, then sets a flag in
+// the header and sleeps on the other side's position; the other side checks the
+// flag after moving its position and wakes it if it is set. Sleeping and waking
+// use the same futex on the same word in C++ and in JS, since SpiderMonkey's
+// own Atomics.wait cannot be woken by a thread that has no JSContext. Contexts
+// created with 'boilerplate::NewChildContext' may use Atomics.wait as well, for
+// rings whose ends are both scripts.
+//
+// The buffer reaches other contexts by posting it over a MessageChannel (see
+// 'messagechannel.cpp'); globals created by 'boilerplate::CreateGlobal' have
+// SharedArrayBuffer enabled. The C++ side reads the buffer's memory directly,
+// so it must keep the SharedArrayBuffer alive, for example in a
+// JS::PersistentRooted, for as long as it uses the ring.
+//
+// Usage in C++:
+//
+//   JS::RootedObject buffer(cx,
+//       boilerplate::SharedRing::NewBuffer(cx, 65536, sizeof(Record)));
+//   ...post 'buffer' to the consumer
+//   boilerplate::SharedRing ring(buffer);
+//   ring.push(&record);  // waits while the ring is full
+//   ring.close();
+//
+// Usage in JS:
+//
+//   const ring = new SharedRing(buffer);
+//   let n;
+//   while ((n = ring.read(offset => { sum += ring.f64[offset / 8]; })) >= 0)
+//     ...n records read, or none after a timeout
+//
+//   ring.write(offset => { ring.f64[offset / 8] = value; });
+//
+// A script that waits is still interruptible, by the same interrupt callbacks
+// as a running script; see RingWait.
+//
+// NOTE: Blocking uses futexes on Linux; elsewhere, sleeping is replaced with
+// short naps.
+
+static constexpr size_t HeadOffset = 0;
+static constexpr size_t TailOffset = 64;
+static constexpr size_t CapacityOffset = 128;
+static constexpr size_t RecordSizeOffset = 132;
+static constexpr size_t ClosedOffset = 136;
+static constexpr size_t ConsumerWaitingOffset = 140;
+static constexpr size_t ProducerWaitingOffset = 144;
+
+static constexpr int Spins = 100;
+
+// A script's wait is cut into slices this long, with a check for interrupts
+// after each.
+static constexpr int WaitSliceMs = 20;
+
+static const char* RingSource = R"js(
+(function (wait, wake, create) {
+  "use strict";
+  const HEAD = 0, TAIL = 16, CAPACITY = 32, RECORD_SIZE = 33, CLOSED = 34,
+        CONSUMER_WAITING = 35, PRODUCER_WAITING = 36, HEADER = 192,
+        SPINS = 100;
+
+  return class SharedRing {
+    static create(capacity, recordSize) {
+      return new SharedRing(create(capacity, recordSize));
+    }
+
+    constructor(buffer) {
+      this.buffer = buffer;
+      this.i32 = new Int32Array(buffer);
+      this.f64 = new Float64Array(buffer, 0, buffer.byteLength >> 3);
+      this.capacity = this.i32[CAPACITY];
+      this.recordSize = this.i32[RECORD_SIZE];
+      this.mask = this.capacity - 1;
+    }
+
+    get closed() {
+      return Atomics.load(this.i32, CLOSED) !== 0;
+    }
+
+    close() {
+      Atomics.store(this.i32, CLOSED, 1);
+      wake(this.buffer, HEAD);
+      wake(this.buffer, TAIL);
+    }
+
+    // Wait until the word at 'index' is no longer 'value'.
+    waitFor(index, value, flag, timeout) {
+      const i32 = this.i32;
+      for (let i = 0; i < SPINS; i++) {
+        if (Atomics.load(i32, index) !== value) return;
+      }
+      Atomics.store(i32, flag, 1);
+      if (Atomics.load(i32, index) === value && !this.closed)
+        wait(this.buffer, index, value, timeout);
+      Atomics.store(i32, flag, 0);
+    }
+
+    // Call fn(offset) for each record that is ready, with the record's byte
+    // offset in the buffer, waiting up to 'timeout' ms if there are none.
+    // Returns the number of records read, or -1 if the ring is closed and
+    // empty.
+    read(fn, timeout = Infinity) {
+      const i32 = this.i32;
+      let head = i32[HEAD];
+      let tail = Atomics.load(i32, TAIL);
+      if (head === tail) {
+        this.waitFor(TAIL, head, CONSUMER_WAITING, timeout);
+        tail = Atomics.load(i32, TAIL);
+        if (head === tail)
+          return this.closed && Atomics.load(i32, TAIL) === head ? -1 : 0;
+      }
+
+      const mask = this.mask, size = this.recordSize;
+      let count = 0;
+      while (head !== tail) {
+        fn(HEADER + (head & mask) * size);
+        head = (head + 1) | 0;
+        count++;
+      }
+
+      Atomics.store(i32, HEAD, head);
+      if (Atomics.load(i32, PRODUCER_WAITING) !== 0) wake(this.buffer, HEAD);
+      return count;
+    }
+
+    // Call fn(offset) to fill in the next record, waiting up to 'timeout' ms
+    // while the ring is full. Returns false if the ring is closed or still
+    // full.
+    write(fn, timeout = Infinity) {
+      const i32 = this.i32;
+      const tail = i32[TAIL];
+      let head = Atomics.load(i32, HEAD);
+      while (((tail - head) | 0) === this.capacity) {
+        if (this.closed) return false;
+        this.waitFor(HEAD, head, PRODUCER_WAITING, timeout);
+        const seen = head;
+        head = Atomics.load(i32, HEAD);
+        if (head === seen && timeout !== Infinity) return false;
+      }
+      if (this.closed) return false;
+
+      fn(HEADER + (tail & this.mask) * this.recordSize);
+
+      Atomics.store(i32, TAIL, (tail + 1) | 0);
+      if (Atomics.load(i32, CONSUMER_WAITING) !== 0) wake(this.buffer, TAIL);
+      return true;
+    }
+  };
+})
+)js";
+
+// Sleep while 'word' is 'value', until woken or for at most 'timeoutMs'.
+// Returns false if the timeout expired.
+static bool Wait(std::atomic<uint32_t>& word, uint32_t value, int timeoutMs) {
+#ifdef __linux__
+  struct timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+  long result = syscall(
+      SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, value,
+      timeoutMs == boilerplate::SharedRing::Forever ? nullptr : &timeout,
+      nullptr, 0);
+  return result == 0 || errno != ETIMEDOUT;
+#else
+  std::this_thread::sleep_for(std::chrono::microseconds(50));
+  return true;
+#endif
+}
+
+static void Wake(std::atomic<uint32_t>& word) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+          INT32_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+// The header is accessed with std::atomic on the SharedArrayBuffer's memory,
+// which is suitably aligned, and which JS accesses with Atomics on an
+// Int32Array; lock-free atomics have the same representation as the plain
+// integers.
+static std::atomic<uint32_t>& Word(uint8_t* memory, size_t offset) {
+  return *reinterpret_cast<std::atomic<uint32_t>*>(memory + offset);
+}
+
+static uint8_t* BufferData(JSObject* buffer) {
+  JS::AutoCheckCannotGC nogc;
+  bool isSharedMemory;
+  return JS::GetSharedArrayBufferData(buffer, &isSharedMemory, nogc);
+}
+
+// Create a SharedArrayBuffer for a ring of 'capacity' records of 'recordSize'
+// bytes. The capacity must be a power of two, and the record size a multiple
+// of 8 so that records can be read as Float64Array elements.
+JSObject* boilerplate::SharedRing::NewBuffer(JSContext* cx, uint32_t capacity,
+                                             uint32_t recordSize) {
+  if (capacity == 0 || capacity > (1u << 30) ||
+      (capacity & (capacity - 1)) != 0 || recordSize == 0 ||
+      recordSize % 8 != 0) {
+    JS_ReportErrorASCII(cx,
+                        "SharedRing: the capacity must be a power of two, and "
+                        "the record size a multiple of 8");
+    return nullptr;
+  }
+
+  size_t bytes = HeaderBytes + size_t(capacity) * recordSize;
+  JS::RootedObject buffer(cx, JS::NewSharedArrayBuffer(cx, bytes));
+  if (!buffer) return nullptr;
+
+  uint8_t* memory = BufferData(buffer);
+  Word(memory, CapacityOffset).store(capacity);
+  Word(memory, RecordSizeOffset).store(recordSize);
+  return buffer;
+}
+
+// 'buffer' is a SharedArrayBuffer created by NewBuffer, here or in another
+// context.
+boilerplate::SharedRing::SharedRing(JSObject* buffer)
+    : m_memory(BufferData(buffer)) {
+  m_mask = word(CapacityOffset).load() - 1;
+  m_recordSize = word(RecordSizeOffset).load();
+  m_head = m_seenHead = word(HeadOffset).load();
+  m_tail = m_seenTail = word(TailOffset).load();
+}
+
+std::atomic<uint32_t>& boilerplate::SharedRing::word(size_t offset) const {
+  return Word(m_memory, offset);
+}
+
+uint8_t* boilerplate::SharedRing::record(uint32_t position) const {
+  return m_memory + HeaderBytes + size_t(position & m_mask) * m_recordSize;
+}
+
+bool boilerplate::SharedRing::closed() const {
+  return word(ClosedOffset).load() != 0;
+}
+
+// Close the ring. The consumer still reads the records that were already
+// written.
+void boilerplate::SharedRing::close() {
+  word(ClosedOffset).store(1);
+  Wake(word(HeadOffset));
+  Wake(word(TailOffset));
+}
+
+// Wait until the word at 'offset' is no longer 'value', the ring is closed, or
+// the timeout expires. Returns false in the last case.
+bool boilerplate::SharedRing::waitFor(size_t offset, uint32_t value,
+                                    size_t flag, int timeoutMs) {
+  std::atomic<uint32_t>& position = word(offset);
+  for (int i = 0; i < Spins; i++) {
+    if (position.load(std::memory_order_acquire) != value) return true;
+  }
+
+  word(flag).store(1);
+  if (position.load() == value && !closed()) {
+    Wait(position, value, timeoutMs);
+  }
+  word(flag).store(0);
+  return position.load() != value || closed();
+}
+
+// The next record to write, or null if the ring is full. The record is not
+// visible to the consumer until it is committed.
+void* boilerplate::SharedRing::tryReserve() {
+  if (m_tail - m_seenHead > m_mask) {
+    m_seenHead = word(HeadOffset).load(std::memory_order_acquire);
+    if (m_tail - m_seenHead > m_mask) return nullptr;
+  }
+  return record(m_tail);
+}
+
+// The next record to write, waiting while the ring is full. Returns null if the
+// ring is closed, or still full after the timeout.
+void* boilerplate::SharedRing::reserve(int timeoutMs) {
+  for (;;) {
+    if (void* slot = tryReserve()) return closed() ? nullptr : slot;
+    if (closed()) return nullptr;
+    if (!waitFor(HeadOffset, m_seenHead, ProducerWaitingOffset, timeoutMs) &&
+        timeoutMs != Forever) {
+      return nullptr;
+    }
+  }
+}
+
+// Make the reserved record visible to the consumer.
+void boilerplate::SharedRing::commit() {
+  m_tail++;
+  word(TailOffset).store(m_tail);
+  if (word(ConsumerWaitingOffset).load() != 0) Wake(word(TailOffset));
+}
+
+// Copy a record into the ring, waiting while it is full. Returns false if the
+// ring is closed.
+bool boilerplate::SharedRing::push(const void* data) {
+  void* slot = reserve();
+  if (!slot) return false;
+
+  memcpy(slot, data, m_recordSize);
+  commit();
+  return true;
+}
+
+// The next record to read, or null if the ring is empty.
+const void* boilerplate::SharedRing::tryFront() {
+  if (m_head == m_seenTail) {
+    m_seenTail = word(TailOffset).load(std::memory_order_acquire);
+    if (m_head == m_seenTail) return nullptr;
+  }
+  return record(m_head);
+}
+
+// The next record to read, waiting while the ring is empty. Returns null if the
+// ring is closed and empty, or still empty after the timeout.
+const void* boilerplate::SharedRing::front(int timeoutMs) {
+  for (;;) {
+    if (const void* slot = tryFront()) return slot;
+    if (closed()) return tryFront();
+    if (!waitFor(TailOffset, m_seenTail, ConsumerWaitingOffset, timeoutMs) &&
+        timeoutMs != Forever) {
+      return nullptr;
+    }
+  }
+}
+
+// Give the record returned by 'front' back to the producer.
+void boilerplate::SharedRing::pop() {
+  m_head++;
+  word(HeadOffset).store(m_head);
+  if (word(ProducerWaitingOffset).load() != 0) Wake(word(HeadOffset));
+}
+
+static bool GetWord(JSContext* cx, const JS::CallArgs& args,
+                    std::atomic<uint32_t>** word) {
+  int32_t index;
+  if (!JS::ToInt32(cx, args.get(1), &index)) return false;
+
+  if (!args.get(0).isObject() ||
+      !JS::IsSharedArrayBufferObject(&args[0].toObject())) {
+    JS_ReportErrorASCII(cx, "SharedRing: not a SharedArrayBuffer");
+    return false;
+  }
+
+  JSObject* buffer = &args[0].toObject();
+  if (index < 0 ||
+      (size_t(index) + 1) * 4 > JS::GetSharedArrayBufferByteLength(buffer)) {
+    JS_ReportErrorASCII(cx, "SharedRing: index out of range");
+    return false;
+  }
+
+  *word = &Word(BufferData(buffer), size_t(index) * 4);
+  return true;
+}
+
+// wait(buffer, index, value, timeout): futex wait on the Int32Array element
+// 'index' of 'buffer'. The futex cannot be interrupted, so the wait is done in
+// short slices, and between them the context's interrupt callbacks get to run:
+// a watchdog (see 'watchdog.cpp') can still terminate a script that waits on a
+// ring that nobody writes to.
+static bool RingWait(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  int32_t value;
+  double timeout = boilerplate::SharedRing::Forever;
+  if (!JS::ToInt32(cx, args.get(2), &value) ||
+      (!args.get(3).isUndefined() && !JS::ToNumber(cx, args[3], &timeout))) {
+    return false;
+  }
+  int timeoutMs = boilerplate::SharedRing::Forever;
+  if (timeout >= 0 && timeout < INT32_MAX) timeoutMs = int(timeout);
+
+  std::atomic<uint32_t>* word;
+  if (!GetWord(cx, args, &word)) return false;
+
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point deadline =
+      Clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+  for (;;) {
+    int sliceMs = WaitSliceMs;
+    if (timeoutMs != boilerplate::SharedRing::Forever) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      if (left.count() <= 0) break;
+      sliceMs = std::min(sliceMs, int(left.count()));
+    }
+    if (Wait(*word, uint32_t(value), sliceMs)) break;
+    if (!JS_CheckForInterrupt(cx)) return false;
+  }
+
+  args.rval().setUndefined();
+  return true;
+}
+
+// wake(buffer, index): wake the threads waiting on element 'index'.
+static bool RingWake(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  std::atomic<uint32_t>* word;
+  if (!GetWord(cx, args, &word)) return false;
+
+  Wake(*word);
+  args.rval().setUndefined();
+  return true;
+}
+
+// create(capacity, recordSize): a new ring buffer.
+static bool RingCreate(JSContext* cx, unsigned argc, JS::Value* vp) {
+  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
+
+  uint32_t capacity, recordSize;
+  if (!JS::ToUint32(cx, args.get(0), &capacity) ||
+      !JS::ToUint32(cx, args.get(1), &recordSize)) {
+    return false;
+  }
+
+  JSObject* buffer =
+      boilerplate::SharedRing::NewBuffer(cx, capacity, recordSize);
+  if (!buffer) return false;
+
+  args.rval().setObject(*buffer);
+  return true;
+}
+
+// Define the SharedRing class on 'global', which must be the current global.
+bool boilerplate::SharedRing::DefineFunctions(JSContext* cx,
+                                              JS::HandleObject global) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("sharedring.js", 1);
+
+  JS::RootedValue factory(cx);
+  if (!boilerplate::Evaluate(cx, options, RingSource, strlen(RingSource),
+                             &factory)) {
+    return false;
+  }
+
+  JS::RootedValueArray<3> natives(cx);
+  const JSNative functions[] = {RingWait, RingWake, RingCreate};
+  const char* names[] = {"wait", "wake", "create"};
+  for (size_t i = 0; i < 3; i++) {
+    JSFunction* fun = JS_NewFunction(cx, functions[i], 4, 0, names[i]);
+    if (!fun) return false;
+    natives[i].setObject(*JS_GetFunctionObject(fun));
+  }
+
+  JS::RootedValue ringClass(cx);
+  if (!JS::Call(cx, JS::UndefinedHandleValue, factory, natives, &ringClass)) {
+    return false;
+  }
+  return JS_DefineProperty(cx, global, "SharedRing", ringClass, 0);
+}
@@ -0,0 +1,64 @@
+#ifndef SHAREDRING_H_
+#define SHAREDRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <jsapi.h>
+
+// See 'sharedring.cpp' for documentation.
+
+namespace boilerplate {
+
+class SharedRing {
+ public:
+  static constexpr size_t HeaderBytes = 192;
+  static constexpr int Forever = -1;
+
+  static JSObject* NewBuffer(JSContext* cx, uint32_t capacity,
+                             uint32_t recordSize);
+  static bool DefineFunctions(JSContext* cx, JS::HandleObject global);
+
+  explicit SharedRing(JSObject* buffer);
+
+  SharedRing(const SharedRing&) = delete;
+  SharedRing& operator=(const SharedRing&) = delete;
+
+  uint32_t capacity() const { return m_mask + 1; }
+  uint32_t recordSize() const { return m_recordSize; }
+
+  // Producer
+  void* tryReserve();
+  void* reserve(int timeoutMs = Forever);
+  void commit();
+  bool push(const void* record);
+
+  // Consumer
+  const void* tryFront();
+  const void* front(int timeoutMs = Forever);
+  void pop();
+
+  void close();
+  bool closed() const;
+
+ private:
+  std::atomic<uint32_t>& word(size_t offset) const;
+  uint8_t* record(uint32_t position) const;
+  bool waitFor(size_t offset, uint32_t value, size_t flag, int timeoutMs);
+
+  uint8_t* m_memory;
+  uint32_t m_mask;
+  uint32_t m_recordSize;
+
+  // Positions owned by this side, and the last seen position of the other
+  // side, which only needs to be read again when the ring looks full or empty.
+  uint32_t m_tail;
+  uint32_t m_head;
+  uint32_t m_seenHead;
+  uint32_t m_seenTail;
+};
+
+}  // namespace boilerplate
+
+#endif  // SHAREDRING_H_
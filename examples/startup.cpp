@@ -0,0 +1,178 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+#include <js/Initialization.h>
+
+#include "boilerplate.h"
+
+// This program measures how long it takes from JS_Init until a JSContext has
+// evaluated its first script, and how much memory the process uses, with 1, 8
+// and 64 contexts (one on the main thread and the rest on worker threads).
+//
+// Every context here starts a top-level runtime of its own, as in a process
+// that hosts independent engines. Child contexts, created with a parent runtime
+// like those from boilerplate::NewChildContext, would share their parent's
+// self-hosted code in either mode below, and only the main context's startup
+// would differ.
+//
+// It compares two ways of initializing self-hosted code:
+//
+// - "parse":  every context calls JS::InitSelfHostedCode with no cache, and so
+//             parses the self-hosted sources.
+// - "shared": every context calls boilerplate::InitSelfHosting, which decodes
+//             the self-hosted stencil that was built once (in this case, by an
+//             earlier process, and stored in a cache file).
+//
+// JS_Init can only be called once per process, so each measurement runs in a
+// process of its own. This only works on POSIX systems.
+//
+// Usage: startup [CONTEXTS...]
+
+using Clock = std::chrono::steady_clock;
+
+static double Millis(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+static bool InitContext(JSContext* cx, bool shared) {
+  return shared ? boilerplate::InitSelfHosting(cx) : JS::InitSelfHostedCode(cx);
+}
+
+static bool FirstEvaluate(JSContext* cx) {
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  const char* code = "[1, 2, 3].map(x => x * 2).join()";
+  JS::CompileOptions options(cx);
+  options.setFileAndLine("first", 1);
+
+  JS::RootedValue rval(cx);
+  return boilerplate::Evaluate(cx, options, code, strlen(code), &rval);
+}
+
+static long PeakRSSKilobytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// Runs in a child process.
+static bool Trial(unsigned contexts, bool shared, bool quiet) {
+  Clock::time_point start = Clock::now();
+
+  if (!JS_Init()) return false;
+
+  JSContext* cx = JS_NewContext(JS::DefaultHeapMaxBytes);
+  if (!cx) return false;
+  if (!InitContext(cx, shared) || !FirstEvaluate(cx)) return false;
+
+  double first = Millis(start);
+
+  // Worker contexts stay alive until every one of them has evaluated its
+  // first script, so that the memory measurement includes all of them.
+  std::atomic<unsigned> done(0);
+  std::atomic<bool> ok(true);
+  std::promise<void> release;
+  std::shared_future<void> released(release.get_future());
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < contexts; i++) {
+    threads.emplace_back([&] {
+      JSContext* wcx = JS_NewContext(8L * 1024L * 1024L);
+      if (!wcx || !InitContext(wcx, shared) || !FirstEvaluate(wcx)) {
+        ok = false;
+      }
+      done++;
+      released.wait();
+      if (wcx) JS_DestroyContext(wcx);
+    });
+  }
+
+  while (done < contexts - 1) {
+    std::this_thread::yield();
+  }
+  double all = Millis(start);
+  long rss = PeakRSSKilobytes();
+
+  release.set_value();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  if (!quiet) {
+    printf("%-6s %3u contexts  first eval %8.2f ms  all evals %8.2f ms  "
+           "peak RSS %7.1f MB\n",
+           shared ? "shared" : "parse", contexts, first, all, rss / 1024.0);
+  }
+
+  JS_DestroyContext(cx);
+  JS_ShutDown();
+  return ok;
+}
+
+static bool RunInChild(unsigned contexts, bool shared, bool quiet) {
+  fflush(stdout);
+
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    bool ok = Trial(contexts, shared, quiet);
+    fflush(stdout);
+    _exit(ok ? 0 : 1);
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) < 0) return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, const char* argv[]) {
+  std::vector<unsigned> counts;
+  for (int i = 1; i < argc; i++) {
+    int count = atoi(argv[i]);
+    if (count <= 0) {
+      fprintf(stderr, "Usage: %s [CONTEXTS...]\n", argv[0]);
+      return 1;
+    }
+    counts.push_back(count);
+  }
+  if (counts.empty()) {
+    counts = {1, 8, 64};
+  }
+
+  // Use a fresh cache file, and fill it once before measuring.
+  std::string cachePath =
+      "/tmp/boilerplate-selfhosted-" + std::to_string(getpid()) + ".bin";
+  setenv("BOILERPLATE_SELFHOSTED_CACHE", cachePath.c_str(), 1);
+  if (!RunInChild(1, /* shared = */ true, /* quiet = */ true)) {
+    return 1;
+  }
+
+  bool ok = true;
+  for (unsigned count : counts) {
+    ok = RunInChild(count, /* shared = */ false, /* quiet = */ false) && ok;
+    ok = RunInChild(count, /* shared = */ true, /* quiet = */ false) && ok;
+  }
+
+  remove(cachePath.c_str());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <jsapi.h>
+#include <js/CompileOptions.h>
+
+#include "boilerplate.h"
+#include "eventloop.h"
+
+// This program arms TIMERS timers at once on one context, with delays spread
+// evenly over SPREAD milliseconds, clears every tenth one, and runs a
+// boilerplate::EventLoop until the rest have fired. One timer in a hundred is
+// an interval that fires three times. Blocking the thread for each wait, as a
+// sleep() function would, needs a thread per concurrent timer; here they all
+// wait on one thread, which only wakes when a timer is due.
+//
+// It prints the time taken to arm and clear the timers, the total running time
+// against SPREAD, and how late the timers fired.
+//
+// Usage: timers [TIMERS [SPREAD]]
+
+using Clock = std::chrono::steady_clock;
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+static unsigned timerCount = 100000;
+static unsigned spread = 2000;
+
+static bool ExecuteCode(JSContext* cx, const char* filename,
+                        const std::string& code, JS::MutableHandleValue rval) {
+  JS::CompileOptions options(cx);
+  options.setFileAndLine(filename, 1);
+
+  return boilerplate::Evaluate(cx, options, code.data(), code.size(), rval);
+}
+
+static bool Run(JSContext* cx, boilerplate::EventLoop& loop) {
+  std::string arm = "const N = " + std::to_string(timerCount) +
+                    ", SPREAD = " + std::to_string(spread) + R"js(;
+let fired = 0;
+const ids = new Array(N);
+for (let i = 0; i < N; i++) {
+  const delay = Math.floor(i * SPREAD / N);
+  if (i % 100 === 0) {
+    let times = 0;
+    ids[i] = setInterval(() => {
+      fired++;
+      if (++times === 3) clearInterval(ids[i]);
+    }, Math.max(delay, 1) / 3);
+  } else {
+    ids[i] = setTimeout(() => fired++, delay);
+  }
+}
+)js";
+  std::string clear = R"js(
+for (let i = 5; i < N; i += 10)
+  clearTimeout(ids[i]);
+)js";
+
+  JS::RootedValue rval(cx);
+  Clock::time_point start = Clock::now();
+  if (!ExecuteCode(cx, "arm.js", arm, &rval)) return false;
+  Clock::time_point armed = Clock::now();
+  if (!ExecuteCode(cx, "clear.js", clear, &rval)) return false;
+  Clock::time_point cleared = Clock::now();
+  size_t pending = loop.pendingTimers();
+
+  if (!loop.run()) return false;
+  Clock::time_point done = Clock::now();
+
+  if (!ExecuteCode(cx, "check.js", "fired", &rval)) return false;
+
+  unsigned intervals = (timerCount + 99) / 100;
+  unsigned clearedCount = timerCount > 5 ? (timerCount - 6) / 10 + 1 : 0;
+  unsigned expected = timerCount - clearedCount + 2 * intervals;
+  printf("# %u timers, %zu pending after clearing, %.0f fired (expected %u)\n",
+         timerCount, pending, rval.toNumber(), expected);
+  printf("arm:   %.1f ms, %.0f ns per timer\n",
+         Milliseconds(armed - start).count(),
+         Milliseconds(armed - start).count() * 1e6 / timerCount);
+  printf("clear: %.1f ms, %.0f ns per timer\n",
+         Milliseconds(cleared - armed).count(),
+         Milliseconds(cleared - armed).count() * 1e6 /
+             (clearedCount ? clearedCount : 1));
+  printf("run:   %.1f ms for a spread of %u ms\n",
+         Milliseconds(done - cleared).count(), spread);
+
+  const boilerplate::Histogram& lateness = loop.latenessHistogram();
+  printf("late:  p50 %llu us, p99 %llu us, max %llu us\n",
+         (unsigned long long)lateness.percentile(0.5),
+         (unsigned long long)lateness.percentile(0.99),
+         (unsigned long long)lateness.max());
+  return true;
+}
+
+static bool TimersExample(JSContext* cx) {
+  boilerplate::EventLoop loop(cx);
+  if (!loop.init()) return false;
+
+  JS::RootedObject global(cx, boilerplate::CreateGlobal(cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(cx, global);
+
+  if (!loop.defineTimerFunctions(global)) return false;
+
+  if (!Run(cx, loop)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc > 1) timerCount = atoi(argv[1]);
+  if (argc > 2) spread = atoi(argv[2]);
+  if (timerCount == 0 || spread == 0) {
+    fprintf(stderr, "Usage: %s [TIMERS [SPREAD]]\n", argv[0]);
+    return 1;
+  }
+
+  if (!boilerplate::RunExample(TimersExample)) {
+    return 1;
+  }
+  return 0;
+}
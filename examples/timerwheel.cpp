@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <iterator>
+
+#include "timerwheel.h"
+
+// A hierarchical timer wheel, which keeps track of a large number of pending
+// timers in a form where arming and cancelling a timer both take constant
+// time, however many others are pending.
+//
+// Time is counted in ticks (the event loop uses milliseconds) from when the
+// wheel was created. The wheel has four levels of 64 slots each. Level 0 holds
+// the timers that expire in the next 64 ticks, one slot per tick; level 1 holds
+// those that expire in the next 64 * 64 ticks, one slot per 64 ticks, and so
+// on, so the wheel covers 2^24 ticks (about four and a half hours of
+// milliseconds). Timers that expire later than that wait in the last slot of
+// the last level. Each slot is a doubly linked list, so arming a timer is
+// putting it at the front of a list, and cancelling it is unlinking it.
+//
+// When the wheel advances past a multiple of 64 ticks, the timers in the next
+// slot of level 1 are moved down to level 0, and likewise for the higher
+// levels, so each timer moves at most three times before it expires.
+//
+// Timers are identified by an Id, which stays valid until the timer is
+// cancelled or released; Ids of timers that have gone are not reused for a
+// long time, so cancelling a timer that has already fired does nothing. The
+// wheel does not store anything except the timing; 'Index' gives a small
+// integer for each timer, under which the caller can keep its own data.
+//
+// Usage:
+//
+//   boilerplate::TimerWheel wheel;
+//   TimerWheel::Id id = wheel.arm(100);  // expires in 100 ticks
+//   ...
+//   std::vector<TimerWheel::Id> expired;
+//   wheel.advance(ticksSinceStart, &expired);
+//   for (TimerWheel::Id id : expired) {
+//     if (!wheel.live(id)) continue;  // cancelled by an earlier timer
+//     ...run timer
+//     wheel.release(id);
+//   }
+//
+//   uint64_t next = wheel.nextExpiry();  // no need to wake up before this
+
+boilerplate::TimerWheel::TimerWheel() {
+  std::fill(std::begin(m_slots), std::end(m_slots), Nil);
+}
+
+boilerplate::TimerWheel::Id boilerplate::TimerWheel::idOf(
+    uint32_t index) const {
+  return (uint64_t(m_nodes[index].generation) << IndexBits) | index;
+}
+
+boilerplate::TimerWheel::Node* boilerplate::TimerWheel::lookup(Id id) {
+  size_t index = Index(id);
+  if (index >= m_nodes.size()) return nullptr;
+
+  Node& node = m_nodes[index];
+  if (node.state == State::Free || idOf(index) != id) return nullptr;
+  return &node;
+}
+
+const boilerplate::TimerWheel::Node* boilerplate::TimerWheel::lookup(
+    Id id) const {
+  return const_cast<TimerWheel*>(this)->lookup(id);
+}
+
+bool boilerplate::TimerWheel::live(Id id) const {
+  return lookup(id) != nullptr;
+}
+
+// The tick at which a timer expires, or expired; Never if it is gone.
+uint64_t boilerplate::TimerWheel::expires(Id id) const {
+  const Node* node = lookup(id);
+  return node ? node->expires : Never;
+}
+
+// Put a timer in the slot for its expiry time, relative to the current time.
+void boilerplate::TimerWheel::insert(uint32_t index) {
+  Node& node = m_nodes[index];
+
+  unsigned level = 0;
+  uint64_t block = 0;
+  for (; level < Levels; level++) {
+    unsigned shift = level * SlotBits;
+    block = node.expires >> shift;
+    if (block - (m_now >> shift) < Slots) break;
+  }
+  if (level == Levels) {
+    level = Levels - 1;
+    block = (m_now >> (level * SlotBits)) + Slots - 1;
+  }
+
+  node.slot = uint16_t(level * Slots + (block & (Slots - 1)));
+  node.prev = Nil;
+  node.next = m_slots[node.slot];
+  if (node.next != Nil) m_nodes[node.next].prev = index;
+  m_slots[node.slot] = index;
+}
+
+void boilerplate::TimerWheel::unlink(uint32_t index) {
+  Node& node = m_nodes[index];
+  if (node.prev != Nil) {
+    m_nodes[node.prev].next = node.next;
+  } else {
+    m_slots[node.slot] = node.next;
+  }
+  if (node.next != Nil) m_nodes[node.next].prev = node.prev;
+  node.prev = node.next = Nil;
+}
+
+// Arm a timer that expires 'delay' ticks from now, at least one. If 'interval'
+// is not zero, the timer may be armed again with 'rearm' after it expires.
+// Returns 0 if there are too many timers.
+boilerplate::TimerWheel::Id boilerplate::TimerWheel::arm(uint64_t delay,
+                                                         uint64_t interval) {
+  uint32_t index = m_free;
+  if (index != Nil) {
+    m_free = m_nodes[index].next;
+  } else {
+    if (m_nodes.size() > IndexMask) return 0;
+    index = uint32_t(m_nodes.size());
+    m_nodes.emplace_back();
+  }
+
+  Node& node = m_nodes[index];
+  node.expires = m_now + std::max<uint64_t>(delay, 1);
+  node.interval = interval;
+  node.sequence = m_sequence++;
+  node.state = State::Armed;
+  insert(index);
+  m_armed++;
+  return idOf(index);
+}
+
+// Arm an expired interval timer again, 'interval' ticks from now.
+bool boilerplate::TimerWheel::rearm(Id id) {
+  Node* node = lookup(id);
+  if (!node || node->state != State::Expired || node->interval == 0) {
+    return false;
+  }
+
+  node->expires = m_now + node->interval;
+  node->sequence = m_sequence++;
+  node->state = State::Armed;
+  insert(uint32_t(Index(id)));
+  m_armed++;
+  return true;
+}
+
+// Free an expired timer's Id, once the caller is done with it.
+void boilerplate::TimerWheel::release(Id id) {
+  Node* node = lookup(id);
+  if (!node) return;
+
+  if (node->state == State::Armed) {
+    unlink(uint32_t(Index(id)));
+    m_armed--;
+  }
+
+  node->generation = (node->generation + 1) & GenerationMask;
+  if (node->generation == 0) node->generation = 1;
+  node->state = State::Free;
+  node->next = m_free;
+  m_free = uint32_t(Index(id));
+}
+
+// Cancel a pending timer, or an expired one that has not run yet. Returns false
+// if the timer was already gone.
+bool boilerplate::TimerWheel::cancel(Id id) {
+  if (!lookup(id)) return false;
+  release(id);
+  return true;
+}
+
+// Move the timers in the current slot of 'level' to the lower levels.
+void boilerplate::TimerWheel::cascade(unsigned level) {
+  unsigned slot =
+      level * Slots + ((m_now >> (level * SlotBits)) & (Slots - 1));
+  uint32_t index = m_slots[slot];
+  m_slots[slot] = Nil;
+
+  while (index != Nil) {
+    uint32_t next = m_nodes[index].next;
+    insert(index);
+    index = next;
+  }
+}
+
+// Advance the current time to 'now', appending the timers that expired on the
+// way to 'expired', in the order they expire (and in the order they were armed,
+// for timers that expire on the same tick).
+void boilerplate::TimerWheel::advance(uint64_t now,
+                                      std::vector<Id>* expired) {
+  size_t first = expired->size();
+
+  while (m_now < now) {
+    if (m_armed == 0) {
+      m_now = now;
+      break;
+    }
+
+    m_now++;
+
+    unsigned level = 0;
+    for (uint64_t t = m_now; level + 1 < Levels && (t & (Slots - 1)) == 0;
+         t >>= SlotBits) {
+      level++;
+    }
+    for (; level > 0; level--) cascade(level);
+
+    unsigned slot = m_now & (Slots - 1);
+    uint32_t index = m_slots[slot];
+    m_slots[slot] = Nil;
+    while (index != Nil) {
+      Node& node = m_nodes[index];
+      uint32_t next = node.next;
+      node.prev = node.next = Nil;
+      node.state = State::Expired;
+      m_armed--;
+      expired->push_back(idOf(index));
+      index = next;
+    }
+  }
+
+  // Slots are lists filled at the front, and moving timers between levels
+  // shuffles them, so put the expired timers back in order.
+  std::sort(expired->begin() + first, expired->end(), [&](Id a, Id b) {
+    const Node& x = m_nodes[Index(a)];
+    const Node& y = m_nodes[Index(b)];
+    if (x.expires != y.expires) return x.expires < y.expires;
+    return x.sequence < y.sequence;
+  });
+}
+
+// The earliest tick at which a timer may expire, or Never if there are no
+// timers. Waking up earlier is harmless, and for timers on the higher levels
+// this is the tick at which they move to a lower level.
+uint64_t boilerplate::TimerWheel::nextExpiry() const {
+  if (m_armed == 0) return Never;
+
+  uint64_t next = Never;
+  for (unsigned level = 0; level < Levels; level++) {
+    unsigned shift = level * SlotBits;
+    uint64_t block = m_now >> shift;
+    for (uint64_t k = 1; k < Slots; k++) {
+      if (m_slots[level * Slots + ((block + k) & (Slots - 1))] != Nil) {
+        next = std::min(next, (block + k) << shift);
+        break;
+      }
+    }
+  }
+  return next;
+}
@@ -0,0 +1,79 @@
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// See 'timerwheel.cpp' for documentation.
+
+namespace boilerplate {
+
+class TimerWheel {
+ public:
+  using Id = uint64_t;
+
+  static constexpr unsigned Levels = 4;
+  static constexpr unsigned SlotBits = 6;
+  static constexpr unsigned Slots = 1 << SlotBits;
+  static constexpr uint64_t Never = UINT64_MAX;
+
+  TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  Id arm(uint64_t delay, uint64_t interval = 0);
+  bool rearm(Id id);
+  bool cancel(Id id);
+  void release(Id id);
+  bool live(Id id) const;
+  uint64_t expires(Id id) const;
+
+  void advance(uint64_t now, std::vector<Id>* expired);
+  uint64_t nextExpiry() const;
+
+  uint64_t now() const { return m_now; }
+  size_t size() const { return m_armed; }
+  bool empty() const { return m_armed == 0; }
+
+  static size_t Index(Id id) { return size_t(id & IndexMask); }
+
+ private:
+  static constexpr unsigned IndexBits = 24;
+  static constexpr uint64_t IndexMask = (uint64_t(1) << IndexBits) - 1;
+  static constexpr uint32_t GenerationMask = (uint32_t(1) << 29) - 1;
+  static constexpr uint32_t Nil = UINT32_MAX;
+
+  enum class State : uint8_t { Free, Armed, Expired };
+
+  struct Node {
+    uint64_t expires = 0;
+    uint64_t interval = 0;
+    uint64_t sequence = 0;
+    uint32_t prev = Nil;
+    uint32_t next = Nil;
+    uint32_t generation = 1;
+    uint16_t slot = 0;
+    State state = State::Free;
+  };
+
+  Node* lookup(Id id);
+  const Node* lookup(Id id) const;
+  Id idOf(uint32_t index) const;
+
+  void insert(uint32_t index);
+  void unlink(uint32_t index);
+  void cascade(unsigned level);
+
+  std::vector<Node> m_nodes;
+  uint32_t m_slots[Levels * Slots];
+  uint32_t m_free = Nil;
+  uint64_t m_now = 0;
+  uint64_t m_sequence = 0;
+  size_t m_armed = 0;
+};
+
+}  // namespace boilerplate
+
+#endif  // TIMERWHEEL_H_
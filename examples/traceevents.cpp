@@ -0,0 +1,399 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/GCAPI.h>
+
+#include "traceevents.h"
+
+// A timeline recorder that writes the Trace Event format of chrome://tracing,
+// which Perfetto (https://ui.perfetto.dev) also opens. It shows, for each
+// thread, when its context was compiling, executing scripts, draining promise
+// jobs, in a GC slice or minor GC, or inside one of the embedding's natives.
+// That is usually enough to tell what a slow request was waiting for.
+//
+// Spans are recorded by TraceScope objects, which the library's components
+// (ModuleLoader, ScriptCache, ScriptPipeline, MicrotaskQueue, EventLoop and
+// MessagePort) put around their calls into SpiderMonkey. GC pauses come from
+// the slice and nursery callbacks that TraceGC installs. The examples run their
+// scripts through boilerplate::Evaluate, which records the compile and the
+// run separately. An embedding can add its own spans the same way.
+//
+// Each thread records into a buffer of its own, a ring with one writer and one
+// reader, so recording takes no lock: a span costs two clock reads and a copy
+// of its detail string. A background thread drains the rings into the file
+// every 50 ms. If a ring fills up faster than that, new spans are dropped and
+// counted, and a warning is printed when tracing stops.
+//
+// RunExample starts tracing when the BOILERPLATE_TRACE environment variable
+// names a file, so any example can be traced without rebuilding:
+//
+//   BOILERPLATE_TRACE=/tmp/timers.json _build/timers
+//
+// Usage:
+//
+//   boilerplate::StartTracing("trace.json");
+//   boilerplate::TraceThreadName("main");
+//   boilerplate::TraceGC(cx);
+//   {
+//     boilerplate::TraceScope scope("evaluate", "execute", filename);
+//     JS::Evaluate(cx, options, source, &rval);
+//   }
+//   boilerplate::StopTracing();
+//
+// When tracing is off, a TraceScope costs one atomic load.
+//
+// NOTE: Span names, categories and thread names must be string literals, or
+// otherwise outlive the trace, because only the pointer is kept. The detail
+// string is copied, and truncated to 39 bytes. The file is written in the JSON
+// array format, which the viewers can still load when the process ended
+// before StopTracing closed the array.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr auto FlushInterval = std::chrono::milliseconds(50);
+
+namespace {
+
+struct Event {
+  const char* name;
+  const char* category;
+  uint64_t start;     // nanoseconds since tracing started
+  uint64_t duration;  // nanoseconds
+  char detail[40];
+};
+
+// The spans recorded by one thread. Only that thread writes 'head' and the
+// events, and only the flush thread writes 'tail', so neither needs a lock.
+struct ThreadBuffer {
+  static constexpr uint64_t Capacity = 16384;
+
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<const char*> name{nullptr};
+  unsigned tid = 0;
+
+  // The name that was last written to the file. Only the flush thread uses it.
+  const char* written = nullptr;
+
+  Event events[Capacity];
+};
+
+struct Session {
+  FILE* out = nullptr;
+  bool first = true;
+  bool stopping = false;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  std::thread flusher;
+  std::condition_variable wake;
+};
+
+std::atomic<bool> s_enabled{false};
+std::atomic<uint64_t> s_generation{0};
+std::atomic<int64_t> s_origin{0};
+
+// Guards the session, except that only the flush thread writes to the file
+// while tracing is on.
+std::mutex s_lock;
+Session s_session;
+
+// This thread's buffer, and the session it belongs to. The thread keeps a
+// reference, so a buffer outlives a session that stops while it writes.
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+thread_local uint64_t t_generation = 0;
+thread_local const char* t_name = nullptr;
+
+// The GC in progress on this thread's context, if it is traced.
+struct GCState {
+  JSContext* cx = nullptr;
+  JS::GCSliceCallback previousSlice = nullptr;
+  JS::GCNurseryCollectionCallback previousNursery = nullptr;
+  const char* reason = nullptr;
+  uint64_t sliceStart = 0;
+  uint64_t minorStart = 0;
+};
+thread_local GCState t_gc;
+}  // namespace
+
+static int64_t Timestamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+static uint64_t Now() { return Timestamp() - s_origin.load(); }
+
+static ThreadBuffer* ThisThreadBuffer() {
+  if (t_buffer && t_generation == s_generation.load()) return t_buffer.get();
+
+  std::lock_guard<std::mutex> lock(s_lock);
+  if (!s_enabled.load()) return nullptr;
+
+  t_buffer = std::make_shared<ThreadBuffer>();
+  t_buffer->tid = s_session.buffers.size() + 1;
+  t_buffer->name.store(t_name);
+  s_session.buffers.push_back(t_buffer);
+  t_generation = s_generation.load();
+  return t_buffer.get();
+}
+
+static void Record(const char* name, const char* category, const char* detail,
+                   uint64_t start, uint64_t end) {
+  ThreadBuffer* buffer = ThisThreadBuffer();
+  if (!buffer) return;
+
+  uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  if (head - buffer->tail.load(std::memory_order_acquire) ==
+      ThreadBuffer::Capacity) {
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  Event& event = buffer->events[head % ThreadBuffer::Capacity];
+  event.name = name;
+  event.category = category;
+  event.start = start;
+  event.duration = end > start ? end - start : 0;
+  event.detail[0] = '\0';
+  if (detail) {
+    strncat(event.detail, detail, sizeof(event.detail) - 1);
+  }
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// Write a string that came from the embedding, such as a file name, as the
+// contents of a JSON string.
+static void WriteEscaped(FILE* out, const char* s) {
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+}
+
+static void BeginRecord(FILE* out) {
+  fputs(s_session.first ? "\n" : ",\n", out);
+  s_session.first = false;
+}
+
+// Copy the buffers' new events to the file. Called only from the flush thread,
+// and from StopTracing once that thread has finished.
+static void Drain(const std::vector<std::shared_ptr<ThreadBuffer>>& buffers) {
+  FILE* out = s_session.out;
+  int pid = getpid();
+
+  for (const std::shared_ptr<ThreadBuffer>& buffer : buffers) {
+    const char* name = buffer->name.load();
+    if (name && name != buffer->written) {
+      BeginRecord(out);
+      fprintf(out,
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+              "\"args\":{\"name\":\"%s\"}}",
+              pid, buffer->tid, name);
+      buffer->written = name;
+    }
+
+    uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+    uint64_t head = buffer->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      const Event& event = buffer->events[tail % ThreadBuffer::Capacity];
+      BeginRecord(out);
+      fprintf(out,
+              "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+              "\"dur\":%.3f,\"pid\":%d,\"tid\":%u",
+              event.name, event.category, event.start / 1000.0,
+              event.duration / 1000.0, pid, buffer->tid);
+      if (event.detail[0]) {
+        fputs(",\"args\":{\"detail\":\"", out);
+        WriteEscaped(out, event.detail);
+        fputs("\"}", out);
+      }
+      fputc('}', out);
+    }
+    buffer->tail.store(tail, std::memory_order_release);
+  }
+  fflush(out);
+}
+
+static void FlushLoop() {
+  std::unique_lock<std::mutex> lock(s_lock);
+  while (!s_session.stopping) {
+    s_session.wake.wait_for(lock, FlushInterval);
+
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers = s_session.buffers;
+    lock.unlock();
+    Drain(buffers);
+    lock.lock();
+  }
+}
+
+// Start recording into the file at 'path', which is overwritten. Returns false
+// if tracing is already on or the file cannot be opened.
+bool boilerplate::StartTracing(const char* path) {
+  std::lock_guard<std::mutex> lock(s_lock);
+  if (s_enabled.load()) return false;
+
+  FILE* out = fopen(path, "w");
+  if (!out) return false;
+  fputc('[', out);
+
+  s_session.out = out;
+  s_session.first = true;
+  s_session.stopping = false;
+  s_session.buffers.clear();
+  s_origin.store(Timestamp());
+  s_generation++;
+  s_enabled.store(true);
+
+  s_session.flusher = std::thread(FlushLoop);
+  return true;
+}
+
+// Start recording if BOILERPLATE_TRACE names a file. Returns whether tracing
+// is on.
+bool boilerplate::StartTracingFromEnvironment() {
+  const char* path = getenv("BOILERPLATE_TRACE");
+  if (!path || path[0] == '\0') return false;
+
+  if (!StartTracing(path) && !TracingEnabled()) {
+    fprintf(stderr, "Warning: cannot write trace to '%s'\n", path);
+    return false;
+  }
+  return true;
+}
+
+// Stop recording, write the remaining events and close the file. Spans that
+// are still open are not recorded.
+void boilerplate::StopTracing() {
+  {
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (!s_enabled.load()) return;
+    s_enabled.store(false);
+    s_session.stopping = true;
+  }
+  s_session.wake.notify_one();
+  s_session.flusher.join();
+
+  std::lock_guard<std::mutex> lock(s_lock);
+  Drain(s_session.buffers);
+  fputs("\n]\n", s_session.out);
+  fclose(s_session.out);
+  s_session.out = nullptr;
+
+  for (const std::shared_ptr<ThreadBuffer>& buffer : s_session.buffers) {
+    uint64_t dropped = buffer->dropped.load();
+    if (dropped) {
+      const char* name = buffer->name.load();
+      fprintf(stderr, "Warning: trace dropped %llu events on thread %u (%s)\n",
+              (unsigned long long)dropped, buffer->tid,
+              name ? name : "unnamed");
+    }
+  }
+  s_session.buffers.clear();
+}
+
+bool boilerplate::TracingEnabled() {
+  return s_enabled.load(std::memory_order_relaxed);
+}
+
+// Name the calling thread in the timeline. Threads without a name show up by
+// number.
+void boilerplate::TraceThreadName(const char* name) {
+  t_name = name;
+  if (t_buffer) {
+    t_buffer->name.store(name);
+  }
+}
+
+static void OnGCSlice(JSContext* cx, JS::GCProgress progress,
+                      const JS::GCDescription& desc) {
+  if (cx == t_gc.cx && boilerplate::TracingEnabled()) {
+    switch (progress) {
+      case JS::GC_CYCLE_BEGIN:
+        t_gc.reason = JS::ExplainGCReason(desc.reason_);
+        break;
+      case JS::GC_SLICE_BEGIN:
+        t_gc.sliceStart = Now();
+        break;
+      case JS::GC_SLICE_END:
+        Record("GC slice", "gc", t_gc.reason, t_gc.sliceStart, Now());
+        break;
+      case JS::GC_CYCLE_END:
+        break;
+    }
+  }
+
+  if (cx == t_gc.cx && t_gc.previousSlice) {
+    t_gc.previousSlice(cx, progress, desc);
+  }
+}
+
+static void OnNurseryCollection(JSContext* cx, JS::GCNurseryProgress progress,
+                                JS::GCReason reason) {
+  if (cx == t_gc.cx && boilerplate::TracingEnabled()) {
+    if (progress == JS::GCNurseryProgress::GC_NURSERY_COLLECTION_START) {
+      t_gc.minorStart = Now();
+    } else {
+      Record("minor GC", "gc", JS::ExplainGCReason(reason), t_gc.minorStart,
+             Now());
+    }
+  }
+
+  if (cx == t_gc.cx && t_gc.previousNursery) {
+    t_gc.previousNursery(cx, progress, reason);
+  }
+}
+
+// Record the GC slices and minor GCs of 'cx', which must belong to the calling
+// thread. Callbacks that were installed before are still called. Only one
+// context per thread can be traced.
+void boilerplate::TraceGC(JSContext* cx) {
+  if (t_gc.cx == cx) return;
+
+  t_gc = GCState();
+  t_gc.cx = cx;
+  t_gc.previousSlice = JS::SetGCSliceCallback(cx, OnGCSlice);
+  t_gc.previousNursery = JS::SetGCNurseryCollectionCallback(
+      cx, OnNurseryCollection);
+}
+
+void boilerplate::UntraceGC(JSContext* cx) {
+  if (t_gc.cx != cx) return;
+
+  JS::SetGCSliceCallback(cx, t_gc.previousSlice);
+  JS::SetGCNurseryCollectionCallback(cx, t_gc.previousNursery);
+  t_gc = GCState();
+}
+
+// Record a span from now until the scope ends. 'detail', if given, is shown
+// with the span, for example the name of the file being compiled.
+boilerplate::TraceScope::TraceScope(const char* name, const char* category,
+                                    const char* detail)
+    : m_name(nullptr), m_category(category), m_detail(detail), m_start(0) {
+  if (TracingEnabled()) {
+    m_name = name;
+    m_start = Now();
+  }
+}
+
+boilerplate::TraceScope::~TraceScope() {
+  if (m_name && TracingEnabled()) {
+    Record(m_name, m_category, m_detail, m_start, Now());
+  }
+}
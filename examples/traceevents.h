@@ -0,0 +1,44 @@
+#ifndef TRACEEVENTS_H_
+#define TRACEEVENTS_H_
+
+#include <cstdint>
+
+#include <jsapi.h>
+
+// See 'traceevents.cpp' for documentation.
+
+namespace boilerplate {
+
+bool StartTracing(const char* path);
+
+bool StartTracingFromEnvironment();
+
+void StopTracing();
+
+bool TracingEnabled();
+
+void TraceThreadName(const char* name);
+
+void TraceGC(JSContext* cx);
+
+void UntraceGC(JSContext* cx);
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name, const char* category = "execute",
+                      const char* detail = nullptr);
+  ~TraceScope();
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* m_name;
+  const char* m_category;
+  const char* m_detail;
+  uint64_t m_start;
+};
+
+}  // namespace boilerplate
+
+#endif  // TRACEEVENTS_H_
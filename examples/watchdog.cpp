@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#include <jsapi.h>
+
+#include "watchdog.h"
+
+// A watchdog that stops scripts which run longer than they are allowed to,
+// as recommended in 'docs/Miscellaneous.md'. A program like 'while(true){}'
+// otherwise hangs the thread that runs it forever.
+//
+// One watchdog thread serves any number of contexts. Each context is attached
+// once, on its own thread, which installs an interrupt callback. Evaluations
+// are then wrapped in a Budget, which gives them a limit on CPU time, on
+// wall-clock time, or both. While any Budget is running, the watchdog thread
+// sleeps until the earliest deadline among them, then looks at the attached
+// contexts, and when one has run past its limit it calls
+// JS_RequestInterruptCallback. SpiderMonkey calls the interrupt callback at the
+// next loop iteration or function call, and the callback returns false, which
+// terminates the evaluation with an uncatchable exception: no JS 'catch' or
+// 'finally' runs, and the call that started the evaluation returns false with
+// no exception pending. The context can go on to run other scripts.
+//
+// Well-behaved scripts pay almost nothing for this. Starting and ending a
+// Budget reads two clocks and stores a few atomics on the calling thread. Only
+// a Budget that starts after the watchdog thread has gone to sleep without a
+// timeout, or that has an earlier deadline than the thread is sleeping until,
+// takes a lock to wake it. Between Budgets the thread keeps checking every
+// 'resolutionMs', so that in a steady stream of Budgets it is already awake
+// for the next one; only after ArmedIdleMs without any does it sleep without
+// a timeout. The limits are enforced to within about the resolution passed to
+// the constructor, plus the time until the script next checks for interrupts.
+//
+// Usage:
+//
+//   boilerplate::Watchdog watchdog;  // one per process
+//   watchdog.attach(cx);
+//   ...
+//   boilerplate::Watchdog::Budget budget(watchdog, cx, /* cpuMs = */ 100);
+//   if (!JS::Evaluate(cx, options, source, &rval)) {
+//     if (budget.exceeded() != boilerplate::Watchdog::Limit::None)
+//       budget.report();  // nothing to clear
+//     else
+//       boilerplate::ReportAndClearException(cx);
+//   }
+//   ...
+//   watchdog.detach(cx);  // before JS_DestroyContext
+//
+// NOTE: Budgets for the same context do not nest; an inner one only measures.
+// CPU time is per thread on Linux; elsewhere, CPU limits are measured as
+// wall-clock time.
+
+namespace {
+// The slot of the context attached on this thread, if any.
+thread_local void* t_slot = nullptr;
+
+// The context on this thread that has the interrupt callback installed. There
+// is no way to remove it, so attaching the same context again reuses it.
+thread_local JSContext* t_callbackInstalled = nullptr;
+}  // namespace
+
+static constexpr int64_t NoDeadline = std::numeric_limits<int64_t>::max();
+
+// The value of 'm_nextCheck' while the watchdog thread checks the slots.
+static constexpr int64_t Checking = 0;
+
+// How long the watchdog thread keeps checking after the last Budget ended.
+static constexpr int64_t ArmedIdleMs = 100;
+
+static clockid_t ThreadCpuClock() {
+#ifdef __linux__
+  return CLOCK_THREAD_CPUTIME_ID;
+#else
+  return CLOCK_MONOTONIC;
+#endif
+}
+
+static int64_t Deadline(int64_t start, unsigned limitMs) {
+  if (limitMs == boilerplate::Watchdog::Unlimited) {
+    return NoDeadline;
+  }
+  return start + int64_t(limitMs) * 1000000;
+}
+
+// Nanoseconds on 'clock'.
+int64_t boilerplate::Watchdog::Now(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// The watchdog thread never checks more often than every 'resolutionMs'.
+boilerplate::Watchdog::Watchdog(unsigned resolutionMs)
+    : m_resolutionMs(resolutionMs) {
+  m_thread = std::thread(&Watchdog::timerMain, this);
+}
+
+boilerplate::Watchdog::~Watchdog() {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stopping = true;
+  }
+  m_wakeup.notify_all();
+  m_thread.join();
+}
+
+// Watch 'cx', which must be called on the context's own thread. A thread may
+// have only one attached context at a time.
+bool boilerplate::Watchdog::attach(JSContext* cx) {
+  auto slot = std::make_unique<Slot>();
+  slot->cx = cx;
+  slot->cpuClock = ThreadCpuClock();
+#ifdef __linux__
+  if (pthread_getcpuclockid(pthread_self(), &slot->cpuClock) != 0) {
+    fprintf(stderr, "Error: Failed to get the thread's CPU clock\n");
+    return false;
+  }
+#endif
+
+  if (t_callbackInstalled != cx) {
+    if (!JS_AddInterruptCallback(cx, &Watchdog::InterruptCallback)) {
+      JS_ReportOutOfMemory(cx);
+      return false;
+    }
+    t_callbackInstalled = cx;
+  }
+
+  t_slot = slot.get();
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_slots.push_back(std::move(slot));
+  }
+  m_wakeup.notify_all();
+  return true;
+}
+
+// Stop watching 'cx'. Must be called on the context's thread, before the
+// context is destroyed. The interrupt callback stays installed, but does
+// nothing from then on.
+void boilerplate::Watchdog::detach(JSContext* cx) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+    if ((*it)->cx == cx) {
+      if (t_slot == it->get()) {
+        t_slot = nullptr;
+      }
+      m_slots.erase(it);
+      return;
+    }
+  }
+}
+
+bool boilerplate::Watchdog::InterruptCallback(JSContext* cx) {
+  auto* slot = static_cast<Slot*>(t_slot);
+  if (!slot || slot->cx != cx) {
+    return true;
+  }
+
+  // Only terminate the evaluation the watchdog meant to interrupt; a request
+  // that arrives after its Budget ended is ignored.
+  uint64_t generation = slot->generation.load(std::memory_order_relaxed);
+  return !(generation & 1) ||
+         slot->interrupted.load(std::memory_order_acquire) != generation;
+}
+
+// Called by a Budget when it starts, with the earliest wall-clock time at
+// which it can run out. Wakes the watchdog thread if it is asleep without a
+// timeout, is checking the slots and may miss this one, or is sleeping until
+// later than the deadline.
+void boilerplate::Watchdog::budgetStarted(int64_t deadline) {
+  m_running++;
+  m_started++;
+  int64_t nextCheck = m_nextCheck.load();
+  if (m_armed.load() && nextCheck != Checking && deadline >= nextCheck) {
+    return;
+  }
+
+  // Taking the lock makes sure the watchdog thread is either waiting, and gets
+  // the notification, or has not yet looked at this Budget's slot.
+  { std::lock_guard<std::mutex> lock(m_lock); }
+  m_wakeup.notify_one();
+}
+
+void boilerplate::Watchdog::timerMain() {
+  const int64_t resolutionNs = int64_t(m_resolutionMs) * 1000000;
+  std::unique_lock<std::mutex> lock(m_lock);
+  uint64_t seenStarted = m_started.load();
+  int64_t lastBusy = Now(CLOCK_MONOTONIC);
+
+  while (!m_stopping) {
+    // While the slots are being checked, any Budget that starts wakes this
+    // thread, since it cannot be sure it was seen. A Budget that starts later
+    // compares its deadline with the time this thread sleeps until.
+    m_nextCheck.store(Checking);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    int64_t next = NoDeadline;
+    for (std::unique_ptr<Slot>& slot : m_slots) {
+      next = std::min(next, check(slot.get()));
+    }
+
+    int64_t now = Now(CLOCK_MONOTONIC);
+    uint64_t started = m_started.load();
+    bool idle = m_running.load() == 0;
+    if (!idle || started != seenStarted) {
+      seenStarted = started;
+      lastBusy = now;
+    }
+
+    if (idle && now - lastBusy >= ArmedIdleMs * 1000000) {
+      // Disarm. A Budget that starts from here on sees it and wakes the
+      // thread, or has already been counted in 'm_running'.
+      m_nextCheck.store(NoDeadline);
+      m_armed.store(false);
+      if (m_running.load() == 0) {
+        m_wakeup.wait(lock);
+      }
+      m_armed.store(true);
+      lastBusy = Now(CLOCK_MONOTONIC);
+      continue;
+    }
+
+    // Stay armed between Budgets, so that starting one need not wake the
+    // thread.
+    if (idle) {
+      next = now + resolutionNs;
+    }
+    m_nextCheck.store(next);
+
+    if (next == NoDeadline) {
+      m_wakeup.wait(lock);
+      continue;
+    }
+    m_wakeup.wait_for(lock,
+                      std::chrono::nanoseconds(std::max(next - now,
+                                                        resolutionNs)));
+  }
+}
+
+// Called with 'm_lock' held, so the slot's context cannot be detached and
+// destroyed while it is being interrupted. Returns the CLOCK_MONOTONIC time at
+// which the slot should be checked again, or NoDeadline if it need not be.
+int64_t boilerplate::Watchdog::check(Slot* slot) {
+  uint64_t generation = slot->generation.load(std::memory_order_acquire);
+  if (!(generation & 1) ||
+      slot->interrupted.load(std::memory_order_relaxed) == generation) {
+    return NoDeadline;
+  }
+
+  int64_t cpuDeadline = slot->cpuDeadline.load(std::memory_order_relaxed);
+  int64_t wallDeadline = slot->wallDeadline.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->generation.load(std::memory_order_relaxed) != generation) {
+    return NoDeadline;
+  }
+
+  // CPU time cannot pass faster than wall-clock time, so the CPU limit is
+  // reached no sooner than the CPU time it has left from now.
+  int64_t now = Now(CLOCK_MONOTONIC);
+  int64_t next = wallDeadline;
+  Limit limit = Limit::None;
+  if (wallDeadline != NoDeadline && now >= wallDeadline) {
+    limit = Limit::Wall;
+  } else if (cpuDeadline != NoDeadline) {
+    int64_t cpuLeft = cpuDeadline - Now(slot->cpuClock);
+    if (cpuLeft <= 0) {
+      limit = Limit::Cpu;
+    } else {
+      next = std::min(next, now + cpuLeft);
+    }
+  }
+  if (limit == Limit::None) {
+    return next;
+  }
+
+  slot->limit.store(limit, std::memory_order_relaxed);
+  slot->interrupted.store(generation, std::memory_order_release);
+  m_interrupts++;
+  JS_RequestInterruptCallback(slot->cx);
+  return NoDeadline;
+}
+
+// Start measuring an evaluation on 'cx', and have the watchdog interrupt it
+// once it has used 'cpuMs' of CPU time or 'wallMs' of wall-clock time. Either
+// limit may be Unlimited. If 'cx' is not attached, the Budget only measures.
+boilerplate::Watchdog::Budget::Budget(Watchdog& watchdog, JSContext* cx,
+                                      unsigned cpuMs, unsigned wallMs)
+    : m_watchdog(&watchdog),
+      m_slot(static_cast<Slot*>(t_slot)),
+      m_cpuLimitMs(cpuMs),
+      m_wallLimitMs(wallMs),
+      m_generation(0),
+      m_cpuStart(Now(ThreadCpuClock())),
+      m_wallStart(Now(CLOCK_MONOTONIC)) {
+  if (!m_slot || m_slot->cx != cx) {
+    m_slot = nullptr;
+    return;
+  }
+
+  // Only this thread writes the generation, and it is even between budgets.
+  uint64_t generation = m_slot->generation.load(std::memory_order_relaxed);
+  if (generation & 1) {
+    m_slot = nullptr;  // nested
+    return;
+  }
+
+  m_slot->cpuDeadline.store(Deadline(m_cpuStart, cpuMs),
+                            std::memory_order_relaxed);
+  m_slot->wallDeadline.store(Deadline(m_wallStart, wallMs),
+                             std::memory_order_relaxed);
+  m_generation = generation + 1;
+  m_slot->generation.store(m_generation, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  watchdog.budgetStarted(std::min(Deadline(m_wallStart, wallMs),
+                                  Deadline(m_wallStart, cpuMs)));
+}
+
+boilerplate::Watchdog::Budget::~Budget() { finish(); }
+
+// Stop the clock. Called by the destructor, but may be called earlier so the
+// results can be read while the Budget is still in scope. After this,
+// 'exceeded' says whether the evaluation was interrupted, and which limit it
+// ran past.
+void boilerplate::Watchdog::Budget::finish() {
+  if (m_wallUsed >= 0) {
+    return;
+  }
+
+  if (m_slot) {
+    m_slot->generation.store(m_generation + 1, std::memory_order_release);
+    m_watchdog->m_running--;
+    if (m_slot->interrupted.load(std::memory_order_acquire) == m_generation) {
+      m_exceeded = m_slot->limit.load(std::memory_order_relaxed);
+    }
+  }
+
+  m_cpuUsed = Now(ThreadCpuClock()) - m_cpuStart;
+  m_wallUsed = Now(CLOCK_MONOTONIC) - m_wallStart;
+}
+
+// CPU time used so far, or in total once finished.
+double boilerplate::Watchdog::Budget::cpuMs() const {
+  int64_t used =
+      m_cpuUsed >= 0 ? m_cpuUsed : Now(ThreadCpuClock()) - m_cpuStart;
+  return used / 1e6;
+}
+
+// Wall-clock time used so far, or in total once finished.
+double boilerplate::Watchdog::Budget::wallMs() const {
+  int64_t used =
+      m_wallUsed >= 0 ? m_wallUsed : Now(CLOCK_MONOTONIC) - m_wallStart;
+  return used / 1e6;
+}
+
+// Print why an interrupted evaluation was stopped, and how much of each limit
+// it used, to stderr. Does nothing if it was not interrupted.
+void boilerplate::Watchdog::Budget::report() const {
+  if (m_exceeded == Limit::None) {
+    return;
+  }
+
+  unsigned limitMs = m_exceeded == Limit::Cpu ? m_cpuLimitMs : m_wallLimitMs;
+  fprintf(stderr,
+          "Error: Script terminated after exceeding its %s budget of %u ms "
+          "(used %.1f ms CPU, %.1f ms wall-clock)\n",
+          m_exceeded == Limit::Cpu ? "CPU" : "wall-clock", limitMs, cpuMs(),
+          wallMs());
+}
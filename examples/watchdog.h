@@ -0,0 +1,114 @@
+#ifndef WATCHDOG_H_
+#define WATCHDOG_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include <jsapi.h>
+
+// See 'watchdog.cpp' for documentation.
+
+namespace boilerplate {
+
+class Watchdog {
+  struct Slot;
+
+ public:
+  static constexpr unsigned Unlimited = 0;
+
+  enum class Limit { None, Cpu, Wall };
+
+  class Budget {
+   public:
+    Budget(Watchdog& watchdog, JSContext* cx, unsigned cpuMs,
+           unsigned wallMs = Unlimited);
+    ~Budget();
+
+    Budget(const Budget&) = delete;
+    Budget& operator=(const Budget&) = delete;
+
+    void finish();
+
+    Limit exceeded() const { return m_exceeded; }
+    double cpuMs() const;
+    double wallMs() const;
+    void report() const;
+
+   private:
+    Watchdog* m_watchdog;
+    Slot* m_slot;
+    unsigned m_cpuLimitMs;
+    unsigned m_wallLimitMs;
+    uint64_t m_generation;
+    int64_t m_cpuStart;
+    int64_t m_wallStart;
+    int64_t m_cpuUsed = -1;
+    int64_t m_wallUsed = -1;
+    Limit m_exceeded = Limit::None;
+  };
+
+  explicit Watchdog(unsigned resolutionMs = 2);
+  ~Watchdog();
+
+  Watchdog(const Watchdog&) = delete;
+  Watchdog& operator=(const Watchdog&) = delete;
+
+  bool attach(JSContext* cx);
+  void detach(JSContext* cx);
+
+  uint64_t interrupts() const { return m_interrupts; }
+
+ private:
+  struct Slot {
+    JSContext* cx;
+    clockid_t cpuClock;
+
+    // Odd while a budget is running. The limits below belong to the
+    // generation they were written for, so the timer thread reads them between
+    // two loads of the generation, like a seqlock.
+    std::atomic<uint64_t> generation{0};
+    std::atomic<int64_t> cpuDeadline{0};
+    std::atomic<int64_t> wallDeadline{0};
+
+    // The generation the watchdog interrupted, and why.
+    std::atomic<uint64_t> interrupted{0};
+    std::atomic<Limit> limit{Limit::None};
+  };
+
+  static bool InterruptCallback(JSContext* cx);
+  static int64_t Now(clockid_t clock);
+
+  void budgetStarted(int64_t deadline);
+  void timerMain();
+  int64_t check(Slot* slot);
+
+  unsigned m_resolutionMs;
+
+  std::mutex m_lock;
+  std::condition_variable m_wakeup;
+  std::vector<std::unique_ptr<Slot>> m_slots;
+  std::thread m_thread;
+  bool m_stopping = false;
+  std::atomic<uint64_t> m_interrupts{0};
+
+  // The number of Budgets running on attached contexts, and started in total;
+  // the CLOCK_MONOTONIC time the watchdog thread is sleeping until (0 while it
+  // is checking the slots); and whether it will wake by then without being
+  // notified.
+  std::atomic<size_t> m_running{0};
+  std::atomic<uint64_t> m_started{0};
+  std::atomic<int64_t> m_nextCheck{0};
+  std::atomic<bool> m_armed{true};
+};
+
+}  // namespace boilerplate
+
+#endif  // WATCHDOG_H_
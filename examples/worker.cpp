@@ -1,15 +1,14 @@
 #include <cstdio>
-#include <cstdint>
-#include <chrono>
+#include <memory>
 #include <thread>
 
 #include <jsapi.h>
-#include <js/CompilationAndEvaluation.h>
-#include <js/Conversions.h>
+#include <js/CompileOptions.h>
 #include <js/Initialization.h>
-#include <js/SourceText.h>
 
 #include "boilerplate.h"
+#include "eventloop.h"
+#include "messagechannel.h"
 
 // This example illustrates usage of SpiderMonkey in multiple threads. It does
 // no error handling and simply exits if something goes wrong.
@@ -19,19 +18,25 @@
 //
 // To use SpiderMonkey API in multiple threads, you need to create a JSContext
 // in the thread, using the main thread's JSRuntime as a parent, and initialize
-// self-hosted code, and create its own global.
+// self-hosted code, and create its own global. 'boilerplate::NewChildContext'
+// does the first two steps.
+//
+// Each thread's scripts wait with setInterval rather than by blocking the
+// thread, and the thread runs a 'boilerplate::EventLoop' that sleeps until the
+// next timer is due. See 'timers.cpp' for one thread with many timers pending.
+//
+// The threads do not share any JS objects, but each worker has a
+// 'boilerplate::MessageChannel' to the main thread, over which it sends its
+// messages with postMessage; the main thread receives them in the onmessage
+// handler of an object standing for the worker. See 'messaging.cpp' for the
+// throughput of a channel, and for transferring large ArrayBuffers.
 
 static bool ExecuteCode(JSContext* cx, const char* code) {
   JS::CompileOptions options(cx);
   options.setFileAndLine("noname", 1);
 
-  JS::SourceText<mozilla::Utf8Unit> source;
-  if (!source.init(cx, code, strlen(code), JS::SourceOwnership::Borrowed)) {
-    return false;
-  }
-
   JS::Rooted<JS::Value> rval(cx);
-  if (!JS::Evaluate(cx, options, source, &rval)) {
+  if (!boilerplate::Evaluate(cx, options, code, strlen(code), &rval)) {
     return false;
   }
 
@@ -54,41 +59,35 @@ static bool Print(JSContext* cx, unsigned argc, JS::Value* vp) {
   return true;
 }
 
-static bool Sleep(JSContext* cx, unsigned argc, JS::Value* vp) {
-  JS::CallArgs args = JS::CallArgsFromVp(argc, vp);
-
-  JS::Rooted<JS::Value> arg(cx, args.get(0));
-  int32_t ms;
-  if (!JS::ToInt32(cx, arg, &ms)) {
-    return false;
-  }
-
-  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
-
-  args.rval().setUndefined();
-  return true;
-}
-
-bool DefineFunctions(JSContext* cx, JS::Handle<JSObject*> global) {
+bool DefineFunctions(JSContext* cx, JS::Handle<JSObject*> global,
+                     boilerplate::EventLoop& loop) {
   if (!JS_DefineFunction(cx, global, "print", &Print, 0, 0)) {
     return false;
   }
-  if (!JS_DefineFunction(cx, global, "sleep", &Sleep, 0, 0)) {
+  if (!loop.defineTimerFunctions(global)) {
     return false;
   }
 
   return true;
 }
 
-static void WorkerMain(JSRuntime* parentRuntime) {
-  JSContext* cx = JS_NewContext(8L * 1024L * 1024L, parentRuntime);
-
-  if (!JS::InitSelfHostedCode(cx)) {
-    fprintf(stderr, "Error: Failed during JS::InitSelfHostedCode\n");
+static void RunWorker(JSRuntime* parentRuntime,
+                      boilerplate::MessagePort& port) {
+  // This creates the context and initializes self-hosted code, reusing the
+  // self-hosted stencil that the main thread's context already built.
+  JSContext* cx = boilerplate::NewChildContext(parentRuntime);
+  if (!cx) {
+    fprintf(stderr, "Error: Failed during boilerplate::NewChildContext\n");
     return;
   }
 
   {
+    boilerplate::EventLoop loop(cx);
+    if (!loop.init()) {
+      fprintf(stderr, "Error: Failed during boilerplate::EventLoop::init\n");
+      return;
+    }
+
     JS::Rooted<JSObject*> global(cx, boilerplate::CreateGlobal(cx));
     if (!global) {
       fprintf(stderr, "Error: Failed during boilerplate::CreateGlobal\n");
@@ -97,20 +96,30 @@ static void WorkerMain(JSRuntime* parentRuntime) {
 
     JSAutoRealm ar(cx, global);
 
-    if (!DefineFunctions(cx, global)) {
+    // The worker's end of the channel is its global, as in a web worker.
+    if (!DefineFunctions(cx, global, loop) ||
+        !port.attach(cx, &loop, global)) {
       boilerplate::ReportAndClearException(cx);
       return;
     }
 
     if (!ExecuteCode(cx, R"js(
-for (let i = 0; i < 10; i++) {
-  print(`in worker thread, it is ${new Date()}`);
-  sleep(1000);
-}
+let i = 0;
+const timer = setInterval(() => {
+  postMessage(`in worker thread, it is ${new Date()}`);
+  if (++i === 10) {
+    clearInterval(timer);
+    close();
+  }
+}, 1000);
     )js")) {
       boilerplate::ReportAndClearException(cx);
       return;
     }
+
+    if (!loop.run()) {
+      return;
+    }
   }
 
   JS_DestroyContext(cx);
@@ -118,32 +127,67 @@ for (let i = 0; i < 10; i++) {
   return;
 }
 
+static void WorkerMain(JSRuntime* parentRuntime,
+                       std::shared_ptr<boilerplate::MessageChannel> channel) {
+  RunWorker(parentRuntime, channel->port2());
+
+  // If the worker failed, the main thread must not wait for it forever.
+  channel->port2().close();
+}
+
 static bool WorkerExample(JSContext* cx) {
+  boilerplate::EventLoop loop(cx);
+  if (!loop.init()) {
+    return false;
+  }
+
   JS::Rooted<JSObject*> global(cx, boilerplate::CreateGlobal(cx));
   if (!global) {
     return false;
   }
 
-  std::thread thread1(WorkerMain, JS_GetRuntime(cx));
-  std::thread thread2(WorkerMain, JS_GetRuntime(cx));
+  auto channel1 = std::make_shared<boilerplate::MessageChannel>();
+  auto channel2 = std::make_shared<boilerplate::MessageChannel>();
+  std::thread thread1(WorkerMain, JS_GetRuntime(cx), channel1);
+  std::thread thread2(WorkerMain, JS_GetRuntime(cx), channel2);
 
   JSAutoRealm ar(cx, global);
 
-  if (!DefineFunctions(cx, global)) {
+  if (!DefineFunctions(cx, global, loop)) {
+    boilerplate::ReportAndClearException(cx);
+    return false;
+  }
+
+  // The main thread's end of each channel is an object standing for the worker.
+  JS::Rooted<JSObject*> worker1(cx, JS_NewPlainObject(cx));
+  JS::Rooted<JSObject*> worker2(cx, JS_NewPlainObject(cx));
+  if (!worker1 || !worker2 ||
+      !channel1->port1().attach(cx, &loop, worker1) ||
+      !channel2->port1().attach(cx, &loop, worker2) ||
+      !JS_DefineProperty(cx, global, "worker1", worker1, 0) ||
+      !JS_DefineProperty(cx, global, "worker2", worker2, 0)) {
     boilerplate::ReportAndClearException(cx);
     return false;
   }
 
   if (!ExecuteCode(cx, R"js(
-for (let i = 0; i < 10; i++) {
+worker1.onmessage = e => print(`worker 1 says: ${e.data}`);
+worker2.onmessage = e => print(`worker 2 says: ${e.data}`);
+
+let i = 0;
+const timer = setInterval(() => {
   print(`in main thread, it is ${new Date()}`);
-  sleep(1000);
-}
+  if (++i === 10) clearInterval(timer);
+}, 1000);
   )js")) {
     boilerplate::ReportAndClearException(cx);
     return false;
   }
 
+  if (!loop.run()) {
+    return false;
+  }
+
   thread1.join();
   thread2.join();
 
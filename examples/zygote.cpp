@@ -0,0 +1,323 @@
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <jsapi.h>
+#include <js/CompilationAndEvaluation.h>
+#include <js/HelperThreadAPI.h>
+#include <js/Initialization.h>
+#include <js/SourceText.h>
+
+#include "boilerplate.h"
+#include "jitprofile.h"
+#include "zygote.h"
+
+// A "zygote" for pre-forking servers. Even a process that keeps a pool of
+// contexts (see 'contextpool.cpp') pays for JS_Init, for initializing
+// self-hosted code, and for compiling whatever bootstrap scripts every global
+// runs, once per process. A zygote does all of that once, and then fork()s the
+// worker processes, which share the resulting pages copy-on-write.
+//
+// The zygote calls JS_Init, initializes self-hosted code in a temporary
+// context, which leaves the serialized self-hosted stencil in memory (see
+// boilerplate::InitSelfHosting), and compiles the bootstrap scripts to
+// stencils, which do not belong to any context. Before the first fork it
+// destroys the context: only the forking thread survives in a child, so a
+// child has to create contexts of its own, and decodes the self-hosted stencil
+// and instantiates the bootstrap stencils that it inherited instead of
+// parsing them again.
+//
+// fork() is only safe in a process that has a single thread, because any lock
+// held by another thread stays locked forever in the child. SpiderMonkey
+// normally starts helper threads for off-thread compilation and GC work. The
+// zygote instead gives it a thread pool of its own, with
+// JS::SetHelperThreadTaskCallback, which is not started in the zygote: tasks
+// queued there wait, and the GC runs its own tasks on the main thread when it
+// needs them done. Every child starts the pool after the fork. As a last line
+// of defense, fork() refuses to run if the zygote has other threads, where it
+// can tell (on Linux).
+//
+// Usage:
+//
+//   boilerplate::Zygote zygote;
+//   if (!zygote.init() || !zygote.addBootstrapScript("lib.js", source))
+//     return false;
+//   for (unsigned i = 0; i < workers; i++) {
+//     pid_t pid = zygote.fork();
+//     if (pid == 0) {
+//       JSContext* cx = zygote.newContext();
+//       ... create a global, call zygote.runBootstrap(cx) in its realm ...
+//       zygote.exitChild(cx, ok ? 0 : 1);
+//     }
+//   }
+//   ... wait for the workers ...
+//   zygote.shutdown();
+//
+// See 'prefork.cpp' for a measurement of the time and memory it saves.
+//
+// Like RunExample, the zygote applies the GC and JIT profiles named in the
+// environment (see 'gcprofile.cpp' and 'jitprofile.cpp'). It does not start
+// tracing, which would need a thread in the zygote; a child that wants a
+// timeline calls boilerplate::StartTracing with a file of its own before
+// newContext.
+//
+// NOTE: Use only one Zygote per process, instead of RunExample, which calls
+// JS_Init itself. Child processes must leave through exitChild, not by
+// returning into the zygote's code. This only works on POSIX systems.
+
+// The helper thread pool that SpiderMonkey hands its tasks to. It is global to
+// the process, like the callback. Each dispatch asks for one call to
+// JS::RunHelperThreadTask on a pool thread.
+static const size_t HelperStackSize = 2 * 1024 * 1024;
+
+static std::mutex poolLock;
+static std::condition_variable poolWakeup;
+static size_t pendingTasks = 0;
+static bool poolStopping = false;
+static std::vector<pthread_t> poolThreads;
+
+static void DispatchHelperTask(JS::DispatchReason reason) {
+  {
+    std::lock_guard<std::mutex> lock(poolLock);
+    pendingTasks++;
+  }
+  poolWakeup.notify_one();
+}
+
+static void* HelperThreadMain(void* arg) {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(poolLock);
+      poolWakeup.wait(lock, [] { return pendingTasks > 0 || poolStopping; });
+      if (pendingTasks == 0) return nullptr;
+      pendingTasks--;
+    }
+    JS::RunHelperThreadTask();
+  }
+}
+
+// Threads are created with pthreads, since SpiderMonkey relies on their stacks
+// being the size it was told.
+static bool StartHelperThreads(size_t count) {
+  pthread_attr_t attr;
+  if (pthread_attr_init(&attr) != 0) return false;
+  pthread_attr_setstacksize(&attr, HelperStackSize);
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < count; i++) {
+    pthread_t thread;
+    ok = pthread_create(&thread, &attr, HelperThreadMain, nullptr) == 0;
+    if (ok) poolThreads.push_back(thread);
+  }
+  pthread_attr_destroy(&attr);
+  return ok;
+}
+
+static void StopHelperThreads() {
+  {
+    std::lock_guard<std::mutex> lock(poolLock);
+    poolStopping = true;
+  }
+  poolWakeup.notify_all();
+  for (pthread_t thread : poolThreads) {
+    pthread_join(thread, nullptr);
+  }
+  poolThreads.clear();
+}
+
+// The number of threads in this process, or 0 if there is no way to tell.
+static size_t ThreadCount() {
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) return 0;
+
+  size_t count = 0;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+// 'helperThreads' is the size of each child's helper thread pool, by default
+// one per core.
+boilerplate::Zygote::Zygote(size_t helperThreads)
+    : m_helperThreads(helperThreads ? helperThreads
+                                    : std::thread::hardware_concurrency()) {
+  if (m_helperThreads == 0) m_helperThreads = 1;
+}
+
+boilerplate::Zygote::~Zygote() {
+  if (!m_isChild) shutdown();
+}
+
+// Initialize the engine and self-hosted code. Returns false on failure, with
+// an error printed.
+bool boilerplate::Zygote::init() {
+  if (!JS_Init()) {
+    fprintf(stderr, "Error: JS_Init failed\n");
+    return false;
+  }
+  m_initialized = true;
+
+  JS::SetHelperThreadTaskCallback(DispatchHelperTask, m_helperThreads,
+                                  HelperStackSize);
+
+  m_cx = JS_NewContext(JS::DefaultHeapMaxBytes);
+  if (!m_cx) {
+    fprintf(stderr, "Error: Cannot create the zygote's context\n");
+    return false;
+  }
+
+  boilerplate::ApplyEnvironmentGCProfile(m_cx);
+
+  // JIT options are global to the process, so setting them once here, before
+  // the first fork, covers every context in every child. See 'jitprofile.cpp'.
+  if (!boilerplate::ApplyJitProfileFromEnvironment(m_cx)) return false;
+
+  if (!boilerplate::InitSelfHosting(m_cx)) {
+    fprintf(stderr, "Error: Cannot initialize the zygote's context\n");
+    return false;
+  }
+  return true;
+}
+
+// Compile a script that every child runs in its globals, with runBootstrap.
+// Only possible before the first fork. Returns false with the error reported.
+bool boilerplate::Zygote::addBootstrapScript(const char* filename,
+                                             const std::string& source) {
+  if (!m_cx) {
+    fprintf(stderr, "Error: Bootstrap scripts must be added before forking\n");
+    return false;
+  }
+
+  JS::RootedObject global(m_cx, boilerplate::CreateGlobal(m_cx));
+  if (!global) return false;
+
+  JSAutoRealm ar(m_cx, global);
+
+  JS::CompileOptions options(m_cx);
+  options.setFileAndLine(filename, 1);
+
+  JS::SourceText<mozilla::Utf8Unit> srcBuf;
+  RefPtr<JS::Stencil> stencil;
+  if (srcBuf.init(m_cx, source.data(), source.size(),
+                  JS::SourceOwnership::Borrowed)) {
+    stencil = JS::CompileGlobalScriptToStencil(m_cx, options, srcBuf);
+  }
+  if (!stencil) {
+    boilerplate::ReportAndClearException(m_cx);
+    return false;
+  }
+
+  m_bootstrap.push_back({filename, stencil});
+  return true;
+}
+
+// Get ready to fork, by destroying the zygote's own context and making sure no
+// other thread is running.
+bool boilerplate::Zygote::freeze() {
+  if (m_cx) {
+    JS_DestroyContext(m_cx);
+    m_cx = nullptr;
+  }
+
+  size_t threads = ThreadCount();
+  if (threads > 1) {
+    fprintf(stderr,
+            "Error: The zygote has %zu threads; forking it could leave locks "
+            "held forever in the child\n",
+            threads);
+    return false;
+  }
+  return true;
+}
+
+// Fork a worker process. Returns as fork() does: the child's process ID in
+// the zygote, 0 in the child, and -1 on failure. The child has its helper
+// threads started, and should go on to call newContext.
+pid_t boilerplate::Zygote::fork() {
+  if (!m_initialized || m_isChild || !freeze()) return -1;
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    m_isChild = true;
+    if (!StartHelperThreads(m_helperThreads)) {
+      fprintf(stderr, "Error: Cannot start helper threads\n");
+      _exit(1);
+    }
+  }
+  return pid;
+}
+
+// Shut the engine down in the zygote, after the children are done. Safe to
+// call more than once.
+void boilerplate::Zygote::shutdown() {
+  if (!m_initialized || m_isChild) return;
+
+  if (m_cx) {
+    JS_DestroyContext(m_cx);
+    m_cx = nullptr;
+  }
+  m_bootstrap.clear();
+  JS_ShutDown();
+  m_initialized = false;
+}
+
+// Create a context in a child process, with self-hosted code decoded from the
+// stencil the zygote left behind, and the GC profile from the environment.
+// Its GC pauses are traced if the child has started tracing. Returns nullptr
+// on failure.
+JSContext* boilerplate::Zygote::newContext(uint32_t maxBytes) {
+  if (!m_isChild) return nullptr;
+
+  JSContext* cx = JS_NewContext(maxBytes);
+  if (!cx) return nullptr;
+
+  boilerplate::ApplyEnvironmentGCProfile(cx);
+  boilerplate::TraceContext(cx, "main");
+
+  if (!boilerplate::InitSelfHosting(cx)) {
+    JS_DestroyContext(cx);
+    return nullptr;
+  }
+  return cx;
+}
+
+// Run the bootstrap scripts, in the order they were added, in the context's
+// current global. Returns false with an exception pending on failure.
+bool boilerplate::Zygote::runBootstrap(JSContext* cx) {
+  JS::RootedScript script(cx);
+  JS::RootedValue rval(cx);
+  for (const Bootstrap& bootstrap : m_bootstrap) {
+    JS::CompileOptions options(cx);
+    options.setFileAndLine(bootstrap.filename.c_str(), 1);
+
+    JS::InstantiateOptions instantiateOptions(options);
+    script = JS::InstantiateGlobalStencil(cx, instantiateOptions,
+                                          bootstrap.stencil);
+    if (!script || !JS_ExecuteScript(cx, script, &rval)) return false;
+  }
+  return true;
+}
+
+// End a child process: destroy its context, if any, stop its helper threads
+// and shut down its copy of the engine.
+void boilerplate::Zygote::exitChild(JSContext* cx, int status) {
+  if (cx) JS_DestroyContext(cx);
+  m_bootstrap.clear();
+  StopHelperThreads();
+  JS_ShutDown();
+
+  fflush(stdout);
+  fflush(stderr);
+  _exit(status);
+}
@@ -0,0 +1,57 @@
+#ifndef ZYGOTE_H_
+#define ZYGOTE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <jsapi.h>
+#include <js/experimental/JSStencil.h>
+
+#include <mozilla/RefPtr.h>
+
+// See 'zygote.cpp' for documentation.
+
+namespace boilerplate {
+
+class Zygote {
+ public:
+  explicit Zygote(size_t helperThreads = 0);
+  ~Zygote();
+
+  Zygote(const Zygote&) = delete;
+  Zygote& operator=(const Zygote&) = delete;
+
+  bool init();
+  bool addBootstrapScript(const char* filename, const std::string& source);
+  pid_t fork();
+  void shutdown();
+
+  // In a child process:
+  JSContext* newContext(uint32_t maxBytes = JS::DefaultHeapMaxBytes);
+  bool runBootstrap(JSContext* cx);
+  [[noreturn]] void exitChild(JSContext* cx, int status);
+
+  bool isChild() const { return m_isChild; }
+
+ private:
+  struct Bootstrap {
+    std::string filename;
+    RefPtr<JS::Stencil> stencil;
+  };
+
+  bool freeze();
+
+  size_t m_helperThreads;
+  JSContext* m_cx = nullptr;
+  std::vector<Bootstrap> m_bootstrap;
+  bool m_initialized = false;
+  bool m_isChild = false;
+};
+
+}  // namespace boilerplate
+
+#endif  // ZYGOTE_H_
@@ -0,0 +1,78 @@
+#!/usr/bin/env -S python3 -B
+# coding: utf-8
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this file,
+# You can obtain one at http://mozilla.org/MPL/2.0/.
+
+""" Usage: bench_speedup.py NAME=RESULTS_JSON NAME=RESULTS_JSON...
+
+    This script reads the results of several runs of the bench example, for
+    instance of successive build configurations, and prints the median time of
+    every benchmark in each run, with the speedup of each run over the
+    previous one and over the first.
+
+    The last lines give the geometric mean of the speedups, over all the
+    benchmarks that every run has.
+"""
+
+import json
+import math
+import sys
+
+
+def read_medians(path):
+    with open(path, 'r', encoding='utf-8') as f:
+        results = json.load(f)
+    return {b['name']: b['median_ns'] for b in results['benchmarks']}
+
+
+def geomean(values):
+    return math.exp(sum(math.log(v) for v in values) / len(values))
+
+
+def print_speedups(runs, out):
+    names = [name for name in runs[0][1]
+             if all(name in medians for _, medians in runs)]
+    if not names:
+        print('The runs have no benchmarks in common', file=out)
+        return
+
+    width = max(len(name) for name in names)
+    header = '{:<{w}}'.format('benchmark', w=width)
+    for label, _ in runs:
+        header += ' {:>14}'.format(label + ' ns')
+    print(header, file=out)
+    for name in names:
+        line = '{:<{w}}'.format(name, w=width)
+        for i, (_, medians) in enumerate(runs):
+            cell = '{:.1f}'.format(medians[name])
+            if i:
+                cell += ' {:.2f}x'.format(runs[i - 1][1][name] / medians[name])
+            line += ' {:>14}'.format(cell)
+        print(line, file=out)
+
+    print('', file=out)
+    first = runs[0][1]
+    for i in range(1, len(runs)):
+        label, medians = runs[i]
+        previous = runs[i - 1][1]
+        step = geomean([previous[n] / medians[n] for n in names])
+        total = geomean([first[n] / medians[n] for n in names])
+        print('{}: {:.3f}x over {}, {:.3f}x over {}'.format(
+            label, step, runs[i - 1][0], total, runs[0][0]), file=out)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        print('Usage: bench_speedup.py NAME=RESULTS_JSON NAME=RESULTS_JSON...',
+              file=sys.stderr)
+        sys.exit(1)
+
+    runs = []
+    for arg in sys.argv[1:]:
+        label, _, path = arg.partition('=')
+        if not path:
+            label, path = arg, arg
+        runs.append((label, read_medians(path)))
+
+    print_speedups(runs, sys.stdout)
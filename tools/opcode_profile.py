@@ -0,0 +1,136 @@
+#!/usr/bin/env -S python3 -B
+# coding: utf-8
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this file,
+# You can obtain one at http://mozilla.org/MPL/2.0/.
+
+""" Usage: opcode_profile.py PATH_TO_SPIDERMONKEY_SOURCE OPCOUNTS_JSON [TOP]
+
+    This script reads the bytecode execution counts written by the opcounts
+    example, and joins them with the opcode descriptions from
+    js/src/vm/Opcodes.h, as in docs/Bytecodes.md.
+
+    It prints the TOP (default 20) opcodes and instructions that ran most
+    often, and the scripts that ran in the interpreter and Baseline but never
+    in Ion.
+"""
+
+import json
+import os
+import sys
+from collections import Counter
+
+
+def first_sentence(desc):
+    text = ' '.join(desc.split())
+    end = text.find('. ')
+    return text if end < 0 else text[:end + 1]
+
+
+def script_name(summary):
+    return '{file}:{line} {name}'.format(
+        file=summary.get('file', '?'),
+        line=summary.get('line', '?'),
+        name=summary.get('name', '<top-level>'))
+
+
+def interp_count(entry):
+    return entry.get('counts', {}).get('interp', 0)
+
+
+def print_hot_opcodes(opcodes, scripts, top, out):
+    counts = Counter()
+    for script in scripts:
+        for entry in script['contents'].get('opcodes', []):
+            counts[entry['name']] += interp_count(entry)
+    total = sum(counts.values())
+
+    print('## Hot opcodes ##\n', file=out)
+    print('{:>14} {:>6}  {:<20} {}'.format('count', '%', 'opcode', 'category'),
+          file=out)
+    for name, count in counts.most_common(top):
+        if not count:
+            break
+        opcode = opcodes.get(name)
+        if opcode:
+            category = opcode.category_name
+            if opcode.type_name:
+                category += ' / ' + opcode.type_name
+            desc = first_sentence(opcode.desc)
+        else:
+            category = '?'
+            desc = '(not in Opcodes.h; a different SpiderMonkey version?)'
+        print('{:>14} {:>6.2f}  {:<20} {}'.format(
+            count, 100.0 * count / total, name, category), file=out)
+        print('{:>44}{}'.format('', desc), file=out)
+    print('', file=out)
+
+
+def print_hot_instructions(scripts, top, out):
+    instructions = []
+    for script in scripts:
+        for entry in script['contents'].get('opcodes', []):
+            count = interp_count(entry)
+            if count:
+                instructions.append((count, script['summary'], entry))
+    instructions.sort(key=lambda i: i[0], reverse=True)
+
+    print('## Hot instructions ##\n', file=out)
+    print('{:>14}  {:<20} {}'.format('count', 'opcode', 'location'), file=out)
+    for count, summary, entry in instructions[:top]:
+        print('{:>14}  {:<20} {} line {} (+{})'.format(
+            count, entry['name'], script_name(summary),
+            entry.get('line', '?'), entry.get('id', '?')), file=out)
+    print('', file=out)
+
+
+def print_never_tiered(scripts, top, out):
+    never = []
+    for script in scripts:
+        totals = script['summary'].get('totals', {})
+        if totals.get('interp', 0) and not totals.get('ion', 0):
+            never.append((totals['interp'], script))
+    never.sort(key=lambda s: s[0], reverse=True)
+
+    print('## Scripts that never ran in Ion ##\n', file=out)
+    if not never:
+        print('(none)\n', file=out)
+        return
+
+    print('{:>14}  {:<40} {}'.format('count', 'script', 'hottest opcodes'),
+          file=out)
+    for count, script in never[:top]:
+        ops = Counter()
+        for entry in script['contents'].get('opcodes', []):
+            ops[entry['name']] += interp_count(entry)
+        hottest = ', '.join(name for name, _ in ops.most_common(3))
+        print('{:>14}  {:<40} {}'.format(
+            count, script_name(script['summary']), hottest), file=out)
+    print('', file=out)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        print('Usage: opcode_profile.py PATH_TO_SPIDERMONKEY_SOURCE '
+              'OPCOUNTS_JSON [TOP]', file=sys.stderr)
+        sys.exit(1)
+    dir = sys.argv[1]
+    counts_path = sys.argv[2]
+    top = int(sys.argv[3]) if len(sys.argv) > 3 else 20
+
+    thisdir = os.path.dirname(os.path.realpath(__file__))
+    sys.path.insert(0, thisdir)
+    import jsopcode
+
+    try:
+        _, opcodes = jsopcode.get_opcodes(dir)
+    except Exception as e:
+        print("Error: {}".format(' '.join(map(str, e.args))), file=sys.stderr)
+        sys.exit(1)
+
+    with open(counts_path, 'r', encoding='utf-8') as f:
+        scripts = json.load(f)
+
+    print_hot_opcodes(opcodes, scripts, top, sys.stdout)
+    print_hot_instructions(scripts, top, sys.stdout)
+    print_never_tiered(scripts, top, sys.stdout)
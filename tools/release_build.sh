@@ -0,0 +1,74 @@
+#!/bin/bash
+# Build the examples for a release embedding, one optimization at a time, and
+# report the speedup of each step on the benchmark suite (examples/bench.cpp):
+#
+#   release  optimized build, without assertions
+#   lto      plus link-time optimization across boilerplate and the examples
+#   pgo      plus profile-guided optimization, trained on the benchmark suite
+#
+# Each step has its own build directory under OUTDIR (default _release), along
+# with its benchmark results in STEP.json. Leave out the PGO step with
+# --no-pgo. With clang, PGO needs llvm-profdata in the PATH.
+#
+# Usage: tools/release_build.sh [--no-pgo] [OUTDIR]
+
+set -e
+
+pgo=1
+if [ "$1" = "--no-pgo" ]; then
+    pgo=
+    shift
+fi
+
+srcdir=$(cd "$(dirname "$0")/.." && pwd)
+outdir=$(mkdir -p "${1:-_release}" && cd "${1:-_release}" && pwd)
+release_options=(--buildtype=release -Db_ndebug=true)
+
+# build STEP MESON_OPTIONS...
+build() {
+    local builddir="$outdir/$1"
+    shift
+    if [ -d "$builddir" ]; then
+        meson configure "$builddir" "$@"
+    else
+        meson setup "$builddir" "$srcdir" "$@"
+    fi
+    ninja -C "$builddir"
+}
+
+# benchmark STEP
+benchmark() {
+    echo "Benchmarking $1..."
+    "$outdir/$1/bench" --json "$outdir/$1.json" > "$outdir/$1.txt"
+}
+
+build release "${release_options[@]}" -Db_lto=false -Db_pgo=off
+benchmark release
+steps=(release="$outdir/release.json")
+
+build lto "${release_options[@]}" -Db_lto=true -Db_pgo=off
+benchmark lto
+steps+=(lto="$outdir/lto.json")
+
+if [ -n "$pgo" ]; then
+    # Train on a shorter run of the same benchmarks. GCC writes its profiles
+    # next to the object files; clang writes raw profiles that have to be
+    # merged into the default.profdata that -fprofile-use reads.
+    builddir="$outdir/pgo"
+    build pgo "${release_options[@]}" -Db_lto=true -Db_pgo=generate
+    rm -f "$builddir"/*.profraw "$builddir/default.profdata"
+    echo "Training..."
+    (cd "$builddir" &&
+        LLVM_PROFILE_FILE="$builddir/pgo-%p.profraw" ./bench --samples 3 \
+            > /dev/null)
+    if ls "$builddir"/*.profraw > /dev/null 2>&1; then
+        llvm-profdata merge -o "$builddir/default.profdata" \
+            "$builddir"/*.profraw
+    fi
+    build pgo -Db_pgo=use
+    benchmark pgo
+    steps+=(pgo="$outdir/pgo.json")
+fi
+
+echo
+"$srcdir/tools/bench_speedup.py" "${steps[@]}"